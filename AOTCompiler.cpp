@@ -0,0 +1,456 @@
+#include "AOTCompiler.h"
+#include "FunctionRegistry.h"
+#include "SheetStore.h"
+#include <dlfcn.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace aot
+{
+
+    // helpers the generated functions are written against, each one mirrors applyBinary /
+    // applyUnary / fn_IF for the value kinds that can reach it (text makes load bail out)
+    static constexpr const char *prelude = R"(#include "GPFEAot.h"
+#include <math.h>
+
+namespace
+{
+    struct V
+    {
+        int32_t kind;
+        int32_t err;
+        double n;
+    };
+
+    enum
+    {
+        ADD, SUB, MUL, DIV, POW, LT, GT, LE, GE, EQ, NE,
+        PLUS, MINUS, PERCENT
+    };
+
+    inline V num(double n) { return V{GPFE_NUMBER, GPFE_ERR_NONE, n}; }
+    inline V boolean(bool b) { return V{GPFE_BOOL, GPFE_ERR_NONE, b ? 1.0 : 0.0}; }
+    inline V error(int32_t code) { return V{GPFE_ERROR, code, 0.0}; }
+
+    inline bool load(const gpfe_aot_cells *cells, int32_t row, int32_t col, V &v)
+    {
+        if (row < 1 || col < 1)
+        {
+            v = error(GPFE_ERR_REF);
+            return true;
+        }
+        gpfe_value g;
+        cells->read(cells->ctx, row, col, &g);
+        if (g.kind == GPFE_TEXT)
+            return false;
+        v = V{g.kind, g.error_code, g.number};
+        return true;
+    }
+
+    inline V binary(int op, V a, V b)
+    {
+        if (a.kind == GPFE_ERROR || b.kind == GPFE_ERROR)
+            return error(GPFE_ERR_VALUE);
+        if (a.kind == GPFE_BLANK)
+            a = num(0.0);
+        if (b.kind == GPFE_BLANK)
+            b = num(0.0);
+        if (op == EQ || op == NE)
+        {
+            bool same = a.kind == b.kind && a.n == b.n;
+            return boolean(op == EQ ? same : !same);
+        }
+        if (a.kind != GPFE_NUMBER || b.kind != GPFE_NUMBER)
+            return error(GPFE_ERR_VALUE);
+        switch (op)
+        {
+        case ADD:
+            return num(a.n + b.n);
+        case SUB:
+            return num(a.n - b.n);
+        case MUL:
+            return num(a.n * b.n);
+        case DIV:
+            return b.n == 0.0 ? error(GPFE_ERR_DIV0) : num(a.n / b.n);
+        case POW:
+        {
+            if (a.n == 0.0 && b.n == 0.0)
+                return error(GPFE_ERR_NUM);
+            double r = pow(a.n, b.n);
+            return isfinite(r) ? num(r) : error(GPFE_ERR_NUM);
+        }
+        case LT:
+            return boolean(a.n < b.n);
+        case GT:
+            return boolean(a.n > b.n);
+        case LE:
+            return boolean(a.n <= b.n);
+        case GE:
+            return boolean(a.n >= b.n);
+        }
+        return error(GPFE_ERR_VALUE);
+    }
+
+    inline V unary(int op, V a)
+    {
+        if (a.kind != GPFE_NUMBER)
+            return error(GPFE_ERR_VALUE);
+        if (op == MINUS)
+            return num(-1.0 * a.n);
+        if (op == PERCENT)
+            return num(a.n / 100.0);
+        return a;
+    }
+
+    inline V choose(V cond, V a, V b)
+    {
+        if (cond.kind != GPFE_BOOL || a.kind == GPFE_BLANK || a.kind == GPFE_ERROR || b.kind == GPFE_BLANK || b.kind == GPFE_ERROR)
+            return error(GPFE_ERR_VALUE);
+        return cond.n != 0.0 ? a : b;
+    }
+
+    inline int store(V v, gpfe_value *out)
+    {
+        out->kind = v.kind;
+        out->error_code = v.err;
+        out->number = v.n;
+        out->text = 0;
+        out->text_len = 0;
+        return 0;
+    }
+}
+)";
+
+    static bool isIf(const FunctionCall &call)
+    {
+        static const funcs::FunctionSignature *if_sig = funcs::lookup("IF");
+        return call.form == SpecialForm::None && call.args.size() == 3 && funcs::lookup(call.identifier) == if_sig;
+    }
+
+    bool canCompile(const ASTNode *node)
+    {
+        if (node->inferredType.type == BaseType::Error)
+            return true; // constant #VALUE!
+        switch (node->type)
+        {
+        case ASTNodeType::Literal:
+            return std::get<Literal>(node->node).type == LiteralType::Numeric;
+        case ASTNodeType::Reference:
+        {
+            const auto &reference = std::get<Reference>(node->node);
+            // compiled loads read the sheet being evaluated only
+            return reference.type == ReferenceType::Cell && !reference.deleted && reference.sheet < 0;
+        }
+        case ASTNodeType::Unary:
+            return canCompile(std::get<UnaryOperation>(node->node).operand.get());
+        case ASTNodeType::Binary:
+        {
+            const auto &binary_op = std::get<BinaryOperation>(node->node);
+            if (binary_op.op == BinaryOp::Range || binary_op.op == BinaryOp::Concat)
+                return false;
+            return canCompile(binary_op.left.get()) && canCompile(binary_op.right.get());
+        }
+        case ASTNodeType::FunctionCall:
+        {
+            const auto &call = std::get<FunctionCall>(node->node);
+            if (!isIf(call))
+                return false;
+            for (const auto &arg : call.args)
+                if (!canCompile(arg.get()))
+                    return false;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    static const char *binaryOpName(BinaryOp op)
+    {
+        switch (op)
+        {
+        case BinaryOp::Add:
+            return "ADD";
+        case BinaryOp::Sub:
+            return "SUB";
+        case BinaryOp::Mul:
+            return "MUL";
+        case BinaryOp::Div:
+            return "DIV";
+        case BinaryOp::Pow:
+            return "POW";
+        case BinaryOp::Less:
+            return "LT";
+        case BinaryOp::Greater:
+            return "GT";
+        case BinaryOp::Leq:
+            return "LE";
+        case BinaryOp::Geq:
+            return "GE";
+        case BinaryOp::Eq:
+            return "EQ";
+        case BinaryOp::Neq:
+            return "NE";
+        default:
+            throw std::runtime_error("BINARY OPERATOR NOT SUPPORTED BY AOT");
+        }
+    }
+
+    static const char *unaryOpName(UnaryOp op)
+    {
+        switch (op)
+        {
+        case UnaryOp::Minus:
+            return "MINUS";
+        case UnaryOp::Percent:
+            return "PERCENT";
+        default:
+            return "PLUS";
+        }
+    }
+
+    // straight line code, one V per node in postorder, shared subtrees (cseSlot) are emitted once
+    struct Emitter
+    {
+        std::string body;
+        int next_temp = 0;
+        std::unordered_map<int, std::string> cse_temps;
+
+        std::string temp()
+        {
+            return "t" + std::to_string(next_temp++);
+        }
+
+        std::string emit(const ASTNode *node)
+        {
+            if (node->cseSlot >= 0)
+                if (auto it = cse_temps.find(node->cseSlot); it != cse_temps.end())
+                    return it->second;
+            std::string t = emitUncached(node);
+            if (node->cseSlot >= 0)
+                cse_temps.emplace(node->cseSlot, t);
+            return t;
+        }
+
+        std::string emitUncached(const ASTNode *node)
+        {
+            if (node->inferredType.type == BaseType::Error)
+            {
+                std::string t = temp();
+                body += "    const V " + t + " = error(GPFE_ERR_VALUE);\n";
+                return t;
+            }
+            switch (node->type)
+            {
+            case ASTNodeType::Literal:
+            {
+                // hex float literals round trip exactly
+                char buf[64];
+                std::snprintf(buf, sizeof(buf), "%a", std::get<Number>(std::get<Literal>(node->node).value));
+                std::string t = temp();
+                body += "    const V " + t + " = num(" + buf + ");\n";
+                return t;
+            }
+            case ASTNodeType::Reference:
+            {
+                const auto &ref = std::get<CellReference>(std::get<Reference>(node->node).ref);
+                std::string row = ref.relative ? "row + (" + std::to_string(ref.row) + ")" : std::to_string(ref.row);
+                std::string col = ref.relative ? "col + (" + std::to_string(ref.col) + ")" : std::to_string(ref.col);
+                std::string t = temp();
+                body += "    V " + t + ";\n";
+                body += "    if (!load(cells, " + row + ", " + col + ", " + t + "))\n        return 1;\n";
+                return t;
+            }
+            case ASTNodeType::Unary:
+            {
+                const auto &unary_op = std::get<UnaryOperation>(node->node);
+                std::string operand = emit(unary_op.operand.get());
+                std::string t = temp();
+                body += "    const V " + t + " = unary(" + unaryOpName(unary_op.op) + ", " + operand + ");\n";
+                return t;
+            }
+            case ASTNodeType::Binary:
+            {
+                const auto &binary_op = std::get<BinaryOperation>(node->node);
+                std::string left = emit(binary_op.left.get());
+                std::string right = emit(binary_op.right.get());
+                std::string t = temp();
+                body += "    const V " + t + " = binary(" + binaryOpName(binary_op.op) + ", " + left + ", " + right + ");\n";
+                return t;
+            }
+            case ASTNodeType::FunctionCall:
+            {
+                // the interpreter evaluates every IF argument too, so no short circuit here either
+                const auto &call = std::get<FunctionCall>(node->node);
+                std::string cond = emit(call.args[0].get());
+                std::string a = emit(call.args[1].get());
+                std::string b = emit(call.args[2].get());
+                std::string t = temp();
+                body += "    const V " + t + " = choose(" + cond + ", " + a + ", " + b + ");\n";
+                return t;
+            }
+            default:
+                throw std::runtime_error("NODE NOT SUPPORTED BY AOT");
+            }
+        }
+    };
+
+    static std::string cStringLiteral(const std::string &s)
+    {
+        std::string out = "\"";
+        for (unsigned char c : s)
+        {
+            if (c >= 0x20 && c < 0x7F && c != '"' && c != '\\' && c != '?')
+            {
+                out.push_back(static_cast<char>(c));
+            }
+            else
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\%03o", c);
+                out += buf;
+            }
+        }
+        out.push_back('"');
+        return out;
+    }
+
+    std::string generateModule(const FormulaCache &cache)
+    {
+        std::string source = prelude;
+        std::vector<FormulaHandle> compiled;
+        for (FormulaHandle handle = 0; handle < cache.size(); handle++)
+        {
+            const CompiledFormula &formula = cache.get(handle);
+            if (!canCompile(&formula.root))
+                continue;
+            Emitter emitter;
+            std::string result = emitter.emit(&formula.root);
+            source += "\nstatic int f" + std::to_string(handle) + "(const gpfe_aot_cells *cells, int32_t row, int32_t col, gpfe_value *out)\n{\n";
+            source += "    (void)cells;\n    (void)row;\n    (void)col;\n";
+            source += emitter.body;
+            source += "    return store(" + result + ", out);\n}\n";
+            compiled.push_back(handle);
+        }
+
+        if (compiled.empty())
+        {
+            source += "\nstatic const gpfe_aot_module module = {GPFE_AOT_ABI_VERSION, 0, 0, 0};\n";
+        }
+        else
+        {
+            source += "\nstatic const char *const keys[] = {\n";
+            for (FormulaHandle handle : compiled)
+                source += "    " + cStringLiteral(cache.get(handle).key) + ",\n";
+            source += "};\n\nstatic const gpfe_aot_fn functions[] = {\n";
+            for (FormulaHandle handle : compiled)
+                source += "    f" + std::to_string(handle) + ",\n";
+            source += "};\n\nstatic const gpfe_aot_module module = {GPFE_AOT_ABI_VERSION, " + std::to_string(compiled.size()) + ", keys, functions};\n";
+        }
+        source += "\nextern \"C\" const gpfe_aot_module *gpfe_aot_module_get(void)\n{\n    return &module;\n}\n";
+        return source;
+    }
+
+    void buildModule(const std::string &source, const std::string &so_path, const std::string &include_dir)
+    {
+        // paths are single quoted for the shell
+        if (so_path.find('\'') != std::string::npos || include_dir.find('\'') != std::string::npos)
+            throw std::runtime_error("AOT MODULE PATHS CAN'T CONTAIN QUOTES");
+        std::string source_path = so_path + ".cpp";
+        {
+            std::ofstream file(source_path, std::ios::binary | std::ios::trunc);
+            if (!file)
+                throw std::runtime_error("COULD NOT WRITE AOT SOURCE: " + source_path);
+            file << source;
+        }
+        const char *cxx = std::getenv("CXX");
+        std::string command = std::string(cxx && *cxx ? cxx : "c++") + " -std=c++17 -O2 -shared -fPIC -I'" + include_dir + "' -o '" + so_path + "' '" + source_path + "'";
+        if (std::system(command.c_str()) != 0)
+            throw std::runtime_error("AOT MODULE BUILD FAILED: " + command);
+    }
+
+}
+
+// anything the generated code has no semantics for is reported as text so the module bails out
+static void readCell(void *ctx, int32_t row, int32_t col, gpfe_value *out)
+{
+    auto *evalCtx = static_cast<EvalContext *>(ctx);
+    *out = gpfe_value{GPFE_BLANK, GPFE_ERR_NONE, 0.0, nullptr, 0};
+    Value v = evalCtx->sheet->get(RC{row, col});
+    if (std::holds_alternative<Number>(v))
+    {
+        out->kind = GPFE_NUMBER;
+        out->number = std::get<Number>(v);
+    }
+    else if (std::holds_alternative<Bool>(v))
+    {
+        out->kind = GPFE_BOOL;
+        out->number = std::get<Bool>(v) ? 1.0 : 0.0;
+    }
+    else if (std::holds_alternative<Error>(v))
+    {
+        out->kind = GPFE_ERROR;
+        out->error_code = static_cast<int32_t>(std::get<Error>(v).code);
+    }
+    else if (!std::holds_alternative<Blank>(v))
+    {
+        out->kind = GPFE_TEXT;
+    }
+}
+
+void AOTModule::load(const std::string &path, const FormulaCache &cache)
+{
+    void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+        throw std::runtime_error("COULD NOT LOAD AOT MODULE: " + std::string(dlerror()));
+    auto get = reinterpret_cast<gpfe_aot_module_get_fn>(dlsym(handle, "gpfe_aot_module_get"));
+    const gpfe_aot_module *module = get ? get() : nullptr;
+    if (!module || module->abi_version != GPFE_AOT_ABI_VERSION)
+    {
+        dlclose(handle);
+        throw std::runtime_error("AOT MODULE MISSING OR ABI VERSION MISMATCH: " + path);
+    }
+
+    std::unordered_map<std::string, gpfe_aot_fn> by_key;
+    for (uint32_t i = 0; i < module->count; i++)
+        by_key.emplace(module->keys[i], module->functions[i]);
+    by_handle_.assign(cache.size(), nullptr);
+    compiled_ = 0;
+    for (FormulaHandle h = 0; h < cache.size(); h++)
+    {
+        if (auto it = by_key.find(cache.get(h).key); it != by_key.end())
+        {
+            by_handle_[h] = it->second;
+            compiled_++;
+        }
+    }
+    // handle is intentionally never closed, by_handle_ points into the module
+}
+
+Value AOTModule::evaluateAt(const FormulaCache &cache, FormulaHandle handle, RC cell, EvalContext &evalCtx)
+{
+    if (handle < by_handle_.size() && by_handle_[handle])
+    {
+        gpfe_aot_cells cells{readCell, &evalCtx};
+        gpfe_value out;
+        if (by_handle_[handle](&cells, cell.first, cell.second, &out) == 0)
+        {
+            switch (out.kind)
+            {
+            case GPFE_NUMBER:
+                return out.number;
+            case GPFE_BOOL:
+                return out.number != 0.0;
+            case GPFE_ERROR:
+                return Error{static_cast<ErrorCode>(out.error_code)};
+            default:
+                return Blank{};
+            }
+        }
+    }
+    fallbacks_++;
+    return fallback_.evaluateAt(&cache.get(handle).root, cell, evalCtx);
+}
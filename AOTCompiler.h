@@ -0,0 +1,46 @@
+#ifndef AOT_COMPILER_H
+#define AOT_COMPILER_H
+
+#include "GPFETypes.h"
+#include "EvalTypes.h"
+#include "Evaluator.h"
+#include "FormulaCache.h"
+#include "GPFEAot.h"
+#include <string>
+#include <vector>
+
+namespace aot
+{
+    // numeric literals, cell references, unary/binary arithmetic and comparisons and IF
+    // anything else (text literals, ranges, &, other functions, LET/LAMBDA) stays interpreted
+    bool canCompile(const ASTNode *root);
+
+    // C++ source with one function per distinct compiled formula that canCompile accepts
+    std::string generateModule(const FormulaCache &cache);
+
+    // writes source next to so_path and builds it with $CXX (c++ by default), include_dir must
+    // contain GPFEAot.h and GPFEPlugin.h, throws when the compiler fails
+    void buildModule(const std::string &source, const std::string &so_path, const std::string &include_dir);
+}
+
+// dispatches formula evaluation to a loaded module, formulas it doesn't have (or that bail out
+// on their inputs at runtime) go through the Evaluator
+class AOTModule
+{
+public:
+    // dlopen a module and bind its functions to the cache's handles by key, throws on failure
+    void load(const std::string &path, const FormulaCache &cache);
+
+    Value evaluateAt(const FormulaCache &cache, FormulaHandle handle, RC cell, EvalContext &evalCtx);
+
+    size_t compiledCount() const { return compiled_; }
+    size_t fallbacks() const { return fallbacks_; }
+
+private:
+    std::vector<gpfe_aot_fn> by_handle_; // null when the formula isn't in the module
+    Evaluator fallback_;
+    size_t compiled_ = 0;
+    size_t fallbacks_ = 0;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "AggregateViews.h"
+#include "RangeView.h"
+#include <algorithm>
+#include <cmath>
+
+// a range found too small to be worth a view, never counted again
+static constexpr uint32_t not_hot = ~uint32_t{0};
+// scan counts are only a heuristic, forget them all instead of growing without bound
+static constexpr size_t max_tracked_scans = 1 << 16;
+
+void AggregateViews::add(AggregateView &view, double x)
+{
+    const double t = view.sum + x;
+    view.compensation += std::abs(view.sum) >= std::abs(x) ? (view.sum - t) + x : (x - t) + view.sum;
+    view.sum = t;
+}
+
+void AggregateViews::build(AggregateView &view, const SheetStore &sheet)
+{
+    view.sum = view.compensation = 0;
+    view.count = 0;
+    view.populated = 0;
+    view.min = HUGE_VAL;
+    view.max = -HUGE_VAL;
+    RangeView range(sheet, view.range);
+    range.forEachNumberSpan([&](const NumberSpan &span)
+                            {
+        for (int i = span.begin; i < span.end; i++)
+        {
+            if (!span.valid(i))
+                continue;
+            const double x = span.numbers[i];
+            add(view, x);
+            view.count++;
+            view.min = std::min(view.min, x);
+            view.max = std::max(view.max, x);
+        } });
+    view.populated = view.count;
+    range.forEachOther([&](int, int, const Value &)
+                       { view.populated++; });
+    view.extrema_valid = true;
+}
+
+const AggregateView *AggregateViews::find(const RangeRef &range, const SheetStore &sheet, bool extrema)
+{
+    if (auto it = by_range_.find(range); it != by_range_.end())
+    {
+        AggregateView &view = views_[it->second];
+        if (extrema && !view.extrema_valid)
+        {
+            build(view, sheet);
+            stats_.rescans++;
+        }
+        stats_.hits++;
+        stats_.cells_avoided += view.populated;
+        return &view;
+    }
+    // small ranges can't hold min_cells, they aren't even counted
+    if (static_cast<int64_t>(range.bottom - range.top + 1) * (range.right - range.left + 1) < static_cast<int64_t>(min_cells))
+        return nullptr;
+    if (scans_.size() >= max_tracked_scans)
+        scans_.clear();
+    uint32_t &scans = scans_[range];
+    if (scans == not_hot || ++scans < materialize_after || views_.size() >= max_views)
+        return nullptr;
+    AggregateView view;
+    view.range = range;
+    build(view, sheet);
+    stats_.built++;
+    if (view.populated < min_cells)
+    {
+        scans = not_hot;
+        return nullptr;
+    }
+    scans_.erase(range);
+    by_range_[range] = static_cast<uint32_t>(views_.size());
+    views_.push_back(view);
+    return &views_.back();
+}
+
+bool AggregateViews::materialize(const RangeRef &range, const SheetStore &sheet)
+{
+    if (by_range_.count(range))
+        return true;
+    if (views_.size() >= max_views)
+        return false;
+    AggregateView view;
+    view.range = range;
+    build(view, sheet);
+    stats_.built++;
+    scans_.erase(range);
+    by_range_[range] = static_cast<uint32_t>(views_.size());
+    views_.push_back(view);
+    return true;
+}
+
+void AggregateViews::drop(const RangeRef &range)
+{
+    auto it = by_range_.find(range);
+    if (it == by_range_.end())
+        return;
+    // swap the last view into the hole
+    const uint32_t idx = it->second;
+    by_range_.erase(it);
+    if (idx != views_.size() - 1)
+    {
+        views_[idx] = views_.back();
+        by_range_[views_[idx].range] = idx;
+    }
+    views_.pop_back();
+}
+
+void AggregateViews::clear()
+{
+    views_.clear();
+    by_range_.clear();
+    scans_.clear();
+}
+
+void AggregateViews::update(RC cell, const Value &old_value, const Value &new_value)
+{
+    const Number *old_number = std::get_if<Number>(&old_value);
+    const Number *new_number = std::get_if<Number>(&new_value);
+    const int populated = std::holds_alternative<Blank>(old_value) - std::holds_alternative<Blank>(new_value);
+    if (!old_number && !new_number && !populated)
+        return;
+    for (AggregateView &view : views_)
+    {
+        const RangeRef &r = view.range;
+        if (cell.first < r.top || cell.first > r.bottom || cell.second < r.left || cell.second > r.right)
+            continue;
+        stats_.deltas++;
+        view.populated += populated;
+        if (old_number)
+        {
+            add(view, -*old_number);
+            view.count--;
+            // the extreme may have been this cell, only a rescan can tell what replaces it
+            if (*old_number == view.min || *old_number == view.max)
+                view.extrema_valid = false;
+        }
+        if (new_number)
+        {
+            add(view, *new_number);
+            view.count++;
+            if (view.extrema_valid)
+            {
+                view.min = std::min(view.min, *new_number);
+                view.max = std::max(view.max, *new_number);
+            }
+        }
+        // an empty range has no extrema to compare against, the next number starts them over
+        if (!view.count)
+        {
+            view.sum = view.compensation = 0;
+            view.min = HUGE_VAL;
+            view.max = -HUGE_VAL;
+            view.extrema_valid = true;
+        }
+    }
+}
+
+AggregateViewStats AggregateViews::stats() const
+{
+    AggregateViewStats out = stats_;
+    out.views = views_.size();
+    return out;
+}
@@ -0,0 +1,93 @@
+#ifndef AGGREGATE_VIEWS_H
+#define AGGREGATE_VIEWS_H
+
+#include "EvalTypes.h"
+#include "SheetStore.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct AggregateViewStats
+{
+    size_t views = 0;         // ranges materialized right now
+    size_t built = 0;         // full scans spent building views
+    size_t hits = 0;          // range scans answered from a view
+    size_t cells_avoided = 0; // populated cells those scans would have visited
+    size_t deltas = 0;        // cell writes folded into a view
+    size_t rescans = 0;       // MIN/MAX rescans after the extreme cell was overwritten
+};
+
+// SUM/COUNT/AVERAGE/MIN/MAX state of the numeric cells of one range, what a scan of it would find
+struct AggregateView
+{
+    RangeRef range;
+    double sum = 0;
+    double compensation = 0; // Neumaier term, the sum is sum + compensation
+    size_t count = 0;
+    size_t populated = 0; // populated cells when built, what a scan costs
+    double min = 0;
+    double max = 0;
+    bool extrema_valid = true; // false once the min or max cell was overwritten
+
+    double total() const { return sum + compensation; }
+};
+
+// materialized aggregates over hot ranges (dashboard totals over SUM(B:B) style columns), kept up
+// to date by the writer with a delta per cell write instead of rescanning the range per recalc
+// a range is materialized on its materialize_after-th scan when it holds at least min_cells
+// populated cells, or right away through materialize()
+// SUM and AVERAGE keep a compensated running sum and can differ from a rescan in the last bits,
+// MIN and MAX rescan lazily when the extreme cell is overwritten
+// not synchronized, owned by the one writer of the sheet (see Workbook.h)
+class AggregateViews
+{
+public:
+    static constexpr uint32_t materialize_after = 3;
+    static constexpr size_t min_cells = 1024;
+    static constexpr size_t max_views = 256;
+
+    // view of range, built when it is hinted or just became hot, null when the caller should scan
+    // extrema asks for min and max to be valid, rescanning if needed
+    const AggregateView *find(const RangeRef &range, const SheetStore &sheet, bool extrema);
+    // explicit hint, builds the view now, false when max_views are in use
+    bool materialize(const RangeRef &range, const SheetStore &sheet);
+    void drop(const RangeRef &range);
+    // after structural edits, ranges no longer mean the same cells
+    void clear();
+
+    // cell went from old_value to new_value, call for every write to the sheet the views cover
+    void update(RC cell, const Value &old_value, const Value &new_value);
+
+    size_t size() const { return views_.size(); }
+    AggregateViewStats stats() const;
+
+private:
+    struct RangeHash
+    {
+        size_t operator()(const RangeRef &r) const
+        {
+            uint64_t a = static_cast<uint64_t>(r.top) << 32 | static_cast<uint32_t>(r.left);
+            uint64_t b = static_cast<uint64_t>(r.bottom) << 32 | static_cast<uint32_t>(r.right);
+            return std::hash<uint64_t>()(a * 0x9E3779B97F4A7C15ull ^ b);
+        }
+    };
+    struct RangeEq
+    {
+        bool operator()(const RangeRef &a, const RangeRef &b) const
+        {
+            return a.top == b.top && a.left == b.left && a.bottom == b.bottom && a.right == b.right;
+        }
+    };
+
+    // few views, a write checks each of them, unlike DependencyIndex there is no column bucketing
+    std::vector<AggregateView> views_;
+    std::unordered_map<RangeRef, uint32_t, RangeHash, RangeEq> by_range_; // index into views_
+    std::unordered_map<RangeRef, uint32_t, RangeHash, RangeEq> scans_;    // scans of ranges without a view
+    AggregateViewStats stats_;
+
+    static void add(AggregateView &view, double x);
+    static void build(AggregateView &view, const SheetStore &sheet);
+};
+
+#endif
@@ -0,0 +1,485 @@
+#include "BatchEvaluator.h"
+#include "FunctionRegistry.h"
+#include "PluginLoader.h"
+#include "GPFEHelpers.h"
+#include "SheetStore.h"
+#include "RangeView.h"
+#include <cmath>
+#include <functional>
+
+void BatchEvaluator::Lanes::resize(size_t n)
+{
+    numbers.assign(n, 0.0);
+    kinds.assign(n, Kind::Number);
+    others.clear();
+    all_numeric = true;
+}
+
+void BatchEvaluator::Lanes::set(size_t i, Value v)
+{
+    if (std::holds_alternative<Number>(v))
+    {
+        numbers[i] = std::get<Number>(v);
+        kinds[i] = Kind::Number;
+        return;
+    }
+    all_numeric = false;
+    if (std::holds_alternative<Bool>(v))
+    {
+        setBool(i, std::get<Bool>(v));
+        return;
+    }
+    if (std::holds_alternative<Error>(v))
+    {
+        numbers[i] = static_cast<double>(std::get<Error>(v).code);
+        kinds[i] = Kind::Error;
+        return;
+    }
+    if (std::holds_alternative<Blank>(v))
+    {
+        kinds[i] = Kind::Blank;
+        return;
+    }
+    // a lane written twice reuses its slot
+    if (kinds[i] == Kind::Other)
+    {
+        others[static_cast<size_t>(numbers[i])] = std::move(v);
+        return;
+    }
+    numbers[i] = static_cast<double>(others.size());
+    kinds[i] = Kind::Other;
+    others.push_back(std::move(v));
+}
+
+Value BatchEvaluator::Lanes::get(size_t i) const
+{
+    switch (kinds[i])
+    {
+    case Kind::Number:
+        return numbers[i];
+    case Kind::Bool:
+        return numbers[i] != 0.0;
+    case Kind::Error:
+        return Error{static_cast<ErrorCode>(numbers[i])};
+    case Kind::Blank:
+        return Blank{};
+    default:
+        return others[static_cast<size_t>(numbers[i])];
+    }
+}
+
+Value BatchEvaluator::Lanes::take(size_t i)
+{
+    if (kinds[i] == Kind::Other)
+        return std::move(others[static_cast<size_t>(numbers[i])]);
+    return get(i);
+}
+
+void BatchEvaluator::evaluateColumn(const ASTNode *root, int col, int first_row, int row_count, EvalContext &evalCtx, Value *out)
+{
+    if (row_count <= 0)
+        return;
+    // RAND draws are counted per cell in evaluation order, keep the scalar order for those
+    if (root->isVolatile)
+    {
+        for (int i = 0; i < row_count; i++)
+            out[i] = scalar_.evaluateAt(root, RC{first_row + i, col}, evalCtx);
+        return;
+    }
+
+    col_ = col;
+    first_row_ = first_row;
+    lanes_ = static_cast<size_t>(row_count);
+    cse_results_.clear();
+    cse_storage_.clear();
+
+    Lanes result;
+    eval(root, evalCtx, result);
+    for (size_t i = 0; i < lanes_; i++)
+        out[i] = result.take(i);
+}
+
+// scalar fallback for nodes without a vector implementation
+void BatchEvaluator::evalPerLane(const ASTNode *node, EvalContext &evalCtx, Lanes &out)
+{
+    out.resize(lanes_);
+    for (size_t i = 0; i < lanes_; i++)
+    {
+        evalCtx.current_cell = RC{first_row_ + static_cast<int>(i), col_};
+        out.set(i, scalar_.evaluateNode(node, EvalNeed::Scalar, evalCtx));
+    }
+}
+
+bool BatchEvaluator::evalSlidingWindow(const ASTNode *node, const funcs::FunctionSignature *sig, EvalContext &evalCtx, Lanes &out)
+{
+    static const funcs::FunctionSignature *sum_sig = funcs::lookup("SUM");
+    static const funcs::FunctionSignature *count_sig = funcs::lookup("COUNT");
+    static const funcs::FunctionSignature *average_sig = funcs::lookup("AVERAGE");
+    static const funcs::FunctionSignature *min_sig = funcs::lookup("MIN");
+    static const funcs::FunctionSignature *max_sig = funcs::lookup("MAX");
+    if (sig != sum_sig && sig != count_sig && sig != average_sig && sig != min_sig && sig != max_sig)
+        return false;
+    const auto &call = std::get<FunctionCall>(node->node);
+    if (call.args.size() != 1 || call.args[0]->type != ASTNodeType::Reference)
+        return false;
+    const auto &reference = std::get<Reference>(call.args[0]->node);
+    if (reference.type != ReferenceType::Range || reference.deleted || reference.sheet >= 0)
+        return false;
+    const auto &ref = std::get<RangeReference>(reference.ref);
+    const int height = ref.bottom - ref.top + 1;
+    if (!ref.relative || ref.whole_cols || ref.whole_rows || height < 2 || lanes_ < 2)
+        return false;
+
+    // a window starting above row 1 is a #REF! argument, which fails the signature check
+    const int first_top = first_row_ + ref.top;
+    const size_t skip = ref.left + col_ < 1 ? lanes_ : first_top >= 1 ? 0 : std::min(lanes_, static_cast<size_t>(1 - first_top));
+    for (size_t i = 0; i < skip; i++)
+        out.set(i, Error{ErrorCode::Value});
+    if (skip == lanes_)
+        return true;
+
+    // one pass over the rows the run covers, reduced per row across the range's columns
+    RangeRef rows{};
+    rows.left = ref.left + col_;
+    rows.right = ref.right + col_;
+    rows.top = first_top + static_cast<int>(skip);
+    rows.bottom = first_row_ + static_cast<int>(lanes_) - 1 + ref.bottom;
+    const size_t n = static_cast<size_t>(rows.bottom - rows.top + 1);
+    std::vector<double> sums(n, 0.0), lows(n, HUGE_VAL), highs(n, -HUGE_VAL);
+    std::vector<uint32_t> counts(n, 0);
+    RangeView(*evalCtx.sheet, rows).forEachNumberSpan([&](const NumberSpan &span)
+                                                      {
+        for (int i = span.begin; i < span.end; i++)
+        {
+            if (!span.valid(i))
+                continue;
+            const size_t r = static_cast<size_t>(span.first_row + i - rows.top);
+            const double x = span.numbers[i];
+            sums[r] += x;
+            counts[r]++;
+            lows[r] = std::min(lows[r], x);
+            highs[r] = std::max(highs[r], x);
+        } });
+
+    // lane i covers rows [i - skip, i - skip + height) of the arrays
+    if (sig == min_sig || sig == max_sig)
+    {
+        // monotonic deque of rows holding numbers, its head is the extreme of the window
+        const bool want_max = sig == max_sig;
+        const std::vector<double> &extremes = want_max ? highs : lows;
+        std::vector<uint32_t> deque(n);
+        size_t head = 0, tail = 0, next = 0;
+        for (size_t i = skip; i < lanes_; i++)
+        {
+            const size_t top = i - skip;
+            for (; next < top + height; next++)
+            {
+                if (!counts[next])
+                    continue;
+                const double x = extremes[next];
+                while (tail > head && (want_max ? extremes[deque[tail - 1]] <= x : extremes[deque[tail - 1]] >= x))
+                    tail--;
+                deque[tail++] = static_cast<uint32_t>(next);
+            }
+            while (head < tail && deque[head] < top)
+                head++;
+            // MIN and MAX of nothing numeric are 0
+            out.numbers[i] = head < tail ? extremes[deque[head]] : 0.0;
+        }
+        return true;
+    }
+
+    // Neumaier sum, rows enter at the bottom and leave at the top, reseeded from scratch every
+    // height lanes so the error can't build up over the run
+    double sum = 0, compensation = 0;
+    size_t count = 0;
+    auto add = [&](double x)
+    {
+        const double t = sum + x;
+        compensation += std::abs(sum) >= std::abs(x) ? (sum - t) + x : (x - t) + sum;
+        sum = t;
+    };
+    for (size_t i = skip; i < lanes_; i++)
+    {
+        const size_t top = i - skip;
+        if (top % height == 0)
+        {
+            sum = compensation = 0;
+            count = 0;
+            for (size_t r = top; r < top + height; r++)
+            {
+                add(sums[r]);
+                count += counts[r];
+            }
+        }
+        else
+        {
+            add(sums[top + height - 1]);
+            add(-sums[top - 1]);
+            count += counts[top + height - 1];
+            count -= counts[top - 1];
+        }
+        if (sig == count_sig)
+            out.numbers[i] = static_cast<double>(count);
+        else if (sig == sum_sig)
+            out.numbers[i] = sum + compensation;
+        else if (count)
+            out.numbers[i] = (sum + compensation) / count;
+        else
+            out.set(i, Error{ErrorCode::Div0});
+    }
+    return true;
+}
+
+void BatchEvaluator::eval(const ASTNode *node, EvalContext &evalCtx, Lanes &out)
+{
+    if (node->cseSlot >= 0 && static_cast<size_t>(node->cseSlot) < cse_results_.size() && cse_results_[node->cseSlot])
+    {
+        out = *cse_results_[node->cseSlot];
+        return;
+    }
+
+    out.resize(lanes_);
+    if (node->inferredType.type == BaseType::Error)
+    {
+        for (size_t i = 0; i < lanes_; i++)
+            out.set(i, Error{ErrorCode::Value});
+        return;
+    }
+
+    switch (node->type)
+    {
+    case ASTNodeType::Literal:
+    {
+        const auto &lit = std::get<Literal>(node->node);
+        if (lit.type == LiteralType::Numeric)
+        {
+            std::fill(out.numbers.begin(), out.numbers.end(), std::get<Number>(lit.value));
+        }
+        else
+        {
+            for (size_t i = 0; i < lanes_; i++)
+                out.set(i, std::get<InternedText>(lit.value));
+        }
+        break;
+    }
+    case ASTNodeType::Reference:
+    {
+        const auto &reference = std::get<Reference>(node->node);
+        // the column slices come from the sheet being evaluated, others go through the evaluator
+        if (reference.type != ReferenceType::Cell || reference.deleted || reference.sheet >= 0)
+        {
+            evalPerLane(node, evalCtx, out);
+            break;
+        }
+        // load the column slice the reference points at
+        const auto &ref = std::get<CellReference>(reference.ref);
+        for (size_t i = 0; i < lanes_; i++)
+        {
+            int row = ref.relative ? first_row_ + static_cast<int>(i) + ref.row : ref.row;
+            int col = ref.relative ? col_ + ref.col : ref.col;
+            if (row < 1 || col < 1)
+            {
+                out.set(i, Error{ErrorCode::Ref});
+                continue;
+            }
+            // numbers come straight out of the chunk, everything else through get
+            const ColumnChunk *chunk = evalCtx.sheet->chunkAt(col, row);
+            const int offset = (row - 1) % SheetStore::chunk_rows;
+            if (chunk && chunk->isNumeric(offset))
+                out.numbers[i] = chunk->numbers[offset];
+            else
+                out.set(i, evalCtx.sheet->get(RC{row, col}));
+        }
+        break;
+    }
+    case ASTNodeType::Unary:
+    {
+        const auto &unary_op = std::get<UnaryOperation>(node->node);
+        Lanes operand;
+        eval(unary_op.operand.get(), evalCtx, operand);
+        for (size_t i = 0; i < lanes_; i++)
+        {
+            if (!operand.isNumber(i))
+                out.set(i, applyUnary(unary_op.op, operand.get(i)));
+            else if (unary_op.op == UnaryOp::Minus)
+                out.numbers[i] = -1.0 * operand.numbers[i];
+            else if (unary_op.op == UnaryOp::Percent)
+                out.numbers[i] = operand.numbers[i] / 100.0;
+            else
+                out.numbers[i] = operand.numbers[i];
+        }
+        break;
+    }
+    case ASTNodeType::Binary:
+    {
+        const auto &binary_op = std::get<BinaryOperation>(node->node);
+        if (binary_op.op == BinaryOp::Range)
+        {
+            evalPerLane(node, evalCtx, out);
+            break;
+        }
+        Lanes left, right;
+        eval(binary_op.left.get(), evalCtx, left);
+        eval(binary_op.right.get(), evalCtx, right);
+        const double *l = left.numbers.data();
+        const double *r = right.numbers.data();
+        double *o = out.numbers.data();
+        const size_t n = lanes_;
+
+        // all numeric lanes: straight loops the compiler can vectorize
+        bool vectorized = left.all_numeric && right.all_numeric;
+        if (vectorized && binary_op.op == BinaryOp::Add)
+            for (size_t i = 0; i < n; i++)
+                o[i] = l[i] + r[i];
+        else if (vectorized && binary_op.op == BinaryOp::Sub)
+            for (size_t i = 0; i < n; i++)
+                o[i] = l[i] - r[i];
+        else if (vectorized && binary_op.op == BinaryOp::Mul)
+            for (size_t i = 0; i < n; i++)
+                o[i] = l[i] * r[i];
+        else
+            vectorized = false;
+
+        if (vectorized)
+            break;
+
+        // mixed lanes: the op is picked once, number pairs go through it and everything else
+        // (errors, blanks, text, bools, concat) through applyBinary
+        auto lanewise = [&](auto number_op)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                if (left.isNumber(i) && right.isNumber(i) && number_op(i))
+                    continue;
+                out.set(i, applyBinary(binary_op.op, left.get(i), right.get(i)));
+            }
+        };
+        auto compare = [&](auto cmp)
+        {
+            lanewise([&](size_t i)
+                     { out.setBool(i, cmp(l[i], r[i])); return true; });
+        };
+        switch (binary_op.op)
+        {
+        case BinaryOp::Add:
+            lanewise([&](size_t i)
+                     { o[i] = l[i] + r[i]; return true; });
+            break;
+        case BinaryOp::Sub:
+            lanewise([&](size_t i)
+                     { o[i] = l[i] - r[i]; return true; });
+            break;
+        case BinaryOp::Mul:
+            lanewise([&](size_t i)
+                     { o[i] = l[i] * r[i]; return true; });
+            break;
+        case BinaryOp::Div:
+            lanewise([&](size_t i)
+                     {
+                if (r[i] == 0.0)
+                    out.set(i, Error{ErrorCode::Div0});
+                else
+                    o[i] = l[i] / r[i];
+                return true; });
+            break;
+        case BinaryOp::Pow:
+            lanewise([&](size_t i)
+                     {
+                const double x = std::pow(l[i], r[i]);
+                if ((l[i] == 0.0 && r[i] == 0.0) || !std::isfinite(x))
+                    out.set(i, Error{ErrorCode::Num});
+                else
+                    o[i] = x;
+                return true; });
+            break;
+        case BinaryOp::Less:
+            compare(std::less<double>());
+            break;
+        case BinaryOp::Greater:
+            compare(std::greater<double>());
+            break;
+        case BinaryOp::Leq:
+            compare(std::less_equal<double>());
+            break;
+        case BinaryOp::Geq:
+            compare(std::greater_equal<double>());
+            break;
+        case BinaryOp::Eq:
+            compare(std::equal_to<double>());
+            break;
+        case BinaryOp::Neq:
+            compare(std::not_equal_to<double>());
+            break;
+        default:
+            lanewise([](size_t)
+                     { return false; });
+            break;
+        }
+        break;
+    }
+    case ASTNodeType::FunctionCall:
+    {
+        const auto &call = std::get<FunctionCall>(node->node);
+        const auto *sig = call.form == SpecialForm::None ? funcs::lookup(call.identifier) : nullptr;
+        // reference functions need their args as references and may read a cell afterwards
+        if (!sig || sig->returnsRef)
+        {
+            evalPerLane(node, evalCtx, out);
+            break;
+        }
+        if (evalSlidingWindow(node, sig, evalCtx, out))
+            break;
+        std::vector<Lanes> arg_lanes(call.args.size());
+        for (size_t a = 0; a < call.args.size(); a++)
+            eval(call.args[a].get(), evalCtx, arg_lanes[a]);
+
+        std::vector<Value> args(call.args.size());
+        if (sig->native && sig->native->batch)
+        {
+            // one call across the plugin boundary for the lanes that pass the signature check, the
+            // plugin never sees a kind its params exclude, the others are #VALUE! as in callFunction
+            std::vector<std::vector<Value>> columns(call.args.size());
+            std::vector<uint32_t> passed;
+            passed.reserve(lanes_);
+            for (size_t i = 0; i < lanes_; i++)
+            {
+                for (size_t a = 0; a < args.size(); a++)
+                    args[a] = arg_lanes[a].get(i);
+                if (!argsMatchSignature(sig, args))
+                {
+                    out.set(i, Error{ErrorCode::Value});
+                    continue;
+                }
+                for (size_t a = 0; a < args.size(); a++)
+                    columns[a].push_back(std::move(args[a]));
+                passed.push_back(static_cast<uint32_t>(i));
+            }
+            std::vector<Value> results;
+            plugins::callBatch(*sig->native, columns, passed.size(), results);
+            for (size_t k = 0; k < passed.size(); k++)
+                out.set(passed[k], std::move(results[k]));
+            break;
+        }
+        for (size_t i = 0; i < lanes_; i++)
+        {
+            evalCtx.current_cell = RC{first_row_ + static_cast<int>(i), col_};
+            for (size_t a = 0; a < args.size(); a++)
+                args[a] = arg_lanes[a].get(i);
+            out.set(i, callFunction(sig, args, evalCtx));
+        }
+        break;
+    }
+    default:
+        evalPerLane(node, evalCtx, out);
+        break;
+    }
+
+    if (node->cseSlot >= 0)
+    {
+        if (static_cast<size_t>(node->cseSlot) >= cse_results_.size())
+            cse_results_.resize(node->cseSlot + 1, nullptr);
+        cse_storage_.push_back(std::make_unique<Lanes>(out));
+        cse_results_[node->cseSlot] = cse_storage_.back().get();
+    }
+}
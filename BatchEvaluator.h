@@ -0,0 +1,71 @@
+#ifndef BATCH_EVALUATOR_H
+#define BATCH_EVALUATOR_H
+
+#include "GPFETypes.h"
+#include "EvalTypes.h"
+#include "Evaluator.h"
+#include "FunctionRegistry.h"
+#include <cstdint>
+#include <vector>
+
+// evaluates one (relative) compiled formula for a contiguous run of rows in a column
+// every node is evaluated once over all lanes, numeric lanes go through tight loops over
+// double arrays and anything else (errors, blanks, text) falls back to the scalar operator
+// semantics per lane, so results are identical to calling Evaluator::evaluateAt per row
+// a fill down of SUM/COUNT/AVERAGE/MIN/MAX over a relative range is one sliding window, it is
+// moved down the run a row at a time instead of rescanning every window, SUM and AVERAGE keep a
+// compensated running sum and can differ from a rescan in the last bits
+class BatchEvaluator
+{
+public:
+    // out must have room for row_count values, out[i] is the result for row first_row + i
+    void evaluateColumn(const ASTNode *root, int col, int first_row, int row_count, EvalContext &evalCtx, Value *out);
+
+private:
+    // per node results, columnar, numbers[i] holds a number lane, a bool lane as 0 or 1 and an
+    // error lane's code, blanks need nothing, text and arrays are rare and kept on the side in
+    // others with numbers[i] their index there, so mixed data doesn't cost a Value per lane
+    struct Lanes
+    {
+        enum class Kind : uint8_t
+        {
+            Number,
+            Bool,
+            Error,
+            Blank,
+            Other
+        };
+
+        std::vector<double> numbers;
+        std::vector<Kind> kinds;
+        std::vector<Value> others;
+        bool all_numeric = true;
+
+        void resize(size_t n);
+        void set(size_t i, Value v);
+        void setBool(size_t i, bool b)
+        {
+            numbers[i] = b ? 1.0 : 0.0;
+            kinds[i] = Kind::Bool;
+            all_numeric = false;
+        }
+        bool isNumber(size_t i) const { return kinds[i] == Kind::Number; }
+        Value get(size_t i) const;
+        // get, moving an exceptional value out
+        Value take(size_t i);
+    };
+
+    Evaluator scalar_;
+    int col_ = 0;
+    int first_row_ = 0;
+    size_t lanes_ = 0;
+    std::vector<const Lanes *> cse_results_; // shared subtrees, indexed by ASTNode::cseSlot
+    std::vector<std::unique_ptr<Lanes>> cse_storage_;
+
+    void eval(const ASTNode *node, EvalContext &evalCtx, Lanes &out);
+    void evalPerLane(const ASTNode *node, EvalContext &evalCtx, Lanes &out);
+    // false when the call isn't one aggregate over one relative range
+    bool evalSlidingWindow(const ASTNode *node, const funcs::FunctionSignature *sig, EvalContext &evalCtx, Lanes &out);
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include "CSE.h"
+#include "FunctionRegistry.h"
+#include <cstring>
+#include <unordered_map>
+
+static uint64_t mix(uint64_t h, uint64_t v)
+{
+    h ^= v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+    return h;
+}
+
+static uint64_t hashString(const std::string &s)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (char c : s)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// hash of the node's own fields, children are mixed in by the caller
+static uint64_t localHash(const ASTNode *node)
+{
+    uint64_t h = mix(0, static_cast<uint64_t>(node->type));
+    switch (node->type)
+    {
+    case ASTNodeType::Literal:
+    {
+        const auto &lit = std::get<Literal>(node->node);
+        if (lit.type == LiteralType::Numeric)
+        {
+            double d = std::get<double>(lit.value);
+            uint64_t bits;
+            std::memcpy(&bits, &d, sizeof(bits));
+            return mix(mix(h, 1), bits);
+        }
+        return mix(mix(h, 2), std::get<InternedText>(lit.value).id);
+    }
+    case ASTNodeType::Reference:
+    {
+        const auto &ref = std::get<Reference>(node->node);
+        h = mix(h, ref.deleted);
+        h = mix(h, static_cast<uint64_t>(ref.sheet + 1));
+        if (ref.type == ReferenceType::Cell)
+        {
+            const auto &cell = std::get<CellReference>(ref.ref);
+            return mix(mix(mix(mix(h, 1), cell.row), cell.col), cell.relative);
+        }
+        const auto &range = std::get<RangeReference>(ref.ref);
+        h = mix(mix(mix(mix(mix(h, 2), range.top), range.left), range.bottom), range.right);
+        return mix(mix(mix(h, range.relative), range.whole_cols), range.whole_rows);
+    }
+    case ASTNodeType::Unary:
+        return mix(h, static_cast<uint64_t>(std::get<UnaryOperation>(node->node).op));
+    case ASTNodeType::Binary:
+        return mix(h, static_cast<uint64_t>(std::get<BinaryOperation>(node->node).op));
+    case ASTNodeType::FunctionCall:
+    {
+        const auto &call = std::get<FunctionCall>(node->node);
+        return mix(mix(h, hashString(call.identifier)), call.args.size());
+    }
+    case ASTNodeType::Name:
+    {
+        const auto &name = std::get<Name>(node->node);
+        return mix(h, static_cast<uint64_t>(name.slot));
+    }
+    }
+    return h;
+}
+
+uint64_t structuralHash(const ASTNode *node)
+{
+    uint64_t h = localHash(node);
+    switch (node->type)
+    {
+    case ASTNodeType::Unary:
+        return mix(h, structuralHash(std::get<UnaryOperation>(node->node).operand.get()));
+    case ASTNodeType::Binary:
+    {
+        const auto &binary_op = std::get<BinaryOperation>(node->node);
+        return mix(mix(h, structuralHash(binary_op.left.get())), structuralHash(binary_op.right.get()));
+    }
+    case ASTNodeType::FunctionCall:
+        for (const auto &arg : std::get<FunctionCall>(node->node).args)
+            h = mix(h, structuralHash(arg.get()));
+        return h;
+    default:
+        return h;
+    }
+}
+
+bool sameTree(const ASTNode *a, const ASTNode *b)
+{
+    if (a == b)
+        return true;
+    if (a->type != b->type)
+        return false;
+    switch (a->type)
+    {
+    case ASTNodeType::Literal:
+    {
+        const auto &la = std::get<Literal>(a->node);
+        const auto &lb = std::get<Literal>(b->node);
+        return la.type == lb.type && la.value == lb.value;
+    }
+    case ASTNodeType::Reference:
+    {
+        const auto &ra = std::get<Reference>(a->node);
+        const auto &rb = std::get<Reference>(b->node);
+        if (ra.type != rb.type || ra.deleted != rb.deleted || ra.sheet != rb.sheet)
+            return false;
+        if (ra.type == ReferenceType::Cell)
+        {
+            const auto &ca = std::get<CellReference>(ra.ref);
+            const auto &cb = std::get<CellReference>(rb.ref);
+            return ca.row == cb.row && ca.col == cb.col && ca.relative == cb.relative;
+        }
+        const auto &ga = std::get<RangeReference>(ra.ref);
+        const auto &gb = std::get<RangeReference>(rb.ref);
+        return ga.top == gb.top && ga.left == gb.left && ga.bottom == gb.bottom && ga.right == gb.right && ga.relative == gb.relative && ga.whole_cols == gb.whole_cols && ga.whole_rows == gb.whole_rows;
+    }
+    case ASTNodeType::Unary:
+    {
+        const auto &ua = std::get<UnaryOperation>(a->node);
+        const auto &ub = std::get<UnaryOperation>(b->node);
+        return ua.op == ub.op && sameTree(ua.operand.get(), ub.operand.get());
+    }
+    case ASTNodeType::Binary:
+    {
+        const auto &ba = std::get<BinaryOperation>(a->node);
+        const auto &bb = std::get<BinaryOperation>(b->node);
+        return ba.op == bb.op && sameTree(ba.left.get(), bb.left.get()) && sameTree(ba.right.get(), bb.right.get());
+    }
+    case ASTNodeType::FunctionCall:
+    {
+        const auto &fa = std::get<FunctionCall>(a->node);
+        const auto &fb = std::get<FunctionCall>(b->node);
+        if (fa.identifier != fb.identifier || fa.args.size() != fb.args.size())
+            return false;
+        for (size_t i = 0; i < fa.args.size(); i++)
+            if (!sameTree(fa.args[i].get(), fb.args[i].get()))
+                return false;
+        return true;
+    }
+    case ASTNodeType::Name:
+        return std::get<Name>(a->node).slot == std::get<Name>(b->node).slot;
+    }
+    return false;
+}
+
+// postorder, records every node with its hash and whether its value is fixed for one formula evaluation
+uint64_t CSEPass::visit(ASTNode *node, bool &pure)
+{
+    uint64_t h = localHash(node);
+    pure = true;
+    bool child_pure = true;
+    switch (node->type)
+    {
+    case ASTNodeType::Unary:
+        h = mix(h, visit(std::get<UnaryOperation>(node->node).operand.get(), child_pure));
+        pure = child_pure;
+        break;
+    case ASTNodeType::Binary:
+    {
+        auto &binary_op = std::get<BinaryOperation>(node->node);
+        h = mix(h, visit(binary_op.left.get(), child_pure));
+        pure = child_pure;
+        h = mix(h, visit(binary_op.right.get(), child_pure));
+        pure = pure && child_pure;
+        break;
+    }
+    case ASTNodeType::FunctionCall:
+    {
+        auto &call = std::get<FunctionCall>(node->node);
+        for (auto &arg : call.args)
+        {
+            h = mix(h, visit(arg.get(), child_pure));
+            pure = pure && child_pure;
+        }
+        if (call.form != SpecialForm::None)
+        {
+            pure = false; // binds or reads locals
+        }
+        else
+        {
+            // a reference result becomes a value or stays a range depending on where it is used,
+            // a slot shared between two uses would hand the second one the first one's kind
+            const auto *sig = funcs::lookup(call.identifier);
+            if (!sig || sig->isVolatile || sig->returnsRef)
+                pure = false;
+        }
+        break;
+    }
+    case ASTNodeType::Name:
+        // LAMBDA params (and LETs inside a LAMBDA body) change while the formula is evaluated
+        pure = false;
+        break;
+    default:
+        break;
+    }
+    node->cseSlot = -1;
+    visited_.push_back({node, h, pure});
+    return h;
+}
+
+CSEStats CSEPass::run(ASTNode *root)
+{
+    CSEStats stats;
+    visited_.clear();
+    bool pure;
+    visit(root, pure);
+    stats.nodes = visited_.size();
+
+    // equivalence classes, hash -> representatives of each distinct tree with that hash
+    struct Class
+    {
+        const ASTNode *representative;
+        std::vector<ASTNode *> members;
+        bool pure;
+    };
+    std::vector<Class> classes;
+    std::unordered_map<uint64_t, std::vector<size_t>> by_hash;
+    for (const auto &v : visited_)
+    {
+        auto &candidates = by_hash[v.hash];
+        bool found = false;
+        for (size_t idx : candidates)
+        {
+            if (sameTree(classes[idx].representative, v.node))
+            {
+                classes[idx].members.push_back(v.node);
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            candidates.push_back(classes.size());
+            classes.push_back({v.node, {v.node}, v.pure});
+        }
+    }
+    stats.unique_nodes = classes.size();
+
+    for (const auto &c : classes)
+    {
+        if (!c.pure || c.members.size() < 2)
+            continue;
+        // literals and references are as cheap to evaluate as a cache read
+        ASTNodeType type = c.representative->type;
+        if (type != ASTNodeType::Unary && type != ASTNodeType::Binary && type != ASTNodeType::FunctionCall)
+            continue;
+        int slot = next_slot_++;
+        for (ASTNode *member : c.members)
+            member->cseSlot = slot;
+        stats.shared_subtrees++;
+        stats.shared_nodes += c.members.size() - 1;
+    }
+    visited_.clear();
+    return stats;
+}
@@ -0,0 +1,56 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include "GPFETypes.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// common subexpression elimination over a type checked formula
+// structurally identical pure subtrees get the same ASTNode::cseSlot, the evaluator computes a slot
+// once per formula evaluation and every other occurrence reads the cached value, so the tree is
+// evaluated as a DAG. subtrees containing volatile calls, local names (LET/LAMBDA) or calls returning a
+// reference (OFFSET, INDEX, INDIRECT) are never shared
+struct CSEStats
+{
+    size_t nodes = 0;           // nodes visited
+    size_t unique_nodes = 0;    // structurally distinct subtrees
+    size_t shared_subtrees = 0; // distinct subtrees that got a slot
+    size_t shared_nodes = 0;    // occurrences that read a slot instead of evaluating
+
+    double dedupRatio() const { return unique_nodes ? static_cast<double>(nodes) / unique_nodes : 1.0; }
+
+    CSEStats &operator+=(const CSEStats &other)
+    {
+        nodes += other.nodes;
+        unique_nodes += other.unique_nodes;
+        shared_subtrees += other.shared_subtrees;
+        shared_nodes += other.shared_nodes;
+        return *this;
+    }
+};
+
+class CSEPass
+{
+public:
+    CSEStats run(ASTNode *root);
+    int slotCount() const { return next_slot_; }
+
+private:
+    struct Visited
+    {
+        ASTNode *node;
+        uint64_t hash;
+        bool pure;
+    };
+
+    std::vector<Visited> visited_;
+    int next_slot_ = 0;
+
+    uint64_t visit(ASTNode *node, bool &pure);
+};
+
+uint64_t structuralHash(const ASTNode *node);
+bool sameTree(const ASTNode *a, const ASTNode *b);
+
+#endif
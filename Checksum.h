@@ -0,0 +1,62 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 64 bit checksum of snapshot sections and log records, rounds in the style of xxHash64 over four
+// independent lanes of 8 byte words so it runs close to memory speed
+// not cryptographic, it catches torn writes, truncation and flipped bits
+namespace checksum
+{
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t prime3 = 0x165667B19E3779F9ull;
+
+    inline uint64_t round(uint64_t lane, uint64_t word)
+    {
+        return std::rotl(lane + word * prime2, 31) * prime1;
+    }
+
+    inline uint64_t word(const unsigned char *p)
+    {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof w);
+        return w;
+    }
+
+    inline uint64_t hash64(const void *data, size_t size, uint64_t seed = 0)
+    {
+        const auto *p = static_cast<const unsigned char *>(data);
+        const unsigned char *end = p + size;
+        uint64_t h;
+        if (size >= 32)
+        {
+            uint64_t lanes[4] = {seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+            for (; end - p >= 32; p += 32)
+                for (int i = 0; i < 4; i++)
+                    lanes[i] = round(lanes[i], word(p + 8 * i));
+            h = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+            for (uint64_t lane : lanes)
+                h = (h ^ round(0, lane)) * prime1 + prime3;
+        }
+        else
+        {
+            h = seed + prime3;
+        }
+        h += size;
+        for (; end - p >= 8; p += 8)
+            h = std::rotl(h ^ round(0, word(p)), 27) * prime1 + prime3;
+        for (; p < end; p++)
+            h = std::rotl(h ^ (*p * prime3), 11) * prime1;
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        return h ^ h >> 32;
+    }
+}
+
+#endif
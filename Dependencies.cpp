@@ -0,0 +1,342 @@
+#include "Dependencies.h"
+#include "GPFEHelpers.h"
+#include "FunctionRegistry.h"
+#include <algorithm>
+
+RangeRef resolveReference(const Reference &reference, RC cell)
+{
+    RangeRef range_ref;
+    range_ref.sheet = reference.sheet;
+    if (reference.type == ReferenceType::Cell)
+    {
+        const auto &ref = std::get<CellReference>(reference.ref);
+        int row = ref.relative ? cell.first + ref.row : ref.row;
+        int col = ref.relative ? cell.second + ref.col : ref.col;
+        range_ref.left = col;
+        range_ref.right = col;
+        range_ref.top = row;
+        range_ref.bottom = row;
+        return range_ref;
+    }
+    const auto &ref = std::get<RangeReference>(reference.ref);
+    int row_offset = ref.relative && !ref.whole_cols ? cell.first : 0;
+    int col_offset = ref.relative && !ref.whole_rows ? cell.second : 0;
+    range_ref.left = ref.left + col_offset;
+    range_ref.right = ref.right + col_offset;
+    range_ref.top = ref.top + row_offset;
+    range_ref.bottom = ref.bottom + row_offset;
+    return range_ref;
+}
+
+static void collect(const ASTNode *node, RC cell, Precedents &out)
+{
+    if (node->type == ASTNodeType::Reference)
+    {
+        // a deleted reference reads nothing
+        if (!std::get<Reference>(node->node).deleted)
+            out.ranges.push_back(resolveReference(std::get<Reference>(node->node), cell));
+        return;
+    }
+    if (node->type == ASTNodeType::Binary)
+    {
+        const auto &binary_op = std::get<BinaryOperation>(node->node);
+        if (binary_op.op == BinaryOp::Range)
+        {
+            const ASTNode *left = binary_op.left.get();
+            const ASTNode *right = binary_op.right.get();
+            // A1:B2:C3 and similar chains of references still have a static bounding box
+            if (left->type == ASTNodeType::Reference && right->type == ASTNodeType::Reference)
+            {
+                if (std::get<Reference>(left->node).deleted || std::get<Reference>(right->node).deleted)
+                    return;
+                RangeRef a = resolveReference(std::get<Reference>(left->node), cell);
+                RangeRef b = resolveReference(std::get<Reference>(right->node), cell);
+                // A1:Sheet1!B2 may or may not be one sheet, only evaluating it can tell
+                if (a.sheet == b.sheet)
+                {
+                    out.ranges.push_back(RangeRef{std::min(a.left, b.left), std::max(a.right, b.right), std::min(a.top, b.top), std::max(a.bottom, b.bottom), a.sheet});
+                    return;
+                }
+            }
+            out.dynamic = true;
+        }
+    }
+    if (node->type == ASTNodeType::FunctionCall)
+    {
+        const auto &call = std::get<FunctionCall>(node->node);
+        const auto *sig = call.form == SpecialForm::None ? funcs::lookup(call.identifier) : nullptr;
+        if (sig && sig->returnsRef)
+        {
+            out.dynamic = true;
+            for (size_t i = 0; i < call.args.size(); i++)
+            {
+                // a reference passed by reference only gives an address, its cells aren't read
+                const funcs::Param *param = sig->paramAt(i);
+                if (param && param->byReference() && call.args[i]->type == ASTNodeType::Reference)
+                    continue;
+                collect(call.args[i].get(), cell, out);
+            }
+            return;
+        }
+    }
+    forEachChild(node, [&](const ASTNode *child)
+                 { collect(child, cell, out); });
+}
+
+Precedents collectPrecedents(const ASTNode *root, RC cell)
+{
+    Precedents precedents;
+    collect(root, cell, precedents);
+    return precedents;
+}
+
+void DependencyIndex::add(uint64_t formula, const Precedents &precedents)
+{
+    remove(formula);
+    FormulaEntry &entry = formulas_[formula];
+    if (precedents.dynamic)
+        dynamic_.insert(formula);
+    for (const RangeRef &range : precedents.ranges)
+        link(formula, range, entry.precedents);
+}
+
+// moves the entries whose key changes, all of them are taken out before any is put back since a
+// cell moving down may land on a key that is yet to move, a new key of 0 drops the entry
+template <typename Map>
+static void rekey(Map &map, const std::vector<std::pair<uint64_t, uint64_t>> &moves)
+{
+    std::vector<typename Map::node_type> nodes;
+    nodes.reserve(moves.size());
+    for (const auto &[from, to] : moves)
+        nodes.push_back(map.extract(from));
+    for (size_t i = 0; i < moves.size(); i++)
+    {
+        if (!moves[i].second)
+            continue;
+        nodes[i].key() = moves[i].second;
+        map.insert(std::move(nodes[i]));
+    }
+}
+
+void DependencyIndex::restructure(const StructuralEdit &edit, bool own_sheet)
+{
+    // where a key ends up, 0 when its cell was deleted, formulas move when they live on the edited
+    // sheet and cells of the index when it covers it
+    auto moved_formula = [&](uint64_t key) -> uint64_t
+    {
+        if (sheetFromKey(key) != edit.sheet)
+            return key;
+        RC rc = cellFromKey(key);
+        return edit.mapCell(rc) ? cellKey(edit.sheet, rc) : 0;
+    };
+    auto moved_cell = [&](uint64_t key) -> uint64_t
+    {
+        RC rc = cellFromKey(key);
+        return !own_sheet ? key : edit.mapCell(rc) ? cellKey(rc) : 0;
+    };
+    const int limit = edit.rows ? max_rows : max_cols;
+    bool dropped = false;
+    auto drop_range = [&](uint32_t idx)
+    {
+        ranges_[idx].formula = 0;
+        free_ranges_.push_back(idx);
+        dropped = true;
+    };
+    // edges follow the cells, a range spanning the whole axis (A:A on a row edit) stays as it is
+    auto move_edges = [&](uint64_t formula, Edges &edges)
+    {
+        size_t kept = 0;
+        for (uint64_t cell : edges.cells)
+            if (uint64_t moved = moved_cell(cell))
+                edges.cells[kept++] = moved;
+        edges.cells.resize(kept);
+        kept = 0;
+        for (uint32_t idx : edges.ranges)
+        {
+            RangeRef &range = ranges_[idx].range;
+            int &lo = edit.rows ? range.top : range.left;
+            int &hi = edit.rows ? range.bottom : range.right;
+            if (own_sheet && !(lo <= 1 && hi >= limit) && !edit.mapSpan(lo, hi))
+            {
+                drop_range(idx);
+                continue;
+            }
+            ranges_[idx].formula = formula;
+            edges.ranges[kept++] = idx;
+        }
+        edges.ranges.resize(kept);
+    };
+
+    // the walks are arithmetic on every entry, hashing is only spent on entries that move
+    std::vector<std::pair<uint64_t, uint64_t>> moves;
+    for (auto &[key, entry] : formulas_)
+    {
+        const uint64_t moved = moved_formula(key);
+        if (moved)
+        {
+            move_edges(moved, entry.precedents);
+            move_edges(moved, entry.dynamic_reads);
+        }
+        else
+        {
+            for (uint32_t idx : entry.precedents.ranges)
+                drop_range(idx);
+            for (uint32_t idx : entry.dynamic_reads.ranges)
+                drop_range(idx);
+        }
+        if (moved != key)
+            moves.emplace_back(key, moved);
+    }
+    rekey(formulas_, moves);
+    std::vector<uint64_t> dynamic;
+    for (const auto &[from, to] : moves)
+        if (dynamic_.erase(from) && to)
+            dynamic.push_back(to);
+    dynamic_.insert(dynamic.begin(), dynamic.end());
+
+    moves.clear();
+    for (auto &[cell, dependents] : cell_dependents_)
+    {
+        size_t kept = 0;
+        for (uint64_t formula : dependents)
+            if (uint64_t moved = moved_formula(formula))
+                dependents[kept++] = moved;
+        dependents.resize(kept);
+        const uint64_t moved = kept ? moved_cell(cell) : 0;
+        if (moved != cell)
+            moves.emplace_back(cell, moved);
+    }
+    rekey(cell_dependents_, moves);
+
+    // rows don't change which columns a range covers and neither do edits of other sheets, only
+    // dropped ranges leave their buckets, column edits of this sheet rebuild them
+    if (edit.rows || !own_sheet)
+    {
+        if (!dropped)
+            return;
+        auto dead = [&](uint32_t idx)
+        { return ranges_[idx].formula == 0; };
+        for (auto &list : by_col_)
+            list.erase(std::remove_if(list.begin(), list.end(), dead), list.end());
+        wide_.erase(std::remove_if(wide_.begin(), wide_.end(), dead), wide_.end());
+        return;
+    }
+    for (auto &list : by_col_)
+        list.clear();
+    wide_.clear();
+    for (uint32_t idx = 0; idx < ranges_.size(); idx++)
+    {
+        const RangeRef &range = ranges_[idx].range;
+        if (!ranges_[idx].formula)
+            continue;
+        if (range.right - range.left + 1 > wide_cols)
+        {
+            wide_.push_back(idx);
+            continue;
+        }
+        if (range.right > static_cast<int>(by_col_.size()))
+            by_col_.resize(range.right);
+        for (int col = std::max(range.left, 1); col <= range.right; col++)
+            by_col_[col - 1].push_back(idx);
+    }
+}
+
+void DependencyIndex::setDynamicReads(uint64_t formula, const std::vector<RangeRef> &ranges)
+{
+    // a formula reading this sheet only at runtime gets its entry here
+    FormulaEntry &entry = formulas_[formula];
+    unlink(formula, entry.dynamic_reads);
+    for (const RangeRef &range : ranges)
+        link(formula, range, entry.dynamic_reads);
+}
+
+void DependencyIndex::reserve(size_t formulas, size_t cells)
+{
+    formulas_.reserve(formulas);
+    cell_dependents_.reserve(cells);
+}
+
+void DependencyIndex::remove(uint64_t formula)
+{
+    auto it = formulas_.find(formula);
+    if (it == formulas_.end())
+        return;
+    unlink(formula, it->second.precedents);
+    unlink(formula, it->second.dynamic_reads);
+    formulas_.erase(it);
+    dynamic_.erase(formula);
+}
+
+void DependencyIndex::link(uint64_t formula, const RangeRef &range, Edges &edges)
+{
+    if (range.left == range.right && range.top == range.bottom)
+    {
+        uint64_t cell = cellKey(RC{range.top, range.left});
+        if (std::find(edges.cells.begin(), edges.cells.end(), cell) != edges.cells.end())
+            return;
+        edges.cells.push_back(cell);
+        cell_dependents_[cell].push_back(formula);
+        return;
+    }
+    uint32_t idx;
+    if (free_ranges_.empty())
+    {
+        idx = static_cast<uint32_t>(ranges_.size());
+        ranges_.push_back({range, formula});
+    }
+    else
+    {
+        idx = free_ranges_.back();
+        free_ranges_.pop_back();
+        ranges_[idx] = {range, formula};
+    }
+    edges.ranges.push_back(idx);
+    if (range.right - range.left + 1 > wide_cols)
+    {
+        wide_.push_back(idx);
+        return;
+    }
+    if (range.right > static_cast<int>(by_col_.size()))
+        by_col_.resize(range.right);
+    for (int col = std::max(range.left, 1); col <= range.right; col++)
+        by_col_[col - 1].push_back(idx);
+}
+
+void DependencyIndex::unlink(uint64_t formula, Edges &edges)
+{
+    auto erase_from = [](auto &list, auto value)
+    {
+        list.erase(std::find(list.begin(), list.end(), value));
+    };
+    for (uint64_t cell : edges.cells)
+    {
+        auto deps = cell_dependents_.find(cell);
+        erase_from(deps->second, formula);
+        if (deps->second.empty())
+            cell_dependents_.erase(deps);
+    }
+    for (uint32_t idx : edges.ranges)
+    {
+        const RangeRef &range = ranges_[idx].range;
+        if (range.right - range.left + 1 > wide_cols)
+            erase_from(wide_, idx);
+        else
+            for (int col = std::max(range.left, 1); col <= range.right; col++)
+                erase_from(by_col_[col - 1], idx);
+        ranges_[idx].formula = 0;
+        free_ranges_.push_back(idx);
+    }
+    edges.cells.clear();
+    edges.ranges.clear();
+}
+
+void DependencyIndex::appendRanges(const Edges &edges, std::vector<RangeRef> &out) const
+{
+    for (uint64_t cell : edges.cells)
+    {
+        RC rc = cellFromKey(cell);
+        out.push_back(RangeRef{rc.second, rc.second, rc.first, rc.first});
+    }
+    for (uint32_t idx : edges.ranges)
+        out.push_back(ranges_[idx].range);
+}
@@ -0,0 +1,146 @@
+#ifndef DEPENDENCIES_H
+#define DEPENDENCIES_H
+
+#include "GPFETypes.h"
+#include "EvalTypes.h"
+#include "StructuralEdit.h"
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// the cells a formula reads, found from the tree alone
+struct Precedents
+{
+    std::vector<RangeRef> ranges; // single cells are 1x1 ranges
+    // OFFSET, INDEX, INDIRECT or a ':' with a computed endpoint, the formula reads cells outside
+    // ranges that are only known once it runs (see EvalContext::dynamic_reads)
+    bool dynamic = false;
+};
+
+// absolute bounds of a reference in the formula living in cell
+RangeRef resolveReference(const Reference &reference, RC cell);
+
+// static references under root resolved for the formula living in cell
+Precedents collectPrecedents(const ASTNode *root, RC cell);
+
+// a cell as one hashable integer, never 0 for a cell on the sheet
+inline uint64_t cellKey(RC cell) { return static_cast<uint64_t>(cell.first) << 32 | static_cast<uint32_t>(cell.second); }
+// a cell of a workbook, the sheet id sits in the bits above the column, sheet 0 keys are plain keys
+inline uint64_t cellKey(int sheet, RC cell) { return cellKey(cell) | static_cast<uint64_t>(sheet) << 16; }
+inline RC cellFromKey(uint64_t key) { return RC{static_cast<int>(key >> 32), static_cast<int>(key & 0xFFFF)}; }
+inline int sheetFromKey(uint64_t key) { return static_cast<int>(key >> 16 & 0xFFFF); }
+
+// reverse edges of the dependency graph into one sheet, which formula cells read a given cell
+// formulas are workbook keys (cellKey(sheet, cell)), a formula reading several sheets is in the
+// index of each of them with the ranges it reads there, so the index of a sheet is only touched
+// by edits and recalcs of cells on it
+// single cells are hashed, ranges are bucketed by every column they cover, ranges wider than
+// wide_cols (whole rows) sit in one list checked on every lookup
+// formulas with dynamic precedents also get edges for the ranges their last evaluation read, so
+// they aren't dirtied by every edit, only by their static inputs and by what they last read
+class DependencyIndex
+{
+public:
+    static constexpr int wide_cols = 64;
+
+    // replaces whatever was recorded for formula, precedents are its ranges on this sheet
+    void add(uint64_t formula, const Precedents &precedents);
+    void remove(uint64_t formula);
+    // room for this many formulas and distinct precedent cells, ahead of a bulk load
+    void reserve(size_t formulas, size_t cells);
+    // replaces the ranges on this sheet the last evaluation of a dynamic formula read
+    void setDynamicReads(uint64_t formula, const std::vector<RangeRef> &ranges);
+    // moves every formula and edge along with the cells of a structural edit in one pass over the
+    // index, what re-adding the rewritten formulas would record, formulas in deleted cells and edges
+    // to deleted cells are dropped
+    // own_sheet is set for the index of the edited sheet, other indexes only move the formulas of it
+    void restructure(const StructuralEdit &edit, bool own_sheet);
+
+    // fn(uint64_t formula) for every dependent of cell, a formula can be reported more than once
+    template <typename Fn>
+    void forEachDependent(RC cell, Fn &&fn) const;
+    // fn(uint64_t formula) for every formula with edges into this sheet
+    template <typename Fn>
+    void forEachFormula(Fn &&fn) const
+    {
+        for (const auto &[formula, entry] : formulas_)
+            fn(formula);
+    }
+
+    // fn(uint64_t formula, bool dynamic, const std::vector<RangeRef> &precedents,
+    // const std::vector<RangeRef> &dynamic_reads) for every formula with edges into this sheet, what
+    // add and setDynamicReads were given with single cells as 1x1 ranges, how a snapshot stores it
+    template <typename Fn>
+    void forEachEntry(Fn &&fn) const;
+
+    const std::unordered_set<uint64_t> &dynamicFormulas() const { return dynamic_; }
+    size_t formulaCount() const { return formulas_.size(); }
+
+private:
+    struct RangeEntry
+    {
+        RangeRef range;
+        uint64_t formula; // 0 when the entry is free
+    };
+
+    // the cells and range entries of one set of edges
+    struct Edges
+    {
+        std::vector<uint64_t> cells;
+        std::vector<uint32_t> ranges;
+    };
+
+    struct FormulaEntry
+    {
+        Edges precedents;
+        Edges dynamic_reads;
+    };
+
+    std::unordered_map<uint64_t, std::vector<uint64_t>> cell_dependents_;
+    std::vector<RangeEntry> ranges_;
+    std::vector<uint32_t> free_ranges_;
+    std::vector<std::vector<uint32_t>> by_col_; // index col - 1
+    std::vector<uint32_t> wide_;
+    std::unordered_map<uint64_t, FormulaEntry> formulas_;
+    std::unordered_set<uint64_t> dynamic_;
+
+    void link(uint64_t formula, const RangeRef &range, Edges &edges);
+    void unlink(uint64_t formula, Edges &edges);
+    void appendRanges(const Edges &edges, std::vector<RangeRef> &out) const;
+};
+
+template <typename Fn>
+void DependencyIndex::forEachEntry(Fn &&fn) const
+{
+    std::vector<RangeRef> precedents, dynamic_reads;
+    for (const auto &[formula, entry] : formulas_)
+    {
+        precedents.clear();
+        dynamic_reads.clear();
+        appendRanges(entry.precedents, precedents);
+        appendRanges(entry.dynamic_reads, dynamic_reads);
+        fn(formula, dynamic_.count(formula) != 0, precedents, dynamic_reads);
+    }
+}
+
+template <typename Fn>
+void DependencyIndex::forEachDependent(RC cell, Fn &&fn) const
+{
+    if (auto it = cell_dependents_.find(cellKey(cell)); it != cell_dependents_.end())
+        for (uint64_t formula : it->second)
+            fn(formula);
+    auto check = [&](uint32_t idx)
+    {
+        const RangeRef &range = ranges_[idx].range;
+        if (range.top <= cell.first && cell.first <= range.bottom && range.left <= cell.second && cell.second <= range.right)
+            fn(ranges_[idx].formula);
+    };
+    if (cell.second >= 1 && cell.second <= static_cast<int>(by_col_.size()))
+        for (uint32_t idx : by_col_[cell.second - 1])
+            check(idx);
+    for (uint32_t idx : wide_)
+        check(idx);
+}
+
+#endif
@@ -1,8 +1,14 @@
 #ifndef EVAL_TYPES_H
 #define EVAL_TYPES_H
 
+#include "GPFETypes.h"
 #include <string>
+#include <memory_resource>
 #include <map>
+#include <variant>
+#include <vector>
+#include <memory>
+#include <cstdint>
 
 enum class ErrorCode
 {
@@ -29,21 +35,70 @@ enum class EvalNeed
 
 using Number = double;
 using Bool = bool;
-using Text = std::string;
+using Text = std::pmr::string; // transient text lives in the recalc arena, see TextArena.h
 struct RangeRef
 {
     int left, right, top, bottom;
+    int sheet = -1; // sheet id, -1 is the sheet being evaluated (EvalContext::sheet)
 };
 
 using Blank = std::monostate;
 
-using Value = std::variant<Number, Bool, Text, RangeRef, Error, Blank>;
+struct ArrayData;
+
+// rows x cols of values in row major order, shared so copying a Value doesn't copy the cells
+struct Array
+{
+    int rows, cols;
+    std::shared_ptr<const ArrayData> data;
+};
+
+// text is either a Text or an InternedText, see isText/textView in StringPool.h
+using Value = std::variant<Number, Bool, Text, RangeRef, Error, Blank, Array, InternedText>;
+
+struct ArrayData
+{
+    std::vector<Value> cells;
+};
 
 using RC = std::pair<int, int>;
 
+class SheetStore;
+class SheetNames;
+class AggregateViews;
+
 struct EvalContext
 {
-    std::map<RC, Value> *cell_map;
+    const SheetStore *sheet = nullptr;
+    // the stores of a workbook by sheet id, Sheet1!A1 references read them, null for a lone sheet
+    const std::vector<const SheetStore *> *sheets = nullptr;
+    const SheetNames *sheet_names = nullptr; // INDIRECT("Sheet1!A1") looks names up here
+    // volatile function state, RAND draws are keyed on (rand_seed, recalc_epoch, current_cell, rand_draws)
+    uint64_t rand_seed = 0;
+    uint32_t recalc_epoch = 0;
+    RC current_cell{0, 0};
+    uint32_t rand_draws = 0; // reset when a new cell is evaluated
+    // LET/LAMBDA slots, indexed by Name::slot, valid for one formula evaluation
+    std::vector<Value> locals;
+    // CSE cache indexed by ASTNode::cseSlot, a slot is filled when its stamp equals eval_generation
+    std::vector<Value> cse_values;
+    std::vector<uint32_t> cse_stamps;
+    uint32_t eval_generation = 0; // bumped each time a formula evaluation starts
+    // when set, every range a formula computes at runtime (OFFSET, INDEX, INDIRECT and ':' over them)
+    // is appended, they are the cells it read that collectPrecedents can't see
+    std::vector<RangeRef> *dynamic_reads = nullptr;
+    // materialized range aggregates of sheet, SUM and friends read them instead of scanning
+    AggregateViews *aggregate_views = nullptr;
 };
 
+// the store range reads, null when it names a sheet ctx doesn't have
+inline const SheetStore *sheetOf(const EvalContext &ctx, const RangeRef &range)
+{
+    if (range.sheet < 0)
+        return ctx.sheet;
+    if (!ctx.sheets || range.sheet >= static_cast<int>(ctx.sheets->size()))
+        return nullptr;
+    return (*ctx.sheets)[range.sheet];
+}
+
 #endif
\ No newline at end of file
@@ -1,6 +1,14 @@
 #include "Evaluator.h"
 #include "FunctionRegistry.h"
+#include "PluginLoader.h"
+#include "Dependencies.h"
+#include "SheetStore.h"
+#include "RangeView.h"
+#include "TextArena.h"
+#include "StringPool.h"
+#include "NumberFormat.h"
 #include <iostream>
+#include <cmath>
 
 inline BaseType typeOfValue(const Value &v)
 {
@@ -10,10 +18,12 @@ inline BaseType typeOfValue(const Value &v)
         using T = std::decay_t<decltype(x)>;
         if constexpr (std::is_same_v<T, Number>)     return BaseType::Number;
         else if constexpr (std::is_same_v<T, Text>)  return BaseType::String;
+        else if constexpr (std::is_same_v<T, InternedText>) return BaseType::String;
         else if constexpr (std::is_same_v<T, Bool>)  return BaseType::Bool;
         else if constexpr (std::is_same_v<T, RangeRef>) return BaseType::Range;
         else if constexpr (std::is_same_v<T, Error>) return BaseType::Error;
         else if constexpr (std::is_same_v<T, Blank>) return BaseType::Blank;
+        else if constexpr (std::is_same_v<T, Array>) return BaseType::Array;
         else return BaseType::Unknown; }, v);
 }
 
@@ -43,32 +53,44 @@ bool argsMatchSignature(const funcs::FunctionSignature *sig, const std::vector<V
     return true;
 }
 
-inline Text EVAL_to_text(const Value &v)
+Value callFunction(const funcs::FunctionSignature *sig, const std::vector<Value> &args, EvalContext &evalCtx)
 {
-    return std::visit([](const auto &x) -> Text
-                      {
+    if (!argsMatchSignature(sig, args))
+        return Error{ErrorCode::Value};
+    if (sig->native)
+        return plugins::callScalar(*sig->native, args);
+    return sig->eval_function(args, evalCtx);
+}
+
+// appends v as text to out, no temporaries for numbers and bools
+inline void EVAL_append_text(Text &out, const Value &v)
+{
+    std::visit([&out](const auto &x)
+               {
         using T = std::decay_t<decltype(x)>;
         if constexpr (std::is_same_v<T, Number>) {
-            char buf[32];
-            std::snprintf(buf, sizeof(buf), "%.15g", x);
-            return std::string(buf);
+            char buf[numfmt::max_chars];
+            out.append(buf, numfmt::format(x, buf));
         } else if constexpr (std::is_same_v<T, Bool>) {
-            return std::string(x ? "TRUE" : "FALSE");
+            out.append(x ? "TRUE" : "FALSE");
         } else if constexpr (std::is_same_v<T, Text>) {
-            return x; // copy is fine
-        } else if constexpr (std::is_same_v<T, RangeRef>) {
-            return std::string("#VALUE!");
-        }
-        else if constexpr (std::is_same_v<T, Blank>)
-        {
-            return std::string("");
-        }
-        else
-        {                             
-            return std::string("#VALUE!"); 
+            out.append(x);
+        } else if constexpr (std::is_same_v<T, InternedText>) {
+            out.append(StringPool::global().view(x));
+        } else if constexpr (std::is_same_v<T, Blank>) {
+        } else {
+            out.append("#VALUE!");
         } }, v);
 }
 
+// upper bound on what EVAL_append_text adds for v
+inline size_t EVAL_text_size_hint(const Value &v)
+{
+    if (isText(v))
+        return textView(v).size();
+    return 24;
+}
+
 inline bool is_error(const Value &v)
 {
     return std::holds_alternative<Error>(v);
@@ -76,7 +98,7 @@ inline bool is_error(const Value &v)
 
 inline bool is_textish(const Value &v)
 {
-    return std::holds_alternative<Number>(v) || std::holds_alternative<Bool>(v) || std::holds_alternative<Text>(v) || std::holds_alternative<Blank>(v); // or Text
+    return std::holds_alternative<Number>(v) || std::holds_alternative<Bool>(v) || isText(v) || std::holds_alternative<Blank>(v);
 }
 
 // 0 --> not same type or wrong types, 1 --> double, 2 --> string, 3 --> bool
@@ -84,7 +106,7 @@ inline int get_equality_type(const Value &left, const Value &right)
 {
     if (std::holds_alternative<Number>(left) && std::holds_alternative<Number>(right))
         return 1;
-    else if (std::holds_alternative<Text>(left) && std::holds_alternative<Text>(right))
+    else if (isText(left) && isText(right))
         return 2;
     else if (std::holds_alternative<Bool>(left) && std::holds_alternative<Bool>(right))
         return 3;
@@ -93,16 +115,343 @@ inline int get_equality_type(const Value &left, const Value &right)
     return 0;
 };
 
+// interned pairs compare ids, anything else compares characters
+inline bool EVAL_text_equal(const Value &left, const Value &right)
+{
+    const auto *a = std::get_if<InternedText>(&left);
+    const auto *b = std::get_if<InternedText>(&right);
+    if (a && b)
+        return a->id == b->id;
+    return textView(left) == textView(right);
+}
+
 auto EVAL_valid_concat_operands = [](const Value &left, const Value &right)
 {
     return is_textish(left) && is_textish(right);
 };
 
+// called after blanks are coerced to 0
 auto EVAL_valid_numeric_operands = [](const Value &left, const Value &right)
 {
-    return (!std::holds_alternative<Number>(left) || !std::holds_alternative<Blank>(left) || !std::holds_alternative<Number>(right) || !std::holds_alternative<Blank>(right));
+    return std::holds_alternative<Number>(left) && std::holds_alternative<Number>(right);
 };
 
+Value applyBinary(BinaryOp op, const Value &left, const Value &right)
+{
+    Value evaluated_left;
+    Value evaluated_right;
+    if (is_error(left) || is_error(right))
+        // pls fix
+        return Error{ErrorCode::Value};
+    if (std::holds_alternative<Blank>(left))
+        evaluated_left = 0.0;
+    else
+        evaluated_left = left;
+    if (std::holds_alternative<Blank>(right))
+        evaluated_right = 0.0;
+    else
+        evaluated_right = right;
+    switch (op)
+    {
+    case BinaryOp::Add:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        return std::get<Number>(evaluated_left) + std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Sub:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        return std::get<Number>(evaluated_left) - std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Mul:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        return std::get<Number>(evaluated_left) * std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Div:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        if (std::get<Number>(evaluated_right) == 0.0)
+        {
+            return Error{ErrorCode::Div0};
+        }
+        return std::get<Number>(evaluated_left) / std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Pow:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        if (std::get<Number>(evaluated_left) == 0.0 && std::get<Number>(evaluated_right) == 0.0)
+        {
+            return Error{ErrorCode::Num};
+        }
+        Number result = std::pow(std::get<Number>(evaluated_left), std::get<Number>(evaluated_right));
+        if (!std::isfinite(result))
+            return Error{ErrorCode::Num};
+        return result;
+    }
+    case BinaryOp::Less:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        return std::get<Number>(evaluated_left) < std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Greater:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        return std::get<Number>(evaluated_left) > std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Leq:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        return std::get<Number>(evaluated_left) <= std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Geq:
+    {
+        if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
+            return Error{ErrorCode::Value};
+        return std::get<Number>(evaluated_left) >= std::get<Number>(evaluated_right);
+    }
+    case BinaryOp::Eq:
+    {
+        int equality_type = get_equality_type(evaluated_left, evaluated_right);
+        if (!equality_type)
+            return false;
+        switch (equality_type)
+        {
+        case 1:
+        {
+            Number d_left = std::get<Number>(evaluated_left);
+            Number d_right = std::get<Number>(evaluated_right);
+            return d_left == d_right;
+        }
+        case 2:
+        {
+            return EVAL_text_equal(evaluated_left, evaluated_right);
+        }
+        case 3:
+        {
+            Bool b_left = std::get<Bool>(evaluated_left);
+            Bool b_right = std::get<Bool>(evaluated_right);
+            return b_left == b_right;
+        }
+        case 4:
+            return true;
+        default:
+            return Error{ErrorCode::Value};
+        }
+    }
+    case BinaryOp::Neq:
+    {
+        int equality_type = get_equality_type(evaluated_left, evaluated_right);
+        if (!equality_type)
+            return true;
+        switch (equality_type)
+        {
+        case 1:
+        {
+            Number d_left = std::get<Number>(evaluated_left);
+            Number d_right = std::get<Number>(evaluated_right);
+            return d_left != d_right;
+        }
+        case 2:
+        {
+            return !EVAL_text_equal(evaluated_left, evaluated_right);
+        }
+        case 3:
+        {
+            Bool b_left = std::get<Bool>(evaluated_left);
+            Bool b_right = std::get<Bool>(evaluated_right);
+            return b_left != b_right;
+        }
+        case 4:
+            return false;
+        default:
+            return true;
+        }
+    }
+    case BinaryOp::Concat:
+    {
+        if (!EVAL_valid_concat_operands(left, right))
+            return Error{ErrorCode::Value};
+        Text out = text_arena::make();
+        out.reserve(EVAL_text_size_hint(left) + EVAL_text_size_hint(right));
+        EVAL_append_text(out, left);
+        EVAL_append_text(out, right);
+        return out;
+    }
+    default:
+        return Error{ErrorCode::Value};
+    }
+}
+
+bool sameValue(const Value &a, const Value &b)
+{
+    if (isText(a) && isText(b))
+        return EVAL_text_equal(a, b);
+    if (a.index() != b.index())
+        return false;
+    return std::visit([&b](const auto &x)
+                      {
+        using T = std::decay_t<decltype(x)>;
+        const T &y = std::get<T>(b);
+        if constexpr (std::is_same_v<T, RangeRef>)
+            return x.left == y.left && x.right == y.right && x.top == y.top && x.bottom == y.bottom;
+        else if constexpr (std::is_same_v<T, Error>)
+            return x.code == y.code;
+        else if constexpr (std::is_same_v<T, Array>)
+        {
+            if (x.data == y.data)
+                return true;
+            if (x.rows != y.rows || x.cols != y.cols)
+                return false;
+            for (size_t i = 0; i < x.data->cells.size(); i++)
+                if (!sameValue(x.data->cells[i], y.data->cells[i]))
+                    return false;
+            return true;
+        }
+        else
+            return x == y; }, a);
+}
+
+Value applyUnary(UnaryOp op, const Value &operand)
+{
+    if (!std::holds_alternative<Number>(operand))
+        return Error{ErrorCode::Value};
+    Number double_value = std::get<Number>(operand);
+    switch (op)
+    {
+    case UnaryOp::Plus:
+        return double_value;
+    case UnaryOp::Minus:
+        return -1.0 * double_value;
+    case UnaryOp::Percent:
+        return double_value / 100.0;
+    default:
+        return Error{ErrorCode::Value};
+    }
+}
+
+// flattens a MAP/REDUCE argument into row major elements, scalars are 1x1
+inline bool EVAL_elements(const Value &v, EvalContext &evalCtx, int &rows, int &cols, std::vector<Value> &out)
+{
+    out.clear();
+    if (std::holds_alternative<Array>(v))
+    {
+        const auto &array = std::get<Array>(v);
+        rows = array.rows;
+        cols = array.cols;
+        out = array.data->cells;
+        return true;
+    }
+    if (std::holds_alternative<RangeRef>(v))
+    {
+        const auto &range = std::get<RangeRef>(v);
+        rows = range.bottom - range.top + 1;
+        cols = range.right - range.left + 1;
+        out.assign(static_cast<size_t>(rows) * cols, Blank{});
+        RangeView(*sheetOf(evalCtx, range), range).forEachCell([&](int r, int c, const Value &value)
+                                                               { out[static_cast<size_t>(r - range.top) * cols + (c - range.left)] = value; });
+        return true;
+    }
+    if (is_error(v))
+        return false;
+    rows = 1;
+    cols = 1;
+    out.push_back(v);
+    return true;
+}
+
+// absolute bounds of a reference, relative refs are offsets from the cell being evaluated
+inline RangeRef EVAL_resolve(const Reference &reference, const EvalContext &evalCtx)
+{
+    return resolveReference(reference, evalCtx.current_cell);
+}
+
+inline Value &EVAL_local(EvalContext &evalCtx, int slot)
+{
+    if (slot >= static_cast<int>(evalCtx.locals.size()))
+        evalCtx.locals.resize(slot + 1);
+    return evalCtx.locals[slot];
+}
+
+Value Evaluator::evalSpecialForm(const ASTNode *node, EvalNeed need, EvalContext &evalCtx)
+{
+    const auto &call = std::get<FunctionCall>(node->node);
+    switch (call.form)
+    {
+    case SpecialForm::Let:
+    {
+        // each binding is evaluated once and read from its slot afterwards
+        for (size_t i = 0; i + 1 < call.args.size(); i += 2)
+        {
+            int slot = std::get<Name>(call.args[i]->node).slot;
+            EVAL_local(evalCtx, slot) = evalScalar(call.args[i + 1].get(), evalCtx);
+        }
+        return evaluateNode(call.args.back().get(), need, evalCtx);
+    }
+    case SpecialForm::Map:
+    {
+        const auto &lambda = std::get<FunctionCall>(call.args.back()->node);
+        const size_t array_count = call.args.size() - 1;
+        std::vector<std::vector<Value>> arrays(array_count);
+        int rows = 0, cols = 0;
+        for (size_t i = 0; i < array_count; i++)
+        {
+            int r = 0, c = 0;
+            if (!EVAL_elements(evalScalar(call.args[i].get(), evalCtx), evalCtx, r, c, arrays[i]))
+                return Error{ErrorCode::Value};
+            if (i && (r != rows || c != cols))
+                return Error{ErrorCode::Value}; // pls fix broadcast mismatched shapes
+            rows = r;
+            cols = c;
+        }
+        auto data = std::make_shared<ArrayData>();
+        data->cells.reserve(static_cast<size_t>(rows) * cols);
+        for (size_t k = 0; k < static_cast<size_t>(rows) * cols; k++)
+        {
+            for (size_t i = 0; i < array_count; i++)
+                EVAL_local(evalCtx, std::get<Name>(lambda.args[i]->node).slot) = arrays[i][k];
+            data->cells.push_back(evalScalar(lambda.args.back().get(), evalCtx));
+        }
+        return Array{rows, cols, std::move(data)};
+    }
+    case SpecialForm::Reduce:
+    {
+        const auto &lambda = std::get<FunctionCall>(call.args[2]->node);
+        int acc_slot = std::get<Name>(lambda.args[0]->node).slot;
+        int elem_slot = std::get<Name>(lambda.args[1]->node).slot;
+        Value acc = evalScalar(call.args[0].get(), evalCtx);
+        std::vector<Value> elements;
+        int rows = 0, cols = 0;
+        if (!EVAL_elements(evalScalar(call.args[1].get(), evalCtx), evalCtx, rows, cols, elements))
+            return Error{ErrorCode::Value};
+        for (const auto &element : elements)
+        {
+            EVAL_local(evalCtx, acc_slot) = std::move(acc);
+            EVAL_local(evalCtx, elem_slot) = element;
+            acc = evalScalar(lambda.args.back().get(), evalCtx);
+        }
+        return acc;
+    }
+    default:
+        // LAMBDA outside MAP/REDUCE is rejected by the TypeChecker
+        return Error{ErrorCode::Value};
+    }
+}
+
+Value Evaluator::evaluateAt(const ASTNode *root, RC cell, EvalContext &evalCtx)
+{
+    evalCtx.current_cell = cell;
+    return evaluateNode(root, EvalNeed::Scalar, evalCtx);
+}
+
 Value Evaluator::evalScalar(const ASTNode *node, EvalContext &evalCtx)
 {
     return evaluateNode(node, EvalNeed::Scalar, evalCtx);
@@ -114,6 +463,38 @@ Value Evaluator::evalRefLike(const ASTNode *node, EvalContext &evalCtx)
 }
 
 Value Evaluator::evaluateNode(const ASTNode *node, EvalNeed need, EvalContext &evalCtx)
+{
+    struct DepthGuard
+    {
+        int &depth;
+        ~DepthGuard() { depth--; }
+    };
+    if (depth_ == 0)
+    {
+        // new formula evaluation, drop cached subexpressions and restart the RAND draw counter
+        evalCtx.eval_generation++;
+        evalCtx.rand_draws = 0;
+    }
+    depth_++;
+    DepthGuard guard{depth_};
+
+    if (node->cseSlot < 0)
+        return evaluateUncached(node, need, evalCtx);
+    const size_t slot = node->cseSlot;
+    if (slot >= evalCtx.cse_values.size())
+    {
+        evalCtx.cse_values.resize(slot + 1);
+        evalCtx.cse_stamps.resize(slot + 1, 0);
+    }
+    if (evalCtx.cse_stamps[slot] == evalCtx.eval_generation)
+        return evalCtx.cse_values[slot];
+    Value value = evaluateUncached(node, need, evalCtx);
+    evalCtx.cse_values[slot] = value;
+    evalCtx.cse_stamps[slot] = evalCtx.eval_generation;
+    return value;
+}
+
+Value Evaluator::evaluateUncached(const ASTNode *node, EvalNeed need, EvalContext &evalCtx)
 {
     // add check in each operator, if the Value of a node is unknown after evaluation just throw a #VALUE
     if (node->inferredType.type == BaseType::Error)
@@ -130,28 +511,14 @@ Value Evaluator::evaluateNode(const ASTNode *node, EvalNeed need, EvalContext &e
         case LiteralType::Numeric:
             return std::get<Number>(lit.value);
         case LiteralType::String:
-            return std::get<Text>(lit.value);
+            return std::get<InternedText>(lit.value);
         }
     }
     case ASTNodeType::Unary:
     {
         const auto &unary_op = std::get<UnaryOperation>(node->node);
         auto operand = unary_op.operand.get();
-        Value operand_value = evalScalar(operand, evalCtx);
-        if (!std::holds_alternative<Number>(operand_value))
-            return Error{ErrorCode::Value};
-        Number double_value = std::get<Number>(operand_value);
-        switch (unary_op.op)
-        {
-        case UnaryOp::Plus:
-            return double_value;
-        case UnaryOp::Minus:
-            return -1.0 * double_value;
-        case UnaryOp::Percent:
-            return double_value / 100.0;
-        default:
-            return Error{ErrorCode::Value};
-        }
+        return applyUnary(unary_op.op, evalScalar(operand, evalCtx));
     }
     case ASTNodeType::Binary:
     {
@@ -172,255 +539,79 @@ Value Evaluator::evaluateNode(const ASTNode *node, EvalNeed need, EvalContext &e
             }
             RangeRef range_left = std::get<RangeRef>(evaluated_left);
             RangeRef range_right = std::get<RangeRef>(evaluated_right);
+            // a range lives on one sheet, A1:Sheet1!B2 is fine on Sheet1 only
+            if (sheetOf(evalCtx, range_left) != sheetOf(evalCtx, range_right))
+                return Error{ErrorCode::Ref};
             RangeRef new_range{};
+            new_range.sheet = range_left.sheet;
             new_range.top = std::min(range_left.top, range_right.top);
             new_range.bottom = std::max(range_left.bottom, range_right.bottom);
-            new_range.left = std::min(range_left.left, range_right.right);
-            new_range.right = std::max(range_left.left, range_right.right);
+            new_range.left = std::min(range_left.left, range_right.left);
+            new_range.right = std::max(range_left.right, range_right.right);
+            if (evalCtx.dynamic_reads && (left->type != ASTNodeType::Reference || right->type != ASTNodeType::Reference || range_left.sheet != range_right.sheet))
+                evalCtx.dynamic_reads->push_back(new_range);
             return new_range;
         }
         else
         {
-            Value evaluated_left_no_coerce = evalScalar(left, evalCtx);
-            Value evaluated_right_no_coerce = evalScalar(right, evalCtx);
-            Value evaluated_left;
-            Value evaluated_right;
-            if (is_error(evaluated_left_no_coerce) || is_error(evaluated_right_no_coerce))
-                // pls fix
-                return Error{ErrorCode::Value};
-            if (std::holds_alternative<Blank>(evaluated_left_no_coerce))
-                evaluated_left = 0.0;
-            else
-                evaluated_left = evaluated_left_no_coerce;
-            if (std::holds_alternative<Blank>(evaluated_right_no_coerce))
-                evaluated_right = 0.0;
-            else
-                evaluated_right = evaluated_right_no_coerce;
-            switch (binary_op.op)
-            {
-            case BinaryOp::Add:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                return std::get<Number>(evaluated_left) + std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Sub:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                return std::get<Number>(evaluated_left) - std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Mul:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                return std::get<Number>(evaluated_left) * std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Div:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                if (std::get<Number>(evaluated_right) == 0.0)
-                {
-                    return Error{ErrorCode::Div0};
-                }
-                return std::get<Number>(evaluated_left) / std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Pow:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                if (std::get<Number>(evaluated_left) == 0.0 && std::get<Number>(evaluated_right) == 0.0)
-                {
-                    return Error{ErrorCode::Num};
-                }
-                // pls fix POW
-                return std::get<Number>(evaluated_left) / std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Less:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                return std::get<Number>(evaluated_left) < std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Greater:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                return std::get<Number>(evaluated_left) > std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Leq:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                return std::get<Number>(evaluated_left) <= std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Geq:
-            {
-                if (!EVAL_valid_numeric_operands(evaluated_left, evaluated_right))
-                    return Error{ErrorCode::Value};
-                return std::get<Number>(evaluated_left) >= std::get<Number>(evaluated_right);
-            }
-            case BinaryOp::Eq:
-            {
-                int equality_type = get_equality_type(evaluated_left, evaluated_right);
-                if (!equality_type)
-                    return false;
-                switch (equality_type)
-                {
-                case 1:
-                {
-                    Number d_left = std::get<Number>(evaluated_left);
-                    Number d_right = std::get<Number>(evaluated_right);
-                    std::cout << "checking double equality\n";
-                    std::cout << "D_LEFT = " << d_left << "\n";
-                    std::cout << "D_RIGHT = " << d_right << "\n";
-
-                    return d_left == d_right;
-                }
-                case 2:
-                {
-                    Text s_left = std::get<Text>(evaluated_left);
-                    Text s_right = std::get<Text>(evaluated_right);
-                    return s_left == s_right;
-                }
-                case 3:
-                {
-                    Bool b_left = std::get<Bool>(evaluated_left);
-                    Bool b_right = std::get<Bool>(evaluated_right);
-                    return b_left == b_right;
-                }
-                case 4:
-                    return true;
-                default:
-                    return Error{ErrorCode::Value};
-                }
-            }
-            case BinaryOp::Neq:
-            {
-                int equality_type = get_equality_type(evaluated_left, evaluated_right);
-                if (!equality_type)
-                    return true;
-                switch (equality_type)
-                {
-                case 1:
-                {
-                    Number d_left = std::get<Number>(evaluated_left);
-                    Number d_right = std::get<Number>(evaluated_right);
-                    return d_left != d_right;
-                }
-                case 2:
-                {
-                    Text s_left = std::get<Text>(evaluated_left);
-                    Text s_right = std::get<Text>(evaluated_right);
-                    return s_left != s_right;
-                }
-                case 3:
-                {
-                    Bool b_left = std::get<Bool>(evaluated_left);
-                    Bool b_right = std::get<Bool>(evaluated_right);
-                    return b_left != b_right;
-                }
-                case 4:
-                    return false;
-                default:
-                    return true;
-                }
-            }
-            case BinaryOp::Concat:
-            {
-                if (!EVAL_valid_concat_operands(evaluated_left_no_coerce, evaluated_right_no_coerce))
-                    return Error{ErrorCode::Value};
-                Text a = EVAL_to_text(evaluated_left_no_coerce);
-                Text b = EVAL_to_text(evaluated_right_no_coerce);
-                Text out;
-                out.reserve(a.size() + b.size());
-                out.append(a);
-                out.append(b);
-                return out;
-            }
-            default:
-                return Error{ErrorCode::Value};
-            }
+            // left before right, RAND draws are numbered in evaluation order
+            Value evaluated_left = evalScalar(left, evalCtx);
+            return applyBinary(binary_op.op, evaluated_left, evalScalar(right, evalCtx));
         }
     }
     case ASTNodeType::Reference:
     {
-        if (need == EvalNeed::RefLike)
-        {
-            const auto &reference = std::get<Reference>(node->node);
-            switch (reference.type)
-            {
-            case ReferenceType::Cell:
-            {
-                // pls fix bounds checking
-                CellReference ref = std::get<CellReference>(reference.ref);
-                RangeRef range_ref;
-                range_ref.left = ref.col;
-                range_ref.right = ref.col;
-                range_ref.top = ref.row;
-                range_ref.bottom = ref.row;
-                return range_ref;
-            }
-            case ReferenceType::Range:
-            {
-                RangeReference ref = std::get<RangeReference>(reference.ref);
-                RangeRef range_ref;
-                range_ref.left = ref.left;
-                range_ref.right = ref.right;
-                range_ref.top = ref.top;
-                range_ref.bottom = ref.bottom;
-                return range_ref;
-            }
-            default:
-                return Error{ErrorCode::Value};
-            }
-        }
-        else if (need == EvalNeed::Scalar)
-        {
-            const auto &reference = std::get<Reference>(node->node);
-            switch (reference.type)
-            {
-            case ReferenceType::Cell:
-            {
-                // pls fix bounds checking
-                CellReference ref = std::get<CellReference>(reference.ref);
-                auto it = evalCtx.cell_map->find(RC{ref.row, ref.col});
-                if (it != evalCtx.cell_map->end())
-                {
-                    return it->second;
-                }
-                else
-                {
-                    return Blank{};
-                }
-            }
-            case ReferenceType::Range:
-            {
-                return Error{ErrorCode::Value};
-            }
-            default:
-                return Error{ErrorCode::Value};
-            }
-        }
+        const auto &reference = std::get<Reference>(node->node);
+        if (reference.deleted)
+            return Error{ErrorCode::Ref};
+        RangeRef range_ref = EVAL_resolve(reference, evalCtx);
+        // pls fix upper bounds checking
+        // the one place a sheet id is checked, every range handed on reads a store that exists
+        const SheetStore *sheet = sheetOf(evalCtx, range_ref);
+        if (range_ref.top < 1 || range_ref.left < 1 || !sheet)
+            return Error{ErrorCode::Ref};
+        // ranges evaluate to themselves like the ':' operator does, functions take them as is
+        if (need == EvalNeed::RefLike || reference.type == ReferenceType::Range)
+            return range_ref;
+        return sheet->get(RC{range_ref.top, range_ref.left});
+    }
+    case ASTNodeType::Name:
+    {
+        int slot = std::get<Name>(node->node).slot;
+        if (slot < 0 || slot >= static_cast<int>(evalCtx.locals.size()))
+            return Error{ErrorCode::Name};
+        return evalCtx.locals[slot];
     }
     case ASTNodeType::FunctionCall:
     {
         const auto &function_call = std::get<FunctionCall>(node->node);
+        if (function_call.form != SpecialForm::None)
+            return evalSpecialForm(node, need, evalCtx);
+        const auto *sig = funcs::lookup(function_call.identifier);
+        if (!sig)
+            return Error{ErrorCode::Name};
         std::vector<Value> evaluated_args;
-        // evaluate args
+        // evaluate args, reference params get the reference and not the cells behind it
         for (int i = 0; i < function_call.args.size(); i++)
         {
-            evaluated_args.push_back(evalScalar(function_call.args[i].get(), evalCtx));
+            const funcs::Param *param = sig->paramAt(i);
+            if (param && param->byReference())
+                evaluated_args.push_back(evalRefLike(function_call.args[i].get(), evalCtx));
+            else
+                evaluated_args.push_back(evalScalar(function_call.args[i].get(), evalCtx));
         }
 
-        // type check args
-        const auto *sig = funcs::lookup(function_call.identifier);
-        if (!sig)
-            return Error{ErrorCode::Name};
-        if (!argsMatchSignature(sig, evaluated_args))
-            return Error{ErrorCode::Value};
-        return sig->eval_function(evaluated_args, evalCtx);
+        Value result = callFunction(sig, evaluated_args, evalCtx);
+        if (sig->returnsRef && std::holds_alternative<RangeRef>(result))
+        {
+            const RangeRef range = std::get<RangeRef>(result);
+            if (evalCtx.dynamic_reads)
+                evalCtx.dynamic_reads->push_back(range);
+            // a lone cell is read where a value is wanted, the same as a cell reference
+            if (need == EvalNeed::Scalar && range.top == range.bottom && range.left == range.right)
+                return sheetOf(evalCtx, range)->get(RC{range.top, range.left});
+        }
+        return result;
     }
     default:
         return Error{ErrorCode::Value};
@@ -1,11 +1,33 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
 #include "GPFETypes.h"
 #include "EvalTypes.h"
+#include "FunctionRegistry.h"
 #include <map>
 
 class Evaluator
 {
 public:
     Value evaluateNode(const ASTNode *node, EvalNeed need, EvalContext &evalCtx);
+    // evaluates a formula for the cell it lives in, relative references resolve against cell
+    Value evaluateAt(const ASTNode *root, RC cell, EvalContext &evalCtx);
     Value evalScalar(const ASTNode *node, EvalContext &evalCtx);
     Value evalRefLike(const ASTNode *node, EvalContext &evalCtx);
-};
\ No newline at end of file
+
+private:
+    int depth_ = 0; // evaluateNode nesting, 0 means a new formula evaluation starts
+    Value evaluateUncached(const ASTNode *node, EvalNeed need, EvalContext &evalCtx);
+    Value evalSpecialForm(const ASTNode *node, EvalNeed need, EvalContext &evalCtx);
+};
+
+// scalar operator semantics, shared by the tree walker and the batch evaluator
+Value applyBinary(BinaryOp op, const Value &left, const Value &right); // not BinaryOp::Range
+Value applyUnary(UnaryOp op, const Value &operand);
+// identical values, not formula equality: same kind and same contents, text compares exactly
+bool sameValue(const Value &a, const Value &b);
+bool argsMatchSignature(const funcs::FunctionSignature *sig, const std::vector<Value> &args);
+// checks args against the signature at runtime and dispatches to the builtin or plugin
+Value callFunction(const funcs::FunctionSignature *sig, const std::vector<Value> &args, EvalContext &evalCtx);
+
+#endif
@@ -0,0 +1,277 @@
+#include "FormulaCache.h"
+#include "GPFEHelpers.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "TypeChecker.h"
+#include <bit>
+#include <charconv>
+
+std::string normalizedKey(const std::vector<Token> &tokens, RC anchor, const SheetNames *sheets)
+{
+    std::string key;
+    auto qualify = [&](const Token &token)
+    {
+        if (token.sheet.empty())
+            return;
+        int id = sheets ? sheets->find(token.sheet) : -1;
+        if (id < 0)
+            throw std::runtime_error("UNKNOWN SHEET: " + token.sheet);
+        key += "!" + std::to_string(id);
+    };
+    for (const auto &token : tokens)
+    {
+        if (token.type == EOF_TOKEN)
+            break;
+        // token type keeps keys unambiguous without having to escape the text
+        key.push_back(static_cast<char>('A' + token.type));
+        switch (token.type)
+        {
+        case REFERENCE_TOKEN:
+        {
+            CellReference ref = cellRefFromA1(token.token);
+            key += "R[" + std::to_string(ref.row - anchor.first) + "]C[" + std::to_string(ref.col - anchor.second) + "]";
+            qualify(token);
+            break;
+        }
+        case RANGE_TOKEN:
+        {
+            // whole columns/rows are only relative along the axis they name
+            RangeReference ref = rangeRefFromA1(token.token);
+            std::string rows = "R[" + std::to_string(ref.top - anchor.first) + "]:R[" + std::to_string(ref.bottom - anchor.first) + "]";
+            std::string cols = "C[" + std::to_string(ref.left - anchor.second) + "]:C[" + std::to_string(ref.right - anchor.second) + "]";
+            if (ref.whole_cols)
+                key += cols;
+            else if (ref.whole_rows)
+                key += rows;
+            else
+                key += rows + cols;
+            qualify(token);
+            break;
+        }
+        case IDENT_TOKEN:
+            for (char c : token.token)
+                key.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+            break;
+        case STRING_TOKEN:
+            key += std::to_string(token.token.size());
+            key.push_back(':');
+            key += token.token;
+            break;
+        default:
+            key += token.token;
+            break;
+        }
+    }
+    return key;
+}
+
+void makeRelative(ASTNode *node, RC anchor)
+{
+    if (node->type == ASTNodeType::Reference)
+    {
+        auto &reference = std::get<Reference>(node->node);
+        if (reference.type == ReferenceType::Cell)
+        {
+            auto &ref = std::get<CellReference>(reference.ref);
+            if (!ref.relative)
+            {
+                ref.row -= anchor.first;
+                ref.col -= anchor.second;
+                ref.relative = true;
+            }
+        }
+        else
+        {
+            auto &ref = std::get<RangeReference>(reference.ref);
+            if (!ref.relative)
+            {
+                if (!ref.whole_cols)
+                {
+                    ref.top -= anchor.first;
+                    ref.bottom -= anchor.first;
+                }
+                if (!ref.whole_rows)
+                {
+                    ref.left -= anchor.second;
+                    ref.right -= anchor.second;
+                }
+                ref.relative = true;
+            }
+        }
+        return;
+    }
+    forEachChild(node, [&](ASTNode *child)
+                 { makeRelative(child, anchor); });
+}
+
+static ASTNode cloneNode(const ASTNode &node)
+{
+    ASTNode copy;
+    copy.type = node.type;
+    copy.inferredType = node.inferredType;
+    copy.cseSlot = node.cseSlot;
+    copy.isVolatile = node.isVolatile;
+    auto child = [](const std::unique_ptr<ASTNode> &n)
+    { return std::make_unique<ASTNode>(cloneNode(*n)); };
+    switch (node.type)
+    {
+    case ASTNodeType::Unary:
+    {
+        const auto &unary_op = std::get<UnaryOperation>(node.node);
+        copy.node = UnaryOperation{unary_op.op, child(unary_op.operand)};
+        break;
+    }
+    case ASTNodeType::Binary:
+    {
+        const auto &binary_op = std::get<BinaryOperation>(node.node);
+        copy.node = BinaryOperation{binary_op.op, child(binary_op.left), child(binary_op.right)};
+        break;
+    }
+    case ASTNodeType::FunctionCall:
+    {
+        const auto &call = std::get<FunctionCall>(node.node);
+        FunctionCall out{call.identifier, {}, call.form};
+        for (const auto &arg : call.args)
+            out.args.push_back(child(arg));
+        copy.node = std::move(out);
+        break;
+    }
+    case ASTNodeType::Literal:
+        copy.node = std::get<Literal>(node.node);
+        break;
+    case ASTNodeType::Reference:
+        copy.node = std::get<Reference>(node.node);
+        break;
+    case ASTNodeType::Name:
+        copy.node = std::get<Name>(node.node);
+        break;
+    }
+    return copy;
+}
+
+// key of a rewritten tree, starts with '~' so it can't collide with token keys
+static void treeKey(const ASTNode *node, std::string &key)
+{
+    key.push_back(static_cast<char>('0' + static_cast<int>(node->type)));
+    switch (node->type)
+    {
+    case ASTNodeType::Literal:
+    {
+        const auto &lit = std::get<Literal>(node->node);
+        if (lit.type == LiteralType::Numeric)
+        {
+            // the exact bits, a decimal rendering would give different literals the same key
+            char bits[16];
+            key.append(bits, std::to_chars(bits, bits + sizeof bits, std::bit_cast<uint64_t>(std::get<double>(lit.value)), 16).ptr);
+        }
+        else
+            key += "\"" + std::to_string(std::get<InternedText>(lit.value).id);
+        break;
+    }
+    case ASTNodeType::Reference:
+    {
+        const auto &reference = std::get<Reference>(node->node);
+        if (reference.sheet >= 0)
+            key += "!" + std::to_string(reference.sheet);
+        if (reference.deleted)
+        {
+            key += "#REF";
+        }
+        else if (reference.type == ReferenceType::Cell)
+        {
+            const auto &ref = std::get<CellReference>(reference.ref);
+            key += "R[" + std::to_string(ref.row) + "]C[" + std::to_string(ref.col) + "]";
+        }
+        else
+        {
+            const auto &ref = std::get<RangeReference>(reference.ref);
+            key += "R[" + std::to_string(ref.top) + "]:R[" + std::to_string(ref.bottom) + "]C[" + std::to_string(ref.left) + "]:C[" + std::to_string(ref.right) + "]";
+            key += ref.whole_cols ? "c" : ref.whole_rows ? "r" : "";
+        }
+        break;
+    }
+    case ASTNodeType::Unary:
+        key += std::to_string(static_cast<int>(std::get<UnaryOperation>(node->node).op));
+        break;
+    case ASTNodeType::Binary:
+        key += std::to_string(static_cast<int>(std::get<BinaryOperation>(node->node).op));
+        break;
+    case ASTNodeType::FunctionCall:
+        key += std::get<FunctionCall>(node->node).identifier;
+        break;
+    case ASTNodeType::Name:
+        key += std::get<Name>(node->node).identifier;
+        break;
+    }
+    key.push_back('(');
+    forEachChild(node, [&](const ASTNode *child)
+                 { treeKey(child, key); key.push_back(','); });
+    key.push_back(')');
+}
+
+FormulaHandle FormulaCache::rewrite(FormulaHandle handle, int sheet, RC anchor, RC new_anchor, const StructuralEdit &edit)
+{
+    // type and CSE slots carry over, rewriting maps equal references to equal references
+    ASTNode root = cloneNode(formulas_[handle].root);
+    rewriteReferences(&root, sheet, anchor, new_anchor, edit);
+    std::string key = "~";
+    treeKey(&root, key);
+    if (auto it = by_key_.find(key); it != by_key_.end())
+    {
+        hits_++;
+        return it->second;
+    }
+    const CompiledFormula &source = formulas_[handle];
+    FormulaHandle rewritten = static_cast<FormulaHandle>(formulas_.size());
+    CompiledFormula &compiled = formulas_.emplace_back();
+    compiled.key = key;
+    compiled.root = std::move(root);
+    compiled.local_slots = source.local_slots;
+    compiled.cse_slots = source.cse_slots;
+    compiled.cse_stats = source.cse_stats;
+    by_key_.emplace(std::move(key), rewritten);
+    return rewritten;
+}
+
+FormulaHandle FormulaCache::compile(const std::string &formula, RC anchor, const SheetNames *sheets)
+{
+    Lexer lexer(formula);
+    std::vector<Token> tokens = lexer.tokenize();
+    std::string key = normalizedKey(tokens, anchor, sheets);
+    if (auto it = by_key_.find(key); it != by_key_.end())
+    {
+        hits_++;
+        return it->second;
+    }
+
+    Parser parser(tokens, sheets);
+    ASTNode root = parser.parse();
+    makeRelative(&root, anchor);
+    TypeChecker type_checker;
+    type_checker.infer(&root);
+    CSEPass cse;
+    CSEStats cse_stats = cse.run(&root);
+
+    FormulaHandle handle = static_cast<FormulaHandle>(formulas_.size());
+    CompiledFormula &compiled = formulas_.emplace_back();
+    compiled.key = key;
+    compiled.root = std::move(root);
+    compiled.local_slots = type_checker.slotCount();
+    compiled.cse_slots = cse.slotCount();
+    compiled.cse_stats = cse_stats;
+    by_key_.emplace(std::move(key), handle);
+    return handle;
+}
+
+FormulaHandle FormulaCache::adopt(CompiledFormula compiled)
+{
+    if (auto it = by_key_.find(compiled.key); it != by_key_.end())
+    {
+        hits_++;
+        return it->second;
+    }
+    FormulaHandle handle = static_cast<FormulaHandle>(formulas_.size());
+    by_key_.emplace(compiled.key, handle);
+    formulas_.push_back(std::move(compiled));
+    return handle;
+}
@@ -0,0 +1,66 @@
+#ifndef FORMULA_CACHE_H
+#define FORMULA_CACHE_H
+
+#include "GPFETypes.h"
+#include "EvalTypes.h"
+#include "CSE.h"
+#include "StructuralEdit.h"
+#include "SheetNames.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+using FormulaHandle = uint32_t;
+
+// a lexed, parsed, type checked and CSE'd formula with references stored as offsets from the cell
+// it is evaluated in, so every fill-down copy (=B2*C2, =B3*C3, ...) shares one CompiledFormula
+struct CompiledFormula
+{
+    std::string key; // position independent (R1C1 style) form
+    ASTNode root;
+    int local_slots = 0;
+    int cse_slots = 0;
+    CSEStats cse_stats;
+};
+
+// what a formula cell stores, the anchor is the cell's own position
+struct FormulaCell
+{
+    FormulaHandle handle;
+    RC anchor;
+};
+
+class FormulaCache
+{
+public:
+    // returns the handle of an existing program when the normalized form was seen before,
+    // only distinct formulas are parsed and type checked
+    // sheets resolves Sheet1!A1 style references, programs are shared across sheets
+    FormulaHandle compile(const std::string &formula, RC anchor, const SheetNames *sheets = nullptr);
+    // the program of a formula on sheet moved from anchor to new_anchor by a structural edit, a
+    // copy of handle with its references rewritten, shared like compiled ones
+    FormulaHandle rewrite(FormulaHandle handle, int sheet, RC anchor, RC new_anchor, const StructuralEdit &edit);
+    // a program restored from a snapshot (see Snapshot.h) as it was compiled, the handle of an
+    // existing program with the same key otherwise
+    FormulaHandle adopt(CompiledFormula compiled);
+    const CompiledFormula &get(FormulaHandle handle) const { return formulas_[handle]; }
+    size_t size() const { return formulas_.size(); }
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return formulas_.size(); }
+
+private:
+    std::deque<CompiledFormula> formulas_; // stable addresses, handles index into it
+    std::unordered_map<std::string, FormulaHandle> by_key_;
+    size_t hits_ = 0;
+};
+
+// key for a token stream with every A1 reference rewritten as R[dr]C[dc] from anchor, and the
+// sheet names of qualified references replaced by their ids
+std::string normalizedKey(const std::vector<Token> &tokens, RC anchor, const SheetNames *sheets = nullptr);
+
+// rewrites the absolute references under node as offsets from anchor
+void makeRelative(ASTNode *node, RC anchor);
+
+#endif
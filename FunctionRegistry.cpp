@@ -1,47 +1,189 @@
 #include "FunctionRegistry.h"
+#include "Random.h"
+#include "SheetStore.h"
+#include "RangeView.h"
+#include "AggregateViews.h"
+#include "SheetNames.h"
+#include "StringPool.h"
+#include "NumberFormat.h"
+#include "GPFEHelpers.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <unordered_map>
-#include <iostream>
+#include <stdexcept>
 
-Value fn_SUM(const std::vector<Value> &args, EvalContext &evalCtx)
+// four independent accumulators so the loop isn't one long dependency chain and vectorizes,
+// non numeric cells hold 0 in the run and add nothing
+static double spanSum(const NumberSpan &span)
 {
-    std::cout << "STARTING SUM\n";
-    Number sum = 0;
-    for (int i = 0; i < args.size(); i++)
+    const double *n = span.numbers;
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = span.begin;
+    for (; i + 4 <= span.end; i += 4)
     {
-        if (std::holds_alternative<Number>(args[i]))
+        s0 += n[i];
+        s1 += n[i + 1];
+        s2 += n[i + 2];
+        s3 += n[i + 3];
+    }
+    for (; i < span.end; i++)
+        s0 += n[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+static void spanExtrema(const NumberSpan &span, double &lo, double &hi)
+{
+    const double *n = span.numbers;
+    if (span.count() == span.end - span.begin)
+    {
+        // dense run, no mask test in the loop
+        double lo0 = lo, lo1 = lo, hi0 = hi, hi1 = hi;
+        int i = span.begin;
+        for (; i + 2 <= span.end; i += 2)
         {
-            sum += std::get<Number>(args[i]);
+            lo0 = std::min(lo0, n[i]);
+            lo1 = std::min(lo1, n[i + 1]);
+            hi0 = std::max(hi0, n[i]);
+            hi1 = std::max(hi1, n[i + 1]);
         }
-        else if (std::holds_alternative<RangeRef>(args[i]))
+        for (; i < span.end; i++)
         {
-            RangeRef range = std::get<RangeRef>(args[i]);
-            for (int r = range.left; r <= range.right; r++)
+            lo0 = std::min(lo0, n[i]);
+            hi0 = std::max(hi0, n[i]);
+        }
+        lo = std::min(lo0, lo1);
+        hi = std::max(hi0, hi1);
+        return;
+    }
+    for (int i = span.begin; i < span.end; i++)
+    {
+        if (!span.valid(i))
+            continue;
+        lo = std::min(lo, n[i]);
+        hi = std::max(hi, n[i]);
+    }
+}
+
+// calls on_number for numeric scalar args and array elements and on_span for every numeric run
+// of a range arg, text, bools and blanks inside ranges and arrays are skipped
+// a range with a materialized view goes to on_view instead, extrema asks for its min and max
+template <typename NumberFn, typename SpanFn, typename ViewFn>
+static void forEachNumberArg(const std::vector<Value> &args, EvalContext &evalCtx, bool extrema, NumberFn &&on_number, SpanFn &&on_span, ViewFn &&on_view)
+{
+    for (const auto &arg : args)
+    {
+        if (std::holds_alternative<Number>(arg))
+        {
+            on_number(std::get<Number>(arg));
+        }
+        else if (std::holds_alternative<RangeRef>(arg))
+        {
+            const RangeRef &range = std::get<RangeRef>(arg);
+            // views cover the sheet being evaluated only
+            const SheetStore *sheet = sheetOf(evalCtx, range);
+            const AggregateView *view = evalCtx.aggregate_views && sheet == evalCtx.sheet ? evalCtx.aggregate_views->find(range, *sheet, extrema) : nullptr;
+            if (view)
+                on_view(*view);
+            else
+                RangeView(*sheet, range).forEachNumberSpan(on_span);
+        }
+        else if (std::holds_alternative<Array>(arg))
+        {
+            for (const auto &cell : std::get<Array>(arg).data->cells)
             {
-                for (int c = range.top; c <= range.bottom; c++)
-                {
-                    auto it = evalCtx.cell_map->find(RC{r, c});
-                    if (it != evalCtx.cell_map->end())
-                    {
-                        if (std::holds_alternative<Number>(it->second))
-                            sum += std::get<Number>(it->second);
-                    }
-                }
+                if (std::holds_alternative<Number>(cell))
+                    on_number(std::get<Number>(cell));
             }
         }
     }
-    std::cout << "RETURNING FROM SUM\n";
+}
+
+Value fn_SUM(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    Number sum = 0;
+    forEachNumberArg(args, evalCtx, false, [&](Number x)
+                     { sum += x; }, [&](const NumberSpan &span)
+                     { sum += spanSum(span); }, [&](const AggregateView &view)
+                     { sum += view.total(); });
     return sum;
 };
 
+Value fn_COUNT(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    size_t count = 0;
+    forEachNumberArg(args, evalCtx, false, [&](Number)
+                     { count++; }, [&](const NumberSpan &span)
+                     { count += span.count(); }, [&](const AggregateView &view)
+                     { count += view.count; });
+    return static_cast<Number>(count);
+}
+
+Value fn_AVERAGE(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    Number sum = 0;
+    size_t count = 0;
+    forEachNumberArg(args, evalCtx, false, [&](Number x)
+                     { sum += x; count++; }, [&](const NumberSpan &span)
+                     { sum += spanSum(span); count += span.count(); }, [&](const AggregateView &view)
+                     { sum += view.total(); count += view.count; });
+    if (!count)
+        return Error{ErrorCode::Div0};
+    return sum / count;
+}
+
+// MIN and MAX of nothing numeric are 0
+static Value minOrMax(const std::vector<Value> &args, EvalContext &evalCtx, bool want_max)
+{
+    Number lo = HUGE_VAL;
+    Number hi = -HUGE_VAL;
+    bool any = false;
+    forEachNumberArg(args, evalCtx, true, [&](Number x)
+                     { lo = std::min(lo, x); hi = std::max(hi, x); any = true; }, [&](const NumberSpan &span)
+                     {
+        if (span.count())
+        {
+            spanExtrema(span, lo, hi);
+            any = true;
+        } }, [&](const AggregateView &view)
+                     {
+        if (view.count)
+        {
+            lo = std::min(lo, view.min);
+            hi = std::max(hi, view.max);
+            any = true;
+        } });
+    if (!any)
+        return 0.0;
+    return want_max ? hi : lo;
+}
+
+Value fn_MIN(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    return minOrMax(args, evalCtx, false);
+}
+
+Value fn_MAX(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    return minOrMax(args, evalCtx, true);
+}
+
 Value fn_LEN(const std::vector<Value> &args, EvalContext &evalCtx)
 {
-    // pls fix len should attemp type coercion
     if (!args.size())
         throw std::runtime_error("LEN should never receive no args and reach this pont of execution");
-    if (std::holds_alternative<Text>(args[0]))
+    if (isText(args[0]))
+    {
+        return 1.0 * textView(args[0]).size();
+    }
+    // numbers and bools are measured as the text they concatenate as
+    if (std::holds_alternative<Number>(args[0]))
     {
-        return 1.0 * std::get<Text>(args[0]).size();
+        char buf[numfmt::max_chars];
+        return 1.0 * (numfmt::format(std::get<Number>(args[0]), buf) - buf);
     }
+    if (std::holds_alternative<Bool>(args[0]))
+        return std::get<Bool>(args[0]) ? 4.0 : 5.0;
     return 0.0;
 };
 
@@ -51,7 +193,6 @@ Value fn_IF(const std::vector<Value> &args, EvalContext &evalCtx)
         throw std::runtime_error("IF should never not receive 3 args and reach this pont of execution");
     if (std::holds_alternative<Bool>(args[0]))
     {
-        std::cout << std::get<Bool>(args[0]) << "\n";
         if (std::get<Bool>(args[0]))
         {
             return args[1];
@@ -64,25 +205,436 @@ Value fn_IF(const std::vector<Value> &args, EvalContext &evalCtx)
     return Blank{};
 }
 
+static Number nextRandom(EvalContext &evalCtx)
+{
+    return rng::uniform(evalCtx.rand_seed, evalCtx.recalc_epoch, evalCtx.current_cell.first, evalCtx.current_cell.second, evalCtx.rand_draws++);
+}
+
+Value fn_RAND(const std::vector<Value> &, EvalContext &evalCtx)
+{
+    return nextRandom(evalCtx);
+}
+
+Value fn_RANDBETWEEN(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    if (args.size() != 2)
+        throw std::runtime_error("RANDBETWEEN should never not receive 2 args and reach this pont of execution");
+    if (!std::holds_alternative<Number>(args[0]) || !std::holds_alternative<Number>(args[1]))
+        return Error{ErrorCode::Value};
+    Number bottom = std::ceil(std::get<Number>(args[0]));
+    Number top = std::floor(std::get<Number>(args[1]));
+    if (bottom > top)
+        return Error{ErrorCode::Num};
+    return bottom + std::floor(nextRandom(evalCtx) * (top - bottom + 1));
+}
+
+// RANDARRAY([rows], [cols], [min], [max], [whole_number])
+Value fn_RANDARRAY(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    if (args.size() > 5)
+        return Error{ErrorCode::Value};
+    Number numbers[4] = {1, 1, 0, 1};
+    bool whole_number = false;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (std::holds_alternative<Blank>(args[i]))
+            continue; // omitted, keep the default
+        if (i == 4)
+        {
+            if (std::holds_alternative<Bool>(args[i]))
+                whole_number = std::get<Bool>(args[i]);
+            else if (std::holds_alternative<Number>(args[i]))
+                whole_number = std::get<Number>(args[i]) != 0.0;
+            else
+                return Error{ErrorCode::Value};
+        }
+        else
+        {
+            if (!std::holds_alternative<Number>(args[i]))
+                return Error{ErrorCode::Value};
+            numbers[i] = std::get<Number>(args[i]);
+        }
+    }
+    int rows = static_cast<int>(numbers[0]);
+    int cols = static_cast<int>(numbers[1]);
+    Number min = numbers[2];
+    Number max = numbers[3];
+    if (whole_number)
+    {
+        min = std::ceil(min);
+        max = std::floor(max);
+    }
+    if (rows < 1 || cols < 1 || min > max)
+        return Error{ErrorCode::Value};
+    if (static_cast<int64_t>(rows) * cols > (1 << 24))
+        return Error{ErrorCode::Num};
+
+    auto data = std::make_shared<ArrayData>();
+    data->cells.reserve(static_cast<size_t>(rows) * cols);
+    for (int i = 0; i < rows * cols; i++)
+    {
+        Number u = nextRandom(evalCtx);
+        if (whole_number)
+            data->cells.push_back(min + std::floor(u * (max - min + 1)));
+        else
+            data->cells.push_back(min + u * (max - min));
+    }
+    return Array{rows, cols, std::move(data)};
+}
+
+// the reference functions below return where to read, never what is there, the evaluator reads a
+// lone cell when a value is wanted and hands ranges to callers like SUM to stream over
+
+// truncates like Excel does for row and column arguments
+static bool wholeNumber(const Value &v, int &out)
+{
+    if (!std::holds_alternative<Number>(v))
+        return false;
+    Number n = std::trunc(std::get<Number>(v));
+    if (std::abs(n) > max_rows)
+        return false;
+    out = static_cast<int>(n);
+    return true;
+}
+
+static bool onSheet(const RangeRef &range)
+{
+    return range.top >= 1 && range.left >= 1 && range.bottom <= max_rows && range.right <= max_cols;
+}
+
+// OFFSET(reference, rows, cols, [height], [width])
+Value fn_OFFSET(const std::vector<Value> &args, EvalContext &)
+{
+    if (args.size() < 3 || args.size() > 5 || !std::holds_alternative<RangeRef>(args[0]))
+        return Error{ErrorCode::Value};
+    const RangeRef &base = std::get<RangeRef>(args[0]);
+    int rows = 0, cols = 0;
+    int height = base.bottom - base.top + 1;
+    int width = base.right - base.left + 1;
+    if (!wholeNumber(args[1], rows) || !wholeNumber(args[2], cols))
+        return Error{ErrorCode::Value};
+    if ((args.size() > 3 && !wholeNumber(args[3], height)) || (args.size() > 4 && !wholeNumber(args[4], width)))
+        return Error{ErrorCode::Value};
+    if (height < 1 || width < 1)
+        return Error{ErrorCode::Ref};
+    RangeRef moved{};
+    moved.sheet = base.sheet;
+    moved.top = base.top + rows;
+    moved.left = base.left + cols;
+    moved.bottom = moved.top + height - 1;
+    moved.right = moved.left + width - 1;
+    if (!onSheet(moved))
+        return Error{ErrorCode::Ref};
+    return moved;
+}
+
+// INDEX(range, row, [col]), 0 for row or col selects the whole column or row
+// a single row range takes its one index as the column, arrays give back the element itself
+Value fn_INDEX(const std::vector<Value> &args, EvalContext &)
+{
+    if (args.size() < 2 || args.size() > 3)
+        return Error{ErrorCode::Value};
+    int row = 0, col = 0;
+    if (!wholeNumber(args[1], row) || (args.size() == 3 && !wholeNumber(args[2], col)))
+        return Error{ErrorCode::Value};
+    int height, width;
+    if (const RangeRef *range = std::get_if<RangeRef>(&args[0]))
+    {
+        height = range->bottom - range->top + 1;
+        width = range->right - range->left + 1;
+    }
+    else
+    {
+        const Array &array = std::get<Array>(args[0]);
+        height = array.rows;
+        width = array.cols;
+    }
+    if (args.size() == 2 && height == 1)
+        std::swap(row, col);
+    if (row < 0 || col < 0 || row > height || col > width)
+        return Error{ErrorCode::Ref};
+
+    if (const Array *array = std::get_if<Array>(&args[0]))
+    {
+        if ((!row && height > 1) || (!col && width > 1))
+            return Error{ErrorCode::Value};
+        return array->data->cells[static_cast<size_t>(std::max(row, 1) - 1) * width + std::max(col, 1) - 1];
+    }
+    RangeRef picked = std::get<RangeRef>(args[0]);
+    if (row)
+        picked.top = picked.bottom = picked.top + row - 1;
+    if (col)
+        picked.left = picked.right = picked.left + col - 1;
+    return picked;
+}
+
+// INDIRECT(text), A1 style only, "$" anchors are accepted and ignored, a Sheet1! or 'My Sheet'!
+// prefix picks the sheet
+Value fn_INDIRECT(const std::vector<Value> &args, EvalContext &evalCtx)
+{
+    if (args.size() != 1 || !isText(args[0]))
+        return Error{ErrorCode::Value};
+    std::string_view text = textView(args[0]);
+    RangeRef target{};
+    if (size_t bang = text.rfind('!'); bang != std::string_view::npos)
+    {
+        std::string name;
+        std::string_view prefix = text.substr(0, bang);
+        if (prefix.size() >= 2 && prefix.front() == '\'' && prefix.back() == '\'')
+        {
+            // '' is a quote inside the name
+            prefix = prefix.substr(1, prefix.size() - 2);
+            for (size_t i = 0; i < prefix.size(); i++)
+            {
+                name.push_back(prefix[i]);
+                if (prefix[i] == '\'' && i + 1 < prefix.size() && prefix[i + 1] == '\'')
+                    i++;
+            }
+        }
+        else
+        {
+            name = prefix;
+        }
+        target.sheet = evalCtx.sheet_names ? evalCtx.sheet_names->find(name) : -1;
+        if (target.sheet < 0)
+            return Error{ErrorCode::Ref};
+        text = text.substr(bang + 1);
+    }
+    std::string address;
+    for (char c : text)
+        if (c != '$')
+            address.push_back(c);
+    try
+    {
+        if (address.find(':') == std::string::npos)
+        {
+            CellReference cell = cellRefFromA1(address);
+            target.top = target.bottom = cell.row;
+            target.left = target.right = cell.col;
+        }
+        else
+        {
+            RangeReference range = rangeRefFromA1(address);
+            target.top = range.top;
+            target.bottom = range.bottom;
+            target.left = range.left;
+            target.right = range.right;
+        }
+    }
+    catch (const std::runtime_error &)
+    {
+        return Error{ErrorCode::Ref};
+    }
+    if (!onSheet(target))
+        return Error{ErrorCode::Ref};
+    return target;
+}
+
 namespace funcs
 {
 
-    static const std::unordered_map<std::string, FunctionSignature> &table()
+    static constexpr FunctionSignature builtins[] = {
+        {"SUM", {Param{ArgKind::Number, ArgKind::Ref, ArgKind::Range}}, true, BaseType::Number, fn_SUM},
+        {"COUNT", {Param{ArgKind::Number, ArgKind::Ref, ArgKind::Range}}, true, BaseType::Number, fn_COUNT},
+        {"AVERAGE", {Param{ArgKind::Number, ArgKind::Ref, ArgKind::Range}}, true, BaseType::Number, fn_AVERAGE},
+        {"MIN", {Param{ArgKind::Number, ArgKind::Ref, ArgKind::Range}}, true, BaseType::Number, fn_MIN},
+        {"MAX", {Param{ArgKind::Number, ArgKind::Ref, ArgKind::Range}}, true, BaseType::Number, fn_MAX},
+        {"LEN", {Param{ArgKind::AnyScalar}}, false, BaseType::Number, fn_LEN},
+        {"IF", {Param{ArgKind::Bool}, Param{ArgKind::AnyScalar}, Param{ArgKind::AnyScalar}}, false, BaseType::Unknown, fn_IF},
+        {"RAND", {}, false, BaseType::Number, fn_RAND, true},
+        {"RANDBETWEEN", {Param{ArgKind::Number}, Param{ArgKind::Number}}, false, BaseType::Number, fn_RANDBETWEEN, true},
+        {"RANDARRAY", {Param{ArgKind::Number, ArgKind::Bool}}, true, BaseType::Array, fn_RANDARRAY, true},
+        {"OFFSET", {Param{ArgKind::Ref, ArgKind::Range}, Param{ArgKind::Number}, Param{ArgKind::Number}}, true, BaseType::Unknown, fn_OFFSET, false, true},
+        {"INDEX", {Param{ArgKind::Ref, ArgKind::Range}, Param{ArgKind::Number}}, true, BaseType::Unknown, fn_INDEX, false, true},
+        {"INDIRECT", {Param{ArgKind::Text}}, false, BaseType::Unknown, fn_INDIRECT, false, true},
+    };
+
+    constexpr size_t builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+
+    constexpr char foldUpper(char c)
+    {
+        return ('a' <= c && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+
+    // FNV-1a over the uppercased name, lookups are case insensitive
+    constexpr uint64_t hashName(std::string_view name)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : name)
+        {
+            h ^= static_cast<unsigned char>(foldUpper(c));
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    constexpr bool namesEqual(std::string_view upper, std::string_view name)
+    {
+        if (upper.size() != name.size())
+            return false;
+        for (size_t i = 0; i < name.size(); i++)
+            if (upper[i] != foldUpper(name[i]))
+                return false;
+        return true;
+    }
+
+    // hash and displace perfect hash built at compile time
+    // bucket = h % buckets picks a displacement d, slot = mix(h, d) & (slots - 1)
+    template <size_t N>
+    struct PerfectHashTable
     {
-        static const std::unordered_map<std::string, FunctionSignature> k = {
-            {"SUM", FunctionSignature{"SUM", {Param{{ArgKind::Number, ArgKind::Ref, ArgKind::Range}}}, true, BaseType::Number, fn_SUM}},
-            {"LEN", FunctionSignature{"LEN", {Param{{ArgKind::Text}}}, false, BaseType::Number, fn_LEN}},
-            {"IF", FunctionSignature{"IF", {Param{{ArgKind::Bool}}, Param{{ArgKind::AnyScalar}}, Param{{ArgKind::AnyScalar}}}, false, BaseType::Unknown, fn_IF}},
-        };
+        static constexpr size_t buckets = N / 4 + 1;
+        static constexpr size_t slots = [] { size_t s = 1; while (s < 2 * N) s <<= 1; return s; }();
+
+        std::array<uint32_t, buckets> displacement{};
+        std::array<int16_t, slots> index{};
+
+        static constexpr size_t bucketOf(uint64_t h) { return h % buckets; }
+        static constexpr size_t slotOf(uint64_t h, uint32_t d)
+        {
+            // murmur3 finalizer so every displacement gives an independent placement
+            uint64_t x = h ^ (static_cast<uint64_t>(d) * 0x9E3779B97F4A7C15ull);
+            x ^= x >> 33;
+            x *= 0xFF51AFD7ED558CCDull;
+            x ^= x >> 33;
+            return x & (slots - 1);
+        }
+    };
+
+    template <size_t N>
+    constexpr PerfectHashTable<N> buildPerfectHash(const FunctionSignature (&sigs)[N])
+    {
+        PerfectHashTable<N> table;
+        for (auto &i : table.index)
+            i = -1;
+
+        std::array<uint64_t, N> hashes{};
+        std::array<size_t, N> bucket_size{};
+        for (size_t i = 0; i < N; i++)
+        {
+            for (size_t j = 0; j < i; j++)
+                if (namesEqual(sigs[j].name, sigs[i].name))
+                    throw "DUPLICATE FUNCTION NAME IN REGISTRY";
+            hashes[i] = hashName(sigs[i].name);
+            bucket_size[PerfectHashTable<N>::bucketOf(hashes[i])]++;
+        }
+
+        // place the largest buckets first while the table is still sparse
+        std::array<size_t, PerfectHashTable<N>::buckets> order{};
+        for (size_t b = 0; b < order.size(); b++)
+            order[b] = b;
+        for (size_t a = 0; a < order.size(); a++)
+            for (size_t b = a + 1; b < order.size(); b++)
+                if (bucket_size[order[b]] > bucket_size[order[a]])
+                    std::swap(order[a], order[b]);
+
+        for (size_t bucket : order)
+        {
+            if (!bucket_size[bucket])
+                break;
+            for (uint32_t d = 0;; d++)
+            {
+                if (d > 100000)
+                    throw "COULD NOT BUILD PERFECT HASH FOR REGISTRY";
+                std::array<size_t, N> placed{};
+                size_t placed_count = 0;
+                bool ok = true;
+                for (size_t i = 0; i < N && ok; i++)
+                {
+                    if (PerfectHashTable<N>::bucketOf(hashes[i]) != bucket)
+                        continue;
+                    size_t slot = PerfectHashTable<N>::slotOf(hashes[i], d);
+                    if (table.index[slot] != -1)
+                        ok = false;
+                    for (size_t p = 0; p < placed_count && ok; p++)
+                        if (placed[p] == slot)
+                            ok = false;
+                    placed[placed_count++] = slot;
+                }
+                if (!ok)
+                    continue;
+                table.displacement[bucket] = d;
+                for (size_t i = 0; i < N; i++)
+                    if (PerfectHashTable<N>::bucketOf(hashes[i]) == bucket)
+                        table.index[PerfectHashTable<N>::slotOf(hashes[i], d)] = static_cast<int16_t>(i);
+                break;
+            }
+        }
+        return table;
+    }
+
+    static constexpr auto builtin_table = buildPerfectHash(builtins);
+
+    // functions registered at runtime (plugins), consulted only when the built-in table misses
+    struct FoldedHash
+    {
+        size_t operator()(std::string_view name) const { return hashName(name); }
+    };
+
+    struct FoldedEq
+    {
+        bool operator()(std::string_view a, std::string_view b) const
+        {
+            if (a.size() != b.size())
+                return false;
+            for (size_t i = 0; i < a.size(); i++)
+                if (foldUpper(a[i]) != foldUpper(b[i]))
+                    return false;
+            return true;
+        }
+    };
+
+    struct RuntimeTable
+    {
+        std::deque<std::string> names; // stable storage for the signature name views
+        std::deque<FunctionSignature> sigs;
+        std::unordered_map<std::string_view, const FunctionSignature *, FoldedHash, FoldedEq> by_name;
+    };
+
+    static RuntimeTable &runtimeTable()
+    {
+        static RuntimeTable k;
         return k;
     }
 
     const FunctionSignature *lookup(std::string_view name)
     {
-        const auto &k = table();
-        if (auto it = k.find(std::string(name)); it != k.end())
-            return &it->second;
+        uint64_t h = hashName(name);
+        uint32_t d = builtin_table.displacement[builtin_table.bucketOf(h)];
+        int16_t idx = builtin_table.index[builtin_table.slotOf(h, d)];
+        if (idx >= 0 && namesEqual(builtins[idx].name, name))
+            return &builtins[idx];
+
+        const auto &runtime = runtimeTable();
+        if (runtime.by_name.empty())
+            return nullptr;
+        if (auto it = runtime.by_name.find(name); it != runtime.by_name.end())
+            return it->second;
         return nullptr;
     }
 
+    const FunctionSignature *registerFunction(const FunctionSignature &sig)
+    {
+        if (sig.name.empty())
+            throw std::runtime_error("CANNOT REGISTER FUNCTION WITHOUT A NAME");
+        if (!sig.eval_function && !sig.native)
+            throw std::runtime_error("CANNOT REGISTER FUNCTION WITHOUT AN ENTRY POINT");
+        if (lookup(sig.name))
+            throw std::runtime_error("FUNCTION ALREADY REGISTERED: " + std::string(sig.name));
+
+        auto &runtime = runtimeTable();
+        std::string &name = runtime.names.emplace_back(sig.name);
+        for (char &c : name)
+            c = foldUpper(c);
+        FunctionSignature &stored = runtime.sigs.emplace_back(sig);
+        stored.name = name;
+        runtime.by_name.emplace(stored.name, &stored);
+        return &stored;
+    }
+
+    void unregisterFunction(std::string_view name)
+    {
+        runtimeTable().by_name.erase(name);
+    }
+
 } // namespace funcs
\ No newline at end of file
@@ -2,14 +2,19 @@
 #define FUNCTION_REGISTRY_H
 
 #include <string>
+#include <string_view>
+#include <array>
 #include <vector>
+#include <cstdint>
+#include <initializer_list>
 #include "GPFETypes.h"
 #include "EvalTypes.h"
+#include "GPFEPlugin.h"
 
 namespace funcs
 {
 
-    enum class ArgKind
+    enum class ArgKind : uint8_t
     {
         Number,
         Text,
@@ -19,12 +24,12 @@ namespace funcs
         Range
     };
 
-    struct Param
+    constexpr uint16_t typeBit(BaseType t)
     {
-        std::vector<ArgKind> anyOf; // allowed kinds
-    };
+        return static_cast<uint16_t>(1u << static_cast<int>(t));
+    }
 
-    inline bool kindMatches(ArgKind k, BaseType t)
+    constexpr bool kindMatches(ArgKind k, BaseType t)
     {
         switch (k)
         {
@@ -39,46 +44,121 @@ namespace funcs
         case ArgKind::Ref:
             return t == BaseType::CellRef; // (no RefAny yet)
         case ArgKind::Range:
-            return t == BaseType::Range;
+            return t == BaseType::Range || t == BaseType::Array;
         }
         return false;
     }
 
-    // allow Unknown and CellRef-as-scalar
-    inline bool matchesParam(const Param &p, BaseType t)
+    // bitset of allowed ArgKinds, plus the BaseTypes they accept precomputed so
+    // signature checks are a single mask test instead of a loop over kinds
+    struct Param
     {
-        if (t == BaseType::Unknown)
-            return true; // defer to runtime
-        // implicit deref: allow CellRef where scalar is expected
-        if (t == BaseType::CellRef)
+        uint8_t anyOf = 0;    // allowed kinds, one bit per ArgKind
+        uint16_t accepts = 0; // allowed BaseTypes, one bit per BaseType
+
+        constexpr Param() = default;
+        constexpr Param(std::initializer_list<ArgKind> kinds)
+        {
+            uint8_t mask = 0;
+            for (auto k : kinds)
+                mask |= static_cast<uint8_t>(1u << static_cast<int>(k));
+            *this = Param(mask);
+        }
+        constexpr explicit Param(uint8_t kind_mask) : anyOf(kind_mask)
         {
-            for (auto k : p.anyOf)
+            // allow Unknown (defer to runtime)
+            accepts = typeBit(BaseType::Unknown);
+            for (int k = 0; k <= static_cast<int>(ArgKind::Range); k++)
             {
-                if (k == ArgKind::Ref)
-                    return true;
-                if (k == ArgKind::Number || k == ArgKind::Text || k == ArgKind::Bool || k == ArgKind::AnyScalar)
-                    return true; // treat as scalar via deref at eval
+                if (!allows(static_cast<ArgKind>(k)))
+                    continue;
+                for (int t = 0; t <= static_cast<int>(BaseType::Array); t++)
+                    if (kindMatches(static_cast<ArgKind>(k), static_cast<BaseType>(t)))
+                        accepts |= typeBit(static_cast<BaseType>(t));
+                // implicit deref: allow CellRef where scalar is expected
+                if (static_cast<ArgKind>(k) != ArgKind::Range)
+                    accepts |= typeBit(BaseType::CellRef);
             }
-            return false;
         }
-        for (auto k : p.anyOf)
-            if (kindMatches(k, t))
-                return true;
-        return false;
+
+        constexpr bool allows(ArgKind k) const { return anyOf & (1u << static_cast<int>(k)); }
+        // only Ref/Range, the argument is passed as the reference itself and a lone cell arrives as a
+        // 1x1 RangeRef instead of the value in it
+        constexpr bool byReference() const
+        {
+            return anyOf && !allows(ArgKind::Number) && !allows(ArgKind::Text) && !allows(ArgKind::Bool) && !allows(ArgKind::AnyScalar);
+        }
+    };
+
+    constexpr bool matchesParam(const Param &p, BaseType t)
+    {
+        return p.accepts & typeBit(t);
     }
 
+    constexpr size_t max_params = 8;
+
+    // fixed capacity parameter list so signatures can live in a constexpr table
+    struct ParamList
+    {
+        std::array<Param, max_params> items{};
+        uint8_t count = 0;
+
+        constexpr ParamList() = default;
+        constexpr ParamList(std::initializer_list<Param> params)
+        {
+            if (params.size() > max_params)
+                throw "TOO MANY PARAMS IN SIGNATURE";
+            for (const auto &p : params)
+                items[count++] = p;
+        }
+
+        constexpr size_t size() const { return count; }
+        constexpr bool empty() const { return count == 0; }
+        constexpr const Param &operator[](size_t i) const { return items[i]; }
+        constexpr const Param &back() const { return items[count - 1]; }
+        constexpr const Param *begin() const { return items.data(); }
+        constexpr const Param *end() const { return items.data() + count; }
+    };
+
     using EvalFn = Value (*)(const std::vector<Value> &, EvalContext &evalCtx);
 
+    // entry points of a function implemented in a loaded plugin (see PluginLoader.h)
+    struct NativeFunction
+    {
+        gpfe_scalar_fn scalar;
+        gpfe_batch_fn batch; // optional, nullptr if the plugin only has a scalar entry point
+        void *user_data;
+    };
+
     struct FunctionSignature
     {
-        std::string name;
-        std::vector<Param> params;
+        std::string_view name;
+        ParamList params;
         bool variableArity;
         BaseType returnType;
         EvalFn eval_function;
+        bool isVolatile = false;                // result can change without its inputs changing (RAND, NOW)
+        bool returnsRef = false;                // result is a RangeRef into the sheet (OFFSET, INDEX, INDIRECT)
+        const NativeFunction *native = nullptr; // set instead of eval_function for plugin functions
+
+        // parameter the i-th argument binds to, null past the end of a fixed signature
+        constexpr const Param *paramAt(size_t i) const
+        {
+            const size_t fixed = variableArity && !params.empty() ? params.size() - 1 : params.size();
+            if (i < fixed)
+                return &params[i];
+            return variableArity && !params.empty() ? &params.back() : nullptr;
+        }
     };
 
     const FunctionSignature *lookup(std::string_view name);
+
+    // adds a function after the built-ins, the name is copied and uppercased
+    // not synchronized with lookup, register everything before evaluation starts
+    const FunctionSignature *registerFunction(const FunctionSignature &sig);
+    // takes a registered function back out, for a plugin whose init failed half way, lookup misses it
+    // afterwards but the signature stays allocated, nothing may have compiled a call to it yet
+    void unregisterFunction(std::string_view name);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,52 @@
+#ifndef GPFE_AOT_H
+#define GPFE_AOT_H
+
+/*
+ * C ABI between the engine and modules produced by the ahead of time code generator.
+ *
+ * A module is a shared object exporting:
+ *     const gpfe_aot_module *gpfe_aot_module_get(void);
+ *
+ * Functions are matched to compiled formulas by their normalized key, so a module built in one
+ * process can be loaded by another that compiled the same formulas in a different order.
+ * Bump GPFE_AOT_ABI_VERSION on any layout or semantic change.
+ */
+
+#include "GPFEPlugin.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define GPFE_AOT_ABI_VERSION 1u
+
+    typedef struct gpfe_aot_cells
+    {
+        /* reads the value stored at (row, col), empty cells are GPFE_BLANK */
+        void (*read)(void *ctx, int32_t row, int32_t col, gpfe_value *out);
+        void *ctx;
+    } gpfe_aot_cells;
+
+    /*
+     * Evaluates one formula for the cell at (row, col). Returns 0 with the result in out, or
+     * nonzero when the inputs need semantics the generated code doesn't have (text) and the
+     * formula must be evaluated by the interpreter instead.
+     */
+    typedef int (*gpfe_aot_fn)(const gpfe_aot_cells *cells, int32_t row, int32_t col, gpfe_value *out);
+
+    typedef struct gpfe_aot_module
+    {
+        uint32_t abi_version;
+        uint32_t count;
+        const char *const *keys; /* CompiledFormula::key of each function */
+        const gpfe_aot_fn *functions;
+    } gpfe_aot_module;
+
+    typedef const gpfe_aot_module *(*gpfe_aot_module_get_fn)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
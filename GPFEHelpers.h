@@ -2,6 +2,9 @@
 #define GPFE_HELPERS_H
 
 #include <string>
+#include <cctype>
+#include <stdexcept>
+#include <utility>
 #include "GPFETypes.h"
 
 inline int colLetterToNumber(const std::string &col)
@@ -18,6 +21,138 @@ inline int colLetterToNumber(const std::string &col)
     return result;
 }
 
+// "B12" -> {12, 2}, throws on malformed refs
+inline CellReference cellRefFromA1(const std::string &s)
+{
+    std::string colLetters;
+    int row = 0;
+    size_t i = 0;
+    while (i < s.size() && std::isalpha(static_cast<unsigned char>(s[i])))
+    {
+        colLetters.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(s[i]))));
+        ++i;
+    }
+    if (colLetters.empty())
+        throw std::runtime_error("INVALID CELL REF: MISSING COLUMN");
+    if (i == s.size() || !std::isdigit(static_cast<unsigned char>(s[i])))
+        throw std::runtime_error("INVALID CELL REF: MISSING ROW");
+    while (i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])))
+    {
+        row = row * 10 + (s[i] - '0');
+        ++i;
+    }
+    if (i != s.size())
+        throw std::runtime_error("INVALID CELL REF: TRAILING CHARS");
+    if (row <= 0)
+        throw std::runtime_error("INVALID CELL REF: ROW MUST BE ≥ 1");
+    return CellReference{row, colLetterToNumber(colLetters)};
+}
+
+// "AB" -> true, letters only and within max_cols
+inline bool isColumnName(const std::string &s)
+{
+    if (s.empty() || s.size() > 3)
+        return false;
+    for (char c : s)
+        if (!std::isalpha(static_cast<unsigned char>(c)))
+            return false;
+    return colLetterToNumber(s) <= max_cols;
+}
+
+// "12" -> true, digits only and within 1..max_rows
+inline bool isRowNumber(const std::string &s)
+{
+    if (s.empty() || s.size() > 7)
+        return false;
+    int row = 0;
+    for (char c : s)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(c)))
+            return false;
+        row = row * 10 + (c - '0');
+    }
+    return 1 <= row && row <= max_rows;
+}
+
+// "A1:B10", "A:C" or "1:5" -> normalized so top <= bottom and left <= right, throws on malformed ranges
+inline RangeReference rangeRefFromA1(const std::string &s)
+{
+    size_t colon = s.find(':');
+    if (colon == std::string::npos || s.find(':', colon + 1) != std::string::npos)
+        throw std::runtime_error("INVALID RANGE REF: EXPECTED ONE ':'");
+    std::string first = s.substr(0, colon);
+    std::string second = s.substr(colon + 1);
+    RangeReference range{};
+    if (isColumnName(first) && isColumnName(second))
+    {
+        range.left = colLetterToNumber(first);
+        range.right = colLetterToNumber(second);
+        range.top = 1;
+        range.bottom = max_rows;
+        range.whole_cols = true;
+    }
+    else if (isRowNumber(first) && isRowNumber(second))
+    {
+        range.top = std::stoi(first);
+        range.bottom = std::stoi(second);
+        range.left = 1;
+        range.right = max_cols;
+        range.whole_rows = true;
+    }
+    else
+    {
+        CellReference a = cellRefFromA1(first);
+        CellReference b = cellRefFromA1(second);
+        range.top = a.row;
+        range.left = a.col;
+        range.bottom = b.row;
+        range.right = b.col;
+    }
+    if (range.top > range.bottom)
+        std::swap(range.top, range.bottom);
+    if (range.left > range.right)
+        std::swap(range.left, range.right);
+    return range;
+}
+
+// calls fn on each direct child, works for ASTNode and const ASTNode
+template <typename Node, typename Fn>
+inline void forEachChild(Node *node, Fn &&fn)
+{
+    switch (node->type)
+    {
+    case ASTNodeType::Unary:
+        fn(std::get<UnaryOperation>(node->node).operand.get());
+        return;
+    case ASTNodeType::Binary:
+    {
+        auto &binary_op = std::get<BinaryOperation>(node->node);
+        fn(binary_op.left.get());
+        fn(binary_op.right.get());
+        return;
+    }
+    case ASTNodeType::FunctionCall:
+        for (auto &arg : std::get<FunctionCall>(node->node).args)
+            fn(arg.get());
+        return;
+    default:
+        return;
+    }
+}
+
+inline SpecialForm specialFormOf(const std::string &identifier)
+{
+    if (identifier == "LET")
+        return SpecialForm::Let;
+    if (identifier == "LAMBDA")
+        return SpecialForm::Lambda;
+    if (identifier == "MAP")
+        return SpecialForm::Map;
+    if (identifier == "REDUCE")
+        return SpecialForm::Reduce;
+    return SpecialForm::None;
+}
+
 inline std::string BinaryOpToString(BinaryOp op)
 {
     switch (op)
@@ -86,6 +221,8 @@ inline std::string BaseTypeToString(BaseType base_type)
         return "Unknown";
     case BaseType::Blank:
         return "Blank";
+    case BaseType::Array:
+        return "Array";
     default:
         return "UNIDENTIFIED TYPE";
     }
@@ -0,0 +1,106 @@
+#ifndef GPFE_PLUGIN_H
+#define GPFE_PLUGIN_H
+
+/*
+ * Stable C ABI for native function plugins.
+ *
+ * A plugin is a shared object exporting:
+ *     uint32_t gpfe_plugin_abi_version(void);          // must return GPFE_PLUGIN_ABI_VERSION
+ *     int gpfe_plugin_init(const gpfe_host *host);      // registers functions, 0 on success
+ *
+ * Only plain C types cross the boundary. Bump GPFE_PLUGIN_ABI_VERSION on any layout change.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define GPFE_PLUGIN_ABI_VERSION 1u
+#define GPFE_MAX_PARAMS 8
+
+    /* value kinds */
+    enum
+    {
+        GPFE_NUMBER = 0,
+        GPFE_BOOL = 1,
+        GPFE_TEXT = 2,
+        GPFE_ERROR = 3,
+        GPFE_BLANK = 4
+    };
+
+    /* error codes, same order as ErrorCode */
+    enum
+    {
+        GPFE_ERR_NONE = 0,
+        GPFE_ERR_VALUE = 1,
+        GPFE_ERR_DIV0 = 2,
+        GPFE_ERR_REF = 3,
+        GPFE_ERR_NAME = 4,
+        GPFE_ERR_NUM = 5,
+        GPFE_ERR_CYCLE = 6,
+        GPFE_ERR_NA = 7
+    };
+
+    /* accepted argument kinds, bitmask in the same order as funcs::ArgKind */
+    enum
+    {
+        GPFE_ARG_NUMBER = 1 << 0,
+        GPFE_ARG_TEXT = 1 << 1,
+        GPFE_ARG_BOOL = 1 << 2,
+        GPFE_ARG_ANY_SCALAR = 1 << 3,
+        GPFE_ARG_REF = 1 << 4 /* reserved, ranges don't cross the ABI and registering it fails */
+    };
+
+    typedef struct gpfe_value
+    {
+        int32_t kind;
+        int32_t error_code; /* GPFE_ERROR only */
+        double number;      /* GPFE_NUMBER, GPFE_BOOL (0 or 1) */
+        const char *text;   /* GPFE_TEXT, not null terminated */
+        size_t text_len;
+    } gpfe_value;
+
+    /*
+     * Scalar entry point: one invocation, returns 0 on success.
+     * Text written to out must stay valid until the plugin is called again on the same thread.
+     */
+    typedef int (*gpfe_scalar_fn)(const gpfe_value *args, size_t argc, gpfe_value *out, void *user_data);
+
+    /*
+     * Batch entry point: `rows` invocations at once. columns[a][r] is argument a of invocation r,
+     * results go to out[r]. Returns 0 on success, per row failures are reported as GPFE_ERROR values.
+     */
+    typedef int (*gpfe_batch_fn)(const gpfe_value *const *columns, size_t argc, size_t rows, gpfe_value *out, void *user_data);
+
+    typedef struct gpfe_function_def
+    {
+        const char *name;
+        uint32_t param_count;
+        uint8_t param_kinds[GPFE_MAX_PARAMS]; /* GPFE_ARG_* bitmask per param */
+        int32_t variadic;                     /* last param repeats */
+        int32_t return_kind;                  /* GPFE_NUMBER, GPFE_BOOL, GPFE_TEXT or -1 if unknown */
+        gpfe_scalar_fn scalar;                /* required unless batch is set */
+        gpfe_batch_fn batch;                  /* optional */
+        void *user_data;
+    } gpfe_function_def;
+
+    typedef struct gpfe_host
+    {
+        uint32_t abi_version;
+        /* returns 0 on success */
+        int (*register_function)(void *host_ctx, const gpfe_function_def *def);
+        void *host_ctx;
+    } gpfe_host;
+
+    typedef uint32_t (*gpfe_plugin_abi_version_fn)(void);
+    typedef int (*gpfe_plugin_init_fn)(const gpfe_host *host);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
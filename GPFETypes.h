@@ -1,11 +1,18 @@
 #ifndef GPFE_TYPES_H
 #define GPFE_TYPES_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 #include <variant>
 
+// sheet bounds, whole column/row ranges span all of the other axis
+constexpr int max_rows = 1048576;
+constexpr int max_cols = 16384;
+// sheet ids fit the spare bits of a cell key, see cellKey(sheet, cell)
+constexpr int max_sheets = 65536;
+
 struct Span
 {
     int start;
@@ -21,7 +28,8 @@ enum class BaseType
     Range,
     Unknown,
     Error,
-    Blank
+    Blank,
+    Array
 };
 
 struct TypeInfo
@@ -54,6 +62,7 @@ enum TOKEN_TYPE
     IDENT_TOKEN,
     LPAREN_TOKEN,
     RPAREN_TOKEN,
+    RANGE_TOKEN, // static range literal, A1:B10, A:A or 1:1
     EOF_TOKEN
 };
 
@@ -100,32 +109,59 @@ enum class ASTNodeType
     Unary,
     Binary,
     FunctionCall,
+    Name,
+};
+
+// calls whose arguments are not evaluated eagerly, resolved by the parser
+enum class SpecialForm
+{
+    None,
+    Let,    // LET(name, value, ..., body)
+    Lambda, // LAMBDA(param, ..., body), only as an argument to MAP/REDUCE
+    Map,    // MAP(array, ..., LAMBDA)
+    Reduce, // REDUCE(initial, array, LAMBDA(acc, x, body))
+};
+
+// handle to a string in the global intern pool (StringPool.h), equal ids mean equal strings
+struct InternedText
+{
+    uint32_t id;
+    bool operator==(const InternedText &other) const { return id == other.id; }
 };
 
 struct Literal
 {
     LiteralType type;
-    std::variant<std::string, double> value;
+    std::variant<InternedText, double> value;
 };
 
+// when relative is set row/col are offsets from the cell being evaluated (R1C1 style)
 struct CellReference
 {
     int row;
     int col;
+    bool relative = false;
 };
 
+// relative applies to the axes the range has endpoints on, whole columns (A:A) keep top and
+// bottom absolute and whole rows (1:1) keep left and right absolute
 struct RangeReference
 {
     int top;
     int left;
     int bottom;
     int right;
+    bool relative = false;
+    bool whole_cols = false;
+    bool whole_rows = false;
 };
 
 struct Reference
 {
     ReferenceType type;
     std::variant<CellReference, RangeReference> ref;
+    int sheet = -1;       // sheet id of a Sheet1!A1 reference, -1 is the sheet of the formula
+    bool deleted = false; // its cells were deleted by a structural edit, evaluates to #REF!
 };
 
 struct ASTNode;
@@ -147,13 +183,23 @@ struct FunctionCall
 {
     std::string identifier;
     std::vector<std::unique_ptr<ASTNode>> args;
+    SpecialForm form = SpecialForm::None;
+};
+
+// identifier that isn't a function call, a LET binding or LAMBDA parameter
+struct Name
+{
+    std::string identifier;
+    int slot = -1; // local storage slot, assigned by the TypeChecker
 };
 
 struct ASTNode
 {
     ASTNodeType type;
-    std::variant<Literal, Reference, UnaryOperation, BinaryOperation, FunctionCall> node;
+    std::variant<Literal, Reference, UnaryOperation, BinaryOperation, FunctionCall, Name> node;
     TypeInfo inferredType = {BaseType::Unknown};
+    int cseSlot = -1;         // shared subexpression cache slot, assigned by CSEPass
+    bool isVolatile = false; // a volatile call (RAND) is in this subtree, set by TypeChecker
 };
 
 struct Token
@@ -162,6 +208,7 @@ struct Token
     std::string token_type_string;
     std::string token;
     Span span;
+    std::string sheet = {}; // Sheet1 of Sheet1!A1, the name as written without quotes
 };
 
 #endif
\ No newline at end of file
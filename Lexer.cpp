@@ -1,12 +1,76 @@
 #include "Lexer.h"
+#include "GPFEHelpers.h"
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 
+// a sheet prefix starting at i, Sheet1! or 'My Sheet'!, sets name and the position of the '!'
+static bool sheetPrefix(const std::string &input, size_t i, std::string &name, size_t &bang)
+{
+    name.clear();
+    if (input[i] == '\'')
+    {
+        for (size_t j = i + 1; j < input.size(); j++)
+        {
+            if (input[j] != '\'')
+            {
+                name.push_back(input[j]);
+                continue;
+            }
+            // '' is a quote inside the name
+            if (j + 1 < input.size() && input[j + 1] == '\'')
+            {
+                name.push_back('\'');
+                j++;
+                continue;
+            }
+            if (j + 1 < input.size() && input[j + 1] == '!')
+            {
+                bang = j + 1;
+                return true;
+            }
+            throw std::runtime_error("QUOTED SHEET NAME MUST BE FOLLOWED BY !");
+        }
+        throw std::runtime_error("SHEET NAME NOT TERMINATED");
+    }
+    if (!isalpha(static_cast<unsigned char>(input[i])) && input[i] != '_')
+        return false;
+    size_t j = i;
+    while (j < input.size() && (isalnum(static_cast<unsigned char>(input[j])) || input[j] == '_' || input[j] == '.'))
+        j++;
+    if (j >= input.size() || input[j] != '!')
+        return false;
+    name = input.substr(i, j - i);
+    bang = j;
+    return true;
+}
+
 std::vector<Token> Lexer::tokenize()
 {
     std::vector<Token> tokens;
     int open_parens = 0;
+    std::string sheet;      // prefix waiting for the reference it qualifies
+    size_t sheet_token = 0; // index that reference's token gets
     for (int i = 0; i < input_.size(); i++)
     {
+        if (!sheet.empty() && tokens.size() > sheet_token)
+        {
+            tokens[sheet_token].sheet = std::move(sheet);
+            sheet.clear();
+        }
+        std::string name;
+        size_t bang;
+        if (sheetPrefix(input_, i, name, bang))
+        {
+            if (!sheet.empty())
+                throw std::runtime_error("SHEET NAME MUST BE FOLLOWED BY A REFERENCE");
+            if (name.empty())
+                throw std::runtime_error("SHEET NAME CANNOT BE EMPTY");
+            sheet = std::move(name);
+            sheet_token = tokens.size();
+            i = static_cast<int>(bang);
+            continue;
+        }
         if (input_[i] == '"')
         {
             int start = i;
@@ -129,7 +193,7 @@ std::vector<Token> Lexer::tokenize()
         {
             if (!tokens.size())
                 throw std::runtime_error("CAN'T START EXPRESSION WITH %");
-            if (tokens[tokens.size() - 1].type != LPAREN_TOKEN && tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != NUMBER_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN)
+            if (tokens[tokens.size() - 1].type != LPAREN_TOKEN && tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != NUMBER_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN && tokens[tokens.size() - 1].type != IDENT_TOKEN)
                 throw std::runtime_error("INCORRECT LEFT OPERAND FOR %");
             tokens.push_back({PERCENT_OPERATOR_TOKEN, "PERCENT OPERATOR", "%", {i, i}});
         }
@@ -220,7 +284,7 @@ std::vector<Token> Lexer::tokenize()
             {
                 if (!tokens.size())
                     throw std::runtime_error("BINARY OPERATOR MUST HAVE LEFT OPERAND");
-                if (tokens[tokens.size() - 1].type != NUMBER_TOKEN && tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN)
+                if (tokens[tokens.size() - 1].type != NUMBER_TOKEN && tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN && tokens[tokens.size() - 1].type != IDENT_TOKEN)
                     throw std::runtime_error("INVALID LEFT OPERATOR FOR BINARY OPERAND");
                 std::string token;
                 token.push_back(input_[i]);
@@ -243,7 +307,7 @@ std::vector<Token> Lexer::tokenize()
                 {
                     if (!tokens.size())
                         throw std::runtime_error("CONCAT OPERATOR MUST HAVE LEFT OPERAND");
-                    if (tokens[tokens.size() - 1].type != NUMBER_TOKEN && tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN && tokens[tokens.size() - 1].type != STRING_TOKEN)
+                    if (tokens[tokens.size() - 1].type != NUMBER_TOKEN && tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN && tokens[tokens.size() - 1].type != STRING_TOKEN && tokens[tokens.size() - 1].type != IDENT_TOKEN)
                         throw std::runtime_error("INVALID LEFT OPERATOR FOR CONCAT OPERATION");
                     std::string token;
                     token.push_back(input_[i]);
@@ -253,7 +317,7 @@ std::vector<Token> Lexer::tokenize()
                 {
                     if (!tokens.size())
                         throw std::runtime_error("CELL RANGE APPEND OPERATOR NEEDS LEFT OPERAND");
-                    if (tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN)
+                    if (tokens[tokens.size() - 1].type != REFERENCE_TOKEN && tokens[tokens.size() - 1].type != RPAREN_TOKEN && tokens[tokens.size() - 1].type != IDENT_TOKEN && tokens[tokens.size() - 1].type != NUMBER_TOKEN)
                         throw std::runtime_error("CELL RANGE APPEND OPERATOR NEEDS LEFT OPERAND (OF TYPE CELL REFERENCE_TOKEN OR EXPRESSION THAT RESOLVES TO CELL REFERENCE_TOKEN)");
                     std::string token;
                     token.push_back(input_[i]);
@@ -344,6 +408,54 @@ std::vector<Token> Lexer::tokenize()
             }
         }
     }
+    if (!sheet.empty())
+    {
+        if (tokens.size() <= sheet_token)
+            throw std::runtime_error("SHEET NAME MUST BE FOLLOWED BY A REFERENCE");
+        tokens[sheet_token].sheet = std::move(sheet);
+    }
+    mergeStaticRanges(tokens);
+    // A of Sheet1!A:B folds into a range, a prefix left on anything else qualifies nothing
+    for (const Token &token : tokens)
+        if (!token.sheet.empty() && token.type != REFERENCE_TOKEN && token.type != RANGE_TOKEN)
+            throw std::runtime_error("SHEET NAME MUST BE FOLLOWED BY A REFERENCE");
     tokens.push_back({EOF_TOKEN, "EOF", "EOF", {-1, -1}});
     return tokens;
+}
+
+static bool staticRangeEndpoints(const Token &first, const Token &second, const Token *after)
+{
+    if (first.type == REFERENCE_TOKEN && second.type == REFERENCE_TOKEN)
+        return true;
+    // A:B, unless B is a function name
+    if (first.type == IDENT_TOKEN && second.type == IDENT_TOKEN)
+        return isColumnName(first.token) && isColumnName(second.token) && !(after && after->type == LPAREN_TOKEN);
+    if (first.type == NUMBER_TOKEN && second.type == NUMBER_TOKEN)
+        return isRowNumber(first.token) && isRowNumber(second.token);
+    return false;
+}
+
+void mergeStaticRanges(std::vector<Token> &tokens)
+{
+    std::vector<Token> merged;
+    merged.reserve(tokens.size());
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        const Token *after = i + 3 < tokens.size() ? &tokens[i + 3] : nullptr;
+        if (i + 2 < tokens.size() && tokens[i + 1].type == RANGE_OPERATOR_TOKEN && staticRangeEndpoints(tokens[i], tokens[i + 2], after))
+        {
+            // a ':' chain like A1:B2:C3 keeps its later operators, only the first pair folds
+            // Sheet1!A1:B2 names the sheet once, Sheet1!A1:Sheet1!B2 is allowed as long as it agrees
+            const std::string &sheet = tokens[i].sheet;
+            const std::string &second = tokens[i + 2].sheet;
+            if (!second.empty() && !std::equal(sheet.begin(), sheet.end(), second.begin(), second.end(), [](char a, char b)
+                                               { return std::toupper(static_cast<unsigned char>(a)) == std::toupper(static_cast<unsigned char>(b)); }))
+                throw std::runtime_error("RANGE CANNOT SPAN SHEETS");
+            merged.push_back({RANGE_TOKEN, "RANGE", tokens[i].token + ":" + tokens[i + 2].token, {tokens[i].span.start, tokens[i + 2].span.end}, sheet});
+            i += 2;
+            continue;
+        }
+        merged.push_back(std::move(tokens[i]));
+    }
+    tokens = std::move(merged);
 }
\ No newline at end of file
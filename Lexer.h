@@ -7,9 +7,9 @@
 
 namespace lexemes
 {
-    constexpr std::string_view valid_after_number = ",)+-/*^%&<>=";
-    constexpr std::string_view valid_after_indentifier = ",()+-/*^:";
-    constexpr std::string_view valid_after_reference = ",:)+-/*^>=<";
+    constexpr std::string_view valid_after_number = ",)+-/*^%&<>=:";
+    constexpr std::string_view valid_after_indentifier = ",()+-/*^:&<>=%";
+    constexpr std::string_view valid_after_reference = ",:)+-/*^>=<&%";
     constexpr std::string_view operators = "+-/*^:&";
     constexpr std::string_view binary_math_operators = "/*^";
     constexpr std::string_view comparison_operators = "<=>=<>";
@@ -21,7 +21,10 @@ public:
     std::vector<Token> tokenize();
 
 private:
-    std::string_view input_;
+    std::string input_; // owned, callers often pass temporaries
 };
 
+// folds REF:REF, COL:COL and ROW:ROW into single RANGE_TOKENs, other ':' stay range operators
+void mergeStaticRanges(std::vector<Token> &tokens);
+
 #endif
\ No newline at end of file
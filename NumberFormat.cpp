@@ -0,0 +1,101 @@
+#include "NumberFormat.h"
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace numfmt
+{
+    constexpr int precision = 15;
+
+    static char *writeUnsigned(unsigned long long v, char *out)
+    {
+        char digits[20];
+        int n = 0;
+        do
+        {
+            digits[n++] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v);
+        while (n)
+            *out++ = digits[--n];
+        return out;
+    }
+
+    char *format(double x, char *out)
+    {
+        if (!std::isfinite(x))
+        {
+            int len = std::snprintf(out, max_chars, "%.15g", x);
+            return out + len;
+        }
+        if (std::signbit(x))
+        {
+            *out++ = '-';
+            x = -x;
+        }
+        // integers below 1e15 print as their digits
+        if (x < 1e15 && x == std::floor(x))
+            return writeUnsigned(static_cast<unsigned long long>(x), out);
+
+        // d.ddddde[+-]xx, shortest form first, rounded to 15 digits when it needs more
+        // subnormals carry fewer digits, their shortest form can be shorter than the rounded one
+        char sci[max_chars];
+        char *sci_end = std::to_chars(sci, sci + sizeof(sci), x, std::chars_format::scientific).ptr;
+        char *e = static_cast<char *>(std::memchr(sci, 'e', sci_end - sci));
+        int digit_count = static_cast<int>(e - sci) - (e - sci > 1 ? 1 : 0);
+        if (digit_count > precision || x < std::numeric_limits<double>::min())
+        {
+            sci_end = std::to_chars(sci, sci + sizeof(sci), x, std::chars_format::scientific, precision - 1).ptr;
+            e = static_cast<char *>(std::memchr(sci, 'e', sci_end - sci));
+        }
+        int exponent = 0;
+        std::from_chars(e + (e[1] == '+' ? 2 : 1), sci_end, exponent);
+
+        // significant digits without the point and trailing zeros
+        char digits[precision + 2];
+        int n = 0;
+        for (char *p = sci; p < e; p++)
+            if (*p != '.')
+                digits[n++] = *p;
+        while (n > 1 && digits[n - 1] == '0')
+            n--;
+
+        if (exponent < -4 || exponent >= precision)
+        {
+            *out++ = digits[0];
+            if (n > 1)
+            {
+                *out++ = '.';
+                std::memcpy(out, digits + 1, n - 1);
+                out += n - 1;
+            }
+            *out++ = 'e';
+            *out++ = exponent < 0 ? '-' : '+';
+            unsigned magnitude = exponent < 0 ? -exponent : exponent;
+            if (magnitude < 10)
+                *out++ = '0';
+            return writeUnsigned(magnitude, out);
+        }
+        if (exponent < 0)
+        {
+            *out++ = '0';
+            *out++ = '.';
+            for (int i = exponent + 1; i < 0; i++)
+                *out++ = '0';
+            std::memcpy(out, digits, n);
+            return out + n;
+        }
+        // exponent + 1 digits before the point, padded with zeros when the digits run out
+        for (int i = 0; i <= exponent; i++)
+            *out++ = i < n ? digits[i] : '0';
+        if (n > exponent + 1)
+        {
+            *out++ = '.';
+            std::memcpy(out, digits + exponent + 1, n - exponent - 1);
+            out += n - exponent - 1;
+        }
+        return out;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef NUMBER_FORMAT_H
+#define NUMBER_FORMAT_H
+
+#include <cstddef>
+
+// number -> text the way a cell displays it: at most 15 significant digits, trailing zeros dropped,
+// scientific notation outside 1e-4..1e15 (the output of printf("%.15g"))
+// the digits come from the shortest round trip representation (Ryu, through std::to_chars) and are
+// only rounded to 15 digits when the shortest form needs more, integers skip all of that
+namespace numfmt
+{
+    constexpr size_t max_chars = 32; // "-1.23456789012345e-308" plus slack
+
+    // writes x into out, which must hold max_chars, returns the end of the text (not terminated)
+    char *format(double x, char *out);
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "Parser.h"
 #include "GPFEHelpers.h"
+#include "StringPool.h"
+#include "SheetNames.h"
 #include <memory>
 #include <format>
 #include <iostream>
@@ -18,6 +20,16 @@ const Token &Parser::peek(int offset) const
     return tokens_[position_ + offset];
 }
 
+int Parser::sheetOf(const Token &token) const
+{
+    if (token.sheet.empty())
+        return -1;
+    int id = sheets_ ? sheets_->find(token.sheet) : -1;
+    if (id < 0)
+        throw std::runtime_error("UNKNOWN SHEET: " + token.sheet);
+    return id;
+}
+
 ASTNode Parser::nud(const Token &token)
 {
     ASTNode node;
@@ -36,7 +48,7 @@ ASTNode Parser::nud(const Token &token)
     {
         Literal lit;
         lit.type = LiteralType::String;
-        lit.value = token.token;
+        lit.value = StringPool::global().intern(token.token);
         node.type = ASTNodeType::Literal;
         node.node = std::move(lit);
         return node;
@@ -45,33 +57,20 @@ ASTNode Parser::nud(const Token &token)
     {
         Reference ref;
         ref.type = ReferenceType::Cell;
-
-        std::string colLetters;
-        int row = 0;
-
-        int i = 0;
-        const std::string &s = token.token;
-        int size = token.token.size();
-        while (i < size && std::isalpha(static_cast<unsigned char>(s[i])))
-        {
-            colLetters.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(s[i]))));
-            ++i;
-        }
-        if (colLetters.empty())
-            throw std::runtime_error("INVALID CELL REF: MISSING COLUMN");
-        if (i == s.size() || !std::isdigit(static_cast<unsigned char>(s[i])))
-            throw std::runtime_error("INVALID CELL REF: MISSING ROW");
-        while (i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])))
-        {
-            row = row * 10 + (s[i] - '0');
-            ++i;
-        }
-        if (i != s.size())
-            throw std::runtime_error("INVALID CELL REF: TRAILING CHARS");
-        if (row <= 0)
-            throw std::runtime_error("INVALID CELL REF: ROW MUST BE ≥ 1");
-        CellReference cell_ref = {row, colLetterToNumber(colLetters)};
+        CellReference cell_ref = cellRefFromA1(token.token);
         ref.ref = std::move(cell_ref);
+        ref.sheet = sheetOf(token);
+        node.type = ASTNodeType::Reference;
+        node.node = std::move(ref);
+        return node;
+    }
+    case RANGE_TOKEN:
+    {
+        // static range, bounds known at parse time
+        Reference ref;
+        ref.type = ReferenceType::Range;
+        ref.ref = rangeRefFromA1(token.token);
+        ref.sheet = sheetOf(token);
         node.type = ASTNodeType::Reference;
         node.node = std::move(ref);
         return node;
@@ -107,7 +106,18 @@ ASTNode Parser::nud(const Token &token)
     case IDENT_TOKEN:
     {
         if (peek().type != LPAREN_TOKEN)
-            throw std::runtime_error("FUNCTION MUST BE FOLLOWED BY '('");
+        {
+            // local name (LET binding or LAMBDA param), resolved by the TypeChecker
+            Name name;
+            name.identifier = token.token;
+            for (char &c : name.identifier)
+            {
+                c = std::toupper(static_cast<unsigned char>(c));
+            }
+            node.type = ASTNodeType::Name;
+            node.node = std::move(name);
+            return node;
+        }
         consume(); // '('
 
         FunctionCall call;
@@ -116,6 +126,7 @@ ASTNode Parser::nud(const Token &token)
         {
             c = std::toupper(static_cast<unsigned char>(c));
         }
+        call.form = specialFormOf(call.identifier);
 
         if (peek().type != RPAREN_TOKEN)
         {
@@ -236,7 +247,6 @@ ASTNode Parser::led(const Token &token, std::unique_ptr<ASTNode> left)
 ASTNode Parser::parse()
 {
     auto root = parse_expression(0);
-    std::cout << position_ << "\n";
     if (!at_end())
     {
         std::cerr << "Remaining token: " << peek().token << " at position " << position_ << "\n";
@@ -3,19 +3,24 @@
 
 #include "GPFETypes.h"
 
+class SheetNames;
+
 class Parser
 {
 public:
-    Parser(const std::vector<Token> &tokens) : tokens_(tokens), position_(0) {};
+    // sheets resolves Sheet1!A1 style references, without it they don't parse
+    Parser(const std::vector<Token> &tokens, const SheetNames *sheets = nullptr) : tokens_(tokens), sheets_(sheets), position_(0) {};
     ~Parser() = default;
     ASTNode parse();
 
 private:
     const std::vector<Token> &tokens_;
+    const SheetNames *sheets_;
     size_t position_;
     const Token &peek(int offset = 0) const;
     Token consume();
     ASTNode nud(const Token &token);
+    int sheetOf(const Token &token) const;
     ASTNode led(const Token &token, std::unique_ptr<ASTNode> left);
     ASTNode parse_expression(int binding_power);
     bool at_end() const { return position_ >= tokens_.size() || peek().type == EOF_TOKEN; }
@@ -0,0 +1,238 @@
+#include "PluginLoader.h"
+#include "TextArena.h"
+#include "StringPool.h"
+#include <dlfcn.h>
+#include <deque>
+#include <stdexcept>
+
+namespace plugins
+{
+
+    struct LoadState
+    {
+        std::string path;
+        std::string error;
+        std::vector<std::string> registered; // taken back out when init fails
+    };
+
+    static std::deque<funcs::NativeFunction> &nativeFunctions()
+    {
+        static std::deque<funcs::NativeFunction> k;
+        return k;
+    }
+
+    static BaseType returnKindToBaseType(int32_t kind)
+    {
+        switch (kind)
+        {
+        case GPFE_NUMBER:
+            return BaseType::Number;
+        case GPFE_BOOL:
+            return BaseType::Bool;
+        case GPFE_TEXT:
+            return BaseType::String;
+        default:
+            return BaseType::Unknown;
+        }
+    }
+
+    // exceptions must not unwind through the plugin, errors are reported through the host ctx
+    static int registerFromPlugin(void *host_ctx, const gpfe_function_def *def)
+    {
+        auto *state = static_cast<LoadState *>(host_ctx);
+        try
+        {
+            if (!def || !def->name)
+                throw std::runtime_error("PLUGIN FUNCTION WITHOUT A NAME");
+            if (!def->scalar && !def->batch)
+                throw std::runtime_error("PLUGIN FUNCTION HAS NO ENTRY POINT");
+            if (def->param_count > GPFE_MAX_PARAMS || def->param_count > funcs::max_params)
+                throw std::runtime_error("PLUGIN FUNCTION HAS TOO MANY PARAMS");
+            if (def->variadic && def->param_count == 0)
+                throw std::runtime_error("VARIADIC PLUGIN FUNCTION NEEDS A TAIL PARAM");
+
+            funcs::FunctionSignature sig{};
+            sig.name = def->name;
+            for (uint32_t i = 0; i < def->param_count; i++)
+            {
+                if (!def->param_kinds[i] || def->param_kinds[i] & ~0x1Fu)
+                    throw std::runtime_error("INVALID PARAM KINDS FOR PLUGIN FUNCTION " + std::string(def->name));
+                // ranges can't cross the ABI, a reference param would always get #VALUE!
+                if (def->param_kinds[i] & GPFE_ARG_REF)
+                    throw std::runtime_error("PLUGIN FUNCTION " + std::string(def->name) + " CANNOT TAKE A REFERENCE");
+                sig.params.items[sig.params.count++] = funcs::Param(def->param_kinds[i]);
+            }
+            sig.variableArity = def->variadic != 0;
+            sig.returnType = returnKindToBaseType(def->return_kind);
+            sig.eval_function = nullptr;
+            sig.native = &nativeFunctions().emplace_back(funcs::NativeFunction{def->scalar, def->batch, def->user_data});
+            state->registered.emplace_back(funcs::registerFunction(sig)->name);
+            return 0;
+        }
+        catch (const std::exception &e)
+        {
+            state->error = e.what();
+            return -1;
+        }
+    }
+
+    void load(const std::string &path)
+    {
+        void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle)
+            throw std::runtime_error("COULD NOT LOAD PLUGIN: " + std::string(dlerror()));
+
+        auto abi_version = reinterpret_cast<gpfe_plugin_abi_version_fn>(dlsym(handle, "gpfe_plugin_abi_version"));
+        auto init = reinterpret_cast<gpfe_plugin_init_fn>(dlsym(handle, "gpfe_plugin_init"));
+        if (!abi_version || !init)
+        {
+            dlclose(handle);
+            throw std::runtime_error("PLUGIN IS MISSING gpfe_plugin_abi_version OR gpfe_plugin_init: " + path);
+        }
+        if (abi_version() != GPFE_PLUGIN_ABI_VERSION)
+        {
+            dlclose(handle);
+            throw std::runtime_error("PLUGIN ABI VERSION MISMATCH: " + path);
+        }
+
+        LoadState state{path, "", {}};
+        gpfe_host host{GPFE_PLUGIN_ABI_VERSION, registerFromPlugin, &state};
+        if (init(&host) != 0 || !state.error.empty())
+        {
+            // none of the plugin's functions may outlive the handle
+            for (const std::string &name : state.registered)
+                funcs::unregisterFunction(name);
+            dlclose(handle);
+            throw std::runtime_error("PLUGIN INIT FAILED: " + path + (state.error.empty() ? "" : " (" + state.error + ")"));
+        }
+        // handle is intentionally never closed, registered signatures point into the plugin
+    }
+
+    // text points into v, which must outlive the call
+    static bool toNative(const Value &v, gpfe_value &out)
+    {
+        out = gpfe_value{GPFE_BLANK, GPFE_ERR_NONE, 0.0, nullptr, 0};
+        if (std::holds_alternative<Number>(v))
+        {
+            out.kind = GPFE_NUMBER;
+            out.number = std::get<Number>(v);
+        }
+        else if (std::holds_alternative<Bool>(v))
+        {
+            out.kind = GPFE_BOOL;
+            out.number = std::get<Bool>(v) ? 1.0 : 0.0;
+        }
+        else if (isText(v))
+        {
+            // interned text points straight into the pool
+            std::string_view text = textView(v);
+            out.kind = GPFE_TEXT;
+            out.text = text.data();
+            out.text_len = text.size();
+        }
+        else if (std::holds_alternative<Error>(v))
+        {
+            out.kind = GPFE_ERROR;
+            out.error_code = static_cast<int32_t>(std::get<Error>(v).code);
+        }
+        else if (!std::holds_alternative<Blank>(v))
+        {
+            return false;
+        }
+        return true;
+    }
+
+    static Value fromNative(const gpfe_value &v)
+    {
+        switch (v.kind)
+        {
+        case GPFE_NUMBER:
+            return v.number;
+        case GPFE_BOOL:
+            return v.number != 0.0;
+        case GPFE_TEXT:
+            return v.text ? Text(v.text, v.text_len, text_arena::resource()) : text_arena::make();
+        case GPFE_ERROR:
+            if (v.error_code <= GPFE_ERR_NONE || v.error_code > GPFE_ERR_NA)
+                return Error{ErrorCode::Value};
+            return Error{static_cast<ErrorCode>(v.error_code)};
+        case GPFE_BLANK:
+            return Blank{};
+        default:
+            return Error{ErrorCode::Value};
+        }
+    }
+
+    Value callScalar(const funcs::NativeFunction &fn, const std::vector<Value> &args)
+    {
+        gpfe_value native_args[GPFE_MAX_PARAMS * 4];
+        std::vector<gpfe_value> spilled;
+        gpfe_value *argv = native_args;
+        if (args.size() > sizeof(native_args) / sizeof(native_args[0]))
+        {
+            spilled.resize(args.size());
+            argv = spilled.data();
+        }
+        for (size_t i = 0; i < args.size(); i++)
+            if (!toNative(args[i], argv[i]))
+                return Error{ErrorCode::Value};
+
+        gpfe_value out{GPFE_BLANK, GPFE_ERR_NONE, 0.0, nullptr, 0};
+        int status;
+        if (fn.scalar)
+        {
+            status = fn.scalar(argv, args.size(), &out, fn.user_data);
+        }
+        else
+        {
+            std::vector<const gpfe_value *> columns(args.size());
+            for (size_t i = 0; i < args.size(); i++)
+                columns[i] = &argv[i];
+            status = fn.batch(columns.data(), args.size(), 1, &out, fn.user_data);
+        }
+        if (status != 0)
+            return Error{ErrorCode::Value};
+        return fromNative(out);
+    }
+
+    void callBatch(const funcs::NativeFunction &fn, const std::vector<std::vector<Value>> &columns, size_t rows, std::vector<Value> &out)
+    {
+        out.assign(rows, Blank{});
+        if (!rows)
+            return;
+
+        const size_t argc = columns.size();
+        if (!fn.batch)
+        {
+            std::vector<Value> args(argc);
+            for (size_t r = 0; r < rows; r++)
+            {
+                for (size_t a = 0; a < argc; a++)
+                    args[a] = columns[a][r];
+                out[r] = callScalar(fn, args);
+            }
+            return;
+        }
+
+        std::vector<gpfe_value> native(argc * rows);
+        std::vector<const gpfe_value *> native_columns(argc);
+        std::vector<bool> invalid(rows, false);
+        for (size_t a = 0; a < argc; a++)
+        {
+            native_columns[a] = &native[a * rows];
+            for (size_t r = 0; r < rows; r++)
+                if (!toNative(columns[a][r], native[a * rows + r]))
+                    invalid[r] = true;
+        }
+
+        std::vector<gpfe_value> native_out(rows, gpfe_value{GPFE_BLANK, GPFE_ERR_NONE, 0.0, nullptr, 0});
+        if (fn.batch(native_columns.data(), argc, rows, native_out.data(), fn.user_data) != 0)
+        {
+            out.assign(rows, Error{ErrorCode::Value});
+            return;
+        }
+        for (size_t r = 0; r < rows; r++)
+            out[r] = invalid[r] ? Value{Error{ErrorCode::Value}} : fromNative(native_out[r]);
+    }
+
+}
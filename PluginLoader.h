@@ -0,0 +1,22 @@
+#ifndef PLUGIN_LOADER_H
+#define PLUGIN_LOADER_H
+
+#include <string>
+#include <vector>
+#include "EvalTypes.h"
+#include "FunctionRegistry.h"
+
+namespace plugins
+{
+    // dlopen a plugin and register its functions, throws on failure
+    // plugins stay loaded for the lifetime of the process
+    void load(const std::string &path);
+
+    Value callScalar(const funcs::NativeFunction &fn, const std::vector<Value> &args);
+
+    // columns[a][r] is argument a of invocation r, writes rows results to out
+    // uses the batch entry point when the plugin has one, otherwise loops over the scalar one
+    void callBatch(const funcs::NativeFunction &fn, const std::vector<std::vector<Value>> &columns, size_t rows, std::vector<Value> &out);
+}
+
+#endif
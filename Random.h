@@ -0,0 +1,46 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <array>
+#include <cstdint>
+
+// counter based generator (Philox4x32-10, Salmon et al. "Parallel Random Numbers: As Easy as 1, 2, 3")
+// the output is a pure function of (key, counter) so there is no shared state between threads,
+// a draw is keyed on (seed) and counted on (recalc epoch, cell row, cell col, draw index in cell)
+namespace rng
+{
+    using Counter = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+
+    constexpr uint32_t philox_m0 = 0xD2511F53;
+    constexpr uint32_t philox_m1 = 0xCD9E8D57;
+    constexpr uint32_t philox_w0 = 0x9E3779B9;
+    constexpr uint32_t philox_w1 = 0xBB67AE85;
+
+    constexpr Counter philox4x32(Counter ctr, Key key)
+    {
+        for (int round = 0; round < 10; round++)
+        {
+            uint64_t p0 = static_cast<uint64_t>(philox_m0) * ctr[0];
+            uint64_t p1 = static_cast<uint64_t>(philox_m1) * ctr[2];
+            ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+                   static_cast<uint32_t>(p1),
+                   static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+                   static_cast<uint32_t>(p0)};
+            key[0] += philox_w0;
+            key[1] += philox_w1;
+        }
+        return ctr;
+    }
+
+    // uniform double in [0, 1) with 53 random bits
+    constexpr double uniform(uint64_t seed, uint32_t epoch, int row, int col, uint32_t draw)
+    {
+        Counter out = philox4x32({static_cast<uint32_t>(row), static_cast<uint32_t>(col), epoch, draw},
+                                 {static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)});
+        uint64_t bits = (static_cast<uint64_t>(out[0]) << 21) ^ (out[1] >> 11);
+        return static_cast<double>(bits & ((1ull << 53) - 1)) * (1.0 / 9007199254740992.0);
+    }
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef RANGE_VIEW_H
+#define RANGE_VIEW_H
+
+#include "EvalTypes.h"
+#include "SheetStore.h"
+#include "StringPool.h"
+#include <bit>
+#include <cstdint>
+
+// numeric cells of one column inside one chunk, numbers[i] for i in [begin, end) is the cell at
+// row first_row + i, it holds 0 unless bit i of numeric is set
+struct NumberSpan
+{
+    const double *numbers;
+    const uint64_t *numeric;
+    int begin;
+    int end;
+    int first_row;
+    int col;
+
+    bool valid(int i) const { return numeric[i >> 6] >> (i & 63) & 1; }
+
+    // numeric cells in [begin, end)
+    int count() const
+    {
+        int n = 0;
+        for (int w = begin >> 6; w <= (end - 1) >> 6; w++)
+        {
+            uint64_t bits = numeric[w];
+            if (w == begin >> 6)
+                bits &= ~uint64_t{0} << (begin & 63);
+            if (w == (end - 1) >> 6 && (end & 63))
+                bits &= ~(~uint64_t{0} << (end & 63));
+            n += std::popcount(bits);
+        }
+        return n;
+    }
+};
+
+// a range of the sheet as functions see it, built lazily on top of the store so functions never
+// touch the storage layout or look cells up one at a time
+// every iteration is clipped to the populated part of the range and skips empty chunks
+class RangeView
+{
+public:
+    RangeView(const SheetStore &sheet, RangeRef range) : sheet_(sheet), range_(range) {}
+
+    const RangeRef &bounds() const { return range_; }
+    int rows() const { return range_.bottom - range_.top + 1; }
+    int cols() const { return range_.right - range_.left + 1; }
+    Value get(int row, int col) const { return sheet_.get(RC{row, col}); }
+
+    // fn(const NumberSpan &) for every chunk run holding cells of the range, column by column
+    template <typename Fn>
+    void forEachNumberSpan(Fn &&fn) const
+    {
+        RangeRef range = range_;
+        if (!sheet_.clip(range))
+            return;
+        for (int col = range.left; col <= range.right; col++)
+        {
+            sheet_.forEachChunk(col, range.top, range.bottom, [&](const ColumnChunk &chunk, int chunk_first_row, int begin, int end)
+                                { fn(NumberSpan{chunk.numbers.data(), chunk.numeric.data(), begin, end, chunk_first_row, col}); });
+        }
+    }
+
+    // fn(row, col, const Value &) for every populated cell that isn't a Number (text, bools, errors)
+    template <typename Fn>
+    void forEachOther(Fn &&fn) const
+    {
+        RangeRef range = range_;
+        if (!sheet_.clip(range))
+            return;
+        for (int col = range.left; col <= range.right; col++)
+        {
+            sheet_.forEachChunk(col, range.top, range.bottom, [&](const ColumnChunk &chunk, int chunk_first_row, int begin, int end)
+                                {
+                for (const auto &[offset, value] : chunk.others)
+                    if (begin <= offset && offset < end)
+                        fn(chunk_first_row + offset, col, value); });
+        }
+    }
+
+    // fn(row, col, std::string_view) for every text cell
+    template <typename Fn>
+    void forEachText(Fn &&fn) const
+    {
+        forEachOther([&](int row, int col, const Value &value)
+                     {
+            if (isText(value))
+                fn(row, col, textView(value)); });
+    }
+
+    // fn(row, col, const Value &) for every populated cell
+    template <typename Fn>
+    void forEachCell(Fn &&fn) const
+    {
+        sheet_.forEachCell(range_, fn);
+    }
+
+private:
+    const SheetStore &sheet_;
+    RangeRef range_;
+};
+
+#endif
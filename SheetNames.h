@@ -0,0 +1,57 @@
+#ifndef SHEET_NAMES_H
+#define SHEET_NAMES_H
+
+#include "GPFETypes.h"
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// sheet names of a workbook and their ids, ids are handed out in order and never reused
+// names compare case insensitively, Sheet1!A1 and SHEET1!A1 are the same cells
+class SheetNames
+{
+public:
+    static constexpr size_t max_name = 31;
+
+    // id of the new sheet, throws when the name is taken or can't name a sheet
+    int add(const std::string &name)
+    {
+        if (name.empty() || name.size() > max_name || name.front() == '\'' || name.back() == '\'' ||
+            name.find_first_of(":\\/?*[]") != std::string::npos)
+            throw std::runtime_error("INVALID SHEET NAME");
+        if (names_.size() >= static_cast<size_t>(max_sheets))
+            throw std::runtime_error("TOO MANY SHEETS");
+        auto [it, inserted] = ids_.try_emplace(folded(name), static_cast<int>(names_.size()));
+        if (!inserted)
+            throw std::runtime_error("SHEET NAME TAKEN");
+        names_.push_back(name);
+        return it->second;
+    }
+
+    // -1 when there is no such sheet
+    int find(std::string_view name) const
+    {
+        auto it = ids_.find(folded(name));
+        return it == ids_.end() ? -1 : it->second;
+    }
+
+    const std::string &name(int id) const { return names_.at(id); }
+    int size() const { return static_cast<int>(names_.size()); }
+
+private:
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, int> ids_; // upper case name
+
+    static std::string folded(std::string_view name)
+    {
+        std::string out(name);
+        for (char &c : out)
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        return out;
+    }
+};
+
+#endif
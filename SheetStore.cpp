@@ -0,0 +1,433 @@
+#include "SheetStore.h"
+#include "GPFETypes.h"
+#include "TextArena.h"
+#include "StringPool.h"
+#include <stdexcept>
+
+const Value *ColumnChunk::other(int offset) const
+{
+    auto it = std::lower_bound(others.begin(), others.end(), offset,
+                               [](const std::pair<uint16_t, Value> &entry, int o)
+                               { return entry.first < o; });
+    if (it == others.end() || it->first != offset)
+        return nullptr;
+    return &it->second;
+}
+
+void SheetStore::set(RC cell, Value value)
+{
+    auto [row, col] = cell;
+    if (row < 1 || col < 1 || row > max_rows || col > max_cols)
+        throw std::out_of_range("CELL OUTSIDE OF THE SHEET");
+    if (std::holds_alternative<Blank>(value))
+    {
+        if (col <= static_cast<int>(columns_.size()))
+            erase(columns_[col - 1], row);
+        return;
+    }
+
+    if (col > static_cast<int>(columns_.size()))
+        columns_.resize(col);
+    Column &column = columns_[col - 1];
+    const size_t idx = static_cast<size_t>(row - 1) / chunk_rows;
+    const int offset = (row - 1) % chunk_rows;
+    if (idx >= column.chunks.size())
+    {
+        column.chunks.resize(idx + 1);
+        column.chunk_mask.resize(idx / 64 + 1, 0);
+    }
+    if (!column.chunks[idx])
+    {
+        column.chunks[idx] = std::make_shared<ColumnChunk>();
+        column.chunk_mask[idx / 64] |= uint64_t{1} << (idx % 64);
+    }
+    ColumnChunk &chunk = writableChunk(column, idx);
+    const uint64_t bit = uint64_t{1} << (offset & 63);
+    auto other = std::lower_bound(chunk.others.begin(), chunk.others.end(), offset,
+                                  [](const std::pair<uint16_t, Value> &entry, int o)
+                                  { return entry.first < o; });
+    const bool has_other = other != chunk.others.end() && other->first == offset;
+
+    if (!(chunk.occupied[offset >> 6] & bit))
+    {
+        chunk.occupied[offset >> 6] |= bit;
+        chunk.count++;
+        column.count++;
+        count_++;
+        column.first_row = column.first_row ? std::min(column.first_row, row) : row;
+        column.last_row = std::max(column.last_row, row);
+        if (!used_dirty_)
+        {
+            if (used_.empty())
+            {
+                used_ = UsedRange{row, row, col, col};
+            }
+            else
+            {
+                used_.first_row = std::min(used_.first_row, row);
+                used_.last_row = std::max(used_.last_row, row);
+                used_.first_col = std::min(used_.first_col, col);
+                used_.last_col = std::max(used_.last_col, col);
+            }
+        }
+    }
+
+    if (std::holds_alternative<Number>(value))
+    {
+        chunk.numbers[offset] = std::get<Number>(value);
+        chunk.numeric[offset >> 6] |= bit;
+        if (has_other)
+            chunk.others.erase(other);
+        return;
+    }
+    chunk.numbers[offset] = 0.0;
+    chunk.numeric[offset >> 6] &= ~bit;
+    if (const Text *text = std::get_if<Text>(&value); text && text->size() <= max_interned_length)
+        value = StringPool::global().intern(*text);
+    // the cell outlives the recalc epoch, text built in the arena moves to the heap
+    // text is moved in with emplace, assigning a pmr string copies into the target's allocator
+    Value stored = promote(std::move(value));
+    if (!has_other)
+        chunk.others.emplace(other, static_cast<uint16_t>(offset), std::move(stored));
+    else if (Text *text = std::get_if<Text>(&stored))
+        other->second.emplace<Text>(std::move(*text));
+    else
+        other->second = std::move(stored);
+}
+
+void SheetStore::erase(Column &column, int row)
+{
+    const size_t idx = static_cast<size_t>(row - 1) / chunk_rows;
+    const int offset = (row - 1) % chunk_rows;
+    if (idx >= column.chunks.size() || !column.chunks[idx] || !column.chunks[idx]->isOccupied(offset))
+        return;
+    ColumnChunk &chunk = writableChunk(column, idx);
+    const uint64_t bit = uint64_t{1} << (offset & 63);
+    if (!(chunk.numeric[offset >> 6] & bit))
+    {
+        auto other = std::lower_bound(chunk.others.begin(), chunk.others.end(), offset,
+                                      [](const std::pair<uint16_t, Value> &entry, int o)
+                                      { return entry.first < o; });
+        chunk.others.erase(other);
+    }
+    chunk.numbers[offset] = 0.0;
+    chunk.numeric[offset >> 6] &= ~bit;
+    chunk.occupied[offset >> 6] &= ~bit;
+    column.count--;
+    count_--;
+    if (--chunk.count == 0)
+    {
+        column.chunks[idx].reset();
+        column.chunk_mask[idx / 64] &= ~(uint64_t{1} << (idx % 64));
+    }
+
+    const bool on_boundary = row == column.first_row || row == column.last_row;
+    if (on_boundary)
+        recomputeExtent(column);
+    if (on_boundary || !count_)
+        used_dirty_ = true;
+}
+
+ColumnChunk &SheetStore::writableChunk(Column &column, size_t idx)
+{
+    std::shared_ptr<ColumnChunk> &chunk = column.chunks[idx];
+    // copies are made by the writer, so a count of 1 can't go back up under us
+    if (chunk.use_count() > 1)
+        chunk = std::make_shared<ColumnChunk>(*chunk);
+    return *chunk;
+}
+
+void SheetStore::recomputeExtent(Column &column)
+{
+    column.first_row = 0;
+    column.last_row = 0;
+    if (!column.count)
+        return;
+    auto row_of = [](size_t idx, const ColumnChunk &chunk, bool first)
+    {
+        for (int i = 0; i < ColumnChunk::words; i++)
+        {
+            int w = first ? i : ColumnChunk::words - 1 - i;
+            uint64_t bits = chunk.occupied[w];
+            if (!bits)
+                continue;
+            int offset = w * 64 + (first ? std::countr_zero(bits) : 63 - std::countl_zero(bits));
+            return static_cast<int>(idx) * chunk_rows + offset + 1;
+        }
+        return 0;
+    };
+    for (size_t w = 0; w < column.chunk_mask.size(); w++)
+    {
+        if (column.chunk_mask[w])
+        {
+            size_t idx = w * 64 + std::countr_zero(column.chunk_mask[w]);
+            column.first_row = row_of(idx, *column.chunks[idx], true);
+            break;
+        }
+    }
+    for (size_t w = column.chunk_mask.size(); w-- > 0;)
+    {
+        if (column.chunk_mask[w])
+        {
+            size_t idx = w * 64 + 63 - std::countl_zero(column.chunk_mask[w]);
+            column.last_row = row_of(idx, *column.chunks[idx], false);
+            break;
+        }
+    }
+}
+
+Value SheetStore::get(RC cell) const
+{
+    const ColumnChunk *chunk = chunkAt(cell.second, cell.first);
+    if (!chunk)
+        return Blank{};
+    const int offset = (cell.first - 1) % chunk_rows;
+    if (chunk->isNumeric(offset))
+        return chunk->numbers[offset];
+    if (const Value *v = chunk->other(offset))
+        return *v;
+    return Blank{};
+}
+
+void SheetStore::putChunk(int col, size_t idx, std::shared_ptr<ColumnChunk> chunk)
+{
+    if (col < 1 || col > max_cols || idx >= static_cast<size_t>(max_rows / chunk_rows))
+        throw std::out_of_range("CELL OUTSIDE OF THE SHEET");
+    if (!chunk->count)
+        return;
+    if (col > static_cast<int>(columns_.size()))
+        columns_.resize(col);
+    Column &column = columns_[col - 1];
+    if (idx >= column.chunks.size())
+    {
+        column.chunks.resize(idx + 1);
+        column.chunk_mask.resize(idx / 64 + 1, 0);
+    }
+    if (column.chunks[idx])
+        throw std::runtime_error("CHUNK ALREADY SET");
+    column.count += chunk->count;
+    count_ += chunk->count;
+    column.chunks[idx] = std::move(chunk);
+    column.chunk_mask[idx / 64] |= uint64_t{1} << (idx % 64);
+    recomputeExtent(column);
+    used_dirty_ = true;
+}
+
+bool SheetStore::occupied(RC cell) const
+{
+    const ColumnChunk *chunk = chunkAt(cell.second, cell.first);
+    return chunk && chunk->isOccupied((cell.first - 1) % chunk_rows);
+}
+
+const ColumnChunk *SheetStore::chunkAt(int col, int row) const
+{
+    if (row < 1 || col < 1 || col > static_cast<int>(columns_.size()))
+        return nullptr;
+    const Column &column = columns_[col - 1];
+    const size_t idx = static_cast<size_t>(row - 1) / chunk_rows;
+    if (idx >= column.chunks.size())
+        return nullptr;
+    return column.chunks[idx].get();
+}
+
+// ors bits [from, from + len) of src into dst starting at bit to, returns how many were set
+static int copyBits(uint64_t *dst, int to, const uint64_t *src, int from, int len)
+{
+    int copied = 0;
+    while (len > 0)
+    {
+        const int n = std::min({len, 64 - (from & 63), 64 - (to & 63)});
+        uint64_t bits = src[from >> 6] >> (from & 63);
+        if (n < 64)
+            bits &= (uint64_t{1} << n) - 1;
+        dst[to >> 6] |= bits << (to & 63);
+        copied += std::popcount(bits);
+        from += n;
+        to += n;
+        len -= n;
+    }
+    return copied;
+}
+
+// len cells of src from src_offset land in dst from dst_offset, runs of one dst chunk have to be
+// copied in row order so others stays sorted
+static void copyRun(ColumnChunk &dst, int dst_offset, const ColumnChunk &src, int src_offset, int len)
+{
+    std::copy_n(src.numbers.begin() + src_offset, len, dst.numbers.begin() + dst_offset);
+    dst.count += copyBits(dst.occupied.data(), dst_offset, src.occupied.data(), src_offset, len);
+    copyBits(dst.numeric.data(), dst_offset, src.numeric.data(), src_offset, len);
+    const int end = src_offset + len;
+    auto other = std::lower_bound(src.others.begin(), src.others.end(), src_offset,
+                                  [](const std::pair<uint16_t, Value> &entry, int o)
+                                  { return entry.first < o; });
+    for (; other != src.others.end() && other->first < end; ++other)
+        dst.others.emplace_back(static_cast<uint16_t>(dst_offset + other->first - src_offset), other->second);
+}
+
+void SheetStore::shiftRows(Column &column, int at, int shift, int gap)
+{
+    if (!column.count || column.last_row < at)
+        return;
+    const size_t first = static_cast<size_t>(at - 1) / chunk_rows;
+    if ((at - 1) % chunk_rows == 0 && shift % chunk_rows == 0)
+    {
+        // whole chunks, only the directory moves
+        const size_t moved = static_cast<size_t>(std::abs(shift) / chunk_rows);
+        if (shift > 0)
+            column.chunks.insert(column.chunks.begin() + first, moved, nullptr);
+        else
+            column.chunks.erase(column.chunks.begin() + first, column.chunks.begin() + std::min(first + moved, column.chunks.size()));
+    }
+    else
+    {
+        std::vector<std::shared_ptr<ColumnChunk>> old = column.chunks;
+        auto old_chunk = [&](int row) -> const ColumnChunk *
+        {
+            size_t idx = static_cast<size_t>(row - 1) / chunk_rows;
+            return idx < old.size() ? old[idx].get() : nullptr;
+        };
+        // copies old rows from..to to new rows starting at row, one old chunk at a time
+        auto copy_rows = [&](ColumnChunk &dst, int row, int from, int to)
+        {
+            while (from <= to)
+            {
+                const int len = std::min(to, ((from - 1) / chunk_rows + 1) * chunk_rows) - from + 1;
+                if (const ColumnChunk *src = old_chunk(from))
+                    copyRun(dst, (row - 1) % chunk_rows, *src, (from - 1) % chunk_rows, len);
+                row += len;
+                from += len;
+            }
+        };
+        const int old_last = column.last_row;
+        const int new_last = std::min(max_rows, old_last + std::max(shift, 0));
+        column.chunks.assign(old.begin(), old.begin() + std::min(first, old.size()));
+        column.chunks.resize(static_cast<size_t>(new_last - 1) / chunk_rows + 1);
+        for (size_t j = first; j < column.chunks.size(); j++)
+        {
+            auto chunk = std::make_shared<ColumnChunk>();
+            const int top = static_cast<int>(j) * chunk_rows + 1;
+            const int bottom = top + chunk_rows - 1;
+            // rows above at stay, the gap stays blank, everything below comes from row - shift
+            if (top < at)
+                copy_rows(*chunk, top, top, std::min(bottom, at - 1));
+            const int moved_top = std::max(top, at + gap);
+            if (moved_top <= bottom && moved_top - shift <= old_last)
+                copy_rows(*chunk, moved_top, moved_top - shift, std::min(bottom - shift, old_last));
+            column.chunks[j] = chunk->count ? std::move(chunk) : nullptr;
+        }
+    }
+
+    while (!column.chunks.empty() && !column.chunks.back())
+        column.chunks.pop_back();
+    column.chunk_mask.assign(column.chunks.size() / 64 + 1, 0);
+    column.count = 0;
+    for (size_t idx = 0; idx < column.chunks.size(); idx++)
+    {
+        if (!column.chunks[idx])
+            continue;
+        column.chunk_mask[idx / 64] |= uint64_t{1} << (idx % 64);
+        column.count += column.chunks[idx]->count;
+    }
+    recomputeExtent(column);
+}
+
+void SheetStore::recount()
+{
+    count_ = 0;
+    for (const Column &column : columns_)
+        count_ += column.count;
+    used_dirty_ = true;
+}
+
+void SheetStore::insertRows(int at, int count)
+{
+    if (at < 1 || at > max_rows || count < 1)
+        throw std::out_of_range("ROWS OUTSIDE OF THE SHEET");
+    for (const Column &column : columns_)
+        if (column.count && column.last_row >= at && column.last_row + static_cast<int64_t>(count) > max_rows)
+            throw std::out_of_range("CELLS WOULD BE SHIFTED OFF THE SHEET");
+    for (Column &column : columns_)
+        shiftRows(column, at, count, count);
+    recount();
+}
+
+void SheetStore::deleteRows(int at, int count)
+{
+    if (at < 1 || at > max_rows || count < 1)
+        throw std::out_of_range("ROWS OUTSIDE OF THE SHEET");
+    count = std::min(count, max_rows - at + 1);
+    for (Column &column : columns_)
+        shiftRows(column, at, -count, 0);
+    recount();
+}
+
+void SheetStore::insertColumns(int at, int count)
+{
+    if (at < 1 || at > max_cols || count < 1)
+        throw std::out_of_range("COLUMNS OUTSIDE OF THE SHEET");
+    if (at > static_cast<int>(columns_.size()))
+        return;
+    UsedRange used = usedRange();
+    if (!used.empty() && used.last_col >= at && used.last_col + static_cast<int64_t>(count) > max_cols)
+        throw std::out_of_range("CELLS WOULD BE SHIFTED OFF THE SHEET");
+    columns_.insert(columns_.begin() + (at - 1), count, Column{});
+    if (columns_.size() > static_cast<size_t>(max_cols))
+        columns_.resize(max_cols); // empty, checked above
+    recount();
+}
+
+void SheetStore::deleteColumns(int at, int count)
+{
+    if (at < 1 || at > max_cols || count < 1)
+        throw std::out_of_range("COLUMNS OUTSIDE OF THE SHEET");
+    if (at > static_cast<int>(columns_.size()))
+        return;
+    columns_.erase(columns_.begin() + (at - 1), columns_.begin() + std::min<size_t>(at - 1 + static_cast<size_t>(count), columns_.size()));
+    recount();
+}
+
+UsedRange SheetStore::usedRange() const
+{
+    if (used_dirty_)
+    {
+        used_ = UsedRange{};
+        for (size_t c = 0; c < columns_.size(); c++)
+        {
+            const Column &column = columns_[c];
+            if (!column.count)
+                continue;
+            int col = static_cast<int>(c) + 1;
+            if (used_.empty())
+            {
+                used_ = UsedRange{column.first_row, column.last_row, col, col};
+                continue;
+            }
+            used_.first_row = std::min(used_.first_row, column.first_row);
+            used_.last_row = std::max(used_.last_row, column.last_row);
+            used_.last_col = col;
+        }
+        used_dirty_ = false;
+    }
+    return used_;
+}
+
+bool SheetStore::columnExtent(int col, int &first_row, int &last_row) const
+{
+    if (col < 1 || col > static_cast<int>(columns_.size()) || !columns_[col - 1].count)
+        return false;
+    first_row = columns_[col - 1].first_row;
+    last_row = columns_[col - 1].last_row;
+    return true;
+}
+
+bool SheetStore::clip(RangeRef &range) const
+{
+    UsedRange used = usedRange();
+    if (used.empty())
+        return false;
+    range.top = std::max(range.top, used.first_row);
+    range.bottom = std::min(range.bottom, used.last_row);
+    range.left = std::max(range.left, used.first_col);
+    range.right = std::min(range.right, used.last_col);
+    return range.top <= range.bottom && range.left <= range.right;
+}
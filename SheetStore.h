@@ -0,0 +1,177 @@
+#ifndef SHEET_STORE_H
+#define SHEET_STORE_H
+
+#include "EvalTypes.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// bounds of the populated cells, empty when first_row is 0
+struct UsedRange
+{
+    int first_row = 0;
+    int last_row = 0;
+    int first_col = 0;
+    int last_col = 0;
+    bool empty() const { return first_row == 0; }
+};
+
+// ColumnChunk::rows consecutive cells of one column
+struct ColumnChunk
+{
+    static constexpr int rows = 1024;
+    static constexpr int words = rows / 64;
+
+    std::array<double, rows> numbers{};    // 0 unless the numeric bit is set, so runs can be summed as is
+    std::array<uint64_t, words> numeric{}; // cells holding a Number
+    std::array<uint64_t, words> occupied{};
+    std::vector<std::pair<uint16_t, Value>> others; // every non numeric cell, sorted by offset
+    uint32_t count = 0;
+
+    bool isNumeric(int offset) const { return numeric[offset >> 6] >> (offset & 63) & 1; }
+    bool isOccupied(int offset) const { return occupied[offset >> 6] >> (offset & 63) & 1; }
+    const Value *other(int offset) const;
+};
+
+// column major chunked cell storage, chunks are only allocated once a cell in them is set
+// every column tracks its populated extent and a bitmap of non empty chunks, so range scans
+// clip to populated rows and skip empty chunks instead of walking max_rows cells
+// copies share chunks and a chunk is cloned the first time it is written while shared, so copying
+// a store (a snapshot, see VersionedSheet.h) costs its chunk directory and not its cells
+class SheetStore
+{
+public:
+    static constexpr int chunk_rows = ColumnChunk::rows;
+    // text up to this long is stored interned, longer text is rarely repeated and the pool never frees
+    static constexpr size_t max_interned_length = 255;
+
+    // Blank clears the cell
+    void set(RC cell, Value value);
+    Value get(RC cell) const;
+    bool occupied(RC cell) const;
+    size_t cellCount() const { return count_; }
+
+    UsedRange usedRange() const;
+    // populated rows of one column, false when it's empty
+    bool columnExtent(int col, int &first_row, int &last_row) const;
+    // intersects range with the used range, false when nothing populated can be inside
+    bool clip(RangeRef &range) const;
+
+    // chunk holding (row, col), null when nothing in it is set
+    const ColumnChunk *chunkAt(int col, int row) const;
+    // bulk loading (see Snapshot.h), puts chunk idx ((row - 1) / chunk_rows) of col in place as is,
+    // its count and others have to match its bits and the slot has to be empty
+    void putChunk(int col, size_t idx, std::shared_ptr<ColumnChunk> chunk);
+
+    // fn(chunk, chunk_first_row, begin, end) for every non empty chunk of col overlapping rows
+    // top..bottom, [begin, end) are the overlapping offsets within the chunk
+    template <typename Fn>
+    void forEachChunk(int col, int top, int bottom, Fn &&fn) const;
+
+    // fn(row, col, value) for every populated cell inside range, column by column
+    template <typename Fn>
+    void forEachCell(RangeRef range, Fn &&fn) const;
+
+    // structural edits, cells at and below (right of) at move by count, deleted cells are dropped
+    // chunks that don't move are kept and shifts by whole chunks only move chunk pointers, other
+    // chunks are rebuilt from runs of the old ones, shared chunks are never written
+    // throws when an insert would push populated cells off the sheet
+    void insertRows(int at, int count);
+    void deleteRows(int at, int count);
+    void insertColumns(int at, int count);
+    void deleteColumns(int at, int count);
+
+private:
+    struct Column
+    {
+        std::vector<std::shared_ptr<ColumnChunk>> chunks; // index (row - 1) / chunk_rows
+        std::vector<uint64_t> chunk_mask;                 // bit per non null chunk
+        int first_row = 0;
+        int last_row = 0;
+        size_t count = 0;
+    };
+
+    std::vector<Column> columns_; // index col - 1
+    size_t count_ = 0;
+    mutable UsedRange used_;
+    mutable bool used_dirty_ = false; // a cell on the boundary was cleared
+
+    void erase(Column &column, int row);
+    // new row r holds old row r - shift for r >= at, rows at..at + gap - 1 come out blank
+    // shift is count for inserts (gap = count) and -count for deletes (gap = 0)
+    static void shiftRows(Column &column, int at, int shift, int gap);
+    void recount();
+    // chunk idx of column, cloned first when another copy of the store shares it
+    static ColumnChunk &writableChunk(Column &column, size_t idx);
+    static void recomputeExtent(Column &column);
+};
+
+template <typename Fn>
+void SheetStore::forEachChunk(int col, int top, int bottom, Fn &&fn) const
+{
+    if (col < 1 || col > static_cast<int>(columns_.size()))
+        return;
+    const Column &column = columns_[col - 1];
+    if (!column.count)
+        return;
+    top = std::max(top, column.first_row);
+    bottom = std::min(bottom, column.last_row);
+    if (top > bottom)
+        return;
+    const size_t first = static_cast<size_t>(top - 1) / chunk_rows;
+    const size_t last = static_cast<size_t>(bottom - 1) / chunk_rows;
+    for (size_t w = first / 64; w <= last / 64; w++)
+    {
+        uint64_t bits = column.chunk_mask[w];
+        while (bits)
+        {
+            size_t idx = w * 64 + std::countr_zero(bits);
+            bits &= bits - 1;
+            if (idx < first)
+                continue;
+            if (idx > last)
+                return;
+            int chunk_first_row = static_cast<int>(idx) * chunk_rows + 1;
+            int begin = std::max(top, chunk_first_row) - chunk_first_row;
+            int end = std::min(bottom, chunk_first_row + chunk_rows - 1) - chunk_first_row + 1;
+            fn(*column.chunks[idx], chunk_first_row, begin, end);
+        }
+    }
+}
+
+template <typename Fn>
+void SheetStore::forEachCell(RangeRef range, Fn &&fn) const
+{
+    if (!clip(range))
+        return;
+    for (int col = range.left; col <= range.right; col++)
+    {
+        forEachChunk(col, range.top, range.bottom, [&](const ColumnChunk &chunk, int chunk_first_row, int begin, int end)
+                     {
+            // others is sorted by offset, walk it alongside the occupied bits
+            auto other = std::lower_bound(chunk.others.begin(), chunk.others.end(), begin,
+                                          [](const std::pair<uint16_t, Value> &entry, int offset) { return entry.first < offset; });
+            for (int w = begin >> 6; w <= (end - 1) >> 6; w++)
+            {
+                uint64_t bits = chunk.occupied[w];
+                while (bits)
+                {
+                    int offset = w * 64 + std::countr_zero(bits);
+                    bits &= bits - 1;
+                    if (offset < begin)
+                        continue;
+                    if (offset >= end)
+                        return;
+                    if (chunk.isNumeric(offset))
+                        fn(chunk_first_row + offset, col, Value{chunk.numbers[offset]});
+                    else
+                        fn(chunk_first_row + offset, col, (other++)->second);
+                }
+            } });
+    }
+}
+
+#endif
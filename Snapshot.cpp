@@ -0,0 +1,903 @@
+#include "Snapshot.h"
+#include "Workbook.h"
+#include "Checksum.h"
+#include "StringPool.h"
+#include "TextArena.h"
+#include "GPFEHelpers.h"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double millisSince(Clock::time_point &start)
+{
+    Clock::time_point now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+    start = now;
+    return ms;
+}
+
+// the records of the file, native byte order, every section is an array of one record type
+namespace
+{
+    constexpr char magic[8] = {'G', 'P', 'F', 'E', 'S', 'N', 'A', 'P'};
+    constexpr size_t alignment = 64;
+
+    enum Section : uint32_t
+    {
+        StringIndex,
+        StringChars,
+        Sheets,
+        Chunks,
+        ChunkArrays,
+        Values,
+        Arrays,
+        Programs,
+        Nodes,
+        Formulas,
+        Edges,
+        Ranges,
+        SectionCount
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t sections;
+        uint64_t size;     // of the whole file
+        uint64_t checksum; // chained over the section table and then every section in order
+        uint64_t commit;
+        uint64_t rand_seed;
+        uint32_t recalc_epoch;
+        uint32_t reserved;
+    };
+
+    struct SectionEntry
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct StringRecord
+    {
+        uint64_t offset; // into StringChars
+        uint64_t size;
+    };
+
+    struct SheetRecord
+    {
+        uint32_t name;
+        uint32_t reserved;
+    };
+
+    struct ChunkRecord
+    {
+        uint32_t sheet;
+        uint32_t col;
+        uint32_t idx; // (row - 1) / chunk_rows
+        uint32_t count;
+        uint64_t first_value; // its others in Values
+        uint64_t values;
+    };
+
+    // the arrays of a ColumnChunk as they are in memory
+    struct ChunkArrayRecord
+    {
+        double numbers[ColumnChunk::rows];
+        uint64_t numeric[ColumnChunk::words];
+        uint64_t occupied[ColumnChunk::words];
+    };
+    static_assert(sizeof(ChunkArrayRecord) % alignment == 0);
+
+    enum class ValueTag : uint8_t
+    {
+        Number,
+        Bool,
+        Text,     // longer than the pool takes, payload is a string
+        Interned, // payload is a string
+        Error,
+        Blank,
+        Array, // payload is an array
+    };
+
+    struct ValueRecord
+    {
+        uint16_t offset; // in the chunk, 0 for array cells
+        ValueTag tag;
+        uint8_t reserved[5];
+        uint64_t payload;
+    };
+
+    struct ArrayRecord
+    {
+        uint32_t rows;
+        uint32_t cols;
+        uint64_t first_value; // rows * cols cells in Values, row major
+    };
+
+    struct ProgramRecord
+    {
+        uint32_t key;
+        uint32_t nodes;
+        uint64_t first_node;
+        int32_t local_slots;
+        int32_t cse_slots;
+        uint64_t cse_stats[4]; // nodes, unique_nodes, shared_subtrees, shared_nodes
+    };
+
+    enum NodeFlag : uint8_t
+    {
+        Volatile = 1,
+        Relative = 2,
+        WholeCols = 4,
+        WholeRows = 8,
+        Deleted = 16,
+    };
+
+    // one node of a tree in preorder, its children follow it
+    struct NodeRecord
+    {
+        uint8_t type;     // ASTNodeType
+        uint8_t op;       // LiteralType, ReferenceType, UnaryOp, BinaryOp or SpecialForm
+        uint8_t inferred; // BaseType
+        uint8_t flags;    // NodeFlag
+        int32_t cse_slot;
+        uint32_t children;
+        int32_t sheet;
+        uint32_t text; // literal text, function or name identifier
+        int32_t a, b, c, d; // row, col of a cell and top, left, bottom, right of a range, name slot in a
+        uint32_t reserved;
+        double number;
+    };
+
+    struct FormulaRecord
+    {
+        uint64_t key; // workbook key
+        uint32_t program;
+        uint32_t reserved;
+    };
+
+    struct EdgeRecord
+    {
+        uint64_t key; // formula
+        uint64_t first_range;
+        uint32_t sheet; // whose index it is in
+        uint32_t dynamic;
+        uint32_t precedents; // ranges, the dynamic reads follow them
+        uint32_t dynamic_reads;
+    };
+
+    struct RangeRecord
+    {
+        int32_t top, left, bottom, right;
+    };
+
+    class Writer
+    {
+    public:
+        std::vector<char> sections[SectionCount];
+
+        template <typename T>
+        uint64_t append(Section section, const T &record)
+        {
+            std::vector<char> &out = sections[section];
+            const uint64_t index = out.size() / sizeof(T);
+            const char *bytes = reinterpret_cast<const char *>(&record);
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+            return index;
+        }
+
+        template <typename T>
+        uint64_t count(Section section) const { return sections[section].size() / sizeof(T); }
+
+        uint32_t string(std::string_view s)
+        {
+            auto [it, inserted] = strings_.try_emplace(std::string(s), static_cast<uint32_t>(strings_.size()));
+            if (inserted)
+            {
+                append(StringIndex, StringRecord{sections[StringChars].size(), s.size()});
+                sections[StringChars].insert(sections[StringChars].end(), s.begin(), s.end());
+            }
+            return it->second;
+        }
+
+        uint32_t interned(InternedText text)
+        {
+            auto [it, inserted] = interned_.try_emplace(text.id, 0);
+            if (inserted)
+                it->second = string(StringPool::global().view(text));
+            return it->second;
+        }
+
+        ValueRecord value(const Value &v, uint16_t offset)
+        {
+            ValueRecord record{};
+            record.offset = offset;
+            if (const auto *number = std::get_if<Number>(&v))
+            {
+                record.tag = ValueTag::Number;
+                record.payload = std::bit_cast<uint64_t>(*number);
+            }
+            else if (const auto *flag = std::get_if<Bool>(&v))
+            {
+                record.tag = ValueTag::Bool;
+                record.payload = *flag;
+            }
+            else if (const auto *text = std::get_if<Text>(&v))
+            {
+                record.tag = ValueTag::Text;
+                record.payload = string(*text);
+            }
+            else if (const auto *text = std::get_if<InternedText>(&v))
+            {
+                record.tag = ValueTag::Interned;
+                record.payload = interned(*text);
+            }
+            else if (const auto *error = std::get_if<Error>(&v))
+            {
+                record.tag = ValueTag::Error;
+                record.payload = static_cast<uint64_t>(error->code);
+            }
+            else if (const auto *array = std::get_if<Array>(&v))
+            {
+                // cells first, an array may hold arrays
+                std::vector<ValueRecord> cells;
+                for (const Value &cell : array->data->cells)
+                    cells.push_back(value(cell, 0));
+                ArrayRecord out{static_cast<uint32_t>(array->rows), static_cast<uint32_t>(array->cols), count<ValueRecord>(Values)};
+                for (const ValueRecord &cell : cells)
+                    append(Values, cell);
+                record.tag = ValueTag::Array;
+                record.payload = append(Arrays, out);
+            }
+            else if (std::holds_alternative<RangeRef>(v))
+            {
+                // cells never hold one, evaluateFormula turns it into #VALUE!
+                record.tag = ValueTag::Error;
+                record.payload = static_cast<uint64_t>(ErrorCode::Value);
+            }
+            else
+            {
+                record.tag = ValueTag::Blank;
+            }
+            return record;
+        }
+
+        void node(const ASTNode *n)
+        {
+            NodeRecord record{};
+            record.type = static_cast<uint8_t>(n->type);
+            record.inferred = static_cast<uint8_t>(n->inferredType.type);
+            record.flags = n->isVolatile ? Volatile : 0;
+            record.cse_slot = n->cseSlot;
+            record.sheet = -1;
+            switch (n->type)
+            {
+            case ASTNodeType::Literal:
+            {
+                const auto &lit = std::get<Literal>(n->node);
+                record.op = static_cast<uint8_t>(lit.type);
+                if (lit.type == LiteralType::Numeric)
+                    record.number = std::get<double>(lit.value);
+                else
+                    record.text = interned(std::get<InternedText>(lit.value));
+                break;
+            }
+            case ASTNodeType::Reference:
+            {
+                const auto &reference = std::get<Reference>(n->node);
+                record.op = static_cast<uint8_t>(reference.type);
+                record.sheet = reference.sheet;
+                record.flags |= reference.deleted ? Deleted : 0;
+                if (reference.type == ReferenceType::Cell)
+                {
+                    const auto &ref = std::get<CellReference>(reference.ref);
+                    record.a = ref.row;
+                    record.b = ref.col;
+                    record.flags |= ref.relative ? Relative : 0;
+                }
+                else
+                {
+                    const auto &ref = std::get<RangeReference>(reference.ref);
+                    record.a = ref.top;
+                    record.b = ref.left;
+                    record.c = ref.bottom;
+                    record.d = ref.right;
+                    record.flags |= (ref.relative ? Relative : 0) | (ref.whole_cols ? WholeCols : 0) | (ref.whole_rows ? WholeRows : 0);
+                }
+                break;
+            }
+            case ASTNodeType::Unary:
+                record.op = static_cast<uint8_t>(std::get<UnaryOperation>(n->node).op);
+                record.children = 1;
+                break;
+            case ASTNodeType::Binary:
+                record.op = static_cast<uint8_t>(std::get<BinaryOperation>(n->node).op);
+                record.children = 2;
+                break;
+            case ASTNodeType::FunctionCall:
+            {
+                const auto &call = std::get<FunctionCall>(n->node);
+                record.op = static_cast<uint8_t>(call.form);
+                record.text = string(call.identifier);
+                record.children = static_cast<uint32_t>(call.args.size());
+                break;
+            }
+            case ASTNodeType::Name:
+            {
+                const auto &name = std::get<Name>(n->node);
+                record.text = string(name.identifier);
+                record.a = name.slot;
+                break;
+            }
+            }
+            append(Nodes, record);
+            forEachChild(n, [&](const ASTNode *child)
+                         { node(child); });
+        }
+
+    private:
+        std::unordered_map<std::string, uint32_t> strings_;
+        std::unordered_map<uint32_t, uint32_t> interned_; // pool id -> string
+    };
+
+    [[noreturn]] void corrupt()
+    {
+        throw std::runtime_error("CORRUPT SNAPSHOT");
+    }
+
+    // the sections of a mapped file
+    class Reader
+    {
+    public:
+        Reader(const char *base, const SectionEntry *table) : base_(base), table_(table) {}
+
+        template <typename T>
+        const T *records(Section section, size_t &count) const
+        {
+            const SectionEntry &entry = table_[section];
+            if (entry.size % sizeof(T))
+                corrupt();
+            count = entry.size / sizeof(T);
+            return reinterpret_cast<const T *>(base_ + entry.offset);
+        }
+
+        void loadStrings()
+        {
+            strings_ = records<StringRecord>(StringIndex, string_count_);
+            size_t chars_size;
+            chars_ = records<char>(StringChars, chars_size);
+            for (size_t i = 0; i < string_count_; i++)
+                if (strings_[i].offset > chars_size || strings_[i].size > chars_size - strings_[i].offset)
+                    corrupt();
+            interned_.assign(string_count_, unset);
+        }
+
+        size_t stringCount() const { return string_count_; }
+
+        std::string_view string(uint64_t index) const
+        {
+            if (index >= string_count_)
+                corrupt();
+            return std::string_view(chars_ + strings_[index].offset, strings_[index].size);
+        }
+
+        // every string is interned once, however many cells and literals hold it
+        InternedText interned(uint64_t index)
+        {
+            std::string_view s = string(index);
+            if (interned_[index] == unset)
+                interned_[index] = StringPool::global().intern(s).id;
+            return InternedText{interned_[index]};
+        }
+
+        Value value(const ValueRecord &record)
+        {
+            switch (record.tag)
+            {
+            case ValueTag::Number:
+                return std::bit_cast<double>(record.payload);
+            case ValueTag::Bool:
+                return record.payload != 0;
+            case ValueTag::Text:
+                return Text(string(record.payload));
+            case ValueTag::Interned:
+                return interned(record.payload);
+            case ValueTag::Error:
+                if (record.payload > static_cast<uint64_t>(ErrorCode::NA))
+                    corrupt();
+                return Error{static_cast<ErrorCode>(record.payload)};
+            case ValueTag::Blank:
+                return Blank{};
+            case ValueTag::Array:
+            {
+                size_t array_count, value_count;
+                const ArrayRecord *arrays = records<ArrayRecord>(Arrays, array_count);
+                const ValueRecord *values = records<ValueRecord>(Values, value_count);
+                if (record.payload >= array_count)
+                    corrupt();
+                const ArrayRecord &array = arrays[record.payload];
+                const uint64_t cells = static_cast<uint64_t>(array.rows) * array.cols;
+                if (array.first_value > value_count || cells > value_count - array.first_value)
+                    corrupt();
+                auto data = std::make_shared<ArrayData>();
+                data->cells.reserve(cells);
+                for (uint64_t i = 0; i < cells; i++)
+                    data->cells.push_back(value(values[array.first_value + i]));
+                return Array{static_cast<int>(array.rows), static_cast<int>(array.cols), std::move(data)};
+            }
+            }
+            corrupt();
+        }
+
+        ASTNode node(const NodeRecord *&next, const NodeRecord *end)
+        {
+            if (next == end)
+                corrupt();
+            const NodeRecord &record = *next++;
+            ASTNode n;
+            n.type = static_cast<ASTNodeType>(record.type);
+            n.inferredType = {static_cast<BaseType>(record.inferred)};
+            n.cseSlot = record.cse_slot;
+            n.isVolatile = record.flags & Volatile;
+            auto child = [&]()
+            { return std::make_unique<ASTNode>(node(next, end)); };
+            switch (n.type)
+            {
+            case ASTNodeType::Literal:
+                if (static_cast<LiteralType>(record.op) == LiteralType::Numeric)
+                    n.node = Literal{LiteralType::Numeric, record.number};
+                else
+                    n.node = Literal{LiteralType::String, interned(record.text)};
+                break;
+            case ASTNodeType::Reference:
+            {
+                Reference reference;
+                reference.type = static_cast<ReferenceType>(record.op);
+                reference.sheet = record.sheet;
+                reference.deleted = record.flags & Deleted;
+                if (reference.type == ReferenceType::Cell)
+                    reference.ref = CellReference{record.a, record.b, (record.flags & Relative) != 0};
+                else
+                    reference.ref = RangeReference{record.a, record.b, record.c, record.d, (record.flags & Relative) != 0,
+                                                   (record.flags & WholeCols) != 0, (record.flags & WholeRows) != 0};
+                n.node = std::move(reference);
+                break;
+            }
+            case ASTNodeType::Unary:
+            {
+                UnaryOperation unary{static_cast<UnaryOp>(record.op), child()};
+                n.node = std::move(unary);
+                break;
+            }
+            case ASTNodeType::Binary:
+            {
+                // braced initializers run in order, left comes first in preorder
+                n.node = BinaryOperation{static_cast<BinaryOp>(record.op), child(), child()};
+                break;
+            }
+            case ASTNodeType::FunctionCall:
+            {
+                FunctionCall call{std::string(string(record.text)), {}, static_cast<SpecialForm>(record.op)};
+                if (record.children > static_cast<size_t>(end - next))
+                    corrupt();
+                call.args.reserve(record.children);
+                for (uint32_t i = 0; i < record.children; i++)
+                    call.args.push_back(child());
+                n.node = std::move(call);
+                break;
+            }
+            case ASTNodeType::Name:
+                n.node = Name{std::string(string(record.text)), record.a};
+                break;
+            default:
+                corrupt();
+            }
+            return n;
+        }
+
+    private:
+        static constexpr uint32_t unset = ~uint32_t{0};
+
+        const char *base_;
+        const SectionEntry *table_;
+        const StringRecord *strings_ = nullptr;
+        size_t string_count_ = 0;
+        const char *chars_ = nullptr;
+        std::vector<uint32_t> interned_; // string -> pool id
+    };
+
+    // a read only private mapping of a whole file
+    class Mapping
+    {
+    public:
+        explicit Mapping(const std::string &path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error("CANNOT OPEN SNAPSHOT: " + path);
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("CANNOT OPEN SNAPSHOT: " + path);
+            }
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ < sizeof(Header))
+            {
+                ::close(fd);
+                throw std::runtime_error("NOT A SNAPSHOT: " + path);
+            }
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            // every page is read on load, fault them in at once
+            flags |= MAP_POPULATE;
+#endif
+            void *data = ::mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+                throw std::runtime_error("CANNOT MAP SNAPSHOT: " + path);
+            data_ = static_cast<const char *>(data);
+        }
+        ~Mapping() { ::munmap(const_cast<char *>(data_), size_); }
+        Mapping(const Mapping &) = delete;
+        Mapping &operator=(const Mapping &) = delete;
+
+        const char *data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    void writeAll(int fd, const void *data, size_t size, const std::string &path)
+    {
+        const char *p = static_cast<const char *>(data);
+        while (size)
+        {
+            ssize_t n = ::write(fd, p, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                throw std::runtime_error("CANNOT WRITE SNAPSHOT: " + path);
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+}
+
+SnapshotStats Snapshot::save(const Workbook &book, const std::string &path)
+{
+    if (book.open_)
+        throw std::runtime_error("TRANSACTION ALREADY OPEN");
+    SnapshotStats stats;
+    Clock::time_point phase = Clock::now();
+    Writer out;
+
+    for (int sheet = 0; sheet < book.sheetCount(); sheet++)
+        out.append(Sheets, SheetRecord{out.string(book.sheetName(sheet)), 0});
+    stats.sheets = book.sheets_.size();
+
+    // the draft is the last committed state while no transaction is open
+    for (uint32_t sheet = 0; sheet < book.sheets_.size(); sheet++)
+    {
+        const SheetStore &store = book.sheets_[sheet]->versions.draft();
+        stats.cells += store.cellCount();
+        const int last_col = store.usedRange().last_col;
+        for (int col = 1; col <= last_col; col++)
+        {
+            store.forEachChunk(col, 1, max_rows, [&](const ColumnChunk &chunk, int chunk_first_row, int, int)
+                               {
+                ChunkRecord record{sheet, static_cast<uint32_t>(col), static_cast<uint32_t>((chunk_first_row - 1) / ColumnChunk::rows),
+                                   chunk.count, 0, chunk.others.size()};
+                std::vector<ValueRecord> others;
+                others.reserve(chunk.others.size());
+                for (const auto &[offset, value] : chunk.others)
+                    others.push_back(out.value(value, offset));
+                record.first_value = out.count<ValueRecord>(Values);
+                for (const ValueRecord &value : others)
+                    out.append(Values, value);
+                out.append(Chunks, record);
+                auto &arrays = out.sections[ChunkArrays];
+                const size_t at = arrays.size();
+                arrays.resize(at + sizeof(ChunkArrayRecord));
+                auto *dst = reinterpret_cast<ChunkArrayRecord *>(arrays.data() + at);
+                std::memcpy(dst->numbers, chunk.numbers.data(), sizeof dst->numbers);
+                std::memcpy(dst->numeric, chunk.numeric.data(), sizeof dst->numeric);
+                std::memcpy(dst->occupied, chunk.occupied.data(), sizeof dst->occupied);
+                stats.chunks++; });
+        }
+    }
+    stats.values_ms = millisSince(phase);
+
+    // formula cells and index entries go in cell order, loading then fills the maps row by row
+    // instead of in hash order
+    auto sort_by_key = [&](Section section, auto record, uint64_t first)
+    {
+        using Record = decltype(record);
+        auto *records = reinterpret_cast<Record *>(out.sections[section].data());
+        std::sort(records + first, records + out.count<Record>(section), [](const Record &a, const Record &b)
+                  { return a.key < b.key; });
+    };
+
+    // every program of the cache, handles stay what they are
+    for (FormulaHandle handle = 0; handle < book.cache_.size(); handle++)
+    {
+        const CompiledFormula &compiled = book.cache_.get(handle);
+        ProgramRecord record{};
+        record.key = out.string(compiled.key);
+        record.first_node = out.count<NodeRecord>(Nodes);
+        out.node(&compiled.root);
+        record.nodes = static_cast<uint32_t>(out.count<NodeRecord>(Nodes) - record.first_node);
+        record.local_slots = compiled.local_slots;
+        record.cse_slots = compiled.cse_slots;
+        record.cse_stats[0] = compiled.cse_stats.nodes;
+        record.cse_stats[1] = compiled.cse_stats.unique_nodes;
+        record.cse_stats[2] = compiled.cse_stats.shared_subtrees;
+        record.cse_stats[3] = compiled.cse_stats.shared_nodes;
+        out.append(Programs, record);
+    }
+    stats.programs = book.cache_.size();
+    for (const auto &sheet : book.sheets_)
+        for (const auto &[key, formula] : sheet->formulas)
+            out.append(Formulas, FormulaRecord{key, formula.handle, 0});
+    sort_by_key(Formulas, FormulaRecord{}, 0);
+    stats.formulas = out.count<FormulaRecord>(Formulas);
+    stats.programs_ms = millisSince(phase);
+
+    for (uint32_t sheet = 0; sheet < book.sheets_.size(); sheet++)
+    {
+        const uint64_t first = out.count<EdgeRecord>(Edges);
+        book.sheets_[sheet]->deps.forEachEntry([&](uint64_t formula, bool dynamic, const std::vector<RangeRef> &precedents,
+                                                   const std::vector<RangeRef> &dynamic_reads)
+                                               {
+            out.append(Edges, EdgeRecord{formula, out.count<RangeRecord>(Ranges), sheet, dynamic,
+                                         static_cast<uint32_t>(precedents.size()), static_cast<uint32_t>(dynamic_reads.size())});
+            for (const auto *ranges : {&precedents, &dynamic_reads})
+                for (const RangeRef &range : *ranges)
+                    out.append(Ranges, RangeRecord{range.top, range.left, range.bottom, range.right}); });
+        sort_by_key(Edges, EdgeRecord{}, first);
+    }
+    stats.edges = out.count<EdgeRecord>(Edges);
+    stats.strings = out.count<StringRecord>(StringIndex);
+    stats.index_ms = millisSince(phase);
+
+    // layout, the section table right after the header and every section aligned
+    SectionEntry table[SectionCount];
+    uint64_t offset = sizeof(Header) + sizeof(table);
+    for (uint32_t section = 0; section < SectionCount; section++)
+    {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        table[section] = {offset, out.sections[section].size()};
+        offset += out.sections[section].size();
+    }
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof magic);
+    header.version = format_version;
+    header.sections = SectionCount;
+    header.size = offset;
+    header.commit = book.commits_;
+    header.rand_seed = book.ctx_.rand_seed;
+    header.recalc_epoch = book.ctx_.recalc_epoch;
+    header.checksum = checksum::hash64(table, sizeof(table));
+    for (const auto &section : out.sections)
+        header.checksum = checksum::hash64(section.data(), section.size(), header.checksum);
+    stats.bytes = header.size;
+    stats.commit = header.commit;
+
+    // readers of path see the old file or the whole new one
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("CANNOT WRITE SNAPSHOT: " + path);
+    try
+    {
+        static const char padding[alignment] = {};
+        writeAll(fd, &header, sizeof header, path);
+        writeAll(fd, table, sizeof table, path);
+        uint64_t written = sizeof header + sizeof table;
+        for (uint32_t section = 0; section < SectionCount; section++)
+        {
+            writeAll(fd, padding, table[section].offset - written, path);
+            writeAll(fd, out.sections[section].data(), out.sections[section].size(), path);
+            written = table[section].offset + table[section].size;
+        }
+        if (::fsync(fd) != 0)
+            throw std::runtime_error("CANNOT WRITE SNAPSHOT: " + path);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        ::unlink(tmp.c_str());
+        throw std::runtime_error("CANNOT WRITE SNAPSHOT: " + path);
+    }
+    stats.map_ms = millisSince(phase);
+    return stats;
+}
+
+SnapshotStats Snapshot::load(Workbook &book, const std::string &path)
+{
+    if (book.open_ || book.sheets_.size() != 1 || book.commits_ || book.cache_.size() ||
+        !book.sheets_[0]->formulas.empty() || book.stores_[0]->cellCount())
+        throw std::runtime_error("SNAPSHOT NEEDS A NEW WORKBOOK");
+    SnapshotStats stats;
+    Clock::time_point phase = Clock::now();
+    Mapping file(path);
+    Header header;
+    std::memcpy(&header, file.data(), sizeof header);
+    if (std::memcmp(header.magic, magic, sizeof magic) != 0)
+        throw std::runtime_error("NOT A SNAPSHOT: " + path);
+    if (header.version != format_version)
+        throw std::runtime_error("UNSUPPORTED SNAPSHOT VERSION " + std::to_string(header.version));
+    if (header.sections != SectionCount || header.size != file.size() || file.size() < sizeof(Header) + sizeof(SectionEntry) * SectionCount)
+        corrupt();
+    const auto *table = reinterpret_cast<const SectionEntry *>(file.data() + sizeof(Header));
+    uint64_t sum = checksum::hash64(table, sizeof(SectionEntry) * SectionCount);
+    for (uint32_t section = 0; section < SectionCount; section++)
+    {
+        if (table[section].offset % alignment || table[section].offset > file.size() || table[section].size > file.size() - table[section].offset)
+            corrupt();
+        sum = checksum::hash64(file.data() + table[section].offset, table[section].size, sum);
+    }
+    if (sum != header.checksum)
+        corrupt();
+    stats.bytes = file.size();
+    stats.commit = header.commit;
+    stats.map_ms = millisSince(phase);
+
+    Reader in(file.data(), table);
+    in.loadStrings();
+    stats.strings = in.stringCount();
+    size_t sheet_count;
+    const SheetRecord *sheets = in.records<SheetRecord>(Sheets, sheet_count);
+    if (!sheet_count || in.string(sheets[0].name) != book.sheetName(0))
+        corrupt();
+    for (size_t sheet = 1; sheet < sheet_count; sheet++)
+        book.addSheet(std::string(in.string(sheets[sheet].name)));
+    stats.sheets = sheet_count;
+    stats.strings_ms = millisSince(phase);
+
+    size_t chunk_count, value_count;
+    const ChunkRecord *chunks = in.records<ChunkRecord>(Chunks, chunk_count);
+    const ValueRecord *values = in.records<ValueRecord>(Values, value_count);
+    size_t arrays_count;
+    const ChunkArrayRecord *arrays = in.records<ChunkArrayRecord>(ChunkArrays, arrays_count);
+    if (arrays_count != chunk_count)
+        corrupt();
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        const ChunkRecord &record = chunks[i];
+        if (record.sheet >= sheet_count || record.first_value > value_count || record.values > value_count - record.first_value ||
+            record.count > ColumnChunk::rows)
+            corrupt();
+        auto chunk = std::make_shared<ColumnChunk>();
+        std::memcpy(chunk->numbers.data(), arrays[i].numbers, sizeof arrays[i].numbers);
+        std::memcpy(chunk->numeric.data(), arrays[i].numeric, sizeof arrays[i].numeric);
+        std::memcpy(chunk->occupied.data(), arrays[i].occupied, sizeof arrays[i].occupied);
+        chunk->count = record.count;
+        chunk->others.reserve(record.values);
+        for (uint64_t v = 0; v < record.values; v++)
+            chunk->others.emplace_back(values[record.first_value + v].offset, in.value(values[record.first_value + v]));
+        book.sheets_[record.sheet]->versions.draft().putChunk(static_cast<int>(record.col), record.idx, std::move(chunk));
+        stats.cells += record.count;
+    }
+    stats.chunks = chunk_count;
+    stats.values_ms = millisSince(phase);
+
+    size_t program_count, node_count;
+    const ProgramRecord *programs = in.records<ProgramRecord>(Programs, program_count);
+    const NodeRecord *nodes = in.records<NodeRecord>(Nodes, node_count);
+    std::vector<FormulaHandle> handles;
+    handles.reserve(program_count);
+    for (size_t i = 0; i < program_count; i++)
+    {
+        const ProgramRecord &record = programs[i];
+        if (record.first_node > node_count || record.nodes > node_count - record.first_node)
+            corrupt();
+        CompiledFormula compiled;
+        compiled.key = std::string(in.string(record.key));
+        const NodeRecord *next = nodes + record.first_node;
+        const NodeRecord *end = next + record.nodes;
+        compiled.root = in.node(next, end);
+        if (next != end)
+            corrupt();
+        compiled.local_slots = record.local_slots;
+        compiled.cse_slots = record.cse_slots;
+        compiled.cse_stats.nodes = record.cse_stats[0];
+        compiled.cse_stats.unique_nodes = record.cse_stats[1];
+        compiled.cse_stats.shared_subtrees = record.cse_stats[2];
+        compiled.cse_stats.shared_nodes = record.cse_stats[3];
+        handles.push_back(book.cache_.adopt(std::move(compiled)));
+    }
+    stats.programs = program_count;
+    size_t formula_count;
+    const FormulaRecord *formulas = in.records<FormulaRecord>(Formulas, formula_count);
+    std::vector<size_t> per_sheet(sheet_count, 0);
+    for (size_t i = 0; i < formula_count; i++)
+        per_sheet[std::min(static_cast<size_t>(sheetFromKey(formulas[i].key)), sheet_count - 1)]++;
+    for (size_t sheet = 0; sheet < sheet_count; sheet++)
+        book.sheets_[sheet]->formulas.reserve(per_sheet[sheet]);
+    for (size_t i = 0; i < formula_count; i++)
+    {
+        const FormulaRecord &record = formulas[i];
+        const size_t sheet = static_cast<size_t>(sheetFromKey(record.key));
+        if (sheet >= sheet_count || record.program >= program_count)
+            corrupt();
+        FormulaHandle handle = handles[record.program];
+        book.sheets_[sheet]->formulas.emplace(record.key, FormulaCell{handle, cellFromKey(record.key)});
+        if (book.cache_.get(handle).root.isVolatile)
+            book.volatile_cells_.insert(record.key);
+    }
+    stats.formulas = formula_count;
+    stats.programs_ms = millisSince(phase);
+
+    size_t edge_count, range_count;
+    const EdgeRecord *edges = in.records<EdgeRecord>(Edges, edge_count);
+    const RangeRecord *ranges = in.records<RangeRecord>(Ranges, range_count);
+    // sized up front, rehashing while hundreds of thousands of formulas go in costs more than the inserts
+    std::vector<size_t> entries(sheet_count, 0), cells(sheet_count, 0);
+    for (size_t i = 0; i < edge_count; i++)
+    {
+        if (edges[i].sheet >= sheet_count)
+            corrupt();
+        entries[edges[i].sheet]++;
+        cells[edges[i].sheet] += edges[i].precedents;
+    }
+    for (size_t sheet = 0; sheet < sheet_count; sheet++)
+        book.sheets_[sheet]->deps.reserve(entries[sheet], cells[sheet]);
+    Precedents precedents;
+    std::vector<RangeRef> dynamic_reads;
+    for (size_t i = 0; i < edge_count; i++)
+    {
+        const EdgeRecord &record = edges[i];
+        const uint64_t used = static_cast<uint64_t>(record.precedents) + record.dynamic_reads;
+        if (record.first_range > range_count || used > range_count - record.first_range)
+            corrupt();
+        auto range_at = [&](uint64_t r)
+        {
+            const RangeRecord &range = ranges[record.first_range + r];
+            return RangeRef{range.left, range.right, range.top, range.bottom};
+        };
+        precedents.dynamic = record.dynamic != 0;
+        precedents.ranges.clear();
+        for (uint32_t r = 0; r < record.precedents; r++)
+            precedents.ranges.push_back(range_at(r));
+        DependencyIndex &deps = book.sheets_[record.sheet]->deps;
+        deps.add(record.key, precedents);
+        if (record.dynamic_reads)
+        {
+            dynamic_reads.clear();
+            for (uint32_t r = 0; r < record.dynamic_reads; r++)
+                dynamic_reads.push_back(range_at(record.precedents + r));
+            deps.setDynamicReads(record.key, dynamic_reads);
+        }
+        if (static_cast<uint32_t>(sheetFromKey(record.key)) != record.sheet)
+            book.remote_reads_[record.key].push_back(static_cast<int>(record.sheet));
+    }
+    stats.edges = edge_count;
+
+    book.commits_ = header.commit;
+    book.ctx_.rand_seed = header.rand_seed;
+    book.ctx_.recalc_epoch = header.recalc_epoch;
+    for (const auto &sheet : book.sheets_)
+        sheet->versions.publish();
+    stats.index_ms = millisSince(phase);
+    return stats;
+}
@@ -0,0 +1,60 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Workbook;
+
+// what a save or load did and where its time went
+struct SnapshotStats
+{
+    size_t bytes = 0;
+    size_t sheets = 0;
+    size_t cells = 0;
+    size_t chunks = 0;   // column chunks, copied as they are laid out in the file
+    size_t programs = 0; // compiled formulas, restored without lexing or parsing
+    size_t formulas = 0; // formula cells
+    size_t edges = 0;    // dependency index entries
+    size_t strings = 0;
+    uint64_t commit = 0; // commit number of the workbook state in the file
+
+    double map_ms = 0; // writing the file, or mapping it and checking its checksum
+    double strings_ms = 0;
+    double values_ms = 0;
+    double programs_ms = 0;
+    double index_ms = 0;
+};
+
+// versioned binary image of a workbook's committed state, written in one go and mapped on load
+// the file is a header, a table of sections and the sections, each 64 byte aligned:
+//   strings   one table of every string (sheet names, text cells, literals, identifiers, keys)
+//   sheets    names
+//   chunks    column chunks, the number and bitmap arrays of ColumnChunk as they are in memory
+//   values    non numeric cells of the chunks and the cells of arrays, strings by table index
+//   arrays    array values
+//   programs  compiled formulas, the key and the type checked, CSE'd tree as preorder records
+//   nodes     those records
+//   formulas  formula cells, workbook key and program
+//   edges     entries of each sheet's dependency index, the ranges add and setDynamicReads got
+//   ranges    those ranges
+// loading reads the sections where they are mapped, strings are viewed in place and interned
+// once, chunks are copied whole and programs are rebuilt from their records, only the hash based
+// parts (formula cells, dependency index) are built again
+// the header carries a checksum of everything after it, a file that doesn't match, was cut short
+// or has another format version is rejected before anything is loaded
+class Snapshot
+{
+public:
+    static constexpr uint32_t format_version = 1;
+
+    // writes the last committed state of book to path through a temporary file that is synced and
+    // renamed over it, throws when a transaction is open or the file can't be written
+    static SnapshotStats save(const Workbook &book, const std::string &path);
+    // loads path into book, which has to be new: one empty sheet and nothing committed
+    // throws when the file can't be read, isn't a snapshot or is damaged
+    static SnapshotStats load(Workbook &book, const std::string &path);
+};
+
+#endif
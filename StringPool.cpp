@@ -0,0 +1,115 @@
+#include "StringPool.h"
+#include <bit>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+const char *StringPool::Shard::store(std::string_view s)
+{
+    if (s.empty())
+        return "";
+    // long strings get a block of their own so they don't waste the rest of the current one
+    if (s.size() > block_bytes / 8)
+    {
+        char *own = blocks.emplace_back(std::make_unique<char[]>(s.size())).get();
+        std::memcpy(own, s.data(), s.size());
+        return own;
+    }
+    if (!block || block_used + s.size() > block_bytes)
+    {
+        block = blocks.emplace_back(std::make_unique<char[]>(block_bytes)).get();
+        block_used = 0;
+    }
+    char *out = block + block_used;
+    std::memcpy(out, s.data(), s.size());
+    block_used += s.size();
+    return out;
+}
+
+StringPool::StringPool() : shards_(std::make_unique<Shard[]>(size_t{1} << shard_bits))
+{
+    for (auto &segment : segments_)
+        segment.store(nullptr, std::memory_order_relaxed);
+}
+
+StringPool::~StringPool()
+{
+    for (auto &segment : segments_)
+        delete[] segment.load(std::memory_order_relaxed);
+}
+
+std::string_view &StringPool::entry(uint32_t id)
+{
+    const uint32_t v = id + (uint32_t{1} << first_segment_bits);
+    const int top = 31 - std::countl_zero(v);
+    std::atomic<std::string_view *> &slot = segments_[top - first_segment_bits];
+    std::string_view *segment = slot.load(std::memory_order_acquire);
+    if (!segment)
+    {
+        auto *fresh = new std::string_view[size_t{1} << top]();
+        if (slot.compare_exchange_strong(segment, fresh, std::memory_order_acq_rel))
+            segment = fresh;
+        else
+            delete[] fresh;
+    }
+    return segment[v - (uint32_t{1} << top)];
+}
+
+std::string_view StringPool::view(InternedText text) const
+{
+    const uint32_t v = text.id + (uint32_t{1} << first_segment_bits);
+    const int top = 31 - std::countl_zero(v);
+    return segments_[top - first_segment_bits].load(std::memory_order_acquire)[v - (uint32_t{1} << top)];
+}
+
+InternedText StringPool::intern(std::string_view s)
+{
+    const size_t hash = std::hash<std::string_view>{}(s);
+    Shard &shard = shards_[hash >> (sizeof(size_t) * 8 - shard_bits)];
+    shard.lookups.fetch_add(1, std::memory_order_relaxed);
+    auto hit = [&](uint32_t id)
+    {
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        shard.bytes_saved.fetch_add(s.size(), std::memory_order_relaxed);
+        return InternedText{id};
+    };
+    {
+        std::shared_lock lock(shard.mutex);
+        if (auto it = shard.ids.find(s); it != shard.ids.end())
+            return hit(it->second);
+    }
+
+    std::unique_lock lock(shard.mutex);
+    if (auto it = shard.ids.find(s); it != shard.ids.end())
+        return hit(it->second);
+    const uint32_t id = next_id_.fetch_add(1, std::memory_order_relaxed);
+    if (id >= max_strings)
+        throw std::length_error("STRING POOL FULL");
+    std::string_view stored(shard.store(s), s.size());
+    // the entry is written before the id is published through the map
+    entry(id) = stored;
+    shard.ids.emplace(stored, id);
+    shard.bytes.fetch_add(s.size(), std::memory_order_relaxed);
+    return InternedText{id};
+}
+
+InternStats StringPool::stats() const
+{
+    InternStats stats;
+    for (size_t i = 0; i < (size_t{1} << shard_bits); i++)
+    {
+        const Shard &shard = shards_[i];
+        stats.lookups += shard.lookups.load(std::memory_order_relaxed);
+        stats.hits += shard.hits.load(std::memory_order_relaxed);
+        stats.bytes_saved += shard.bytes_saved.load(std::memory_order_relaxed);
+        stats.bytes += shard.bytes.load(std::memory_order_relaxed);
+    }
+    stats.strings = next_id_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+StringPool &StringPool::global()
+{
+    static StringPool pool;
+    return pool;
+}
@@ -0,0 +1,87 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include "EvalTypes.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct InternStats
+{
+    size_t lookups = 0;
+    size_t hits = 0;        // lookups that found the string already in the pool
+    size_t strings = 0;     // distinct strings
+    size_t bytes = 0;       // characters stored, once per distinct string
+    size_t bytes_saved = 0; // characters the hits would have stored again
+
+    double hitRate() const { return lookups ? static_cast<double>(hits) / lookups : 0.0; }
+};
+
+// append only string interning, a string gets an id the first time it is seen and keeps it and its
+// characters for the life of the pool, so ids are stable and views never dangle
+// lookups are spread over shards behind reader/writer locks, reading a known id takes no lock
+class StringPool
+{
+public:
+    StringPool();
+    ~StringPool();
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+
+    InternedText intern(std::string_view s);
+    // text must come from this pool
+    std::string_view view(InternedText text) const;
+    InternStats stats() const;
+
+    // the pool text cells and formula literals are interned into
+    static StringPool &global();
+
+private:
+    static constexpr int shard_bits = 6;
+    static constexpr int first_segment_bits = 10; // segment k holds ids for 1024 << k strings
+    static constexpr int segment_count = 32 - first_segment_bits;
+    static constexpr uint32_t max_strings = ~uint32_t{0} - (uint32_t{1} << first_segment_bits);
+    static constexpr size_t block_bytes = 64 * 1024;
+
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string_view, uint32_t> ids; // keys point into blocks
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char *block = nullptr; // block being filled
+        size_t block_used = 0;
+        std::atomic<size_t> lookups{0};
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> bytes_saved{0};
+        std::atomic<size_t> bytes{0};
+
+        const char *store(std::string_view s);
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    // id -> characters, segments are allocated on first use and never move
+    std::atomic<std::string_view *> segments_[segment_count];
+    std::atomic<uint32_t> next_id_{0};
+
+    std::string_view &entry(uint32_t id);
+};
+
+inline bool isText(const Value &v)
+{
+    return std::holds_alternative<Text>(v) || std::holds_alternative<InternedText>(v);
+}
+
+// characters of a text value, v must satisfy isText
+inline std::string_view textView(const Value &v)
+{
+    if (const auto *interned = std::get_if<InternedText>(&v))
+        return StringPool::global().view(*interned);
+    return std::get<Text>(v);
+}
+
+#endif
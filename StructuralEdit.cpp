@@ -0,0 +1,164 @@
+#include "StructuralEdit.h"
+#include "GPFEHelpers.h"
+#include <algorithm>
+
+bool StructuralEdit::mapLine(int &line) const
+{
+    if (line < at)
+        return true;
+    if (insert)
+    {
+        // pushed off the sheet, gone like a deleted cell
+        line += count;
+        return line <= (rows ? max_rows : max_cols);
+    }
+    if (line < at + count)
+        return false;
+    line -= count;
+    return true;
+}
+
+bool StructuralEdit::mapSpan(int &lo, int &hi) const
+{
+    const int limit = rows ? max_rows : max_cols;
+    if (insert)
+    {
+        if (lo >= at)
+            lo = std::min(lo + count, limit);
+        if (hi >= at)
+            hi = std::min(hi + count, limit);
+        return true;
+    }
+    if (lo >= at && hi < at + count)
+        return false;
+    lo = lo < at ? lo : lo >= at + count ? lo - count : at;
+    hi = hi < at ? hi : hi >= at + count ? hi - count : at - 1;
+    return true;
+}
+
+bool StructuralEdit::mapCell(RC &cell) const
+{
+    return mapLine(rows ? cell.first : cell.second);
+}
+
+static void extend(const ASTNode *node, int sheet, const StructuralEdit &edit, ReferenceExtent &extent)
+{
+    if (node->type != ASTNodeType::Reference)
+    {
+        forEachChild(node, [&](const ASTNode *child)
+                     { extend(child, sheet, edit, extent); });
+        return;
+    }
+    const auto &reference = std::get<Reference>(node->node);
+    if (reference.deleted)
+        return;
+    if ((reference.sheet < 0 ? sheet : reference.sheet) != edit.sheet)
+    {
+        // only a move of the anchor changes these
+        const bool whole = reference.type == ReferenceType::Range &&
+                           (edit.rows ? std::get<RangeReference>(reference.ref).whole_cols : std::get<RangeReference>(reference.ref).whole_rows);
+        extent.other_sheets |= !whole;
+        return;
+    }
+    auto rows = [&](int lo, int hi)
+    {
+        extent.row_lo = std::min(extent.row_lo, lo);
+        extent.row_hi = std::max(extent.row_hi, hi);
+    };
+    auto cols = [&](int lo, int hi)
+    {
+        extent.col_lo = std::min(extent.col_lo, lo);
+        extent.col_hi = std::max(extent.col_hi, hi);
+    };
+    if (reference.type == ReferenceType::Cell)
+    {
+        const auto &ref = std::get<CellReference>(reference.ref);
+        rows(ref.row, ref.row);
+        cols(ref.col, ref.col);
+        return;
+    }
+    const auto &ref = std::get<RangeReference>(reference.ref);
+    extent.whole_cols |= ref.whole_cols;
+    extent.whole_rows |= ref.whole_rows;
+    if (!ref.whole_cols)
+        rows(ref.top, ref.bottom);
+    if (!ref.whole_rows)
+        cols(ref.left, ref.right);
+}
+
+ReferenceExtent referenceExtent(const ASTNode *root, int sheet, const StructuralEdit &edit)
+{
+    ReferenceExtent extent;
+    extend(root, sheet, edit, extent);
+    return extent;
+}
+
+bool movesAsOne(const ReferenceExtent &extent, int sheet, RC anchor, const StructuralEdit &edit)
+{
+    const int line = edit.rows ? anchor.first : anchor.second;
+    const int lo = edit.rows ? extent.row_lo : extent.col_lo;
+    const int hi = edit.rows ? extent.row_hi : extent.col_hi;
+    const bool empty = lo > hi; // nothing along the edited axis
+    // above (left of) the edit, or on another sheet, the anchor stays and so must every target
+    if (sheet != edit.sheet || line < edit.at)
+        return empty || line + hi < edit.at;
+    // below (right of) everything the edit touches, the anchor moves and so must every target,
+    // cells on other sheets stay where they are
+    const int below = edit.insert ? edit.at : edit.at + edit.count;
+    if (line < below || extent.other_sheets)
+        return false;
+    // an insert can push the furthest reference off the sheet
+    const int limit = edit.rows ? max_rows : max_cols;
+    return empty || (line + lo >= below && (!edit.insert || line + hi + edit.count <= limit));
+}
+
+bool readsAcross(const ReferenceExtent &extent, const StructuralEdit &edit)
+{
+    return edit.rows ? extent.whole_cols : extent.whole_rows;
+}
+
+void rewriteReferences(ASTNode *root, int sheet, RC anchor, RC new_anchor, const StructuralEdit &edit)
+{
+    if (root->type != ASTNodeType::Reference)
+    {
+        forEachChild(root, [&](ASTNode *child)
+                     { rewriteReferences(child, sheet, anchor, new_anchor, edit); });
+        return;
+    }
+    auto &reference = std::get<Reference>(root->node);
+    if (reference.deleted)
+        return;
+    // offsets along the other axis don't change, the anchor only moves along the edited one
+    // references into other sheets keep their cells and only follow the anchor
+    const bool edited = (reference.sheet < 0 ? sheet : reference.sheet) == edit.sheet;
+    const int from = edit.rows ? anchor.first : anchor.second;
+    const int to = edit.rows ? new_anchor.first : new_anchor.second;
+    if (reference.type == ReferenceType::Cell)
+    {
+        auto &ref = std::get<CellReference>(reference.ref);
+        int &offset = edit.rows ? ref.row : ref.col;
+        int line = from + offset;
+        if (edited && !edit.mapLine(line))
+        {
+            reference.deleted = true;
+            return;
+        }
+        offset = line - to;
+        return;
+    }
+    auto &ref = std::get<RangeReference>(reference.ref);
+    // whole columns don't move on row edits and whole rows don't on column edits
+    if (edit.rows ? ref.whole_cols : ref.whole_rows)
+        return;
+    int &lo = edit.rows ? ref.top : ref.left;
+    int &hi = edit.rows ? ref.bottom : ref.right;
+    int first = from + lo;
+    int last = from + hi;
+    if (edited && !edit.mapSpan(first, last))
+    {
+        reference.deleted = true;
+        return;
+    }
+    lo = first - to;
+    hi = last - to;
+}
@@ -0,0 +1,54 @@
+#ifndef STRUCTURAL_EDIT_H
+#define STRUCTURAL_EDIT_H
+
+#include "GPFETypes.h"
+#include "EvalTypes.h"
+#include <climits>
+
+// count rows (or columns) of sheet inserted before at, or deleted starting at at
+// lines are row numbers for row edits and column numbers for column edits
+struct StructuralEdit
+{
+    bool rows = true;    // otherwise columns
+    bool insert = true;  // otherwise delete
+    int at = 1;
+    int count = 1;
+    int sheet = 0;
+
+    // where line ends up, false when it was deleted or pushed off the sheet
+    bool mapLine(int &line) const;
+    // lo..hi after the edit, inserts inside it widen it and deletes shrink it, false when all of
+    // it was deleted
+    bool mapSpan(int &lo, int &hi) const;
+    bool mapCell(RC &cell) const;
+};
+
+// offsets spanned by the references of a compiled formula into the sheet of an edit, rows leave out
+// whole columns and columns leave out whole rows since those don't move along that axis
+struct ReferenceExtent
+{
+    int row_lo = INT_MAX;
+    int row_hi = INT_MIN;
+    int col_lo = INT_MAX;
+    int col_hi = INT_MIN;
+    bool whole_cols = false;   // reads every row of some columns
+    bool whole_rows = false;
+    bool other_sheets = false; // also reads other sheets along the edited axis
+};
+
+// extent of the references of a formula living on sheet into the sheet edit changes
+ReferenceExtent referenceExtent(const ASTNode *root, int sheet, const StructuralEdit &edit);
+
+// true when the relative program of a formula at anchor on sheet stays the same, every reference
+// moves exactly as far as the anchor does
+bool movesAsOne(const ReferenceExtent &extent, int sheet, RC anchor, const StructuralEdit &edit);
+
+// true when edit adds or removes cells the formula reads without moving its references, whole
+// columns on row edits and whole rows on column edits
+bool readsAcross(const ReferenceExtent &extent, const StructuralEdit &edit);
+
+// rewrites the references under root of a formula on sheet moving from anchor to new_anchor,
+// references to deleted cells are marked deleted
+void rewriteReferences(ASTNode *root, int sheet, RC anchor, RC new_anchor, const StructuralEdit &edit);
+
+#endif
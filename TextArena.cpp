@@ -0,0 +1,93 @@
+#include "TextArena.h"
+#include <memory>
+
+namespace
+{
+    // monotonic arena over a buffer that is kept across resets, so a steady state recalc doesn't
+    // touch the heap at all, deallocate is a no-op and reset rewinds to the start of the buffer
+    class ArenaResource : public std::pmr::memory_resource
+    {
+    public:
+        static constexpr size_t initial_bytes = 256 * 1024;
+
+        ArenaResource()
+            : buffer_(std::make_unique<std::byte[]>(initial_bytes)),
+              arena_(buffer_.get(), initial_bytes, std::pmr::new_delete_resource()) {}
+
+        size_t used() const { return used_; }
+
+        void reset()
+        {
+            arena_.release();
+            used_ = 0;
+        }
+
+    private:
+        std::unique_ptr<std::byte[]> buffer_;
+        std::pmr::monotonic_buffer_resource arena_;
+        size_t used_ = 0;
+
+        void *do_allocate(size_t bytes, size_t alignment) override
+        {
+            used_ += bytes;
+            return arena_.allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *, size_t, size_t) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+    ArenaResource &arena()
+    {
+        thread_local ArenaResource instance;
+        return instance;
+    }
+}
+
+namespace text_arena
+{
+    std::pmr::memory_resource *resource()
+    {
+        return &arena();
+    }
+
+    size_t bytesInUse()
+    {
+        return arena().used();
+    }
+
+    void reset()
+    {
+        arena().reset();
+    }
+}
+
+Value promote(Value v)
+{
+    std::pmr::memory_resource *heap = std::pmr::get_default_resource();
+    if (auto *text = std::get_if<Text>(&v))
+    {
+        if (text->get_allocator().resource() != heap)
+            return Text(*text, heap);
+        return v;
+    }
+    if (auto *array = std::get_if<Array>(&v))
+    {
+        bool transient = false;
+        for (const Value &cell : array->data->cells)
+            if (auto *text = std::get_if<Text>(&cell); text && text->get_allocator().resource() != heap)
+                transient = true;
+        if (!transient)
+            return v;
+        auto data = std::make_shared<ArrayData>();
+        data->cells.reserve(array->data->cells.size());
+        for (const Value &cell : array->data->cells)
+            data->cells.push_back(promote(cell));
+        return Array{array->rows, array->cols, std::move(data)};
+    }
+    return v;
+}
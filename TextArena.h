@@ -0,0 +1,30 @@
+#ifndef TEXT_ARENA_H
+#define TEXT_ARENA_H
+
+#include "EvalTypes.h"
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+
+// per thread bump allocator for Text built while formulas are evaluated (concatenations, numbers
+// and bools turned into text, string literals), a transient string costs a pointer bump and the
+// whole arena is dropped at once when the recalc epoch ends
+// only values written back into the sheet outlive the epoch, they are promoted to the heap first
+namespace text_arena
+{
+    std::pmr::memory_resource *resource();
+
+    // bytes handed out on this thread since the last reset
+    size_t bytesInUse();
+
+    // drops every transient Text made on this thread, nothing made since the last reset may still be read
+    void reset();
+
+    inline Text make() { return Text(resource()); }
+    inline Text make(std::string_view s) { return Text(s, resource()); }
+}
+
+// v with any text it holds copied out of the arena, for values that outlive the epoch
+Value promote(Value v);
+
+#endif
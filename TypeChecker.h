@@ -3,34 +3,51 @@
 
 #include "GPFETypes.h"
 #include "FunctionRegistry.h"
+#include "GPFEHelpers.h"
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <iostream>
 
-auto valid_numeric_operand = [](const TypeInfo &type)
+inline bool valid_numeric_operand(const TypeInfo &type)
 {
     return (type.type == BaseType::CellRef || type.type == BaseType::Number || type.type == BaseType::Unknown);
-};
+}
 
-auto is_error = [](const TypeInfo &type)
+inline bool is_error(const TypeInfo &type)
 {
     return type.type == BaseType::Error;
-};
+}
 
-auto is_range = [](const TypeInfo &type)
+inline bool is_range(const TypeInfo &type)
 {
     return type.type == BaseType::Range;
-};
+}
 
-auto valid_range_operand = [](const TypeInfo &type)
+inline bool valid_range_operand(const TypeInfo &type)
 {
-    return (type.type == BaseType::CellRef || type.type == BaseType::Unknown);
-};
+    // ranges are valid too, A1:B2:C3 is the bounding box of all three
+    return (type.type == BaseType::CellRef || type.type == BaseType::Range || type.type == BaseType::Unknown);
+}
 
 class TypeChecker
 {
 public:
     TypeInfo infer(ASTNode *node)
+    {
+        depth_++;
+        TypeInfo type = inferNode(node);
+        // the whole tree is known once the outermost call returns, some error paths skip children
+        if (--depth_ == 0)
+            markVolatile(node);
+        return type;
+    }
+
+    // number of LET/LAMBDA slots handed out so far, the size EvalContext::locals needs
+    int slotCount() const { return next_slot_; }
+
+private:
+    TypeInfo inferNode(ASTNode *node)
     {
         switch (node->type)
         {
@@ -166,9 +183,27 @@ public:
             }
             }
         }
+        case ASTNodeType::Name:
+        {
+            auto &name = std::get<Name>(node->node);
+            for (auto it = scope_.rbegin(); it != scope_.rend(); ++it)
+            {
+                if (it->identifier == name.identifier)
+                {
+                    name.slot = it->slot;
+                    node->inferredType = it->type;
+                    return node->inferredType;
+                }
+            }
+            // diags.error(node->span, "Unknown name " + name.identifier);
+            node->inferredType = {BaseType::Error};
+            return node->inferredType;
+        }
         case ASTNodeType::FunctionCall:
         {
             const auto &call = std::get<FunctionCall>(node->node);
+            if (call.form != SpecialForm::None)
+                return inferSpecialForm(node);
             const auto *sig = funcs::lookup(call.identifier);
             if (!sig)
             {
@@ -243,6 +278,157 @@ public:
         }
         }
     }
+
+    struct Binding
+    {
+        std::string identifier;
+        int slot;
+        TypeInfo type;
+    };
+
+    std::vector<Binding> scope_;
+    int next_slot_ = 0;
+    int depth_ = 0; // infer nesting
+
+    // sets isVolatile on node and everything under it, true when node's subtree is volatile
+    static bool markVolatile(ASTNode *node)
+    {
+        bool found = false;
+        forEachChild(node, [&](ASTNode *child)
+                     { found = markVolatile(child) || found; });
+        if (node->type == ASTNodeType::FunctionCall)
+        {
+            const auto &call = std::get<FunctionCall>(node->node);
+            const auto *sig = call.form == SpecialForm::None ? funcs::lookup(call.identifier) : nullptr;
+            found = found || (sig && sig->isVolatile);
+        }
+        node->isVolatile = found;
+        return found;
+    }
+
+    void bind(ASTNode *name_node, TypeInfo type)
+    {
+        auto &name = std::get<Name>(name_node->node);
+        // the slot holds the dereferenced value, not the reference
+        if (type.type == BaseType::CellRef)
+            type = {BaseType::Unknown};
+        name.slot = next_slot_++;
+        name_node->inferredType = type;
+        scope_.push_back({name.identifier, name.slot, type});
+    }
+
+    static bool is_lambda(const ASTNode *node)
+    {
+        return node->type == ASTNodeType::FunctionCall && std::get<FunctionCall>(node->node).form == SpecialForm::Lambda;
+    }
+
+    // binds the params of an inline LAMBDA and infers its body, params are Unknown until runtime
+    TypeInfo inferLambda(ASTNode *lambda, size_t param_count)
+    {
+        auto &call = std::get<FunctionCall>(lambda->node);
+        if (call.args.size() != param_count + 1)
+        {
+            lambda->inferredType = {BaseType::Error};
+            return lambda->inferredType;
+        }
+        const size_t scope_size = scope_.size();
+        for (size_t i = 0; i < param_count; i++)
+        {
+            if (call.args[i]->type != ASTNodeType::Name)
+            {
+                scope_.resize(scope_size);
+                lambda->inferredType = {BaseType::Error};
+                return lambda->inferredType;
+            }
+            bind(call.args[i].get(), {BaseType::Unknown});
+        }
+        lambda->inferredType = infer(call.args.back().get());
+        scope_.resize(scope_size);
+        return lambda->inferredType;
+    }
+
+    TypeInfo inferSpecialForm(ASTNode *node)
+    {
+        auto &call = std::get<FunctionCall>(node->node);
+        switch (call.form)
+        {
+        case SpecialForm::Let:
+        {
+            if (call.args.size() < 3 || call.args.size() % 2 == 0)
+            {
+                // diags.error(node->span, "LET needs name/value pairs followed by a body");
+                node->inferredType = {BaseType::Error};
+                return node->inferredType;
+            }
+            const size_t scope_size = scope_.size();
+            for (size_t i = 0; i + 1 < call.args.size(); i += 2)
+            {
+                auto value_type = infer(call.args[i + 1].get());
+                if (call.args[i]->type != ASTNodeType::Name || is_error(value_type))
+                {
+                    scope_.resize(scope_size);
+                    node->inferredType = {BaseType::Error};
+                    return node->inferredType;
+                }
+                // bound after the value so a name can't refer to itself
+                bind(call.args[i].get(), value_type);
+            }
+            node->inferredType = infer(call.args.back().get());
+            scope_.resize(scope_size);
+            return node->inferredType;
+        }
+        case SpecialForm::Map:
+        {
+            if (call.args.size() < 2 || !is_lambda(call.args.back().get()))
+            {
+                node->inferredType = {BaseType::Error};
+                return node->inferredType;
+            }
+            const size_t array_count = call.args.size() - 1;
+            for (size_t i = 0; i < array_count; i++)
+            {
+                if (is_error(infer(call.args[i].get())))
+                {
+                    node->inferredType = {BaseType::Error};
+                    return node->inferredType;
+                }
+            }
+            if (is_error(inferLambda(call.args.back().get(), array_count)))
+            {
+                node->inferredType = {BaseType::Error};
+                return node->inferredType;
+            }
+            node->inferredType = {BaseType::Array};
+            return node->inferredType;
+        }
+        case SpecialForm::Reduce:
+        {
+            if (call.args.size() != 3 || !is_lambda(call.args[2].get()))
+            {
+                node->inferredType = {BaseType::Error};
+                return node->inferredType;
+            }
+            auto initial_type = infer(call.args[0].get());
+            auto array_type = infer(call.args[1].get());
+            auto body_type = inferLambda(call.args[2].get(), 2);
+            if (is_error(initial_type) || is_error(array_type) || is_error(body_type))
+            {
+                node->inferredType = {BaseType::Error};
+                return node->inferredType;
+            }
+            // an empty array returns the initial value
+            node->inferredType = body_type.type == initial_type.type ? body_type : TypeInfo{BaseType::Unknown};
+            return node->inferredType;
+        }
+        case SpecialForm::Lambda:
+        default:
+        {
+            // diags.error(node->span, "LAMBDA is only supported as an argument to MAP or REDUCE");
+            node->inferredType = {BaseType::Error};
+            return node->inferredType;
+        }
+        }
+    }
 };
 
 #endif
\ No newline at end of file
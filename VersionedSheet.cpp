@@ -0,0 +1,84 @@
+#include "VersionedSheet.h"
+#include <thread>
+
+VersionedSheet::VersionedSheet() : current_(new Version{0, SheetStore{}}) {}
+
+VersionedSheet::~VersionedSheet()
+{
+    for (const Retired &retired : retired_)
+        delete retired.version;
+    delete current_.load();
+}
+
+VersionedSheet::ReadGuard::ReadGuard(ReadGuard &&other) noexcept
+    : slot_(other.slot_), sheet_(other.sheet_), version_(other.version_)
+{
+    other.slot_ = nullptr;
+}
+
+VersionedSheet::ReadGuard::~ReadGuard()
+{
+    if (slot_)
+        slot_->store(0, std::memory_order_release);
+}
+
+VersionedSheet::ReadGuard VersionedSheet::pin() const
+{
+    // announce the epoch before reading current_, a version retired in an epoch >= ours stays alive
+    // until the slot is cleared, one retired earlier was replaced before we could read it
+    for (int spin = 0;; spin++)
+    {
+        for (ReaderSlot &slot : slots_)
+        {
+            uint64_t expected = 0;
+            const uint64_t epoch = global_epoch_.load();
+            if (slot.epoch.compare_exchange_strong(expected, epoch))
+            {
+                const Version *version = current_.load();
+                return ReadGuard(&slot.epoch, &version->sheet, version->number);
+            }
+        }
+        // more than reader_slots readers pinned at once, wait for one to leave
+        if (spin)
+            std::this_thread::yield();
+    }
+}
+
+uint64_t VersionedSheet::publish()
+{
+    // the copy shares every chunk with the draft, the next write to one clones it
+    auto *version = new Version{next_number_++, draft_};
+    // settle the lazily recomputed used range now, readers share the version and must not write it
+    version->sheet.usedRange();
+    Version *old = current_.exchange(version);
+    retired_.push_back({old, global_epoch_.fetch_add(1)});
+    reclaim();
+    return version->number;
+}
+
+size_t VersionedSheet::reclaim()
+{
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot &slot : slots_)
+    {
+        uint64_t epoch = slot.epoch.load();
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+    size_t freed = 0;
+    for (size_t i = 0; i < retired_.size();)
+    {
+        if (retired_[i].epoch < oldest)
+        {
+            delete retired_[i].version;
+            retired_[i] = retired_.back();
+            retired_.pop_back();
+            freed++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return freed;
+}
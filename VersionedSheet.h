@@ -0,0 +1,83 @@
+#ifndef VERSIONED_SHEET_H
+#define VERSIONED_SHEET_H
+
+#include "SheetStore.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// one writer, many readers: the writer edits and recalcs a draft store and publishes it as an
+// immutable version, readers pin the latest published version and read it without any lock
+// versions share chunks copy on write, a replaced version is retired and freed by epoch based
+// reclamation once no reader that could have seen it is still pinned
+class VersionedSheet
+{
+public:
+    static constexpr int reader_slots = 128; // readers pinned at the same time
+
+    VersionedSheet();
+    ~VersionedSheet();
+    VersionedSheet(const VersionedSheet &) = delete;
+    VersionedSheet &operator=(const VersionedSheet &) = delete;
+
+    // a pinned version, stays valid and unchanged until the guard is destroyed
+    class ReadGuard
+    {
+    public:
+        ReadGuard(ReadGuard &&other) noexcept;
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+        ~ReadGuard();
+
+        const SheetStore &sheet() const { return *sheet_; }
+        uint64_t version() const { return version_; }
+
+    private:
+        friend class VersionedSheet;
+        ReadGuard(std::atomic<uint64_t> *slot, const SheetStore *sheet, uint64_t version)
+            : slot_(slot), sheet_(sheet), version_(version) {}
+
+        std::atomic<uint64_t> *slot_;
+        const SheetStore *sheet_;
+        uint64_t version_;
+    };
+
+    // reader side, never blocks on the writer
+    ReadGuard pin() const;
+
+    // writer side, not thread safe among writers
+    SheetStore &draft() { return draft_; }
+    const SheetStore &draft() const { return draft_; }
+    // makes the draft the latest version and returns its number, retired versions are reclaimed
+    uint64_t publish();
+    // frees retired versions no pinned reader can see, returns how many were freed
+    size_t reclaim();
+    size_t retiredCount() const { return retired_.size(); }
+
+private:
+    struct Version
+    {
+        uint64_t number;
+        SheetStore sheet;
+    };
+
+    struct Retired
+    {
+        Version *version;
+        uint64_t epoch; // readers that pinned in a later epoch can't see it
+    };
+
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<uint64_t> epoch{0}; // 0 when free, else the epoch the reader pinned in
+    };
+
+    SheetStore draft_;
+    std::atomic<Version *> current_;
+    std::atomic<uint64_t> global_epoch_{1};
+    mutable ReaderSlot slots_[reader_slots];
+    std::vector<Retired> retired_;
+    uint64_t next_number_ = 1;
+};
+
+#endif
@@ -0,0 +1,605 @@
+#include "Workbook.h"
+#include "TextArena.h"
+#include "WriteAheadLog.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+using Clock = std::chrono::steady_clock;
+
+static double millisSince(Clock::time_point &start)
+{
+    Clock::time_point now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+    start = now;
+    return ms;
+}
+
+Workbook::Workbook()
+{
+    addSheet("Sheet1");
+    ctx_.sheets = &stores_;
+    ctx_.sheet_names = &names_;
+}
+
+int Workbook::addSheet(const std::string &name)
+{
+    int id = names_.add(name);
+    sheets_.push_back(std::make_unique<Sheet>());
+    stores_.push_back(&sheets_.back()->versions.draft());
+    written_.push_back(0);
+    if (log_)
+        log_->addSheet(id, name);
+    return id;
+}
+
+Workbook::Sheet &Workbook::sheetAt(int sheet)
+{
+    if (sheet < 0 || sheet >= static_cast<int>(sheets_.size()))
+        throw std::out_of_range("NO SUCH SHEET");
+    return *sheets_[sheet];
+}
+
+const Workbook::Sheet &Workbook::sheetAt(int sheet) const
+{
+    if (sheet < 0 || sheet >= static_cast<int>(sheets_.size()))
+        throw std::out_of_range("NO SUCH SHEET");
+    return *sheets_[sheet];
+}
+
+Workbook::Transaction Workbook::begin()
+{
+    if (open_)
+        throw std::runtime_error("TRANSACTION ALREADY OPEN");
+    open_ = true;
+    return Transaction(this);
+}
+
+bool Workbook::formulaAt(int sheet, RC cell, FormulaCell &out) const
+{
+    const auto &formulas = sheetAt(sheet).formulas;
+    auto it = formulas.find(cellKey(sheet, cell));
+    if (it == formulas.end())
+        return false;
+    out = it->second;
+    return true;
+}
+
+bool Workbook::materialize(const RangeRef &range)
+{
+    Sheet &target = sheetAt(range.sheet < 0 ? 0 : range.sheet);
+    return target.views.materialize(range, target.versions.draft());
+}
+
+AggregateViewStats Workbook::aggregateStats() const
+{
+    AggregateViewStats total;
+    for (const auto &sheet : sheets_)
+    {
+        AggregateViewStats stats = sheet->views.stats();
+        total.views += stats.views;
+        total.built += stats.built;
+        total.hits += stats.hits;
+        total.cells_avoided += stats.cells_avoided;
+        total.deltas += stats.deltas;
+        total.rescans += stats.rescans;
+    }
+    return total;
+}
+
+void Workbook::Transaction::setValue(int sheet, RC cell, Value value)
+{
+    if (!book_)
+        throw std::runtime_error("TRANSACTION IS CLOSED");
+    // staged values can outlive the recalc epoch they were made in
+    book_->stage(sheet, cell, Edit{false, promote(std::move(value)), 0, {}});
+}
+
+void Workbook::Transaction::setFormula(int sheet, RC cell, const std::string &formula)
+{
+    if (!book_)
+        throw std::runtime_error("TRANSACTION IS CLOSED");
+    book_->sheetAt(sheet);
+    Clock::time_point start = Clock::now();
+    size_t known = book_->cache_.size();
+    FormulaHandle handle = book_->cache_.compile(formula, cell, &book_->names_);
+    book_->staged_compiled_ += book_->cache_.size() - known;
+    book_->staged_compile_ms_ += millisSince(start);
+    book_->stage(sheet, cell, Edit{true, Blank{}, handle, book_->log_ ? formula : std::string()});
+}
+
+CommitStats Workbook::Transaction::commit()
+{
+    if (!book_)
+        throw std::runtime_error("TRANSACTION IS CLOSED");
+    Workbook *book = book_;
+    book_ = nullptr;
+    return book->commit();
+}
+
+void Workbook::Transaction::abort()
+{
+    if (!book_)
+        return;
+    book_->clearStaged();
+    book_ = nullptr;
+}
+
+void Workbook::stage(int sheet, RC cell, Edit edit)
+{
+    sheetAt(sheet);
+    auto [row, col] = cell;
+    if (row < 1 || col < 1 || row > max_rows || col > max_cols)
+        throw std::out_of_range("CELL OUTSIDE OF THE SHEET");
+    auto [it, inserted] = staged_.insert_or_assign(cellKey(sheet, cell), std::move(edit));
+    if (inserted)
+        staged_order_.push_back(it->first);
+}
+
+void Workbook::clearStaged()
+{
+    staged_.clear();
+    staged_order_.clear();
+    staged_compile_ms_ = 0;
+    staged_compiled_ = 0;
+    restructured_.clear();
+    open_ = false;
+}
+
+void Workbook::link(uint64_t formula, const Precedents &precedents)
+{
+    const int own = sheetFromKey(formula);
+    if (auto it = remote_reads_.find(formula); it != remote_reads_.end())
+    {
+        for (int sheet : it->second)
+            sheets_[sheet]->deps.remove(formula);
+        remote_reads_.erase(it);
+    }
+    Precedents local;
+    local.dynamic = precedents.dynamic;
+    std::vector<int> remote;
+    for (const RangeRef &range : precedents.ranges)
+    {
+        if (range.sheet < 0 || range.sheet == own)
+            local.ranges.push_back(range);
+        else if (std::find(remote.begin(), remote.end(), range.sheet) == remote.end())
+            remote.push_back(range.sheet);
+    }
+    sheets_[own]->deps.add(formula, local);
+    if (remote.empty())
+        return;
+    for (int sheet : remote)
+    {
+        Precedents there;
+        for (const RangeRef &range : precedents.ranges)
+            if (range.sheet == sheet)
+                there.ranges.push_back(range);
+        sheets_[sheet]->deps.add(formula, there);
+    }
+    remote_reads_.emplace(formula, std::move(remote));
+}
+
+void Workbook::unlink(uint64_t formula)
+{
+    sheets_[sheetFromKey(formula)]->deps.remove(formula);
+    if (auto it = remote_reads_.find(formula); it != remote_reads_.end())
+    {
+        for (int sheet : it->second)
+            sheets_[sheet]->deps.remove(formula);
+        remote_reads_.erase(it);
+    }
+}
+
+void Workbook::setDynamicReads(uint64_t formula, const std::vector<RangeRef> &ranges)
+{
+    const int own = sheetFromKey(formula);
+    std::vector<RangeRef> local;
+    auto remote = remote_reads_.find(formula);
+    for (const RangeRef &range : ranges)
+    {
+        if (range.sheet < 0 || range.sheet == own)
+        {
+            local.push_back(range);
+            continue;
+        }
+        if (remote == remote_reads_.end())
+            remote = remote_reads_.try_emplace(formula).first;
+        if (std::find(remote->second.begin(), remote->second.end(), range.sheet) == remote->second.end())
+            remote->second.push_back(range.sheet);
+    }
+    sheets_[own]->deps.setDynamicReads(formula, local);
+    if (remote == remote_reads_.end())
+        return;
+    // every sheet read before gets its reads replaced too, with nothing when this run didn't read it
+    // sheets stay listed until the formula goes, an empty entry only costs a lookup
+    for (int sheet : remote->second)
+    {
+        local.clear();
+        for (const RangeRef &range : ranges)
+            if (range.sheet == sheet)
+                local.push_back(range);
+        sheets_[sheet]->deps.setDynamicReads(formula, local);
+    }
+}
+
+CommitStats Workbook::restructure(const StructuralEdit &edit)
+{
+    if (open_)
+        throw std::runtime_error("TRANSACTION ALREADY OPEN");
+    Sheet &target = sheetAt(edit.sheet);
+    Clock::time_point start = Clock::now();
+    // the store checks the edit and throws before moving anything
+    SheetStore &sheet = target.versions.draft();
+    if (edit.rows)
+        edit.insert ? sheet.insertRows(edit.at, edit.count) : sheet.deleteRows(edit.at, edit.count);
+    else
+        edit.insert ? sheet.insertColumns(edit.at, edit.count) : sheet.deleteColumns(edit.at, edit.count);
+    if (log_)
+        log_->restructure(edit);
+    target.views.clear();
+    target.deps.restructure(edit, true);
+    // formulas of the sheet reading other sheets are in their indexes too and move there as well
+    std::vector<uint8_t> remote(sheets_.size(), 0);
+    for (const auto &[key, reads] : remote_reads_)
+        if (sheetFromKey(key) == edit.sheet)
+            for (int other : reads)
+                remote[other] = 1;
+    for (size_t other = 0; other < sheets_.size(); other++)
+        if (remote[other])
+            sheets_[other]->deps.restructure(edit, false);
+    open_ = true;
+    written_[edit.sheet] = 1;
+
+    // one pass over the formulas of the sheet, only those that move or read across the edit are
+    // touched, the dependency indexes already moved with the cells
+    // copies of a formula share a handle and its extent
+    struct Moved
+    {
+        uint64_t key;
+        FormulaCell formula;
+        bool is_volatile;
+        bool inputs_changed;
+        std::vector<int> remote_reads;
+    };
+    std::vector<Moved> moved;
+    std::unordered_map<FormulaHandle, ReferenceExtent> extents;
+    for (auto it = target.formulas.begin(); it != target.formulas.end();)
+    {
+        FormulaCell formula = it->second;
+        RC anchor = formula.anchor;
+        const bool kept = edit.mapCell(anchor);
+        auto [extent, inserted] = extents.try_emplace(formula.handle);
+        if (inserted)
+            extent->second = referenceExtent(&cache_.get(formula.handle).root, edit.sheet, edit);
+        const bool same_program = movesAsOne(extent->second, edit.sheet, formula.anchor, edit);
+        const bool inputs_changed = !same_program || readsAcross(extent->second, edit);
+        if (kept && same_program && anchor == formula.anchor)
+        {
+            if (inputs_changed)
+                restructured_.push_back(it->first);
+            ++it;
+            continue;
+        }
+        const bool is_volatile = volatile_cells_.erase(it->first) != 0;
+        std::vector<int> remote_reads;
+        if (auto reads = remote_reads_.find(it->first); reads != remote_reads_.end())
+        {
+            remote_reads = std::move(reads->second);
+            remote_reads_.erase(reads);
+        }
+        it = target.formulas.erase(it);
+        if (!kept)
+            continue;
+        FormulaHandle handle = same_program ? formula.handle : cache_.rewrite(formula.handle, edit.sheet, formula.anchor, anchor, edit);
+        moved.push_back({cellKey(edit.sheet, anchor), FormulaCell{handle, anchor}, is_volatile, inputs_changed, std::move(remote_reads)});
+    }
+    // re-added after the pass, a formula moving down may land where another one is yet to leave
+    for (Moved &m : moved)
+    {
+        target.formulas.emplace(m.key, m.formula);
+        if (m.is_volatile)
+            volatile_cells_.insert(m.key);
+        if (m.inputs_changed)
+            restructured_.push_back(m.key);
+        if (!m.remote_reads.empty())
+            remote_reads_.emplace(m.key, std::move(m.remote_reads));
+    }
+    // formulas on other sheets reading this one stay where they are, their references into it are
+    // rewritten when they cross the edit, the extent of a handle is the same on every other sheet
+    extents.clear();
+    std::vector<uint64_t> readers;
+    target.deps.forEachFormula([&](uint64_t key)
+                               {
+        if (sheetFromKey(key) != edit.sheet)
+            readers.push_back(key); });
+    for (uint64_t key : readers)
+    {
+        const int other = sheetFromKey(key);
+        auto found = sheets_[other]->formulas.find(key);
+        if (found == sheets_[other]->formulas.end())
+            continue;
+        FormulaCell &formula = found->second;
+        auto [extent, inserted] = extents.try_emplace(formula.handle);
+        if (inserted)
+            extent->second = referenceExtent(&cache_.get(formula.handle).root, other, edit);
+        const bool same_program = movesAsOne(extent->second, other, formula.anchor, edit);
+        if (!same_program)
+            formula.handle = cache_.rewrite(formula.handle, other, formula.anchor, formula.anchor, edit);
+        if (!same_program || readsAcross(extent->second, edit) || isDynamic(key))
+            restructured_.push_back(key);
+    }
+    // what dynamic formulas read may have moved out from under them, they read again
+    for (uint64_t key : target.deps.dynamicFormulas())
+        restructured_.push_back(key);
+    double restructure_ms = millisSince(start);
+    CommitStats stats = commit();
+    stats.apply_ms += restructure_ms;
+    return stats;
+}
+
+Value Workbook::evaluateFormula(uint64_t key, const FormulaCell &formula)
+{
+    Sheet &target = *sheets_[sheetFromKey(key)];
+    ctx_.sheet = &target.versions.draft();
+    ctx_.aggregate_views = &target.views;
+    // a formula with dynamic precedents records what it reads, the edges of the next commit
+    const bool dynamic = isDynamic(key);
+    dynamic_reads_.clear();
+    ctx_.dynamic_reads = dynamic ? &dynamic_reads_ : nullptr;
+    Value v = evaluator_.evaluateAt(&cache_.get(formula.handle).root, formula.anchor, ctx_);
+    ctx_.dynamic_reads = nullptr;
+    if (dynamic)
+        setDynamicReads(key, dynamic_reads_);
+    // a cell holds one value, a formula that ends in a range doesn't spill
+    if (std::holds_alternative<RangeRef>(v))
+        return Error{ErrorCode::Value};
+    return v;
+}
+
+CommitStats Workbook::commit()
+{
+    try
+    {
+        return applyStaged();
+    }
+    catch (...)
+    {
+        // nothing is undone, the sheets written so far stay marked for the next commit to publish
+        // and which dirty formulas were left stale isn't known, so that commit evaluates all of them
+        ctx_.dynamic_reads = nullptr;
+        recalc_all_ = true;
+        clearStaged();
+        throw;
+    }
+}
+
+CommitStats Workbook::applyStaged()
+{
+    CommitStats stats;
+    stats.edits = staged_order_.size();
+    stats.compiled = staged_compiled_;
+    stats.compile_ms = staged_compile_ms_;
+    Clock::time_point phase = Clock::now();
+
+    // the log gets the transaction before any of it is applied, as the edits that make it up
+    if (log_)
+    {
+        for (uint64_t key : staged_order_)
+        {
+            const Edit &edit = staged_.at(key);
+            if (edit.is_formula)
+                log_->setFormula(sheetFromKey(key), cellFromKey(key), edit.formula);
+            else
+                log_->setValue(sheetFromKey(key), cellFromKey(key), edit.value);
+        }
+        log_->commit(commits_ + 1);
+    }
+
+    // apply every edit, formulas only record their precedents here, they are evaluated below
+    // keys are workbook keys throughout
+    std::vector<uint64_t> nodes; // dirty formula cells
+    std::unordered_map<uint64_t, uint32_t> index;
+    std::vector<std::vector<uint32_t>> edges; // precedent -> dependents among nodes
+    std::vector<uint32_t> indegree;
+    std::vector<uint8_t> stale; // an input changed, the formula has to be evaluated
+    auto node_of = [&](uint64_t key)
+    {
+        auto [it, inserted] = index.try_emplace(key, static_cast<uint32_t>(nodes.size()));
+        if (inserted)
+        {
+            nodes.push_back(key);
+            edges.emplace_back();
+            indegree.push_back(0);
+            stale.push_back(0);
+        }
+        return it->second;
+    };
+    // the formulas reading a cell are in the index of the cell's sheet
+    auto for_each_dependent = [&](uint64_t key, auto &&fn)
+    {
+        sheets_[sheetFromKey(key)]->deps.forEachDependent(cellFromKey(key), fn);
+    };
+    changes_.clear();
+    std::vector<uint64_t> changed_values;
+    for (uint64_t key : staged_order_)
+    {
+        Edit &edit = staged_.at(key);
+        const int sheet_id = sheetFromKey(key);
+        Sheet &target = *sheets_[sheet_id];
+        RC cell = cellFromKey(key);
+        if (edit.is_formula)
+        {
+            const ASTNode &root = cache_.get(edit.handle).root;
+            target.formulas[key] = FormulaCell{edit.handle, cell};
+            link(key, collectPrecedents(&root, cell));
+            if (root.isVolatile)
+                volatile_cells_.insert(key);
+            else
+                volatile_cells_.erase(key);
+            stale[node_of(key)] = 1;
+            continue;
+        }
+        if (target.formulas.erase(key))
+        {
+            unlink(key);
+            volatile_cells_.erase(key);
+        }
+        // rewriting a cell with what it already holds dirties nothing
+        SheetStore &sheet = target.versions.draft();
+        Value old = sheet.get(cell);
+        if (sameValue(old, edit.value))
+            continue;
+        target.views.update(cell, old, edit.value);
+        changes_.push_back({cell, std::move(old), edit.value, sheet_id});
+        sheet.set(cell, std::move(edit.value));
+        written_[sheet_id] = 1;
+        changed_values.push_back(key);
+    }
+    stats.apply_ms = millisSince(phase);
+
+    // union of the dirty closures of all edited cells, walked once, recording the edges between
+    // dirty formulas on the way, volatile formulas always recalc
+    for (uint64_t key : volatile_cells_)
+        stale[node_of(key)] = 1;
+    for (uint64_t key : restructured_)
+        stale[node_of(key)] = 1;
+    if (recalc_all_)
+        for (const auto &sheet : sheets_)
+            for (const auto &[key, formula] : sheet->formulas)
+                stale[node_of(key)] = 1;
+    for (uint64_t key : changed_values)
+        for_each_dependent(key, [&](uint64_t dependent)
+                           { stale[node_of(dependent)] = 1; });
+    for (uint32_t i = 0; i < nodes.size(); i++)
+    {
+        for_each_dependent(nodes[i], [&](uint64_t dependent)
+                           {
+            uint32_t j = node_of(dependent);
+            edges[i].push_back(j);
+            indegree[j]++; });
+    }
+    stats.dirty = nodes.size();
+    stats.dirty_ms = millisSince(phase);
+
+    // Kahn's algorithm over the dirty formulas, run alongside evaluation
+    // a formula with dynamic precedents may read a dirty formula it has no edge to yet, so it is only
+    // taken when nothing static is ready, and when what it read still holds a dirty formula that
+    // wasn't taken yet it waits for that one with a new edge and is evaluated again
+    std::vector<uint8_t> dynamic(nodes.size(), 0);
+    for (uint32_t i = 0; i < nodes.size(); i++)
+        dynamic[i] = isDynamic(nodes[i]);
+    std::vector<uint32_t> ready, deferred;
+    for (uint32_t i = 0; i < nodes.size(); i++)
+        if (!indegree[i])
+            (dynamic[i] ? deferred : ready).push_back(i);
+    std::vector<uint8_t> taken(nodes.size(), 0);
+    // dirty formulas not taken yet inside ranges, a range without a sheet is on the formula's
+    std::vector<uint32_t> waits_on;
+    auto untaken_in = [&](int sheet, const std::vector<RangeRef> &ranges)
+    {
+        waits_on.clear();
+        for (const RangeRef &range : ranges)
+        {
+            const int on = range.sheet < 0 ? sheet : range.sheet;
+            const int64_t cells = static_cast<int64_t>(range.bottom - range.top + 1) * (range.right - range.left + 1);
+            if (cells <= static_cast<int64_t>(nodes.size()))
+            {
+                for (int col = range.left; col <= range.right; col++)
+                    for (int row = range.top; row <= range.bottom; row++)
+                        if (auto it = index.find(cellKey(on, RC{row, col})); it != index.end() && !taken[it->second])
+                            waits_on.push_back(it->second);
+                continue;
+            }
+            for (uint32_t j = 0; j < nodes.size(); j++)
+            {
+                RC cell = cellFromKey(nodes[j]);
+                if (!taken[j] && sheetFromKey(nodes[j]) == on && range.top <= cell.first && cell.first <= range.bottom &&
+                    range.left <= cell.second && cell.second <= range.right)
+                    waits_on.push_back(j);
+            }
+        }
+        return !waits_on.empty();
+    };
+    stats.order_ms = millisSince(phase);
+
+    // early cutoff, a formula whose value didn't change leaves its dependents clean
+    auto store = [&](uint32_t i, Value value)
+    {
+        const int sheet_id = sheetFromKey(nodes[i]);
+        RC cell = cellFromKey(nodes[i]);
+        Sheet &target = *sheets_[sheet_id];
+        SheetStore &sheet = target.versions.draft();
+        Value old = sheet.get(cell);
+        if (sameValue(old, value))
+            return;
+        for (uint32_t j : edges[i])
+            stale[j] = 1;
+        // the feed outlives the epoch, sheet.set promotes its own copy
+        value = promote(std::move(value));
+        target.views.update(cell, old, value);
+        changes_.push_back({cell, std::move(old), value, sheet_id});
+        sheet.set(cell, std::move(value));
+        written_[sheet_id] = 1;
+    };
+    while (!ready.empty() || !deferred.empty())
+    {
+        std::vector<uint32_t> &from = ready.empty() ? deferred : ready;
+        uint32_t i = from.back();
+        from.pop_back();
+        if (stale[i])
+        {
+            const int sheet_id = sheetFromKey(nodes[i]);
+            Value value = evaluateFormula(nodes[i], sheets_[sheet_id]->formulas.at(nodes[i]));
+            if (dynamic[i])
+            {
+                // reading itself waits forever and ends up as a cycle
+                if (untaken_in(sheet_id, dynamic_reads_))
+                {
+                    for (uint32_t j : waits_on)
+                        edges[j].push_back(i);
+                    indegree[i] += static_cast<uint32_t>(waits_on.size());
+                    stats.requeued++;
+                    continue;
+                }
+            }
+            store(i, std::move(value));
+            stats.evaluated++;
+        }
+        else
+        {
+            stats.pruned++;
+        }
+        taken[i] = 1;
+        for (uint32_t j : edges[i])
+            if (--indegree[j] == 0)
+                (dynamic[j] ? deferred : ready).push_back(j);
+    }
+    // whatever Kahn couldn't order sits on or behind a cycle
+    for (uint32_t i = 0; i < nodes.size(); i++)
+    {
+        if (indegree[i])
+        {
+            store(i, Error{ErrorCode::Cycle});
+            stats.cycles++;
+        }
+    }
+    stats.changed = changes_.size();
+    text_arena::reset();
+    ctx_.recalc_epoch++;
+    stats.eval_ms = millisSince(phase);
+
+    // only the sheets this commit wrote get a new version
+    stats.version = ++commits_;
+    for (size_t sheet = 0; sheet < sheets_.size(); sheet++)
+    {
+        if (!written_[sheet])
+            continue;
+        sheets_[sheet]->versions.publish();
+        written_[sheet] = 0;
+        stats.sheets++;
+    }
+    stats.publish_ms = millisSince(phase);
+    recalc_all_ = false;
+    clearStaged();
+    return stats;
+}
@@ -0,0 +1,219 @@
+#ifndef WORKBOOK_H
+#define WORKBOOK_H
+
+#include "EvalTypes.h"
+#include "Evaluator.h"
+#include "FormulaCache.h"
+#include "Dependencies.h"
+#include "VersionedSheet.h"
+#include "AggregateViews.h"
+#include "StructuralEdit.h"
+#include "SheetNames.h"
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class WriteAheadLog;
+
+// one entry of the change feed
+struct CellChange
+{
+    RC cell;
+    Value old_value;
+    Value new_value;
+    int sheet = 0;
+};
+
+// what a commit did and where its time went
+struct CommitStats
+{
+    size_t edits = 0;     // distinct cells written by the transaction
+    size_t compiled = 0;  // formulas that weren't in the formula cache yet
+    size_t dirty = 0;     // formula cells in the dirty closure
+    size_t evaluated = 0; // formula cells evaluated
+    size_t pruned = 0;    // dirty formula cells skipped because none of their inputs changed
+    size_t changed = 0;   // cells whose value changed, the size of the change feed
+    size_t cycles = 0;    // formula cells left with #CYCLE!
+    size_t requeued = 0;  // evaluations thrown away because a dynamic read hit a dirty formula
+    size_t sheets = 0;    // sheets written and published
+    uint64_t version = 0; // commit number, each sheet written publishes a version of its own
+
+    double compile_ms = 0; // lexing, parsing and checking the transaction's formulas
+    double apply_ms = 0;   // writing values and updating the dependency index
+    double dirty_ms = 0;   // walking dependents of the edited cells
+    double order_ms = 0;   // queueing the dirty formulas, the ordering itself runs with eval
+    double eval_ms = 0;
+    double publish_ms = 0;
+};
+
+// sheets of cells and formulas and the dependency graph between them, edited through transactions
+// every sheet has its own store, formulas and dependency index, formulas read other sheets with
+// Sheet1!A1 references, a workbook starts out with one sheet, Sheet1 with id 0, which the calls
+// without a sheet id address
+// a transaction only stages edits, commit applies all of them, recalculates the union of their
+// dirty closures once in dependency order and publishes the sheets it wrote as new versions for
+// readers, a reader pinning several sheets can see them at different commits
+// a formula is only evaluated when one of its inputs changed value, and the commit leaves a feed
+// of exactly the cells whose value changed
+// volatile formulas (a RAND somewhere in the tree) are the only ones evaluated on every commit,
+// so a commit without edits is a volatile tick: those roots and whatever changed below them
+// row and column inserts and deletes shift the cells, rewrite the formulas whose references cross
+// the edit and recalculate only those, the change feed lists the values they changed, not the cells
+// that merely moved
+class Workbook
+{
+public:
+    class Transaction
+    {
+    public:
+        Transaction(Transaction &&other) noexcept : book_(other.book_) { other.book_ = nullptr; }
+        Transaction(const Transaction &) = delete;
+        Transaction &operator=(const Transaction &) = delete;
+        ~Transaction() { abort(); }
+
+        // Blank clears the cell, a later edit of the same cell replaces an earlier one
+        void setValue(int sheet, RC cell, Value value);
+        // formula without the leading '=', compiled right away so parse errors throw here
+        void setFormula(int sheet, RC cell, const std::string &formula);
+        void clear(int sheet, RC cell) { setValue(sheet, cell, Blank{}); }
+
+        void setValue(RC cell, Value value) { setValue(0, cell, std::move(value)); }
+        void setFormula(RC cell, const std::string &formula) { setFormula(0, cell, formula); }
+        void clear(RC cell) { setValue(0, cell, Blank{}); }
+
+        // the transaction is closed even when this throws (a failed log write, an evaluation error),
+        // what was applied before the throw stays in the draft unpublished and the next commit
+        // publishes it and evaluates every formula again
+        CommitStats commit();
+        // drops the staged edits, nothing was applied yet so there is nothing to undo
+        void abort();
+
+    private:
+        friend class Workbook;
+        explicit Transaction(Workbook *book) : book_(book) {}
+        Workbook *book_;
+    };
+
+    Workbook();
+    Workbook(const Workbook &) = delete;
+    Workbook &operator=(const Workbook &) = delete;
+
+    // adds an empty sheet and returns its id, throws when the name is taken or can't name a sheet
+    int addSheet(const std::string &name);
+    // -1 when there is no such sheet
+    int sheetId(const std::string &name) const { return names_.find(name); }
+    const std::string &sheetName(int sheet) const { return names_.name(sheet); }
+    int sheetCount() const { return names_.size(); }
+
+    // one transaction at a time, throws when one is open
+    Transaction begin();
+    // volatile tick, recalculates volatile formulas and the dependents whose inputs changed
+    CommitStats recalc() { return begin().commit(); }
+    size_t volatileCount() const { return volatile_cells_.size(); }
+    // number of the last commit, structural edits and volatile ticks count too
+    uint64_t commitCount() const { return commits_; }
+
+    // structural edits, committed on their own and throwing when a transaction is open
+    // references into deleted rows or columns become #REF!, ranges widen over inserted ones and
+    // shrink over deleted ones
+    // formulas on other sheets reading the edited one are rewritten the same way
+    CommitStats insertRows(int sheet, int at, int count) { return restructure(StructuralEdit{true, true, at, count, sheet}); }
+    CommitStats deleteRows(int sheet, int at, int count) { return restructure(StructuralEdit{true, false, at, count, sheet}); }
+    CommitStats insertColumns(int sheet, int at, int count) { return restructure(StructuralEdit{false, true, at, count, sheet}); }
+    CommitStats deleteColumns(int sheet, int at, int count) { return restructure(StructuralEdit{false, false, at, count, sheet}); }
+    CommitStats insertRows(int at, int count) { return insertRows(0, at, count); }
+    CommitStats deleteRows(int at, int count) { return deleteRows(0, at, count); }
+    CommitStats insertColumns(int at, int count) { return insertColumns(0, at, count); }
+    CommitStats deleteColumns(int at, int count) { return deleteColumns(0, at, count); }
+
+    // latest committed value, writer side
+    Value value(int sheet, RC cell) const { return sheetAt(sheet).versions.draft().get(cell); }
+    Value value(RC cell) const { return value(0, cell); }
+    // formula of cell, false when it holds a plain value
+    bool formulaAt(int sheet, RC cell, FormulaCell &out) const;
+    bool formulaAt(RC cell, FormulaCell &out) const { return formulaAt(0, cell, out); }
+    // reader side, a consistent committed version of a sheet that never blocks on commits
+    VersionedSheet::ReadGuard pin(int sheet) const { return sheetAt(sheet).versions.pin(); }
+    VersionedSheet::ReadGuard pin() const { return pin(0); }
+
+    // cells whose value changed in the last commit, values and formula results alike, in the
+    // order they were written
+    const std::vector<CellChange> &changes() const { return changes_; }
+
+    // keeps SUM/COUNT/AVERAGE/MIN/MAX of range materialized from now on, ranges scanned often enough
+    // are materialized without asking (see AggregateViews.h), false when no view is free
+    // every sheet has views of its own, a range without a sheet is on the first one
+    bool materialize(const RangeRef &range);
+    // summed over the sheets
+    AggregateViewStats aggregateStats() const;
+
+    const FormulaCache &formulas() const { return cache_; }
+    EvalContext &evalContext() { return ctx_; }
+
+private:
+    friend class Snapshot;      // saves and restores the state below
+    friend class WriteAheadLog; // attaches itself and replays commits through it
+
+    struct Edit
+    {
+        bool is_formula = false;
+        Value value;
+        FormulaHandle handle = 0;
+        std::string formula; // text, kept only for the log
+    };
+
+    // one sheet, its cells and formulas and the formulas reading it
+    struct Sheet
+    {
+        VersionedSheet versions;
+        std::unordered_map<uint64_t, FormulaCell> formulas; // formula cells of the sheet by workbook key
+        DependencyIndex deps;                               // formulas of any sheet reading this one
+        AggregateViews views;
+    };
+
+    // staged edits, dirty formulas and the change feed use workbook keys, cellKey(sheet, cell)
+    SheetNames names_;
+    std::vector<std::unique_ptr<Sheet>> sheets_; // by id
+    std::vector<const SheetStore *> stores_;     // draft of every sheet by id, EvalContext::sheets
+    std::vector<uint8_t> written_;               // sheets the open commit wrote to
+    FormulaCache cache_;
+    std::unordered_set<uint64_t> volatile_cells_;
+    // formulas reading sheets other than their own, the sheets whose index they are in as well
+    std::unordered_map<uint64_t, std::vector<int>> remote_reads_;
+    uint64_t commits_ = 0;
+    Evaluator evaluator_;
+    EvalContext ctx_;
+
+    std::vector<CellChange> changes_;
+    std::vector<RangeRef> dynamic_reads_; // scratch for evaluateFormula
+
+    bool open_ = false;
+    std::unordered_map<uint64_t, Edit> staged_;
+    std::vector<uint64_t> staged_order_; // first edit order, so commits apply deterministically
+    double staged_compile_ms_ = 0;
+    size_t staged_compiled_ = 0;
+    std::vector<uint64_t> restructured_; // formulas a structural edit rewrote, stale in its commit
+    WriteAheadLog *log_ = nullptr;       // gets every commit when attached
+    bool recalc_all_ = false;            // a commit threw part way, the next one evaluates every formula
+
+    Sheet &sheetAt(int sheet);
+    const Sheet &sheetAt(int sheet) const;
+    void stage(int sheet, RC cell, Edit edit);
+    // applies the staged edits, closing the transaction whether or not that throws
+    CommitStats commit();
+    CommitStats applyStaged();
+    CommitStats restructure(const StructuralEdit &edit);
+    void clearStaged();
+    Value evaluateFormula(uint64_t key, const FormulaCell &formula);
+
+    // the dependency index of every sheet formula reads gets its ranges there
+    void link(uint64_t formula, const Precedents &precedents);
+    void unlink(uint64_t formula);
+    void setDynamicReads(uint64_t formula, const std::vector<RangeRef> &ranges);
+    bool isDynamic(uint64_t formula) const { return sheets_[sheetFromKey(formula)]->deps.dynamicFormulas().count(formula) != 0; }
+};
+
+#endif
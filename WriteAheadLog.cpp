@@ -0,0 +1,675 @@
+#include "WriteAheadLog.h"
+#include "Workbook.h"
+#include "Checksum.h"
+#include "StringPool.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double millisSince(Clock::time_point &start)
+{
+    Clock::time_point now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+    start = now;
+    return ms;
+}
+
+// the file is a header and then records, native byte order
+// a record is a RecordHeader and its payload, the checksum covers the payload and is seeded with the
+// type and length, so a header cut short or left over from a torn write doesn't pass either
+namespace
+{
+    constexpr char magic[8] = {'G', 'P', 'F', 'E', 'W', 'A', 'L', '1'};
+    constexpr uint32_t max_payload = 1u << 30;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t base_commit; // the first commit record is base_commit + 1
+        uint64_t checksum;    // of the fields above
+    };
+
+    struct RecordHeader
+    {
+        uint32_t length;
+        uint16_t type;
+        uint16_t reserved;
+        uint64_t checksum;
+    };
+
+    enum RecordType : uint16_t
+    {
+        SetValue = 1, // sheet, row, col, value
+        SetFormula,   // sheet, row, col, text
+        Structural,   // sheet, rows, insert, at, count
+        AddSheet,     // id, name, outside of transactions
+        Commit        // commit number, closes the transaction
+    };
+
+    enum class ValueTag : uint8_t
+    {
+        Blank,
+        Number,
+        Bool,
+        Text,
+        Error,
+        Array
+    };
+
+    uint64_t headerSum(const FileHeader &header)
+    {
+        return checksum::hash64(&header, offsetof(FileHeader, checksum));
+    }
+
+    uint64_t recordSum(uint16_t type, const char *payload, uint32_t length)
+    {
+        return checksum::hash64(payload, length, static_cast<uint64_t>(type) << 32 | length);
+    }
+
+    [[noreturn]] void corrupt()
+    {
+        throw std::runtime_error("CORRUPT LOG");
+    }
+
+    class Encoder
+    {
+    public:
+        explicit Encoder(std::vector<char> &out) : out_(out) {}
+
+        template <typename T>
+        void put(T v)
+        {
+            const char *p = reinterpret_cast<const char *>(&v);
+            out_.insert(out_.end(), p, p + sizeof v);
+        }
+
+        void text(std::string_view s)
+        {
+            put(static_cast<uint32_t>(s.size()));
+            out_.insert(out_.end(), s.begin(), s.end());
+        }
+
+        void value(const Value &v)
+        {
+            if (const auto *number = std::get_if<Number>(&v))
+            {
+                put(ValueTag::Number);
+                put(*number);
+            }
+            else if (const auto *flag = std::get_if<Bool>(&v))
+            {
+                put(ValueTag::Bool);
+                put(static_cast<uint8_t>(*flag));
+            }
+            else if (isText(v))
+            {
+                put(ValueTag::Text);
+                text(textView(v));
+            }
+            else if (const auto *error = std::get_if<Error>(&v))
+            {
+                put(ValueTag::Error);
+                put(static_cast<uint8_t>(error->code));
+            }
+            else if (const auto *array = std::get_if<Array>(&v))
+            {
+                put(ValueTag::Array);
+                put(static_cast<int32_t>(array->rows));
+                put(static_cast<int32_t>(array->cols));
+                for (const Value &cell : array->data->cells)
+                    value(cell);
+            }
+            else if (std::holds_alternative<RangeRef>(v))
+            {
+                // cells never hold one, evaluateFormula turns it into #VALUE!
+                put(ValueTag::Error);
+                put(static_cast<uint8_t>(ErrorCode::Value));
+            }
+            else
+            {
+                put(ValueTag::Blank);
+            }
+        }
+
+    private:
+        std::vector<char> &out_;
+    };
+
+    // reads a payload that passed its checksum, running off its end means the writer and reader
+    // disagree about the format
+    class Decoder
+    {
+    public:
+        Decoder(const char *p, uint32_t length) : p_(p), end_(p + length) {}
+
+        template <typename T>
+        T get()
+        {
+            if (static_cast<size_t>(end_ - p_) < sizeof(T))
+                corrupt();
+            T v;
+            std::memcpy(&v, p_, sizeof v);
+            p_ += sizeof v;
+            return v;
+        }
+
+        std::string_view text()
+        {
+            uint32_t size = get<uint32_t>();
+            if (static_cast<size_t>(end_ - p_) < size)
+                corrupt();
+            std::string_view s(p_, size);
+            p_ += size;
+            return s;
+        }
+
+        Value value()
+        {
+            switch (get<ValueTag>())
+            {
+            case ValueTag::Blank:
+                return Blank{};
+            case ValueTag::Number:
+                return get<double>();
+            case ValueTag::Bool:
+                return get<uint8_t>() != 0;
+            case ValueTag::Text:
+                return Text(text());
+            case ValueTag::Error:
+            {
+                uint8_t code = get<uint8_t>();
+                if (code > static_cast<uint8_t>(ErrorCode::NA))
+                    corrupt();
+                return Error{static_cast<ErrorCode>(code)};
+            }
+            case ValueTag::Array:
+            {
+                int32_t rows = get<int32_t>(), cols = get<int32_t>();
+                // every cell takes a byte at least
+                if (rows < 0 || cols < 0 || static_cast<uint64_t>(rows) * cols > static_cast<uint64_t>(end_ - p_))
+                    corrupt();
+                auto data = std::make_shared<ArrayData>();
+                data->cells.reserve(static_cast<size_t>(rows) * cols);
+                for (int64_t i = 0; i < static_cast<int64_t>(rows) * cols; i++)
+                    data->cells.push_back(value());
+                return Array{rows, cols, std::move(data)};
+            }
+            }
+            corrupt();
+        }
+
+        RC cell()
+        {
+            int row = get<int32_t>();
+            int col = get<int32_t>();
+            if (row < 1 || col < 1 || row > max_rows || col > max_cols)
+                corrupt();
+            return {row, col};
+        }
+
+        void finish() const
+        {
+            if (p_ != end_)
+                corrupt();
+        }
+
+    private:
+        const char *p_;
+        const char *end_;
+    };
+
+    struct Record
+    {
+        uint16_t type;
+        const char *payload;
+        uint32_t length;
+    };
+
+    // the part of a log file that can be trusted: the records up to the end of its last whole
+    // transaction, or standalone record, everything after is torn or was never committed
+    struct Scan
+    {
+        bool exists = false;
+        FileHeader header{};
+        std::vector<char> bytes;
+        std::vector<Record> records;
+        size_t valid_end = 0;   // file offset the trusted part ends at
+        uint64_t last_commit = 0;
+    };
+
+    Scan scanLog(const std::string &path)
+    {
+        Scan scan;
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == ENOENT)
+                return scan;
+            throw std::runtime_error("CANNOT OPEN LOG: " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("CANNOT OPEN LOG: " + path);
+        }
+        scan.bytes.resize(static_cast<size_t>(st.st_size));
+        size_t got = 0;
+        while (got < scan.bytes.size())
+        {
+            ssize_t n = ::read(fd, scan.bytes.data() + got, scan.bytes.size() - got);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            got += static_cast<size_t>(n);
+        }
+        ::close(fd);
+        scan.bytes.resize(got);
+        scan.exists = true;
+        // a crash while a new log was started leaves it shorter than its header
+        if (got < sizeof(FileHeader))
+            return scan;
+
+        std::memcpy(&scan.header, scan.bytes.data(), sizeof scan.header);
+        if (std::memcmp(scan.header.magic, magic, sizeof magic) != 0)
+            throw std::runtime_error("NOT A LOG: " + path);
+        if (scan.header.version != WriteAheadLog::format_version)
+            throw std::runtime_error("UNSUPPORTED LOG VERSION " + std::to_string(scan.header.version));
+        if (scan.header.checksum != headerSum(scan.header))
+            corrupt();
+
+        scan.last_commit = scan.header.base_commit;
+        scan.valid_end = sizeof(FileHeader);
+        size_t trusted = 0; // records up to valid_end
+        size_t offset = sizeof(FileHeader);
+        const char *base = scan.bytes.data();
+        while (got - offset >= sizeof(RecordHeader))
+        {
+            RecordHeader header;
+            std::memcpy(&header, base + offset, sizeof header);
+            const size_t payload = offset + sizeof header;
+            if (header.length > max_payload || header.length > got - payload || header.type < SetValue ||
+                header.type > Commit || header.reserved || header.checksum != recordSum(header.type, base + payload, header.length))
+                break;
+            scan.records.push_back(Record{header.type, base + payload, header.length});
+            offset = payload + header.length;
+            if (header.type == Commit || header.type == AddSheet)
+            {
+                // a sheet is added between transactions, never inside one
+                if (header.type == AddSheet && trusted + 1 != scan.records.size())
+                    corrupt();
+                if (header.type == Commit)
+                {
+                    Decoder in(base + payload, header.length);
+                    uint64_t commit = in.get<uint64_t>();
+                    in.finish();
+                    if (commit != scan.last_commit + 1)
+                        corrupt();
+                    scan.last_commit = commit;
+                }
+                trusted = scan.records.size();
+                scan.valid_end = offset;
+            }
+        }
+        scan.records.resize(trusted);
+        return scan;
+    }
+
+    void writeAll(int fd, const char *data, size_t size, const std::string &path)
+    {
+        while (size)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                throw std::runtime_error("CANNOT WRITE LOG: " + path);
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+}
+
+WriteAheadLog::WriteAheadLog(Workbook &book, const std::string &path, Options options)
+    : book_(book), path_(path), options_(options)
+{
+    if (book_.log_)
+        throw std::runtime_error("WORKBOOK ALREADY HAS A LOG");
+    // the staged formulas didn't keep their text
+    if (book_.open_)
+        throw std::runtime_error("TRANSACTION ALREADY OPEN");
+    Scan scan = scanLog(path);
+    if (scan.last_commit > book_.commits_)
+        throw std::runtime_error("LOG IS AHEAD OF THE WORKBOOK");
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        throw std::runtime_error("CANNOT OPEN LOG: " + path);
+    try
+    {
+        // a log without a header, or behind the workbook because the snapshot the workbook came from
+        // has its commits already, starts over
+        if (scan.valid_end == 0 || scan.last_commit < book_.commits_)
+        {
+            restart(book_.commits_);
+        }
+        else if (scan.valid_end < scan.bytes.size())
+        {
+            // cut the torn tail off, or the next records would follow it and never be read
+            if (::ftruncate(fd_, static_cast<off_t>(scan.valid_end)) != 0 || ::fsync(fd_) != 0)
+                throw std::runtime_error("CANNOT WRITE LOG: " + path);
+        }
+    }
+    catch (...)
+    {
+        ::close(fd_);
+        throw;
+    }
+    handed_commit_ = book_.commits_;
+    stats_.durable = book_.commits_;
+    book_.log_ = this;
+    flusher_ = std::thread([this] { flushLoop(); });
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_one();
+    flusher_.join();
+    book_.log_ = nullptr;
+    ::close(fd_);
+}
+
+void WriteAheadLog::sync()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    const size_t target = handed_bytes_;
+    if (error_.empty() && durable_bytes_ < target)
+    {
+        sync_requested_ = true;
+        work_.notify_one();
+        done_.wait(lock, [&] { return durable_bytes_ >= target || !error_.empty(); });
+    }
+    if (!error_.empty())
+        throw std::runtime_error(error_);
+}
+
+SnapshotStats WriteAheadLog::checkpoint(const std::string &snapshot_path)
+{
+    if (book_.open_)
+        throw std::runtime_error("TRANSACTION ALREADY OPEN");
+    sync();
+    SnapshotStats stats = Snapshot::save(book_, snapshot_path);
+    // everything handed over is durable and nothing is handed over while the writer is in here
+    std::lock_guard<std::mutex> lock(mutex_);
+    restart(book_.commits_);
+    return stats;
+}
+
+LogStats WriteAheadLog::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void WriteAheadLog::restart(uint64_t base_commit)
+{
+    FileHeader header{};
+    std::memcpy(header.magic, magic, sizeof magic);
+    header.version = format_version;
+    header.base_commit = base_commit;
+    header.checksum = headerSum(header);
+    if (::ftruncate(fd_, 0) != 0)
+        throw std::runtime_error("CANNOT WRITE LOG: " + path_);
+    writeAll(fd_, reinterpret_cast<const char *>(&header), sizeof header, path_);
+    if (::fsync(fd_) != 0)
+        throw std::runtime_error("CANNOT WRITE LOG: " + path_);
+}
+
+void WriteAheadLog::record(uint16_t type)
+{
+    RecordHeader header{static_cast<uint32_t>(payload_.size()), type, 0, recordSum(type, payload_.data(), static_cast<uint32_t>(payload_.size()))};
+    const char *p = reinterpret_cast<const char *>(&header);
+    txn_.insert(txn_.end(), p, p + sizeof header);
+    txn_.insert(txn_.end(), payload_.begin(), payload_.end());
+    payload_.clear();
+    txn_records_++;
+}
+
+void WriteAheadLog::setValue(int sheet, RC cell, const Value &value)
+{
+    Encoder out(payload_);
+    out.put(static_cast<int32_t>(sheet));
+    out.put(static_cast<int32_t>(cell.first));
+    out.put(static_cast<int32_t>(cell.second));
+    out.value(value);
+    record(SetValue);
+}
+
+void WriteAheadLog::setFormula(int sheet, RC cell, std::string_view formula)
+{
+    Encoder out(payload_);
+    out.put(static_cast<int32_t>(sheet));
+    out.put(static_cast<int32_t>(cell.first));
+    out.put(static_cast<int32_t>(cell.second));
+    out.text(formula);
+    record(SetFormula);
+}
+
+void WriteAheadLog::restructure(const StructuralEdit &edit)
+{
+    Encoder out(payload_);
+    out.put(static_cast<int32_t>(edit.sheet));
+    out.put(static_cast<uint8_t>(edit.rows));
+    out.put(static_cast<uint8_t>(edit.insert));
+    out.put(static_cast<int32_t>(edit.at));
+    out.put(static_cast<int32_t>(edit.count));
+    record(Structural);
+}
+
+void WriteAheadLog::addSheet(int sheet, std::string_view name)
+{
+    Encoder out(payload_);
+    out.put(static_cast<int32_t>(sheet));
+    out.text(name);
+    record(AddSheet);
+    handOver(0);
+}
+
+void WriteAheadLog::commit(uint64_t commit)
+{
+    Encoder out(payload_);
+    out.put(commit);
+    record(Commit);
+    handOver(commit);
+}
+
+void WriteAheadLog::handOver(uint64_t commit)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    // a full group is queued behind a write, wait for the disk instead of buffering without bound
+    done_.wait(lock, [&] { return pending_.size() < options_.group_bytes || !flushing_ || !error_.empty(); });
+    if (!error_.empty())
+    {
+        txn_.clear();
+        txn_records_ = 0;
+        throw std::runtime_error(error_);
+    }
+    const bool was_empty = pending_.empty();
+    pending_.insert(pending_.end(), txn_.begin(), txn_.end());
+    handed_bytes_ += txn_.size();
+    stats_.records += txn_records_;
+    if (commit)
+    {
+        handed_commit_ = commit;
+        stats_.commits++;
+    }
+    txn_.clear();
+    txn_records_ = 0;
+    // the flusher starts the group delay when the first records come in and ends it early when
+    // the group is full
+    if (was_empty || pending_.size() >= options_.group_bytes)
+        work_.notify_one();
+}
+
+void WriteAheadLog::flushLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        work_.wait(lock, [&] { return stop_ || !pending_.empty(); });
+        if (pending_.empty())
+            break;
+        // gather a group
+        work_.wait_for(lock, options_.group_delay, [&] { return stop_ || sync_requested_ || pending_.size() >= options_.group_bytes; });
+        writing_.swap(pending_);
+        const uint64_t commit = handed_commit_;
+        const size_t bytes = handed_bytes_;
+        sync_requested_ = false;
+        flushing_ = true;
+        lock.unlock();
+
+        std::string error;
+        if (!writing_.empty())
+        {
+            try
+            {
+                writeAll(fd_, writing_.data(), writing_.size(), path_);
+                if (::fdatasync(fd_) != 0)
+                    throw std::runtime_error("CANNOT WRITE LOG: " + path_);
+            }
+            catch (const std::exception &e)
+            {
+                error = e.what();
+            }
+        }
+
+        lock.lock();
+        flushing_ = false;
+        if (error.empty() && error_.empty())
+        {
+            stats_.bytes += writing_.size();
+            stats_.syncs++;
+            stats_.durable = commit;
+            durable_bytes_ = bytes;
+        }
+        else if (error_.empty())
+        {
+            error_ = error;
+        }
+        writing_.clear();
+        // nothing after a failed write can be durable
+        if (!error_.empty())
+            pending_.clear();
+        done_.notify_all();
+    }
+}
+
+RecoveryStats WriteAheadLog::recover(Workbook &book, const std::string &snapshot_path, const std::string &log_path)
+{
+    if (book.open_ || book.log_ || book.sheets_.size() != 1 || book.commits_ || book.cache_.size() ||
+        !book.sheets_[0]->formulas.empty() || book.stores_[0]->cellCount())
+        throw std::runtime_error("RECOVERY NEEDS A NEW WORKBOOK");
+    RecoveryStats stats;
+    Clock::time_point phase = Clock::now();
+    if (::access(snapshot_path.c_str(), F_OK) == 0)
+    {
+        stats.snapshot_commit = Snapshot::load(book, snapshot_path).commit;
+        stats.snapshot = true;
+    }
+    stats.load_ms = millisSince(phase);
+
+    Scan scan = scanLog(log_path);
+    stats.records = scan.records.size();
+    stats.dropped_bytes = scan.bytes.size() - scan.valid_end;
+    if (scan.valid_end && scan.header.base_commit > stats.snapshot_commit)
+        throw std::runtime_error("LOG DOES NOT CONTINUE THE SNAPSHOT");
+
+    // commits replay in order and one by one, which gives the commit numbers, RAND epochs and
+    // #CYCLE! cells they had, each recalculates only the dirty closure of its own edits
+    size_t first = 0; // first record of the current transaction
+    for (size_t i = 0; i < scan.records.size(); i++)
+    {
+        const Record &record = scan.records[i];
+        if (record.type == AddSheet)
+        {
+            Decoder in(record.payload, record.length);
+            int sheet = in.get<int32_t>();
+            std::string name(in.text());
+            in.finish();
+            // added before the snapshot was taken
+            if (sheet < book.sheetCount())
+            {
+                if (book.sheetName(sheet) != name)
+                    corrupt();
+            }
+            else if (sheet != book.sheetCount() || book.addSheet(name) != sheet)
+            {
+                corrupt();
+            }
+            first = i + 1;
+            continue;
+        }
+        if (record.type != Commit)
+            continue;
+        const uint64_t commit = Decoder(record.payload, record.length).get<uint64_t>();
+        const size_t last = i;
+        const size_t begin = first;
+        first = i + 1;
+        if (commit <= stats.snapshot_commit)
+        {
+            stats.skipped++;
+            continue;
+        }
+        if (commit != book.commits_ + 1)
+            throw std::runtime_error("LOG DOES NOT CONTINUE THE SNAPSHOT");
+        stats.transactions++;
+        CommitStats commit_stats;
+        if (last - begin == 1 && scan.records[begin].type == Structural)
+        {
+            Decoder in(scan.records[begin].payload, scan.records[begin].length);
+            StructuralEdit edit;
+            edit.sheet = in.get<int32_t>();
+            edit.rows = in.get<uint8_t>() != 0;
+            edit.insert = in.get<uint8_t>() != 0;
+            edit.at = in.get<int32_t>();
+            edit.count = in.get<int32_t>();
+            in.finish();
+            commit_stats = book.restructure(edit);
+        }
+        else
+        {
+            Workbook::Transaction txn = book.begin();
+            for (size_t r = begin; r < last; r++)
+            {
+                // a structural edit is committed on its own
+                if (scan.records[r].type == Structural)
+                    corrupt();
+                Decoder in(scan.records[r].payload, scan.records[r].length);
+                const int sheet = in.get<int32_t>();
+                RC cell = in.cell();
+                if (scan.records[r].type == SetValue)
+                    txn.setValue(sheet, cell, in.value());
+                else
+                    txn.setFormula(sheet, cell, std::string(in.text()));
+                in.finish();
+            }
+            commit_stats = txn.commit();
+        }
+        stats.compiled += commit_stats.compiled;
+        stats.evaluated += commit_stats.evaluated;
+    }
+    stats.commit = book.commits_;
+    stats.replay_ms = millisSince(phase);
+    return stats;
+}
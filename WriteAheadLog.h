@@ -0,0 +1,132 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include "EvalTypes.h"
+#include "Snapshot.h"
+#include "StructuralEdit.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class Workbook;
+
+// what the log wrote so far
+struct LogStats
+{
+    size_t commits = 0;        // transactions handed to the log
+    size_t records = 0;
+    size_t bytes = 0;          // written to the file
+    size_t syncs = 0;          // fdatasync calls, each makes a group of commits durable
+    uint64_t durable = 0;      // last commit known to be on disk
+};
+
+// what recovery found and replayed
+struct RecoveryStats
+{
+    bool snapshot = false;      // a snapshot was loaded
+    uint64_t snapshot_commit = 0;
+    size_t transactions = 0;    // committed transactions of the log replayed, structural edits and volatile ticks too
+    size_t skipped = 0;         // already in the snapshot
+    size_t records = 0;         // valid records read
+    size_t dropped_bytes = 0;   // torn or unfinished tail, not replayed
+    size_t compiled = 0;        // formulas replay compiled, only the ones set after the snapshot
+    size_t evaluated = 0;       // formula cells replay evaluated, the dirty closures of the replayed commits
+    uint64_t commit = 0;        // commit the workbook is at afterwards
+    double load_ms = 0;
+    double replay_ms = 0;
+};
+
+// append only log of committed edits, a workbook with a log attached hands every commit to it before
+// applying it: the cell and formula edits of the transaction, structural edits, added sheets and a
+// commit record closing the transaction, formulas are logged as the text they were set with
+// every record carries its length and a checksum, a file that ends in a cut short or damaged record
+// or in a transaction without its commit record ends where the last whole transaction does
+// group commit: commits are buffered and a flusher thread writes and syncs them in groups of up to
+// group_bytes or group_delay apart, so a commit only waits for the disk when a whole group is queued
+// behind a write and a crash loses about the last group_delay of commits, sync() waits until
+// everything handed over so far is durable
+// recovery loads the snapshot, which brings the compiled formulas and the dependency index along,
+// and replays the commits the log has after it one by one, so only the formulas set since are
+// compiled and each commit recalculates only the dirty closure of its edits, commit numbers, RAND
+// draws and #CYCLE! cells come out as they were before the crash
+// the log has to go before the workbook it is attached to
+class WriteAheadLog
+{
+public:
+    static constexpr uint32_t format_version = 1;
+
+    struct Options
+    {
+        size_t group_bytes = 1 << 20;
+        std::chrono::microseconds group_delay{2000};
+    };
+
+    // opens path for appending and attaches to book, a torn tail is cut off first, path is created
+    // when missing
+    // throws when the log has commits book doesn't, recover() has to run first
+    WriteAheadLog(Workbook &book, const std::string &path, Options options);
+    WriteAheadLog(Workbook &book, const std::string &path) : WriteAheadLog(book, path, Options{}) {}
+    // syncs what is buffered and detaches
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog &) = delete;
+    WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+    // blocks until every commit handed over so far is on disk
+    void sync();
+    // saves a snapshot to snapshot_path and starts the log over after it, throws when a transaction
+    // is open, a crash in between leaves a log whose commits the snapshot already has, which replay skips
+    SnapshotStats checkpoint(const std::string &snapshot_path);
+    LogStats stats() const;
+
+    // loads snapshot_path (an empty workbook when there is none) into book, which has to be new, and
+    // replays the committed transactions of log_path after it, a missing log replays nothing
+    // throws when the log doesn't continue the snapshot or a record can't be applied
+    static RecoveryStats recover(Workbook &book, const std::string &snapshot_path, const std::string &log_path);
+
+private:
+    friend class Workbook;
+
+    // records of the transaction being committed, writer side, handed to the flusher by commit
+    void setValue(int sheet, RC cell, const Value &value);
+    void setFormula(int sheet, RC cell, std::string_view formula);
+    void restructure(const StructuralEdit &edit);
+    void addSheet(int sheet, std::string_view name);
+    void commit(uint64_t commit);
+
+    void record(uint16_t type);
+    // moves the records of txn_ to the flusher, commit is 0 for records outside of a transaction
+    void handOver(uint64_t commit);
+    void flushLoop();
+    // empties the file down to a header saying the log continues commit base_commit
+    void restart(uint64_t base_commit);
+
+    Workbook &book_;
+    std::string path_;
+    Options options_;
+    int fd_ = -1;
+    std::vector<char> txn_;     // records not handed over yet, writer side
+    std::vector<char> payload_; // record being encoded
+    size_t txn_records_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_; // flusher waits for records
+    std::condition_variable done_; // writers wait for a write to finish
+    std::vector<char> pending_;    // handed over, not written yet
+    std::vector<char> writing_;    // spare buffer the flusher swaps with pending_
+    uint64_t handed_commit_ = 0;
+    size_t handed_bytes_ = 0;
+    size_t durable_bytes_ = 0;
+    bool sync_requested_ = false;
+    bool flushing_ = false;
+    bool stop_ = false;
+    std::string error_; // a write failed, nothing after it is durable and every later call throws
+    LogStats stats_;
+    std::thread flusher_;
+};
+
+#endif
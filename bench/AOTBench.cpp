@@ -0,0 +1,80 @@
+// interpreted, ahead of time compiled and column batch evaluation of the same formulas down a column
+#include "AOTCompiler.h"
+#include "BatchEvaluator.h"
+#include "SheetStore.h"
+#include "StringPool.h"
+#include <chrono>
+#include <cstdio>
+
+using Clock = std::chrono::steady_clock;
+
+static double millis(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+int main()
+{
+    const int rows = 200000;
+    SheetStore sheet;
+    for (int r = 1; r <= rows; r++)
+    {
+        sheet.set({r, 2}, Number(r % 7));
+        // mostly numbers, the odd text cell makes the compiled code fall back
+        Value c = Number(r % 3);
+        if (r % 1000 == 0)
+            c = Text("x");
+        else if (r % 500 == 0)
+            c = Blank{};
+        else if (r % 333 == 0)
+            c = Error{ErrorCode::Div0};
+        else if (r % 777 == 0)
+            c = true;
+        sheet.set({r, 3}, c);
+    }
+    EvalContext ctx;
+    ctx.sheet = &sheet;
+
+    const char *formulas[] = {"B1*C1", "B1/C1+1", "B1^C1", "IF(B1>C1, B1*2, -C1%)", "(B1+C1)*(B1+C1)-B1/4+C1*3-2^B1", "B1=C1", "B1<>C1", "C1"};
+    FormulaCache cache;
+    std::vector<FormulaHandle> handles;
+    for (const char *formula : formulas)
+        handles.push_back(cache.compile(formula, {1, 4}));
+
+    Clock::time_point start = Clock::now();
+    const std::string so_path = std::string(BENCH_OUTPUT_DIR) + "/aot_bench_module.so";
+    aot::buildModule(aot::generateModule(cache), so_path, GPFE_SOURCE_DIR);
+    std::printf("module built in %.0f ms\n", millis(start, Clock::now()));
+    AOTModule module;
+    module.load(so_path, cache);
+    std::printf("%zu of %zu formulas compiled, %d rows\n\n", module.compiledCount(), cache.size(), rows);
+
+    std::printf("%-34s %10s %10s %10s %8s\n", "formula", "tree ms", "aot ms", "batch ms", "aot x");
+    Evaluator evaluator;
+    BatchEvaluator batch;
+    int mismatches = 0;
+    std::vector<Value> tree(rows), compiled(rows), column(rows);
+    for (size_t f = 0; f < handles.size(); f++)
+    {
+        const ASTNode *root = &cache.get(handles[f]).root;
+        Clock::time_point t0 = Clock::now();
+        for (int i = 0; i < rows; i++)
+            tree[i] = evaluator.evaluateAt(root, {1 + i, 4}, ctx);
+        Clock::time_point t1 = Clock::now();
+        for (int i = 0; i < rows; i++)
+            compiled[i] = module.evaluateAt(cache, handles[f], {1 + i, 4}, ctx);
+        Clock::time_point t2 = Clock::now();
+        batch.evaluateColumn(root, 4, 1, rows, ctx, column.data());
+        Clock::time_point t3 = Clock::now();
+        for (int i = 0; i < rows; i++)
+        {
+            if (!sameValue(tree[i], compiled[i]))
+                mismatches++;
+            if (!sameValue(tree[i], column[i]))
+                mismatches++;
+        }
+        std::printf("%-34s %10.1f %10.1f %10.1f %8.1f\n", formulas[f], millis(t0, t1), millis(t1, t2), millis(t2, t3), millis(t0, t1) / millis(t1, t2));
+    }
+    std::printf("\nfallbacks to the interpreter %zu, mismatches %d\n", module.fallbacks(), mismatches);
+    return mismatches ? 1 : 0;
+}
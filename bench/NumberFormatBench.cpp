@@ -0,0 +1,59 @@
+// numfmt::format against snprintf("%.15g"), which it replaces, on integers, money amounts and
+// random doubles, checking the text is the same
+#include "NumberFormat.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double nanosPer(Clock::time_point from, Clock::time_point to, size_t count)
+{
+    return std::chrono::duration<double, std::nano>(to - from).count() / count;
+}
+
+int main()
+{
+    const int count = 1000000;
+    std::mt19937_64 rng(5);
+    std::uniform_real_distribution<double> uniform(-1e6, 1e6);
+    std::vector<double> integers, money, random;
+    for (int i = 0; i < count; i++)
+    {
+        integers.push_back(i * 37.0);
+        money.push_back(std::round(uniform(rng) * 100) / 100);
+        random.push_back(uniform(rng));
+    }
+
+    std::printf("%-10s %14s %14s %8s\n", "numbers", "snprintf ns", "numfmt ns", "x");
+    size_t mismatches = 0;
+    auto run = [&](const char *name, const std::vector<double> &xs)
+    {
+        char a[64], b[numfmt::max_chars + 1];
+        size_t chars = 0; // keeps the loops from being optimized out
+        Clock::time_point t0 = Clock::now();
+        for (double x : xs)
+            chars += std::snprintf(a, sizeof a, "%.15g", x);
+        Clock::time_point t1 = Clock::now();
+        for (double x : xs)
+            chars += numfmt::format(x, b) - b;
+        Clock::time_point t2 = Clock::now();
+        for (double x : xs)
+        {
+            std::snprintf(a, sizeof a, "%.15g", x);
+            *numfmt::format(x, b) = 0;
+            if (std::strcmp(a, b))
+                mismatches++;
+        }
+        double slow = nanosPer(t0, t1, xs.size()), fast = nanosPer(t1, t2, xs.size());
+        std::printf("%-10s %14.1f %14.1f %8.1f  (%zu chars)\n", name, slow, fast, slow / fast, chars);
+    };
+    run("integers", integers);
+    run("money", money);
+    run("random", random);
+    std::printf("\nmismatches %zu\n", mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+// opening a workbook by re-parsing and recalculating its formulas against loading a snapshot of it
+#include "Workbook.h"
+#include "Snapshot.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double millisSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main()
+{
+    const int rows = 200000;
+    // distinct literals keep fill-down copies from sharing one program
+    std::vector<std::pair<RC, std::string>> formulas;
+    for (int r = 1; r <= rows; r++)
+    {
+        const std::string row = std::to_string(r);
+        formulas.push_back({{r, 3}, "A" + row + "*B" + row + "+" + std::to_string(r % 500)});
+        formulas.push_back({{r, 4}, "IF(C" + row + ">100,C" + row + "-" + std::to_string(r % 300) + ",ROUND(C" + row + "/7,2))"});
+        formulas.push_back({{r, 5}, "(A" + row + "+B" + row + "+C" + row + ")*" + std::to_string(r % 1000) + "+LEN(\"x" + std::to_string(r % 50) + "\")"});
+    }
+
+    Clock::time_point start = Clock::now();
+    Workbook parsed;
+    {
+        auto txn = parsed.begin();
+        for (int r = 1; r <= rows; r++)
+        {
+            txn.setValue({r, 1}, double(r));
+            txn.setValue({r, 2}, double(r % 13));
+        }
+        for (const auto &[cell, formula] : formulas)
+            txn.setFormula(cell, formula);
+        txn.commit();
+    }
+    const double reparse_ms = millisSince(start);
+    std::printf("re-parse and recalc  %8.0f ms  %zu formulas, %zu programs\n", reparse_ms, formulas.size(), parsed.formulas().size());
+
+    const std::string path = std::string(BENCH_OUTPUT_DIR) + "/snapshot_bench.snap";
+    start = Clock::now();
+    SnapshotStats saved = Snapshot::save(parsed, path);
+    std::printf("save                 %8.0f ms  %zu MB\n", millisSince(start), saved.bytes >> 20);
+
+    start = Clock::now();
+    Workbook loaded;
+    SnapshotStats stats = Snapshot::load(loaded, path);
+    const double load_ms = millisSince(start);
+    std::printf("load                 %8.0f ms  map and checksum %.0f, strings %.0f, values %.0f, programs %.0f, index %.0f\n",
+                load_ms, stats.map_ms, stats.strings_ms, stats.values_ms, stats.programs_ms, stats.index_ms);
+    std::printf("speedup              %8.1fx\n", reparse_ms / load_ms);
+
+    int mismatches = 0;
+    for (int r = 1; r <= rows; r += 97)
+        for (int c = 1; c <= 5; c++)
+            if (!sameValue(parsed.value({r, c}), loaded.value({r, c})))
+                mismatches++;
+    std::printf("mismatches %d\n", mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -14,6 +14,9 @@
 #include "TypeChecker.h"
 #include "Evaluator.h"
 #include "EvalTypes.h"
+#include "StringPool.h"
+#include "CSE.h"
+#include "SheetStore.h"
 
 // need literal, function call, operator, reference
 
@@ -55,7 +58,7 @@ void print_ast(ASTNode *node, int indent)
         }
         else
         {
-            std::cout << std::format("{}LITERAL({}): {}\n", padding, std::get<std::string>(lit.value), BaseTypeToString(node->inferredType.type));
+            std::cout << std::format("{}LITERAL({}): {}\n", padding, StringPool::global().view(std::get<InternedText>(lit.value)), BaseTypeToString(node->inferredType.type));
         }
         return;
     }
@@ -92,6 +95,17 @@ void print_ast(ASTNode *node, int indent)
             const auto &cell_ref = std::get<CellReference>(reference.ref);
             std::cout << std::format("{}REFERENCE({},{}): {}\n", padding, cell_ref.row, cell_ref.col, BaseTypeToString(node->inferredType.type));
         }
+        else
+        {
+            const auto &range_ref = std::get<RangeReference>(reference.ref);
+            std::cout << std::format("{}RANGE({},{}:{},{}): {}\n", padding, range_ref.top, range_ref.left, range_ref.bottom, range_ref.right, BaseTypeToString(node->inferredType.type));
+        }
+        return;
+    }
+    case ASTNodeType::Name:
+    {
+        const auto &name = std::get<Name>(node->node);
+        std::cout << std::format("{}NAME({}, slot {}): {}\n", padding, name.identifier, name.slot, BaseTypeToString(node->inferredType.type));
         return;
     }
     default:
@@ -111,11 +125,14 @@ int main()
     ASTNode root = parser.parse();
     TypeChecker type_checker;
     type_checker.infer(&root);
+    CSEPass cse;
+    cse.run(&root);
     print_ast(&root, 0);
     Evaluator evaluator;
     EvalContext evalCtx;
-    evalCtx.cell_map = new std::map<RC, Value>();
-    evalCtx.cell_map->insert(std::make_pair(RC{1, 1}, Number{5}));
+    SheetStore sheet;
+    sheet.set(RC{1, 1}, Number{5});
+    evalCtx.sheet = &sheet;
     Value evaluated_expr = evaluator.evaluateNode(&root, EvalNeed::Scalar, evalCtx);
     if (std::holds_alternative<double>(evaluated_expr))
     {
@@ -129,9 +146,9 @@ int main()
         else
             std::cout << "FALSE\n";
     }
-    if (std::holds_alternative<std::string>(evaluated_expr))
+    if (isText(evaluated_expr))
     {
-        std::cout << std::get<std::string>(evaluated_expr) << "\n";
+        std::cout << textView(evaluated_expr) << "\n";
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "AOTCompiler.h"
+#include "SheetStore.h"
+#include "StringPool.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool compiles(const std::string &formula)
+{
+    FormulaCache cache;
+    return aot::canCompile(&cache.get(cache.compile(formula, {1, 4})).root);
+}
+
+static bool loadFails(const std::string &path, const FormulaCache &cache)
+{
+    try
+    {
+        AOTModule().load(path, cache);
+        return false;
+    }
+    catch (const std::runtime_error &)
+    {
+        return true;
+    }
+}
+
+int main()
+{
+    check(compiles("A1*2+B1/4-C1^2"), "arithmetic compiles");
+    check(compiles("IF(A1>B1, -A1, A1%)"), "IF, comparisons and unary ops compile");
+    check(!compiles("A1&\"x\""), "concat stays interpreted");
+    check(!compiles("SUM(A1:A3)"), "ranges stay interpreted");
+    check(!compiles("LEN(B1)"), "other functions stay interpreted");
+
+    // A numbers, B mixed: numbers, zeros, text, blanks, errors and bools
+    SheetStore sheet;
+    const int rows = 400;
+    for (int r = 1; r <= rows; r++)
+    {
+        sheet.set({r, 1}, Number(r % 5 - 2));
+        Value b = Number(r % 3);
+        if (r % 11 == 0)
+            b = Text("x");
+        else if (r % 13 == 0)
+            b = Blank{};
+        else if (r % 17 == 0)
+            b = Error{ErrorCode::NA};
+        else if (r % 7 == 0)
+            b = true;
+        if (!std::holds_alternative<Blank>(b))
+            sheet.set({r, 2}, b);
+    }
+    EvalContext ctx;
+    ctx.sheet = &sheet;
+
+    const char *formulas[] = {"A1*B1", "A1/B1+1", "A1^B1", "B1^A1", "IF(A1>B1, A1*2, -B1%)", "A1=B1", "A1<>B1",
+                              "(A1+B1)*(A1+B1)-A1/4+B1*3-2^A1", "B1", "A2-B1", "A1&B1", "SUM(A1:B2)"};
+    FormulaCache cache;
+    std::vector<FormulaHandle> handles;
+    size_t compilable = 0;
+    for (const char *formula : formulas)
+    {
+        handles.push_back(cache.compile(formula, {1, 4}));
+        compilable += aot::canCompile(&cache.get(handles.back()).root);
+    }
+
+    const std::string so_path = std::string(TEST_OUTPUT_DIR) + "/aot_test_module.so";
+    aot::buildModule(aot::generateModule(cache), so_path, GPFE_SOURCE_DIR);
+    AOTModule module;
+    module.load(so_path, cache);
+    check(module.compiledCount() == compilable && compilable == 10, "every formula canCompile accepts is in the module");
+
+    // compiled or not, every row comes out as the interpreter has it
+    Evaluator evaluator;
+    for (size_t f = 0; f < handles.size(); f++)
+    {
+        const ASTNode *root = &cache.get(handles[f]).root;
+        int mismatches = 0;
+        for (int r = 1; r <= rows; r++)
+            if (!sameValue(module.evaluateAt(cache, handles[f], {r, 4}, ctx), evaluator.evaluateAt(root, {r, 4}, ctx)))
+                mismatches++;
+        check(mismatches == 0, std::string("=") + formulas[f] + ", " + std::to_string(mismatches) + " rows differ");
+    }
+
+    // formulas not in the module, and compiled ones whose inputs hold text, go through the interpreter
+    const size_t before = module.fallbacks();
+    module.evaluateAt(cache, handles[0], {1, 4}, ctx);
+    check(module.fallbacks() == before, "a compiled formula on numbers doesn't fall back");
+    module.evaluateAt(cache, handles[0], {11, 4}, ctx);
+    check(module.fallbacks() == before + 1, "a compiled formula reading text falls back");
+    module.evaluateAt(cache, handles[10], {1, 4}, ctx);
+    check(module.fallbacks() == before + 2, "a formula the module doesn't have falls back");
+    FormulaHandle later = cache.compile("A1*3", {1, 4});
+    Value v = module.evaluateAt(cache, later, {4, 4}, ctx);
+    check(module.fallbacks() == before + 3 && std::holds_alternative<Number>(v) && std::get<Number>(v) == 6,
+          "a formula compiled after the module was loaded falls back");
+
+    check(loadFails(std::string(TEST_OUTPUT_DIR) + "/no_such_module.so", cache), "a missing module throws");
+    check(loadFails(TEST_PLUGIN, cache), "a library that isn't a module throws");
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+#include "AggregateViews.h"
+#include "Workbook.h"
+#include <cstdio>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool isNumber(const Value &v, double expected)
+{
+    return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+}
+
+// every write goes through update first, as the workbook does it
+static void write(SheetStore &sheet, AggregateViews &views, RC cell, Value value)
+{
+    views.update(cell, sheet.get(cell), value);
+    sheet.set(cell, std::move(value));
+}
+
+// the view of range has to agree with one built from scratch
+static void checkAgainstRescan(AggregateViews &views, const SheetStore &sheet, const RangeRef &range, const std::string &what)
+{
+    AggregateViews fresh;
+    fresh.materialize(range, sheet);
+    const AggregateView *expected = fresh.find(range, sheet, true);
+    const AggregateView *view = views.find(range, sheet, true);
+    if (!view || !expected)
+    {
+        check(false, what + ": no view");
+        return;
+    }
+    check(view->total() == expected->total(), what + ": sum");
+    check(view->count == expected->count, what + ": count");
+    check(view->populated == expected->populated, what + ": populated cells");
+    check(!view->count || (view->min == expected->min && view->max == expected->max), what + ": min and max");
+}
+
+int main()
+{
+    const RangeRef column{1, 1, 1, 2000}; // A1:A2000
+    SheetStore sheet;
+    for (int r = 1; r <= 2000; r++)
+        sheet.set({r, 1}, r % 50 == 0 ? Value{Text("t")} : Value{Number(r % 97)});
+    // B has a range of 2000 cells holding 10 values
+    for (int r = 1; r <= 10; r++)
+        sheet.set({r * 100, 2}, Number(r));
+
+    // a range is materialized on its third scan, small or sparse ranges never are
+    {
+        AggregateViews views;
+        check(!views.find(column, sheet, false) && !views.find(column, sheet, false), "the first scans go to the sheet");
+        check(views.find(column, sheet, false) != nullptr, "the third scan builds a view");
+        check(views.stats().views == 1 && views.stats().built == 1, "one view built");
+        views.find(column, sheet, false);
+        check(views.stats().hits == 1 && views.stats().cells_avoided == 2000, "a scan answered by the view counts the cells it saved");
+
+        const RangeRef small{1, 1, 1, 100};
+        for (int i = 0; i < 5; i++)
+            views.find(small, sheet, false);
+        check(views.stats().built == 1, "a range smaller than min_cells is never built");
+
+        const RangeRef sparse{2, 2, 1, 2000};
+        for (int i = 0; i < 6; i++)
+            check(!views.find(sparse, sheet, false), "a sparse range keeps going to the sheet");
+        check(views.stats().built == 2 && views.size() == 1, "a sparse range is scanned once to find it isn't hot, never again");
+
+        views.clear();
+        check(views.size() == 0 && !views.find(column, sheet, false), "clear drops the views and the scan counts");
+    }
+
+    // writes inside the range are folded in, writes outside it aren't
+    {
+        SheetStore edited = sheet;
+        AggregateViews views;
+        check(views.materialize(column, edited), "materialize builds right away");
+        checkAgainstRescan(views, edited, column, "freshly built");
+
+        write(edited, views, {3, 1}, 1000.0);
+        checkAgainstRescan(views, edited, column, "number to a new max");
+        write(edited, views, {4, 1}, Text("x"));
+        checkAgainstRescan(views, edited, column, "number to text");
+        write(edited, views, {50, 1}, -5.0);
+        checkAgainstRescan(views, edited, column, "text to a new min");
+        write(edited, views, {6, 1}, Blank{});
+        checkAgainstRescan(views, edited, column, "number to blank");
+        write(edited, views, {6, 1}, 2.5);
+        checkAgainstRescan(views, edited, column, "blank to number");
+        const size_t deltas = views.stats().deltas;
+        write(edited, views, {5, 2}, 9.0);
+        write(edited, views, {2001, 1}, 9.0);
+        write(edited, views, {7, 1}, Text("y"));
+        write(edited, views, {7, 1}, Text("z"));
+        check(views.stats().deltas == deltas + 1, "writes outside the range, and text over text, aren't deltas");
+        checkAgainstRescan(views, edited, column, "after writes outside the range");
+
+        // overwriting an extreme leaves min/max to a rescan, only when they're asked for
+        const size_t rescans = views.stats().rescans;
+        write(edited, views, {3, 1}, 1.0);
+        const AggregateView *view = views.find(column, edited, false);
+        check(view && !view->extrema_valid && views.stats().rescans == rescans, "SUM doesn't rescan for a lost max");
+        checkAgainstRescan(views, edited, column, "max overwritten");
+        check(views.stats().rescans == rescans + 1, "MAX rescans once");
+        write(edited, views, {50, 1}, 3.0);
+        checkAgainstRescan(views, edited, column, "min overwritten");
+        check(views.stats().rescans == rescans + 2, "MIN rescans once");
+
+        // emptying the range starts the extrema over
+        const RangeRef few{3, 3, 1, 3};
+        SheetStore small;
+        small.set({1, 3}, 5.0);
+        small.set({2, 3}, 7.0);
+        AggregateViews small_views;
+        small_views.materialize(few, small);
+        write(small, small_views, {1, 3}, Blank{});
+        write(small, small_views, {2, 3}, Blank{});
+        const AggregateView *empty = small_views.find(few, small, true);
+        check(empty && empty->count == 0 && empty->total() == 0 && empty->populated == 0, "an emptied range has nothing");
+        write(small, small_views, {3, 3}, -2.0);
+        checkAgainstRescan(small_views, small, few, "first number after emptying");
+    }
+
+    // the workbook answers scans from its views and drops them on structural edits
+    {
+        Workbook book;
+        {
+            auto txn = book.begin();
+            for (int r = 1; r <= 2000; r++)
+                txn.setValue({r, 1}, Number(r));
+            txn.setFormula({1, 3}, "SUM(A1:A2000)");
+            txn.setFormula({2, 3}, "MAX(A1:A2000)");
+            txn.commit();
+        }
+        check(book.materialize(column), "workbook materializes");
+        {
+            auto txn = book.begin();
+            txn.setValue({2000, 1}, 1.0);
+            txn.commit();
+        }
+        check(isNumber(book.value({1, 3}), 2001000 - 1999) && isNumber(book.value({2, 3}), 1999), "SUM and MAX from the view");
+        AggregateViewStats stats = book.aggregateStats();
+        check(stats.views == 1 && stats.hits == 2 && stats.deltas == 1 && stats.rescans == 1, "workbook view stats");
+        book.insertRows(1, 1);
+        check(book.aggregateStats().views == 0, "a structural edit clears the views");
+        check(isNumber(book.value({2, 3}), 2001000 - 1999), "the rewritten SUM scans again");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+#include "BatchEvaluator.h"
+#include "FormulaCache.h"
+#include "PluginLoader.h"
+#include "SheetStore.h"
+#include "StringPool.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+// every row of the run has to come out as Evaluator::evaluateAt has it
+// the formula is written as if it were in row anchor_row
+static void checkColumn(const std::string &formula, const SheetStore &sheet, int first_row, int rows, int anchor_row = 1)
+{
+    FormulaCache cache;
+    const ASTNode *root = &cache.get(cache.compile(formula, {anchor_row, 5})).root;
+    EvalContext ctx;
+    ctx.sheet = &sheet;
+    std::vector<Value> batch(rows);
+    BatchEvaluator().evaluateColumn(root, 5, first_row, rows, ctx, batch.data());
+    Evaluator evaluator;
+    int mismatches = 0;
+    for (int i = 0; i < rows; i++)
+        if (!sameValue(batch[i], evaluator.evaluateAt(root, {first_row + i, 5}, ctx)))
+            mismatches++;
+    check(mismatches == 0, "=" + formula + " from row " + std::to_string(first_row) + ", " + std::to_string(mismatches) + " rows differ");
+}
+
+// fill-down aggregate windows slide, SUM and AVERAGE keep a compensated running sum and may differ
+// from a rescan in the last bits
+static void checkWindow(const std::string &formula, const SheetStore &sheet, int first_row, int rows, int anchor_row = 1)
+{
+    FormulaCache cache;
+    const ASTNode *root = &cache.get(cache.compile(formula, {anchor_row, 7})).root;
+    EvalContext ctx;
+    ctx.sheet = &sheet;
+    std::vector<Value> batch(rows);
+    BatchEvaluator().evaluateColumn(root, 7, first_row, rows, ctx, batch.data());
+    Evaluator evaluator;
+    int mismatches = 0;
+    for (int i = 0; i < rows; i++)
+    {
+        Value scalar = evaluator.evaluateAt(root, {first_row + i, 7}, ctx);
+        if (std::holds_alternative<Number>(scalar) && std::holds_alternative<Number>(batch[i]))
+        {
+            const double a = std::get<Number>(scalar), b = std::get<Number>(batch[i]);
+            if (std::abs(a - b) > 1e-9 * std::max(1.0, std::abs(a)))
+                mismatches++;
+        }
+        else if (!sameValue(batch[i], scalar))
+        {
+            mismatches++;
+        }
+    }
+    check(mismatches == 0, "=" + formula + " from row " + std::to_string(first_row) + ", " + std::to_string(mismatches) + " rows differ");
+}
+
+int main()
+{
+    plugins::load(TEST_PLUGIN);
+
+    // B numbers, C mixed: numbers, zeros, text, interned text, blanks, errors and bools, D text
+    SheetStore sheet;
+    const int rows = 3000;
+    for (int r = 1; r <= rows; r++)
+    {
+        sheet.set({r, 1}, Number(r));
+        sheet.set({r, 2}, Number(r % 7 - 3));
+        Value c = Number(r % 3);
+        if (r % 11 == 0)
+            c = Text("x" + std::to_string(r));
+        else if (r % 13 == 0)
+            c = StringPool::global().intern("pooled");
+        else if (r % 5 == 0)
+            c = Blank{};
+        else if (r % 17 == 0)
+            c = Error{ErrorCode::NA};
+        else if (r % 7 == 0)
+            c = r % 2 == 0;
+        if (!std::holds_alternative<Blank>(c))
+            sheet.set({r, 3}, c);
+        if (r % 4 == 0)
+            sheet.set({r, 4}, Text("t"));
+    }
+
+    const char *formulas[] = {
+        "B1*C1", "B1/C1+1", "B1^C1", "C1^B1", "B1-C1", "-C1", "C1%", "+C1",
+        "B1=C1", "B1<>C1", "B1<C1", "C1>=B1", "(B1>C1)+1", "C1&B1", "D1&C1",
+        "IF(B1>C1, B1*2, -C1%)", "(B1+C1)*(B1+C1)-B1/4+C1*3-2^B1",
+        "C1", "D1", "C2-C1", "A1*B2", "C1*0+B1",
+        "SUM(B1,C1)", "ABS(C1)", "SUM(C1:C3)", "MAX(B1:C2)", "LEN(D1)",
+        "PLUGINADD(B1, C1)", "PLUGINADD(A1, B1)", "PLUGINSTRICT(B1, C1)", "PLUGINTWICE(C1)",
+        "RAND()+B1", "RANDBETWEEN(1, 10)*C1"};
+    for (const char *formula : formulas)
+    {
+        checkColumn(formula, sheet, 1, rows);
+        checkColumn(formula, sheet, 37, 500);
+        checkColumn(formula, sheet, 2999, 2);
+    }
+    // references above row 1 are #REF! for the first rows of the run
+    checkColumn("C1+B2", sheet, 1, 10, 5);
+    checkColumn("SUM(C1:C3)", sheet, 1, 10, 5);
+
+    // the plugin only gets the rows that pass its signature, one bad row doesn't fail the rest
+    {
+        FormulaCache cache;
+        const ASTNode *root = &cache.get(cache.compile("PLUGINSTRICT(B1, C1)", {1, 5})).root;
+        EvalContext ctx;
+        ctx.sheet = &sheet;
+        std::vector<Value> out(rows);
+        BatchEvaluator().evaluateColumn(root, 5, 1, rows, ctx, out.data());
+        check(std::holds_alternative<Number>(out[0]) && std::get<Number>(out[0]) == -1, "a number row reaches the plugin");
+        check(std::holds_alternative<Error>(out[10]), "a text row doesn't");
+    }
+
+    // windows with gaps, text, bools and errors inside them, and stretches with no number at all
+    {
+        SheetStore window;
+        for (int r = 1; r <= 2000; r++)
+        {
+            if (r % 9 == 0 || (r > 600 && r < 640))
+                continue;
+            Value v = Number((r * 37 % 101) / 7.0 - 5);
+            if (r % 23 == 0)
+                v = Text("t");
+            else if (r % 29 == 0)
+                v = Error{ErrorCode::Div0};
+            else if (r % 31 == 0)
+                v = true;
+            else if (r % 41 == 0)
+                v = Number(r % 2 ? 1e6 : -1e6);
+            window.set({r, 5}, v);
+            if (r % 3)
+                window.set({r, 6}, Number(r % 17));
+        }
+        const char *aggregates[] = {"SUM", "AVERAGE", "COUNT", "MIN", "MAX"};
+        for (const char *aggregate : aggregates)
+        {
+            const std::string name = aggregate;
+            checkWindow(name + "(E1:E5)", window, 1, 2000);
+            checkWindow(name + "(E1:E50)", window, 1, 1900);
+            checkWindow(name + "(E1:F4)", window, 1, 1990);
+            checkWindow(name + "(E1:E5)", window, 590, 60);
+            checkWindow(name + "(E1:E2)", window, 17, 3);
+            // windows starting above row 1 are #VALUE! until they don't
+            checkWindow(name + "(E1:E3)", window, 1, 40, 8);
+        }
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
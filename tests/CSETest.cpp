@@ -0,0 +1,86 @@
+#include "FormulaCache.h"
+#include "Workbook.h"
+#include <cstdio>
+#include <string>
+
+static int failures = 0;
+
+static void checkNumber(Workbook &book, const std::string &formula, double expected)
+{
+    auto txn = book.begin();
+    txn.setFormula({1, 2}, formula);
+    txn.commit();
+    Value v = book.value({1, 2});
+    if (!std::holds_alternative<Number>(v) || std::get<Number>(v) != expected)
+    {
+        std::printf("FAILED: =%s should be %g\n", formula.c_str(), expected);
+        failures++;
+    }
+}
+
+// slots the pass hands out for a formula, and how many occurrences read one instead of evaluating
+static void checkShared(const std::string &formula, int slots, size_t shared_nodes)
+{
+    FormulaCache cache;
+    const CompiledFormula &compiled = cache.get(cache.compile(formula, {1, 2}));
+    if (compiled.cse_slots != slots || compiled.cse_stats.shared_nodes != shared_nodes)
+    {
+        std::printf("FAILED: =%s should share %d subtrees over %zu nodes, not %d over %zu\n", formula.c_str(), slots,
+                    shared_nodes, compiled.cse_slots, compiled.cse_stats.shared_nodes);
+        failures++;
+    }
+}
+
+int main()
+{
+    // pure calls and operators are shared, each distinct subtree gets one slot
+    checkShared("(A1+A2)*(A1+A2)", 1, 1);
+    checkShared("SUM(A1:A3)+SUM(A1:A3)*SUM(A1:A3)", 1, 2);
+    checkShared("(A1+A2)*(A1+A2)+LEN(A1+A2)", 1, 2);
+    checkShared("(A1*2+1)-(A1*2+1)", 2, 2);
+    // operands are not reordered, A1+A2 and A2+A1 are different trees
+    checkShared("(A1+A2)*(A2+A1)", 0, 0);
+    // references and literals are as cheap as the cache
+    checkShared("A1+A1*2+2", 0, 0);
+    // volatile calls, reference returning calls and locals are never shared
+    checkShared("RAND()+RAND()", 0, 0);
+    checkShared("(RAND()+1)*(RAND()+1)", 0, 0);
+    checkShared("OFFSET(A1,1,0)+OFFSET(A1,1,0)", 0, 0);
+    checkShared("LET(x, 1, x+1)*LET(x, 1, x+1)", 0, 0);
+    checkShared("REDUCE(0, A1:A3, LAMBDA(a, x, a+x*2))+REDUCE(0, A1:A3, LAMBDA(a, x, a+x*2))", 0, 0);
+
+    Workbook book;
+    {
+        auto txn = book.begin();
+        for (int r = 1; r <= 10; r++)
+            txn.setValue({r, 1}, double(r));
+        txn.commit();
+    }
+    checkNumber(book, "(A1+A2)*(A1+A2)+SUM(A1:A3)-SUM(A1:A3)", 9);
+    // the same reference call used as a value and as a range bound must not share a slot
+    checkNumber(book, "OFFSET(A1,1,0)+SUM(OFFSET(A1,1,0):A5)", 16);
+    checkNumber(book, "SUM(INDEX(A1:A10,3):A4)+INDEX(A1:A10,3)", 10);
+    checkNumber(book, "SUM(INDIRECT(\"A2\"):A3)*INDIRECT(\"A2\")", 10);
+    // a slot is filled again by the next evaluation, not read from the last one
+    {
+        auto txn = book.begin();
+        txn.setValue({1, 1}, 4.0);
+        txn.commit();
+    }
+    checkNumber(book, "(A1+A2)*(A1+A2)+SUM(A1:A3)-SUM(A1:A3)", 36);
+    {
+        auto txn = book.begin();
+        txn.setFormula({1, 3}, "RAND()-RAND()");
+        txn.commit();
+        Value v = book.value({1, 3});
+        if (!std::holds_alternative<Number>(v) || std::get<Number>(v) == 0)
+        {
+            std::printf("FAILED: =RAND()-RAND() draws twice\n");
+            failures++;
+        }
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+#include "Workbook.h"
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static bool isNumber(const Value &v, double expected)
+{
+    return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+}
+
+int main()
+{
+    // fill-down copies share one program
+    {
+        Workbook book;
+        auto txn = book.begin();
+        for (int r = 1; r <= 10; r++)
+        {
+            txn.setValue({r, 1}, double(r));
+            txn.setFormula({r, 2}, "A" + std::to_string(r) + "*2");
+        }
+        txn.commit();
+        check(book.formulas().size() == 1, "fill-down copies share a program");
+        check(isNumber(book.value({10, 2}), 20), "fill-down copy evaluates at its own row");
+    }
+
+    // rewritten programs that differ only in a literal past the sixth decimal keep their own keys
+    {
+        Workbook book;
+        auto txn = book.begin();
+        txn.setValue({5, 1}, 1.0);
+        txn.setValue({6, 1}, 1.0);
+        txn.setFormula({1, 2}, "A5*0.0000001");
+        txn.setFormula({2, 2}, "A6*0.0000002");
+        txn.commit();
+        book.insertRows(3, 1);
+        check(isNumber(book.value({1, 2}), 1e-7), "first rewritten formula keeps its literal");
+        check(isNumber(book.value({2, 2}), 2e-7), "second rewritten formula keeps its literal");
+        FormulaCell first{}, second{};
+        check(book.formulaAt({1, 2}, first) && book.formulaAt({2, 2}, second) && first.handle != second.handle,
+              "rewritten formulas get different programs");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include "FunctionRegistry.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static const char *builtins[] = {"SUM", "COUNT", "AVERAGE", "MIN", "MAX", "LEN", "IF", "RAND", "RANDBETWEEN",
+                                 "RANDARRAY", "OFFSET", "INDEX", "INDIRECT"};
+
+static Value fn_TWICE(const std::vector<Value> &args, EvalContext &)
+{
+    return std::get<Number>(args[0]) * 2;
+}
+
+static bool isBuiltin(const std::string &name)
+{
+    for (const char *builtin : builtins)
+        if (name == builtin)
+            return true;
+    return false;
+}
+
+int main()
+{
+    // every built-in is found under its own name, in any case
+    for (const char *name : builtins)
+    {
+        const funcs::FunctionSignature *sig = funcs::lookup(name);
+        check(sig && sig->name == name, std::string(name) + " is found");
+        std::string lower = name, mixed = name;
+        for (size_t i = 0; i < lower.size(); i++)
+        {
+            lower[i] = static_cast<char>(lower[i] - 'A' + 'a');
+            if (i % 2)
+                mixed[i] = lower[i];
+        }
+        check(funcs::lookup(lower) == sig && funcs::lookup(mixed) == sig, std::string(name) + " is case insensitive");
+    }
+    check(funcs::lookup("RAND")->isVolatile && !funcs::lookup("SUM")->isVolatile, "the table keeps each signature's flags");
+    check(funcs::lookup("OFFSET")->returnsRef && funcs::lookup("INDEX")->returnsRef, "and the reference returning ones");
+
+    // a miss lands on some slot of the table, the name check has to turn it away
+    const char *misses[] = {"", "S", "SU", "SUMM", "SUM ", " SUM", "SUM1", "SUMX", "AVERAGEX", "RANDBETWEE",
+                            "INDIRECTS", "LENS", "I", "IFF", "LET", "LAMBDA", "MAP", "REDUCE", "VLOOKUP"};
+    for (const char *name : misses)
+        check(!funcs::lookup(name), std::string("'") + name + "' misses");
+    // short names cover every slot a few times over
+    int wrong = 0;
+    std::string name;
+    for (char a = 'A'; a <= 'Z'; a++)
+        for (char b = 'A'; b <= 'Z'; b++)
+            for (char c = 'A'; c <= 'Z'; c++)
+            {
+                name = {a, b, c};
+                const funcs::FunctionSignature *sig = funcs::lookup(name);
+                if (sig ? sig->name != name : isBuiltin(name))
+                    wrong++;
+            }
+    check(wrong == 0, std::to_string(wrong) + " three letter names found the wrong function");
+
+    // registered functions are looked up after the built-ins miss
+    funcs::FunctionSignature sig{};
+    sig.name = "twice";
+    sig.params = {funcs::Param{funcs::ArgKind::Number}};
+    sig.returnType = BaseType::Number;
+    sig.eval_function = fn_TWICE;
+    const funcs::FunctionSignature *registered = funcs::registerFunction(sig);
+    check(registered->name == "TWICE", "a registered name is uppercased");
+    check(funcs::lookup("TWICE") == registered && funcs::lookup("Twice") == registered, "a registered function is found");
+    check(!funcs::lookup("TWICES") && !funcs::lookup("TWIC"), "and misses stay misses");
+    check(funcs::lookup("SUM")->name == "SUM", "built-ins are unaffected");
+
+    int rejected = 0;
+    for (const char *clash : {"sum", "TWICE"})
+    {
+        sig.name = clash;
+        try
+        {
+            funcs::registerFunction(sig);
+        }
+        catch (const std::runtime_error &)
+        {
+            rejected++;
+        }
+    }
+    check(rejected == 2, "a name already taken, built-in or registered, is rejected");
+
+    funcs::unregisterFunction("twice");
+    check(!funcs::lookup("TWICE"), "an unregistered function misses");
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include "Workbook.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static Value evaluate(Workbook &book, const std::string &formula)
+{
+    auto txn = book.begin();
+    txn.setFormula({1, 3}, formula);
+    txn.commit();
+    return book.value({1, 3});
+}
+
+static void checkNumber(Workbook &book, const std::string &formula, double expected)
+{
+    Value v = evaluate(book, formula);
+    check(std::holds_alternative<Number>(v) && std::get<Number>(v) == expected, "=" + formula + " should be " + std::to_string(expected));
+}
+
+static void checkArray(Workbook &book, const std::string &formula, int rows, int cols, const std::vector<double> &expected)
+{
+    Value v = evaluate(book, formula);
+    bool ok = std::holds_alternative<Array>(v);
+    if (ok)
+    {
+        const Array &array = std::get<Array>(v);
+        ok = array.rows == rows && array.cols == cols && array.data->cells.size() == expected.size();
+        for (size_t i = 0; ok && i < expected.size(); i++)
+            ok = sameValue(array.data->cells[i], Number(expected[i]));
+    }
+    check(ok, "=" + formula);
+}
+
+// names that don't resolve, and special forms used wrong, are refused when compiled or evaluate to an error
+static void checkRejected(Workbook &book, const std::string &formula)
+{
+    bool rejected = false;
+    try
+    {
+        rejected = std::holds_alternative<Error>(evaluate(book, formula));
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    check(rejected, "=" + formula + " is rejected");
+}
+
+int main()
+{
+    Workbook book;
+    {
+        auto txn = book.begin();
+        for (int r = 1; r <= 3; r++)
+        {
+            txn.setValue({r, 1}, double(r));
+            txn.setValue({r, 2}, double(r * 10));
+        }
+        txn.commit();
+    }
+
+    // later bindings see earlier ones, a name is case insensitive
+    checkNumber(book, "LET(x, 2, y, x*3, x+y)", 8);
+    checkNumber(book, "LET(x, A2, X*x)", 4);
+    // an inner LET shadows the outer name only inside its body
+    checkNumber(book, "LET(x, 1, LET(x, 10, x)+x)", 11);
+    checkNumber(book, "LET(x, 1, y, LET(x, 5, x*2), x+y)", 11);
+    // a binding's value is evaluated before its name is bound, so it sees the outer x
+    checkNumber(book, "LET(x, 2, LET(x, x+1, x*10))", 30);
+    // sibling scopes don't leak into each other
+    checkNumber(book, "LET(a, 1, a)+LET(b, 2, b)+LET(a, 3, a)", 6);
+    // a binding is evaluated once, RAND included
+    checkNumber(book, "LET(r, RAND(), r-r)", 0);
+
+    // a LAMBDA parameter shadows a LET name, the LET name is visible again after it
+    checkArray(book, "MAP(A1:A3, LAMBDA(x, x*2))", 3, 1, {2, 4, 6});
+    checkArray(book, "LET(x, 100, MAP(A1:A3, LAMBDA(x, x+1)))", 3, 1, {2, 3, 4});
+    checkArray(book, "LET(k, 100, MAP(A1:A3, LAMBDA(x, x+k)))", 3, 1, {101, 102, 103});
+    checkNumber(book, "LET(x, 100, REDUCE(0, A1:A3, LAMBDA(acc, x, acc+x))+x)", 106);
+    checkArray(book, "MAP(A1:A3, B1:B3, LAMBDA(a, b, a*b))", 3, 1, {10, 40, 90});
+    checkArray(book, "MAP(A1:B2, LAMBDA(v, LET(w, v*v, w+1)))", 2, 2, {2, 101, 5, 401});
+
+    // nested lambdas keep their own slots
+    checkNumber(book, "REDUCE(0, A1:A3, LAMBDA(acc, x, acc+REDUCE(0, B1:B3, LAMBDA(acc, y, acc+x*y))))", 360);
+    checkArray(book, "MAP(A1:A3, LAMBDA(x, REDUCE(x, B1:B3, LAMBDA(a, b, a+b))))", 3, 1, {61, 62, 63});
+    checkNumber(book, "REDUCE(1, A1:A3, LAMBDA(p, x, p*x))", 6);
+    checkNumber(book, "REDUCE(7, A5:A6, LAMBDA(p, x, p*x))", 0);
+
+    // names out of scope
+    checkRejected(book, "LET(x, 1, x)+x");
+    checkRejected(book, "MAP(A1:A3, LAMBDA(x, x))+x");
+    checkRejected(book, "LET(x, x, x)");
+    checkRejected(book, "LET(x, 1)");
+    checkRejected(book, "LAMBDA(x, x)");
+    checkRejected(book, "MAP(A1:A3, LAMBDA(x, y, x))");
+    checkRejected(book, "undefined");
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
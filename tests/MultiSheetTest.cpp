@@ -0,0 +1,149 @@
+#include "Workbook.h"
+#include <cstdio>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool isNumber(const Value &v, double expected)
+{
+    return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+}
+
+static bool isError(const Value &v, ErrorCode code)
+{
+    return std::holds_alternative<Error>(v) && std::get<Error>(v).code == code;
+}
+
+static CommitStats setValue(Workbook &book, int sheet, RC cell, double value)
+{
+    auto txn = book.begin();
+    txn.setValue(sheet, cell, value);
+    return txn.commit();
+}
+
+static bool changed(const Workbook &book, int sheet, RC cell)
+{
+    for (const CellChange &change : book.changes())
+        if (change.sheet == sheet && change.cell == cell)
+            return true;
+    return false;
+}
+
+int main()
+{
+    // Sheet2!A1 dependents recalculate when Sheet2 is written, on both sheets
+    {
+        Workbook book;
+        const int sheet2 = book.addSheet("Sheet2");
+        {
+            auto txn = book.begin();
+            txn.setValue(sheet2, {1, 1}, 5.0);
+            txn.setFormula({1, 1}, "Sheet2!A1*2");
+            txn.setFormula({2, 1}, "A1+Sheet2!A1");
+            txn.setFormula(sheet2, {1, 2}, "Sheet1!A2+1");
+            txn.setFormula({3, 1}, "SUM(Sheet2!A1:B1)");
+            txn.commit();
+        }
+        check(isNumber(book.value({1, 1}), 10) && isNumber(book.value({2, 1}), 15), "first commit");
+        check(isNumber(book.value(sheet2, {1, 2}), 16) && isNumber(book.value({3, 1}), 21), "across and back");
+
+        CommitStats stats = setValue(book, sheet2, {1, 1}, 1.0);
+        check(isNumber(book.value({1, 1}), 2) && isNumber(book.value({2, 1}), 3), "Sheet2!A1 dependents on Sheet1");
+        check(isNumber(book.value(sheet2, {1, 2}), 4) && isNumber(book.value({3, 1}), 5), "their dependents on Sheet2 and back");
+        check(stats.evaluated == 4 && stats.sheets == 2, "one commit evaluates the formulas of both sheets");
+        check(changed(book, 0, {1, 1}) && changed(book, sheet2, {1, 2}) && changed(book, sheet2, {1, 1}), "the feed names the sheets");
+
+        stats = setValue(book, 0, {5, 1}, 9.0);
+        check(stats.evaluated == 0, "A5 on Sheet1 isn't Sheet2!A5");
+        stats = setValue(book, sheet2, {2, 1}, 9.0);
+        check(stats.evaluated == 0, "nothing reads Sheet2!A2");
+    }
+
+    // dynamic reads into another sheet are tracked like static ones
+    {
+        Workbook book;
+        const int data = book.addSheet("Data");
+        {
+            auto txn = book.begin();
+            for (int r = 1; r <= 4; r++)
+                txn.setValue(data, {r, 1}, Number(r));
+            txn.setValue({1, 2}, 2.0);
+            txn.setFormula({1, 1}, "SUM(INDIRECT(\"Data!A1:A\"&B1))");
+            txn.setFormula({2, 1}, "INDIRECT(\"Data!A\"&B1)*10");
+            txn.setFormula({3, 1}, "SUM(OFFSET(Data!A1,B1,0,2,1))");
+            txn.commit();
+        }
+        check(isNumber(book.value({1, 1}), 3) && isNumber(book.value({2, 1}), 20) && isNumber(book.value({3, 1}), 7),
+              "dynamic reads into Data");
+        setValue(book, data, {2, 1}, 20.0);
+        check(isNumber(book.value({1, 1}), 21) && isNumber(book.value({2, 1}), 200), "an edit under a dynamic read");
+        setValue(book, data, {4, 1}, 40.0);
+        check(isNumber(book.value({3, 1}), 43) && isNumber(book.value({1, 1}), 21), "an edit under OFFSET, and outside INDIRECT");
+        setValue(book, 0, {1, 2}, 4.0);
+        check(isNumber(book.value({1, 1}), 64) && isNumber(book.value({2, 1}), 400), "moving the reads");
+        CommitStats stats = setValue(book, data, {4, 1}, 4.0);
+        check(isNumber(book.value({1, 1}), 28) && isNumber(book.value({2, 1}), 40), "the moved reads are tracked");
+        check(stats.evaluated == 2 && isNumber(book.value({3, 1}), 0), "the formulas reading Data!A4 and no other");
+        stats = setValue(book, data, {1, 1}, 100.0);
+        check(isNumber(book.value({1, 1}), 127) && stats.evaluated == 1, "OFFSET doesn't read its anchor's value");
+    }
+
+    // inserts and deletes on one sheet rewrite the formulas pointing at it from another
+    {
+        Workbook book;
+        const int data = book.addSheet("Data");
+        {
+            auto txn = book.begin();
+            for (int r = 1; r <= 5; r++)
+                txn.setValue(data, {r, 1}, Number(r));
+            txn.setValue({2, 1}, 1000.0);
+            txn.setFormula({1, 2}, "Data!A3*2");
+            txn.setFormula({2, 2}, "SUM(Data!A2:A4)");
+            txn.setFormula({3, 2}, "Data!A5+A2");
+            txn.setFormula({5, 2}, "Data!A3");
+            txn.setFormula(data, {1, 2}, "Sheet1!A2+A1");
+            txn.commit();
+        }
+        check(isNumber(book.value({1, 2}), 6) && isNumber(book.value({2, 2}), 9) && isNumber(book.value({3, 2}), 1005), "before");
+
+        book.insertRows(data, 2, 2);
+        check(isNumber(book.value(data, {5, 1}), 3), "Data shifted down");
+        check(isNumber(book.value({1, 2}), 6) && isNumber(book.value({2, 2}), 9) && isNumber(book.value({3, 2}), 1005),
+              "Sheet1 formulas follow the rows that moved");
+        check(isNumber(book.value(data, {1, 2}), 1001), "Data!B1 stays, Sheet1 didn't move");
+        setValue(book, data, {5, 1}, 30.0);
+        check(isNumber(book.value({1, 2}), 60) && isNumber(book.value({2, 2}), 36), "the rewritten references are live");
+        setValue(book, data, {3, 1}, 99.0);
+        check(isNumber(book.value({1, 2}), 60) && isNumber(book.value({2, 2}), 36), "and the old row isn't");
+        setValue(book, 0, {2, 1}, 1.0);
+        check(isNumber(book.value({3, 2}), 6) && isNumber(book.value(data, {1, 2}), 2), "Sheet1 edits still reach Data");
+
+        book.deleteRows(data, 5, 1);
+        check(std::holds_alternative<Error>(book.value({1, 2})), "a reference to a deleted row on another sheet is an error");
+        check(isError(book.value({5, 2}), ErrorCode::Ref), "and #REF! on its own");
+        check(isNumber(book.value({2, 2}), 6), "the range around it shrinks");
+        check(isNumber(book.value({3, 2}), 6), "a reference below it moves up");
+
+        book.insertRows(0, 1, 1);
+        check(isNumber(book.value({4, 2}), 6) && isNumber(book.value(data, {1, 2}), 2), "Data!B1 follows Sheet1!A2 to A3");
+        setValue(book, 0, {3, 1}, 2.0);
+        check(isNumber(book.value(data, {1, 2}), 3) && isNumber(book.value({4, 2}), 7), "and keeps recalculating");
+
+        book.deleteColumns(data, 1, 1);
+        check(std::holds_alternative<Error>(book.value({3, 2})) && std::holds_alternative<Error>(book.value({4, 2})),
+              "deleting the column takes every reference into it");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+#include "NumberFormat.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+
+static int failures = 0;
+static int reported = 0;
+
+// numfmt::format has to print exactly what printf("%.15g") does
+static void checkFormat(double x)
+{
+    char expected[64];
+    std::snprintf(expected, sizeof(expected), "%.15g", x);
+    char out[numfmt::max_chars];
+    std::string got(out, numfmt::format(x, out));
+    if (got != expected)
+    {
+        if (reported++ < 20)
+            std::printf("FAILED: %a gives %s, %%.15g gives %s\n", x, got.c_str(), expected);
+        failures++;
+    }
+}
+
+int main()
+{
+    using limits = std::numeric_limits<double>;
+    const double specials[] = {0.0, -0.0, 1, -1, 0.5, 0.1, 0.2, 0.3, 1.0 / 3, 2.0 / 3, 10, 100, 123456789,
+                               1e14, 1e15, 1e15 - 1, 1e15 + 2, 1e16, 1e17, 1e21, 1e22, 1e100, 1e308, 9007199254740992.0, 9007199254740993.0,
+                               1e-4, 1e-5, 9.99999999999999e-5, 0.000123456789012345678, 1.5e-10, 12345.678901234567,
+                               0.999999999999999944, 0.99999999999999994, 9.999999999999995, 99999999999999.95, 999999999999999.4,
+                               999999999999999.5, 0.1 + 0.2, 1.0000000000000002, 123456789012345.6, 4.35, 2.675, 1.005,
+                               limits::max(), limits::min(), limits::denorm_min(), limits::min() / 3, limits::epsilon(),
+                               limits::infinity(), -limits::infinity(), limits::quiet_NaN()};
+    for (double x : specials)
+    {
+        checkFormat(x);
+        checkFormat(-x);
+    }
+
+    // values a sheet is made of: short decimals, cents, results of arithmetic on them
+    for (int i = -20000; i <= 20000; i++)
+    {
+        checkFormat(i / 100.0);
+        checkFormat(i / 7.0);
+        checkFormat(i * 0.1);
+        checkFormat(std::pow(10.0, i % 40) * 1.5);
+    }
+
+    // every exponent, from random bit patterns
+    std::mt19937_64 gen(3);
+    for (int i = 0; i < 200000; i++)
+    {
+        uint64_t bits = gen();
+        double x;
+        std::memcpy(&x, &bits, sizeof(x));
+        checkFormat(x);
+    }
+    // and around the 1e-4 and 1e15 switches to scientific notation
+    for (double edge : {1e-4, 1e15, 1e-5, 1e14})
+    {
+        double x = edge;
+        for (int i = 0; i < 200; i++)
+        {
+            checkFormat(x);
+            x = std::nextafter(x, 0.0);
+        }
+        x = edge;
+        for (int i = 0; i < 200; i++)
+        {
+            checkFormat(x);
+            x = std::nextafter(x, limits::infinity());
+        }
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+#include "PluginLoader.h"
+#include "FunctionRegistry.h"
+#include "Workbook.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// load has to throw with message containing expected
+static void checkLoadFails(const char *path, const std::string &expected, const char *what)
+{
+    try
+    {
+        plugins::load(path);
+        check(false, what);
+    }
+    catch (const std::runtime_error &e)
+    {
+        check(std::string(e.what()).find(expected) != std::string::npos, what);
+    }
+}
+
+static Value evaluate(const std::string &formula)
+{
+    Workbook book;
+    auto txn = book.begin();
+    txn.setValue({1, 1}, 20.0);
+    txn.setValue({2, 1}, 1.5);
+    txn.setFormula({1, 2}, formula);
+    txn.commit();
+    return book.value({1, 2});
+}
+
+static bool isNumber(const Value &v, double expected)
+{
+    return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+}
+
+int main()
+{
+    plugins::load(TEST_PLUGIN);
+    check(funcs::lookup("PLUGINTWICE") != nullptr, "scalar function registered");
+    check(isNumber(evaluate("PLUGINTWICE(A1)"), 40), "scalar entry point");
+    check(isNumber(evaluate("PLUGINADD(A1, A2)"), 21.5), "batch entry point called for one row");
+
+    const funcs::FunctionSignature *add = funcs::lookup("pluginadd");
+    check(add && add->native && add->native->batch, "lookup is case insensitive and finds the batch entry point");
+    if (add && add->native)
+    {
+        // an array can't cross the ABI, only its row fails
+        Value array = Array{1, 1, std::make_shared<ArrayData>(ArrayData{{1.0}})};
+        std::vector<std::vector<Value>> columns{{1.0, 2.0, 3.0}, {10.0, 20.0, array}};
+        std::vector<Value> out;
+        plugins::callBatch(*add->native, columns, 3, out);
+        check(out.size() == 3 && isNumber(out[0], 11) && isNumber(out[1], 22), "batch results");
+        check(out.size() == 3 && std::holds_alternative<Error>(out[2]), "array argument of a batch row is rejected");
+    }
+
+    checkLoadFails(TEST_PLUGIN, "FUNCTION ALREADY REGISTERED", "loading twice");
+    checkLoadFails("/nonexistent/plugin.so", "COULD NOT LOAD PLUGIN", "missing file");
+    checkLoadFails(TEST_PLUGIN_BAD_ABI, "PLUGIN ABI VERSION MISMATCH", "abi version mismatch");
+    checkLoadFails(TEST_PLUGIN_NO_INIT, "MISSING", "missing init symbol");
+    check(funcs::lookup("PLUGINTWICE") != nullptr, "failed loads keep earlier plugins");
+
+    // functions registered before init failed are taken back out, so loading again fails the same way
+    checkLoadFails(TEST_PLUGIN_FAILING_INIT, "PLUGIN INIT FAILED", "failing init");
+    check(funcs::lookup("FAILINGTWICE") == nullptr, "failing init unregisters its functions");
+    checkLoadFails(TEST_PLUGIN_FAILING_INIT, "PLUGIN INIT FAILED", "failing init again");
+
+    checkLoadFails(TEST_PLUGIN_REF_PARAM, "CANNOT TAKE A REFERENCE", "reference param");
+    check(funcs::lookup("REFTWICE") == nullptr, "rejected reference param unregisters the plugin");
+    check(funcs::lookup("REFRANGE") == nullptr, "reference param function not registered");
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
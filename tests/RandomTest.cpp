@@ -0,0 +1,104 @@
+#include "FormulaCache.h"
+#include "Random.h"
+#include "SheetStore.h"
+#include "Workbook.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+// the generator is constexpr, the same counter gives the same draw at compile time too
+static_assert(rng::uniform(1, 2, 3, 4, 0) == rng::uniform(1, 2, 3, 4, 0));
+static_assert(rng::uniform(1, 2, 3, 4, 0) != rng::uniform(1, 2, 3, 4, 1));
+
+static FormulaCache cache;
+static Evaluator evaluator;
+
+static Value evaluate(const std::string &formula, RC cell, uint64_t seed, uint32_t epoch)
+{
+    SheetStore sheet;
+    EvalContext ctx;
+    ctx.sheet = &sheet;
+    ctx.rand_seed = seed;
+    ctx.recalc_epoch = epoch;
+    return evaluator.evaluateAt(&cache.get(cache.compile(formula, cell)).root, cell, ctx);
+}
+
+static double number(const Value &v)
+{
+    return std::holds_alternative<Number>(v) ? std::get<Number>(v) : -1;
+}
+
+int main()
+{
+    // a draw depends on (seed, epoch, cell) and nothing else
+    const double drawn = number(evaluate("RAND()", {3, 4}, 42, 7));
+    check(drawn >= 0 && drawn < 1, "RAND is in [0, 1)");
+    check(drawn == rng::uniform(42, 7, 3, 4, 0), "RAND is the cell's first draw");
+    check(number(evaluate("RAND()", {3, 4}, 42, 7)) == drawn, "the same seed, epoch and cell draw the same number");
+    evaluate("RAND()", {9, 9}, 42, 7);
+    check(number(evaluate("RAND()", {3, 4}, 42, 7)) == drawn, "whatever was evaluated before");
+    check(number(evaluate("RAND()", {3, 4}, 43, 7)) != drawn, "another seed draws another number");
+    check(number(evaluate("RAND()", {3, 4}, 42, 8)) != drawn, "another epoch draws another number");
+    check(number(evaluate("RAND()", {4, 3}, 42, 7)) != drawn, "another cell draws another number");
+
+    // draws within a cell are counted, the count starts over with every evaluation
+    const double twice = number(evaluate("RAND()-RAND()", {3, 4}, 42, 7));
+    check(twice == rng::uniform(42, 7, 3, 4, 0) - rng::uniform(42, 7, 3, 4, 1), "two RANDs are two draws, not one shared");
+    check(number(evaluate("RAND()-RAND()", {3, 4}, 42, 7)) == twice, "and the same two again next time");
+
+    // over many cells the draws look uniform
+    double sum = 0;
+    int low = 0;
+    const int cells = 20000;
+    for (int r = 1; r <= cells; r++)
+    {
+        double u = rng::uniform(42, 0, r, 1, 0);
+        sum += u;
+        low += u < 0.5;
+    }
+    check(std::fabs(sum / cells - 0.5) < 0.01 && std::abs(low - cells / 2) < 400, "draws are spread over [0, 1)");
+
+    // RANDBETWEEN and RANDARRAY draw from the same counters
+    bool in_range = true;
+    for (int r = 1; r <= 200; r++)
+    {
+        double n = number(evaluate("RANDBETWEEN(1, 6)", {r, 1}, 5, 0));
+        in_range = in_range && n >= 1 && n <= 6 && n == std::floor(n);
+    }
+    check(in_range, "RANDBETWEEN stays within its bounds");
+    check(number(evaluate("RANDBETWEEN(1, 6)", {1, 1}, 5, 0)) == 1 + std::floor(rng::uniform(5, 0, 1, 1, 0) * 6), "RANDBETWEEN draws once");
+    Value array = evaluate("RANDARRAY(2, 3)", {1, 1}, 5, 0);
+    check(std::holds_alternative<Array>(array) && sameValue(array, evaluate("RANDARRAY(2, 3)", {1, 1}, 5, 0)), "RANDARRAY repeats");
+    check(!sameValue(array, evaluate("RANDARRAY(2, 3)", {1, 1}, 5, 1)), "and changes with the epoch");
+
+    // a workbook moves to the next epoch with every commit, two books doing the same agree
+    Workbook a, b;
+    for (Workbook *book : {&a, &b})
+    {
+        auto txn = book->begin();
+        txn.setFormula({1, 1}, "RAND()");
+        txn.setFormula({2, 1}, "RANDBETWEEN(1, 1000000)");
+        txn.commit();
+    }
+    check(sameValue(a.value({1, 1}), b.value({1, 1})) && sameValue(a.value({2, 1}), b.value({2, 1})), "two books agree");
+    const Value before = a.value({1, 1});
+    a.recalc();
+    b.recalc();
+    check(!sameValue(a.value({1, 1}), before), "a volatile tick draws again");
+    check(sameValue(a.value({1, 1}), b.value({1, 1})), "and the books still agree");
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
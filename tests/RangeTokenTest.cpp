@@ -0,0 +1,121 @@
+#include "Lexer.h"
+#include "Parser.h"
+#include "SheetNames.h"
+#include "Workbook.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static std::vector<TOKEN_TYPE> types(const std::string &formula)
+{
+    std::vector<TOKEN_TYPE> out;
+    for (const Token &token : Lexer(formula).tokenize())
+        out.push_back(token.type);
+    return out;
+}
+
+// the first token, A1:B2 in A1:B2+1
+static Token first(const std::string &formula)
+{
+    return Lexer(formula).tokenize().front();
+}
+
+static bool parsesToRange(const std::string &formula, int top, int left, int bottom, int right, bool whole_cols, bool whole_rows,
+                          int sheet = -1)
+{
+    SheetNames names;
+    names.add("Sheet1");
+    names.add("Data");
+    std::vector<Token> tokens = Lexer(formula).tokenize();
+    ASTNode root = Parser(tokens, &names).parse();
+    if (root.type != ASTNodeType::Reference)
+        return false;
+    const Reference &reference = std::get<Reference>(root.node);
+    if (reference.type != ReferenceType::Range || reference.sheet != sheet)
+        return false;
+    const RangeReference &range = std::get<RangeReference>(reference.ref);
+    return range.top == top && range.left == left && range.bottom == bottom && range.right == right &&
+           range.whole_cols == whole_cols && range.whole_rows == whole_rows;
+}
+
+static bool parseFails(const std::string &formula)
+{
+    try
+    {
+        std::vector<Token> tokens = Lexer(formula).tokenize();
+        Parser(tokens).parse();
+        return false;
+    }
+    catch (const std::runtime_error &)
+    {
+        return true;
+    }
+}
+
+int main()
+{
+    // static endpoints fold into one token, computed ones keep the ':' operator
+    check(types("A1:B2") == std::vector<TOKEN_TYPE>{RANGE_TOKEN, EOF_TOKEN}, "A1:B2 is one token");
+    check(first("A1:B10+1").token == "A1:B10" && first("A1:B10").span.start == 0 && first("A1:B10").span.end >= 5, "its text and span");
+    check(types("A:C")[0] == RANGE_TOKEN && first("A:C").token == "A:C", "A:C is one token");
+    check(types("2:5")[0] == RANGE_TOKEN && first("2:5").token == "2:5", "2:5 is one token");
+    check(types("SUM(A1:A3, C:C, 1:1)") ==
+              std::vector<TOKEN_TYPE>{IDENT_TOKEN, LPAREN_TOKEN, RANGE_TOKEN, COMMA_TOKEN, RANGE_TOKEN, COMMA_TOKEN, RANGE_TOKEN, RPAREN_TOKEN, EOF_TOKEN},
+          "ranges as arguments");
+    check(types("A1:B2:C3") == std::vector<TOKEN_TYPE>{RANGE_TOKEN, RANGE_OPERATOR_TOKEN, REFERENCE_TOKEN, EOF_TOKEN}, "only the first pair of a chain folds");
+    check(types("OFFSET(A1,1,0):A5")[8] == RANGE_OPERATOR_TOKEN, "a computed endpoint keeps the operator");
+    check(types("A1:INDEX(A1:A9,2)")[1] == RANGE_OPERATOR_TOKEN, "on either side");
+    check(first("Data!A1:B2").type == RANGE_TOKEN && first("Data!A1:B2").sheet == "Data", "a sheet prefix stays on the range");
+
+    // the parser normalizes the corners
+    check(parsesToRange("A1:B10", 1, 1, 10, 2, false, false), "A1:B10");
+    check(parsesToRange("B10:A1", 1, 1, 10, 2, false, false), "B10:A1 is A1:B10");
+    check(parsesToRange("A10:B1", 1, 1, 10, 2, false, false), "A10:B1 is A1:B10");
+    check(parsesToRange("C:A", 1, 1, max_rows, 3, true, false), "C:A is A:C over every row");
+    check(parsesToRange("5:2", 2, 1, 5, max_cols, false, true), "5:2 is 2:5 over every column");
+    check(parsesToRange("XFD1048576:A1", 1, 1, max_rows, max_cols, false, false), "the last cell");
+    check(parsesToRange("Data!A1:B2", 1, 1, 2, 2, false, false, 1), "a range on another sheet");
+    check(parseFails("A1:"), "a range without an end");
+    check(parseFails(":A1"), "a range without a start");
+
+    // and the folded ranges evaluate like the operator did
+    Workbook book;
+    {
+        auto txn = book.begin();
+        for (int r = 1; r <= 4; r++)
+            for (int c = 1; c <= 3; c++)
+                txn.setValue({r, c}, double(r * c));
+        txn.setFormula({1, 5}, "SUM(C3:A1)");
+        txn.setFormula({6, 5}, "SUM(B:B)");
+        txn.setFormula({7, 5}, "SUM(2:3)");
+        txn.setFormula({8, 5}, "SUM(A1:A2:B3)");
+        txn.setFormula({9, 5}, "SUM(OFFSET(A1,1,1):C4)");
+        txn.commit();
+    }
+    auto isNumber = [&](RC cell, double expected)
+    {
+        Value v = book.value(cell);
+        return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+    };
+    check(isNumber({1, 5}, 36), "SUM(C3:A1)");
+    check(isNumber({6, 5}, 20), "SUM(B:B)");
+    check(isNumber({7, 5}, 12 + 18), "SUM(2:3)");
+    check(isNumber({8, 5}, 18), "SUM(A1:A2:B3)");
+    check(isNumber({9, 5}, 2 * (2 + 3 + 4) + 3 * (2 + 3 + 4)), "SUM(OFFSET(A1,1,1):C4)");
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include "RangeView.h"
+#include <cstdio>
+#include <random>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static const int chunk = SheetStore::chunk_rows;
+
+static std::string name(const RangeRef &range)
+{
+    return "rows " + std::to_string(range.top) + ".." + std::to_string(range.bottom) + " cols " + std::to_string(range.left) + ".." +
+           std::to_string(range.right);
+}
+
+// spans, their counts and the other cells have to match a cell by cell walk of the range
+static void checkRange(const SheetStore &sheet, const RangeRef &range)
+{
+    double expected_sum = 0;
+    int expected_numbers = 0, expected_others = 0, expected_text = 0;
+    UsedRange used = sheet.usedRange();
+    for (int col = range.left; col <= std::min(range.right, used.last_col); col++)
+        for (int row = range.top; row <= std::min(range.bottom, used.last_row); row++)
+        {
+            Value v = sheet.get({row, col});
+            if (std::holds_alternative<Number>(v))
+            {
+                expected_sum += std::get<Number>(v);
+                expected_numbers++;
+            }
+            else if (!std::holds_alternative<Blank>(v))
+            {
+                expected_others++;
+                expected_text += isText(v);
+            }
+        }
+
+    RangeView view(sheet, range);
+    double sum = 0, raw_sum = 0;
+    int numbers = 0, counted = 0;
+    bool in_bounds = true;
+    int last_col = 0, last_row = 0;
+    view.forEachNumberSpan([&](const NumberSpan &span)
+                           {
+        in_bounds = in_bounds && 0 <= span.begin && span.begin < span.end && span.end <= chunk &&
+                    span.first_row + span.begin >= range.top && span.first_row + span.end - 1 <= range.bottom &&
+                    span.col >= range.left && span.col <= range.right && (span.first_row - 1) % chunk == 0;
+        // column by column, top down
+        in_bounds = in_bounds && (span.col > last_col || (span.col == last_col && span.first_row + span.begin > last_row));
+        last_col = span.col;
+        last_row = span.first_row + span.end - 1;
+        counted += span.count();
+        for (int i = span.begin; i < span.end; i++)
+        {
+            raw_sum += span.numbers[i];
+            if (span.valid(i))
+            {
+                sum += span.numbers[i];
+                numbers++;
+            }
+        } });
+    int others = 0, text = 0;
+    view.forEachOther([&](int row, int col, const Value &)
+                      {
+        others++;
+        in_bounds = in_bounds && row >= range.top && row <= range.bottom && col >= range.left && col <= range.right; });
+    view.forEachText([&](int, int, std::string_view)
+                     { text++; });
+
+    const std::string what = name(range);
+    check(in_bounds, what + ": spans stay inside the range and its chunks, in order");
+    check(numbers == expected_numbers && counted == expected_numbers, what + ": numeric cells");
+    check(sum == expected_sum && raw_sum == expected_sum, what + ": sums, with and without the numeric bits");
+    check(others == expected_others && text == expected_text, what + ": other cells");
+    check(view.rows() == range.bottom - range.top + 1 && view.cols() == range.right - range.left + 1, what + ": shape");
+}
+
+int main()
+{
+    // three columns of numbers mixed with text, bools and errors over a few chunks, one column empty
+    SheetStore sheet;
+    std::mt19937 gen(11);
+    for (int col : {1, 2, 4})
+    {
+        for (int row = 1; row <= 3 * chunk + 100; row++)
+        {
+            unsigned pick = gen() % 10;
+            if (pick < 5)
+                sheet.set({row, col}, Number(static_cast<int>(gen() % 1000) - 500));
+            else if (pick == 5)
+                sheet.set({row, col}, Text("t"));
+            else if (pick == 6)
+                sheet.set({row, col}, true);
+            else if (pick == 7)
+                sheet.set({row, col}, Error{ErrorCode::NA});
+        }
+    }
+    // a chunk with a single cell, far down
+    sheet.set({10 * chunk + 5, 2}, 42.0);
+
+    // bounds on and off the word and chunk edges
+    const int rows[] = {1, 2, 63, 64, 65, 127, 128, chunk - 1, chunk, chunk + 1, 2 * chunk, 2 * chunk + 64, 3 * chunk + 100, 10 * chunk + 5};
+    for (int top : rows)
+        for (int bottom : rows)
+            if (top <= bottom)
+                checkRange(sheet, RangeRef{1, 4, top, bottom});
+    checkRange(sheet, RangeRef{3, 3, 1, max_rows});
+    checkRange(sheet, RangeRef{1, max_cols, 1, max_rows});
+    checkRange(sheet, RangeRef{2, 2, 10 * chunk + 5, 10 * chunk + 5});
+    checkRange(sheet, RangeRef{5, 9, 1, 100});
+    for (int i = 0; i < 300; i++)
+    {
+        int top = 1 + static_cast<int>(gen() % (4 * chunk));
+        int bottom = top + static_cast<int>(gen() % (2 * chunk));
+        int left = 1 + static_cast<int>(gen() % 4);
+        int right = left + static_cast<int>(gen() % 3);
+        checkRange(sheet, RangeRef{left, right, top, bottom});
+    }
+
+    // a whole column of an empty sheet has nothing to visit
+    SheetStore empty;
+    int visited = 0;
+    RangeView(empty, RangeRef{1, 1, 1, max_rows}).forEachNumberSpan([&](const NumberSpan &)
+                                                                    { visited++; });
+    check(visited == 0, "an empty sheet has no spans");
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+#include "SheetStore.h"
+#include "Evaluator.h"
+#include <cstdio>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool isNumber(const Value &v, double expected)
+{
+    return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+}
+
+static const int chunk = SheetStore::chunk_rows;
+
+// the store has to hold exactly what the model holds, with a used range around it
+static bool sameAs(const SheetStore &sheet, const std::map<RC, Value> &model, const std::string &what)
+{
+    bool ok = sheet.cellCount() == model.size();
+    UsedRange expected;
+    for (const auto &[cell, value] : model)
+    {
+        ok = ok && sameValue(sheet.get(cell), value) && sheet.occupied(cell);
+        if (expected.empty())
+            expected = {cell.first, cell.first, cell.second, cell.second};
+        expected.first_row = std::min(expected.first_row, cell.first);
+        expected.last_row = std::max(expected.last_row, cell.first);
+        expected.first_col = std::min(expected.first_col, cell.second);
+        expected.last_col = std::max(expected.last_col, cell.second);
+    }
+    UsedRange used = sheet.usedRange();
+    ok = ok && used.first_row == expected.first_row && used.last_row == expected.last_row &&
+         used.first_col == expected.first_col && used.last_col == expected.last_col;
+    size_t visited = 0;
+    if (!used.empty())
+        sheet.forEachCell(RangeRef{1, max_cols, 1, max_rows}, [&](int row, int col, const Value &value)
+                          {
+            visited++;
+            auto it = model.find({row, col});
+            ok = ok && it != model.end() && sameValue(it->second, value); });
+    ok = ok && visited == model.size();
+    check(ok, what);
+    return ok;
+}
+
+int main()
+{
+    // chunks are allocated only where cells are, and a chunk boundary is invisible from outside
+    {
+        SheetStore sheet;
+        check(sheet.usedRange().empty() && !sheet.chunkAt(1, 1), "a new store is empty");
+        sheet.set({chunk, 2}, 1.0);
+        sheet.set({chunk + 1, 2}, 2.0);
+        sheet.set({max_rows, 2}, Text("last"));
+        check(sheet.chunkAt(2, 1) && sheet.chunkAt(2, chunk) == sheet.chunkAt(2, 1), "rows 1..chunk_rows share a chunk");
+        check(sheet.chunkAt(2, chunk + 1) && sheet.chunkAt(2, chunk + 1) != sheet.chunkAt(2, chunk), "the next row starts a chunk");
+        check(!sheet.chunkAt(2, 3 * chunk) && !sheet.chunkAt(1, chunk) && !sheet.chunkAt(3, chunk), "no chunk where nothing was set");
+        check(isNumber(sheet.get({chunk, 2}), 1) && isNumber(sheet.get({chunk + 1, 2}), 2), "both sides of the boundary");
+        check(std::holds_alternative<Blank>(sheet.get({chunk + 2, 2})) && std::holds_alternative<Blank>(sheet.get({1, 1000})), "blanks read as Blank");
+
+        int first = 0, last = 0;
+        check(sheet.columnExtent(2, first, last) && first == chunk && last == max_rows, "column extent");
+        check(!sheet.columnExtent(1, first, last) && !sheet.columnExtent(5000, first, last), "an empty column has no extent");
+        int chunks = 0, cells = 0;
+        sheet.forEachChunk(2, 1, max_rows, [&](const ColumnChunk &c, int chunk_first_row, int begin, int end)
+                           {
+            chunks++;
+            for (int offset = begin; offset < end; offset++)
+                cells += c.isOccupied(offset);
+            check(chunk_first_row % chunk == 1, "a chunk starts one past a multiple of chunk_rows"); });
+        check(chunks == 3 && cells == 3, "forEachChunk visits only the non empty chunks");
+        chunks = 0;
+        sheet.forEachChunk(2, chunk + 1, chunk + 1, [&](const ColumnChunk &, int, int begin, int end)
+                           { chunks++; check(begin == 0 && end == 1, "a one row scan"); });
+        check(chunks == 1, "a scan inside one chunk");
+
+        // the numeric lane only has numbers, text over a number zeroes it
+        const ColumnChunk *c = sheet.chunkAt(2, chunk);
+        check(c->isNumeric(chunk - 1) && c->numbers[chunk - 1] == 1.0, "a number is in the lane");
+        sheet.set({chunk, 2}, Text("now text"));
+        c = sheet.chunkAt(2, chunk);
+        check(!c->isNumeric(chunk - 1) && c->numbers[chunk - 1] == 0.0 && c->isOccupied(chunk - 1), "text isn't");
+        check(std::holds_alternative<InternedText>(sheet.get({chunk, 2})), "short text is interned");
+        sheet.set({chunk, 3}, Text(std::string(SheetStore::max_interned_length + 1, 'y')));
+        check(std::holds_alternative<Text>(sheet.get({chunk, 3})), "long text isn't");
+
+        RangeRef range{1, 10, 1, max_rows};
+        check(sheet.clip(range) && range.top == chunk && range.bottom == max_rows && range.left == 2 && range.right == 3, "clip to the used range");
+        RangeRef outside{5, 6, 1, 10};
+        check(!sheet.clip(outside), "nothing to clip to");
+    }
+
+    // the used range shrinks when a cell on its edge is cleared
+    {
+        SheetStore sheet;
+        std::map<RC, Value> model;
+        for (RC cell : {RC{5, 5}, RC{3, 7}, RC{9, 2}, RC{2000, 5}})
+        {
+            sheet.set(cell, 1.0);
+            model[cell] = 1.0;
+        }
+        sameAs(sheet, model, "four cells");
+        for (RC cell : {RC{2000, 5}, RC{9, 2}, RC{3, 7}})
+        {
+            sheet.set(cell, Blank{});
+            model.erase(cell);
+            sameAs(sheet, model, "cleared " + std::to_string(cell.first) + "," + std::to_string(cell.second));
+        }
+        sheet.set({5, 5}, Blank{});
+        check(sheet.usedRange().empty() && sheet.cellCount() == 0, "clearing the last cell empties the store");
+        sheet.set({7, 7}, Blank{});
+        check(sheet.cellCount() == 0, "clearing a blank cell stores nothing");
+    }
+
+    // random writes and structural edits against a map
+    {
+        std::mt19937 gen(7);
+        SheetStore sheet;
+        std::map<RC, Value> model;
+        auto randomRow = [&]
+        { return 1 + static_cast<int>(gen() % (4 * chunk)); };
+        for (int step = 0; step < 3000; step++)
+        {
+            RC cell{randomRow(), 1 + static_cast<int>(gen() % 4)};
+            Value value;
+            switch (gen() % 4)
+            {
+            case 0:
+                value = Blank{};
+                break;
+            case 1:
+                value = Text("t" + std::to_string(step % 10));
+                break;
+            default:
+                value = Number(step);
+            }
+            sheet.set(cell, value);
+            if (std::holds_alternative<Blank>(value))
+                model.erase(cell);
+            else
+                model[cell] = std::holds_alternative<Text>(value) ? sheet.get(cell) : value;
+        }
+        sameAs(sheet, model, "random writes");
+
+        // whole chunk and partial chunk shifts both ways
+        for (auto [insert, rows, at, count] : {std::tuple{true, true, chunk + 1, chunk}, std::tuple{true, true, 100, 37},
+                                               std::tuple{false, true, 2 * chunk + 1, chunk}, std::tuple{false, true, 50, 1500},
+                                               std::tuple{true, false, 2, 3}, std::tuple{false, false, 1, 2}})
+        {
+            std::map<RC, Value> moved;
+            for (const auto &[cell, value] : model)
+            {
+                int line = rows ? cell.first : cell.second;
+                if (insert && line >= at)
+                    line += count;
+                else if (!insert && line >= at + count)
+                    line -= count;
+                else if (!insert && line >= at)
+                    continue;
+                moved[rows ? RC{line, cell.second} : RC{cell.first, line}] = value;
+            }
+            model = std::move(moved);
+            if (rows)
+                insert ? sheet.insertRows(at, count) : sheet.deleteRows(at, count);
+            else
+                insert ? sheet.insertColumns(at, count) : sheet.deleteColumns(at, count);
+            if (!sameAs(sheet, model, std::string(insert ? "insert " : "delete ") + std::to_string(count) + (rows ? " rows at " : " columns at ") + std::to_string(at)))
+                break;
+        }
+
+        // copies share chunks until written
+        SheetStore copy = sheet;
+        const ColumnChunk *shared = sheet.chunkAt(2, 1);
+        copy.set({1, 2}, -1.0);
+        check(sheet.chunkAt(2, 1) == shared && copy.chunkAt(2, 1) != shared, "a written copy clones the chunk");
+        sameAs(sheet, model, "the original is untouched");
+    }
+
+    // an insert may not push cells off the sheet
+    {
+        SheetStore sheet;
+        sheet.set({max_rows, 1}, 1.0);
+        bool threw = false;
+        try
+        {
+            sheet.insertRows(1, 1);
+        }
+        catch (const std::out_of_range &)
+        {
+            threw = true;
+        }
+        check(threw && isNumber(sheet.get({max_rows, 1}), 1), "pushing the last row off throws and changes nothing");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+#include "Snapshot.h"
+#include "Workbook.h"
+#include "StringPool.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static const std::string dir = TEST_OUTPUT_DIR;
+static const std::string path = dir + "/snapshot_test.snap";
+static const std::string damaged_path = dir + "/snapshot_test_damaged.snap";
+
+static std::string readFile(const std::string &file)
+{
+    std::ifstream in(file, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+static void writeFile(const std::string &file, const std::string &bytes)
+{
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+// index of the first cell the two books disagree on, -1 when they agree everywhere
+static int firstDifference(const Workbook &a, const Workbook &b)
+{
+    if (a.sheetCount() != b.sheetCount())
+        return 0;
+    int index = 0;
+    for (int sheet = 0; sheet < a.sheetCount(); sheet++)
+    {
+        for (int r = 1; r <= 12; r++)
+        {
+            for (int c = 1; c <= 5; c++, index++)
+            {
+                FormulaCell fa{}, fb{};
+                if (!sameValue(a.value(sheet, {r, c}), b.value(sheet, {r, c})) ||
+                    a.formulaAt(sheet, {r, c}, fa) != b.formulaAt(sheet, {r, c}, fb))
+                    return index;
+            }
+        }
+    }
+    return -1;
+}
+
+static void build(Workbook &book)
+{
+    const int data = book.addSheet("Data");
+    auto txn = book.begin();
+    txn.setValue({1, 1}, 1.0);
+    txn.setValue({2, 1}, 2.5);
+    txn.setValue({3, 1}, true);
+    txn.setValue({4, 1}, Error{ErrorCode::NA});
+    txn.setValue({5, 1}, Text("short"));
+    txn.setValue({6, 1}, Text(std::string(5000, 'x') + "end"));
+    txn.setValue({7, 1}, StringPool::global().intern("pooled"));
+    auto cells = std::make_shared<ArrayData>();
+    cells->cells = {1.0, Text("in an array"), Blank{}, Error{ErrorCode::Div0}};
+    txn.setValue({8, 1}, Array{2, 2, cells});
+    txn.setValue({9, 1}, 9.0);
+    txn.setValue(data, {1, 1}, 10.0);
+    txn.setValue(data, {2, 1}, Text("remote"));
+
+    txn.setFormula({1, 2}, "A1+A2*2");
+    txn.setFormula({2, 2}, "A5&\"-\"&LEN(A6)");
+    txn.setFormula({3, 2}, "A9*3"); // its reference is deleted below
+    txn.setFormula({4, 2}, "SUM(INDIRECT(\"A1:A2\"))"); // dynamic reads
+    txn.setFormula({5, 2}, "OFFSET(A1,1,0)*10");
+    txn.setFormula({6, 2}, "Data!A1*2"); // remote reads
+    txn.setFormula({7, 2}, "Data!A2&B2");
+    txn.setFormula({8, 2}, "SUM(Data!A1:A3)+B1");
+    txn.setFormula({9, 2}, "LET(x, A1, x*x+1)");
+    txn.setFormula(data, {1, 2}, "Sheet1!B1+A1");
+    txn.commit();
+    book.deleteRows(0, 9, 1); // takes B9 with it
+}
+
+// the same edits on both books have to leave them the same
+static void editBoth(Workbook &original, Workbook &loaded, const std::string &what, int sheet, RC cell, Value value)
+{
+    for (Workbook *book : {&original, &loaded})
+    {
+        auto txn = book->begin();
+        txn.setValue(sheet, cell, value);
+        txn.commit();
+    }
+    check(original.changes().size() == loaded.changes().size(), what + ": same change feed");
+    check(firstDifference(original, loaded) < 0, what + ": same cells");
+}
+
+static bool loadFails(const std::string &file, const std::string &expected)
+{
+    try
+    {
+        Workbook book;
+        Snapshot::load(book, file);
+        return false;
+    }
+    catch (const std::runtime_error &e)
+    {
+        return std::string(e.what()).find(expected) != std::string::npos;
+    }
+}
+
+int main()
+{
+    Workbook original;
+    build(original);
+    check(std::holds_alternative<Error>(original.value({3, 2})), "the deleted reference is #REF!");
+    SnapshotStats saved = Snapshot::save(original, path);
+    check(saved.sheets == 2 && saved.formulas == 9 && saved.commit == 2, "save stats");
+
+    // a round trip brings back every sheet, value, formula and the commit number
+    Workbook loaded;
+    SnapshotStats stats = Snapshot::load(loaded, path);
+    check(stats.sheets == 2 && stats.formulas == 9 && stats.bytes == saved.bytes && stats.commit == 2, "load stats");
+    check(loaded.sheetCount() == 2 && loaded.sheetName(1) == "Data" && loaded.sheetId("Data") == 1, "sheet names");
+    check(loaded.commitCount() == original.commitCount(), "commit number");
+    check(firstDifference(original, loaded) < 0, "same cells after load, first difference at " + std::to_string(firstDifference(original, loaded)));
+    check(textView(loaded.value({6, 1})).size() == 5003, "long text");
+    check(loaded.formulas().size() == original.formulas().size(), "same programs");
+
+    // and the dependency index, dynamic and remote reads included, so the books keep recalculating alike
+    editBoth(original, loaded, "local edit", 0, {1, 1}, 4.0);
+    editBoth(original, loaded, "edit under a dynamic read", 0, {2, 1}, 7.0);
+    check(original.changes().size() >= 3, "the dynamic formulas recalculated");
+    editBoth(original, loaded, "edit under a remote read", 1, {1, 1}, -3.0);
+    check(original.changes().size() >= 4, "the remote formulas recalculated");
+    editBoth(original, loaded, "edit inside a remote range", 1, {3, 1}, 100.0);
+    {
+        Workbook twice;
+        Snapshot::save(loaded, path);
+        Snapshot::load(twice, path);
+        check(firstDifference(loaded, twice) < 0, "a loaded book saves and loads again");
+        editBoth(loaded, twice, "after a second round trip", 1, {1, 1}, 5.0);
+    }
+
+    // damaged files are rejected before anything is loaded
+    const std::string bytes = readFile(path);
+    writeFile(damaged_path, bytes.substr(0, bytes.size() / 2));
+    check(loadFails(damaged_path, "CORRUPT SNAPSHOT"), "a truncated file");
+    writeFile(damaged_path, bytes.substr(0, 20));
+    check(loadFails(damaged_path, "NOT A SNAPSHOT"), "a file shorter than the header");
+    for (size_t at : {bytes.size() / 3, bytes.size() / 2, bytes.size() - 1})
+    {
+        std::string flipped = bytes;
+        flipped[at] ^= 0x10;
+        writeFile(damaged_path, flipped);
+        check(loadFails(damaged_path, "CORRUPT SNAPSHOT"), "a flipped bit at byte " + std::to_string(at));
+    }
+    std::string version = bytes;
+    version[8] ^= 0x02; // Header::version follows the magic
+    writeFile(damaged_path, version);
+    check(loadFails(damaged_path, "UNSUPPORTED SNAPSHOT VERSION"), "another format version");
+    std::string magic = bytes;
+    magic[0] = 'X';
+    writeFile(damaged_path, magic);
+    check(loadFails(damaged_path, "NOT A SNAPSHOT"), "another magic");
+    check(loadFails(dir + "/no_such.snap", "CANNOT OPEN SNAPSHOT"), "a missing file");
+    try
+    {
+        Snapshot::load(original, path);
+        check(false, "loading into a used workbook");
+    }
+    catch (const std::runtime_error &e)
+    {
+        check(std::string(e.what()) == "SNAPSHOT NEEDS A NEW WORKBOOK", "loading into a used workbook");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
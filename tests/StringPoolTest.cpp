@@ -0,0 +1,100 @@
+#include "StringPool.h"
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+int main()
+{
+    // every lookup is counted, a hit saves the characters it would have stored again
+    {
+        StringPool pool;
+        InternStats stats = pool.stats();
+        check(stats.lookups == 0 && stats.strings == 0 && stats.bytes == 0 && stats.hitRate() == 0, "a new pool is empty");
+
+        InternedText hello = pool.intern("hello");
+        InternedText world = pool.intern("world!");
+        check(!(hello == world) && pool.view(hello) == "hello" && pool.view(world) == "world!", "distinct strings, distinct ids");
+        stats = pool.stats();
+        check(stats.lookups == 2 && stats.hits == 0 && stats.strings == 2 && stats.bytes == 11 && stats.bytes_saved == 0, "two misses");
+
+        std::string again = "hel";
+        again += "lo";
+        check(pool.intern(again) == hello && pool.intern("world!") == world && pool.intern("hello") == hello, "equal strings, equal ids");
+        stats = pool.stats();
+        check(stats.lookups == 5 && stats.hits == 3 && stats.strings == 2 && stats.bytes == 11 && stats.bytes_saved == 16, "three hits");
+        check(stats.hitRate() == 3.0 / 5, "hit rate");
+
+        check(pool.view(pool.intern("")).empty(), "the empty string interns too");
+        check(!(pool.intern("Hello") == hello), "interning is case sensitive");
+        const std::string big(200 * 1024, 'b'); // bigger than a block
+        InternedText large = pool.intern(big);
+        check(pool.view(large) == big && pool.intern(big) == large, "a string bigger than a block");
+        stats = pool.stats();
+        check(stats.strings == 5 && stats.bytes == 11 + 5 + big.size() && stats.bytes_saved == 16 + big.size(), "after the odd sizes");
+        check(pool.view(hello).data() == pool.view(pool.intern("hello")).data(), "a view points at the one stored copy");
+    }
+
+    // ids and views stay put as the pool grows past its first id segment
+    {
+        StringPool pool;
+        std::vector<InternedText> ids;
+        std::vector<const char *> data;
+        for (int i = 0; i < 5000; i++)
+        {
+            ids.push_back(pool.intern("s" + std::to_string(i)));
+            data.push_back(pool.view(ids.back()).data());
+        }
+        bool stable = true;
+        for (int i = 0; i < 5000; i++)
+            stable = stable && pool.view(ids[i]) == "s" + std::to_string(i) && pool.view(ids[i]).data() == data[i] &&
+                     pool.intern("s" + std::to_string(i)) == ids[i];
+        check(stable, "ids and views are stable");
+        InternStats stats = pool.stats();
+        check(stats.strings == 5000 && stats.lookups == 10000 && stats.hits == 5000, "5000 strings, each looked up twice");
+    }
+
+    // threads interning the same strings agree on the ids and the counts add up
+    {
+        StringPool pool;
+        const int threads = 4, distinct = 2000, rounds = 3;
+        std::vector<std::vector<InternedText>> seen(threads);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++)
+            workers.emplace_back([&, t]
+                                 {
+                for (int round = 0; round < rounds; round++)
+                    for (int i = 0; i < distinct; i++)
+                    {
+                        InternedText id = pool.intern("shared " + std::to_string((i * 7 + t) % distinct));
+                        if (round == 0)
+                            seen[t].push_back(id);
+                    } });
+        for (std::thread &worker : workers)
+            worker.join();
+        bool agree = true;
+        for (int t = 0; t < threads; t++)
+            for (int i = 0; i < distinct; i++)
+                agree = agree && pool.view(seen[t][i]) == "shared " + std::to_string((i * 7 + t) % distinct) &&
+                        seen[t][i] == pool.intern("shared " + std::to_string((i * 7 + t) % distinct));
+        check(agree, "every thread got the same id for the same string");
+        InternStats stats = pool.stats();
+        const size_t lookups = size_t{threads} * rounds * distinct + size_t{threads} * distinct;
+        check(stats.strings == distinct && stats.lookups == lookups && stats.hits == lookups - distinct, "concurrent stats");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+/* plugin for PluginLoaderTest and BatchEvaluatorTest, the TEST_PLUGIN_* defines break it in one way each */
+#include "GPFEPlugin.h"
+
+#ifndef TEST_PLUGIN_NO_INIT
+static int twice(const gpfe_value *args, size_t argc, gpfe_value *out, void *user_data)
+{
+    (void)argc;
+    (void)user_data;
+    out->kind = GPFE_NUMBER;
+    out->number = 2 * args[0].number;
+    return 0;
+}
+#endif
+
+#if !defined(TEST_PLUGIN_NO_INIT) && !defined(TEST_PLUGIN_FAILING_INIT) && !defined(TEST_PLUGIN_REF_PARAM)
+static int add(const gpfe_value *const *columns, size_t argc, size_t rows, gpfe_value *out, void *user_data)
+{
+    (void)argc;
+    (void)user_data;
+    for (size_t r = 0; r < rows; r++)
+    {
+        out[r].kind = GPFE_NUMBER;
+        out[r].number = columns[0][r].number + columns[1][r].number;
+    }
+    return 0;
+}
+
+/* fails the whole batch on a kind its number params exclude, so a host passing one shows up */
+static int strict_add(const gpfe_value *const *columns, size_t argc, size_t rows, gpfe_value *out, void *user_data)
+{
+    (void)user_data;
+    for (size_t r = 0; r < rows; r++)
+    {
+        double sum = 0;
+        for (size_t a = 0; a < argc; a++)
+        {
+            if (columns[a][r].kind != GPFE_NUMBER && columns[a][r].kind != GPFE_BLANK)
+                return 1;
+            if (columns[a][r].kind == GPFE_NUMBER)
+                sum += columns[a][r].number;
+        }
+        out[r].kind = GPFE_NUMBER;
+        out[r].number = sum;
+    }
+    return 0;
+}
+#endif
+
+uint32_t gpfe_plugin_abi_version(void)
+{
+#ifdef TEST_PLUGIN_BAD_ABI
+    return GPFE_PLUGIN_ABI_VERSION + 1;
+#else
+    return GPFE_PLUGIN_ABI_VERSION;
+#endif
+}
+
+#ifndef TEST_PLUGIN_NO_INIT
+int gpfe_plugin_init(const gpfe_host *host)
+{
+#if defined(TEST_PLUGIN_FAILING_INIT)
+    gpfe_function_def first = {"FAILINGTWICE", 1, {GPFE_ARG_NUMBER}, 0, GPFE_NUMBER, twice, 0, 0};
+    host->register_function(host->host_ctx, &first);
+    return 1;
+#elif defined(TEST_PLUGIN_REF_PARAM)
+    gpfe_function_def first = {"REFTWICE", 1, {GPFE_ARG_NUMBER}, 0, GPFE_NUMBER, twice, 0, 0};
+    gpfe_function_def range = {"REFRANGE", 1, {GPFE_ARG_REF}, 0, GPFE_NUMBER, twice, 0, 0};
+    if (host->register_function(host->host_ctx, &first) != 0)
+        return 1;
+    return host->register_function(host->host_ctx, &range);
+#else
+    gpfe_function_def scalar = {"PLUGINTWICE", 1, {GPFE_ARG_NUMBER}, 0, GPFE_NUMBER, twice, 0, 0};
+    gpfe_function_def batch = {"PLUGINADD", 2, {GPFE_ARG_NUMBER, GPFE_ARG_NUMBER}, 0, GPFE_NUMBER, 0, add, 0};
+    gpfe_function_def strict = {"PLUGINSTRICT", 2, {GPFE_ARG_NUMBER, GPFE_ARG_NUMBER}, 0, GPFE_NUMBER, 0, strict_add, 0};
+    if (host->register_function(host->host_ctx, &scalar) != 0 || host->register_function(host->host_ctx, &batch) != 0)
+        return 1;
+    return host->register_function(host->host_ctx, &strict);
+#endif
+}
+#endif
@@ -0,0 +1,120 @@
+#include "StringPool.h"
+#include "TextArena.h"
+#include "Workbook.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool onHeap(const Text &text)
+{
+    return text.get_allocator().resource() == std::pmr::get_default_resource();
+}
+
+int main()
+{
+    // transient text is bump allocated and dropped all at once
+    {
+        text_arena::reset();
+        check(text_arena::bytesInUse() == 0, "a reset arena is empty");
+        Text text = text_arena::make("a string long enough not to fit the small string buffer");
+        check(text.get_allocator().resource() == text_arena::resource() && text_arena::bytesInUse() > text.size(), "made in the arena");
+        text += std::string(1000, '+');
+        check(text_arena::bytesInUse() > 1000, "growing it allocates from the arena too");
+
+        size_t in_thread = 1;
+        std::thread([&]
+                    { in_thread = text_arena::bytesInUse(); text_arena::make(std::string(500, 't')); text_arena::reset(); })
+            .join();
+        check(in_thread == 0 && text_arena::bytesInUse() > 1000, "every thread has its own arena");
+
+        // promote copies it out, a copy outlives the reset
+        Value promoted = promote(Value{text});
+        const Text &copy = std::get<Text>(promoted);
+        check(onHeap(copy) && copy == text, "promote copies transient text to the heap");
+        text = Text();
+        text_arena::reset();
+        check(text_arena::bytesInUse() == 0, "reset rewinds the arena");
+        // the next strings land where the old one was
+        for (int i = 0; i < 10; i++)
+            text_arena::make(std::string(100, static_cast<char>('a' + i)));
+        check(copy.size() == 1055 && copy.front() == 'a' && copy.back() == '+', "the promoted copy is untouched");
+        text_arena::reset();
+    }
+
+    // promote leaves heap values alone and copies arrays only when they hold transient text
+    {
+        Text heap("already on the heap, long enough to be allocated");
+        Value same = promote(Value{heap});
+        check(onHeap(std::get<Text>(same)) && std::get<Text>(same) == heap, "heap text stays as it is");
+        check(std::get<Number>(promote(Value{2.5})) == 2.5, "numbers pass through");
+
+        auto cells = std::make_shared<ArrayData>();
+        cells->cells = {1.0, Text("heap"), Blank{}};
+        Value plain = promote(Value{Array{1, 3, cells}});
+        check(std::get<Array>(plain).data == cells, "an array without transient text isn't copied");
+
+        auto transient = std::make_shared<ArrayData>();
+        // pushed, an initializer list would copy the text out of the arena
+        transient->cells.push_back(1.0);
+        transient->cells.push_back(text_arena::make("made in the arena for a while"));
+        transient->cells.push_back(Text("heap"));
+        check(!onHeap(std::get<Text>(transient->cells[1])), "the array holds transient text");
+        Value array = promote(Value{Array{3, 1, transient}});
+        const Array &copied = std::get<Array>(array);
+        check(copied.data != transient && copied.rows == 3 && copied.cols == 1, "an array with transient text is copied");
+        bool all_heap = true;
+        for (const Value &cell : copied.data->cells)
+            if (const Text *text = std::get_if<Text>(&cell))
+                all_heap = all_heap && onHeap(*text);
+        check(all_heap && std::get<Text>(copied.data->cells[1]) == "made in the arena for a while", "its text is on the heap");
+        transient.reset();
+        text_arena::reset();
+    }
+
+    // more than the initial buffer spills to the upstream resource and still resets
+    {
+        for (int i = 0; i < 100; i++)
+            text_arena::make(std::string(10000, 'x'));
+        check(text_arena::bytesInUse() >= 1000000, "a big epoch keeps allocating");
+        text_arena::reset();
+        check(text_arena::bytesInUse() == 0, "and resets");
+    }
+
+    // text a formula builds is in the sheet after the commit reset the arena
+    {
+        Workbook book;
+        {
+            auto txn = book.begin();
+            txn.setValue({1, 1}, Text("abc"));
+            txn.setFormula({1, 2}, "A1&\" and some text long enough to leave the small string buffer\"&A1");
+            txn.setFormula({2, 2}, "B1&B1");
+            txn.commit();
+        }
+        check(text_arena::bytesInUse() == 0, "a commit resets the arena when it's done");
+        for (int i = 0; i < 3; i++)
+        {
+            auto txn = book.begin();
+            txn.setFormula({5, 3}, "\"" + std::string(200, static_cast<char>('a' + i)) + "\"&" + std::to_string(i));
+            txn.commit();
+        }
+        const std::string expected = "abc and some text long enough to leave the small string buffer" "abc";
+        check(textView(book.value({1, 2})) == expected, "the formula's text survives later epochs");
+        check(textView(book.value({2, 2})) == expected + expected, "and so does text built from it");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+#include "VersionedSheet.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool isNumber(const Value &v, double expected)
+{
+    return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+}
+
+int main()
+{
+    // a pinned version stays as it was while the writer goes on
+    {
+        VersionedSheet sheet;
+        {
+            auto empty = sheet.pin();
+            check(empty.version() == 0 && std::holds_alternative<Blank>(empty.sheet().get({1, 1})), "version 0 is empty");
+        }
+        sheet.draft().set({1, 1}, 1.0);
+        sheet.draft().set({5000, 2}, 7.0);
+        check(sheet.publish() == 1, "first publish is version 1");
+        auto first = sheet.pin();
+        check(first.version() == 1 && isNumber(first.sheet().get({1, 1}), 1), "pin sees the published version");
+
+        // unwritten chunks stay shared with the pinned version, a written one is cloned
+        check(sheet.draft().chunkAt(2, 5000) == first.sheet().chunkAt(2, 5000), "draft and version share chunks");
+        sheet.draft().set({1, 1}, 2.0);
+        check(sheet.draft().chunkAt(1, 1) != first.sheet().chunkAt(1, 1), "a written chunk is cloned");
+        check(sheet.draft().chunkAt(2, 5000) == first.sheet().chunkAt(2, 5000), "other chunks stay shared");
+        sheet.draft().set({2, 1}, 3.0);
+        check(sheet.publish() == 2, "second publish");
+        check(isNumber(first.sheet().get({1, 1}), 1) && std::holds_alternative<Blank>(first.sheet().get({2, 1})),
+              "the pinned version is unchanged by later writes");
+        check(first.version() == 1, "the pinned version keeps its number");
+        {
+            auto second = sheet.pin();
+            check(second.version() == 2 && isNumber(second.sheet().get({1, 1}), 2) && isNumber(second.sheet().get({2, 1}), 3),
+                  "a new pin sees the new version");
+        }
+        check(sheet.retiredCount() == 1, "version 1 is retired but pinned, it isn't freed");
+        check(sheet.reclaim() == 0, "reclaim keeps a version a reader still pins");
+    }
+
+    // retired versions are freed once no reader that could have seen them is pinned
+    {
+        VersionedSheet sheet;
+        sheet.draft().set({1, 1}, 1.0);
+        sheet.publish();
+        check(sheet.retiredCount() == 0, "publish without readers frees the old version right away");
+
+        auto oldest = sheet.pin(); // sees version 1
+        sheet.draft().set({1, 1}, 2.0);
+        sheet.publish();
+        auto newer = std::make_unique<VersionedSheet::ReadGuard>(sheet.pin()); // sees version 2
+        sheet.draft().set({1, 1}, 3.0);
+        sheet.publish();
+        check(sheet.retiredCount() == 2, "versions 1 and 2 are retired");
+
+        newer.reset();
+        check(sheet.reclaim() == 0, "the oldest pinned reader holds everything retired since it pinned");
+        check(isNumber(oldest.sheet().get({1, 1}), 1), "the oldest reader still reads its version");
+        {
+            VersionedSheet::ReadGuard moved(std::move(oldest));
+            check(isNumber(moved.sheet().get({1, 1}), 1), "a moved guard keeps the pin");
+            check(sheet.reclaim() == 0, "the moved guard still pins");
+        }
+        check(sheet.reclaim() == 2 && sheet.retiredCount() == 0, "unpinning frees both");
+        auto latest = sheet.pin();
+        check(latest.version() == 3 && isNumber(latest.sheet().get({1, 1}), 3), "the current version is never freed");
+    }
+
+    // readers pinning while the writer publishes only ever see whole versions, in order
+    {
+        VersionedSheet sheet;
+        const int publishes = 2000;
+        const int rows = 64;
+        std::atomic<bool> done{false};
+        std::atomic<int> torn{0}, backwards{0}, pins{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; t++)
+        {
+            readers.emplace_back([&]
+                                 {
+                uint64_t last = 0;
+                while (!done.load())
+                {
+                    auto guard = sheet.pin();
+                    if (guard.version() < last)
+                        backwards++;
+                    last = guard.version();
+                    // version n has n in every row, version 0 is empty
+                    for (int r = 1; r <= rows; r++)
+                    {
+                        Value v = guard.sheet().get({r, 1});
+                        if (last ? !isNumber(v, static_cast<double>(last)) : !std::holds_alternative<Blank>(v))
+                            torn++;
+                    }
+                    pins++;
+                } });
+        }
+        while (pins.load() < 4)
+            std::this_thread::yield();
+        for (int n = 1; n <= publishes; n++)
+        {
+            for (int r = 1; r <= rows; r++)
+                sheet.draft().set({r, 1}, static_cast<double>(n));
+            sheet.publish();
+        }
+        done = true;
+        for (std::thread &reader : readers)
+            reader.join();
+        check(torn == 0, "readers see every row of one version");
+        check(backwards == 0, "a reader never sees an older version after a newer one");
+        check(pins > 0, "readers got to pin");
+        sheet.reclaim();
+        check(sheet.retiredCount() == 0, "everything retired is freed once the readers are gone");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+#include "Workbook.h"
+#include "FunctionRegistry.h"
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static bool isNumber(const Value &v, double expected)
+{
+    return std::holds_alternative<Number>(v) && std::get<Number>(v) == expected;
+}
+
+// stands in for an evaluation that fails half way through a commit
+static bool fail_evaluation = false;
+
+static Value fn_FAILING(const std::vector<Value> &args, EvalContext &)
+{
+    if (fail_evaluation)
+        throw std::runtime_error("FAILING");
+    return args[0];
+}
+
+static CommitStats setValue(Workbook &book, RC cell, double value)
+{
+    auto txn = book.begin();
+    txn.setValue(cell, value);
+    return txn.commit();
+}
+
+int main()
+{
+    // edits of one transaction recalculate their shared dependents once
+    {
+        Workbook book;
+        {
+            auto txn = book.begin();
+            txn.setValue({1, 1}, 1.0);
+            txn.setValue({2, 1}, 2.0);
+            txn.setFormula({1, 2}, "A1+A2");
+            txn.setFormula({2, 2}, "B1*10");
+            CommitStats stats = txn.commit();
+            check(stats.edits == 4 && stats.dirty == 2 && stats.evaluated == 2, "first commit evaluates both formulas once");
+            check(isNumber(book.value({2, 2}), 30), "first commit result");
+        }
+        auto txn = book.begin();
+        txn.setValue({1, 1}, 5.0);
+        txn.setValue({2, 1}, 7.0);
+        txn.setValue({1, 1}, 6.0);
+        CommitStats stats = txn.commit();
+        check(stats.edits == 2, "a cell edited twice counts once");
+        check(stats.dirty == 2 && stats.evaluated == 2, "two edits under one formula evaluate it once");
+        check(stats.version == 2 && book.commitCount() == 2, "one commit number per transaction");
+        check(isNumber(book.value({2, 2}), 130), "coalesced recalc result");
+    }
+
+    // abort and a dropped transaction apply nothing and free the workbook
+    {
+        Workbook book;
+        {
+            auto txn = book.begin();
+            txn.setValue({1, 1}, 1.0);
+            txn.setFormula({1, 2}, "A1+1");
+            txn.commit();
+        }
+        auto txn = book.begin();
+        txn.setValue({1, 1}, 9.0);
+        txn.abort();
+        check(isNumber(book.value({1, 1}), 1) && isNumber(book.value({1, 2}), 2), "abort applies nothing");
+        check(book.commitCount() == 1, "abort doesn't count as a commit");
+        bool closed = false;
+        try
+        {
+            txn.setValue({1, 1}, 3.0);
+        }
+        catch (const std::runtime_error &)
+        {
+            closed = true;
+        }
+        check(closed, "an aborted transaction is closed");
+
+        {
+            auto dropped = book.begin();
+            dropped.setValue({1, 1}, 4.0);
+        }
+        check(isNumber(book.value({1, 1}), 1), "a dropped transaction applies nothing");
+        bool open = false;
+        {
+            auto first = book.begin();
+            try
+            {
+                book.begin();
+            }
+            catch (const std::runtime_error &)
+            {
+                open = true;
+            }
+        }
+        check(open, "a second transaction while one is open throws");
+        check(book.recalc().version == 2, "the workbook takes a transaction after an abort");
+    }
+
+    // a commit that throws closes its transaction, the next one evaluates every formula
+    {
+        funcs::FunctionSignature sig{};
+        sig.name = "FAILING";
+        sig.params = {funcs::Param{funcs::ArgKind::Number}};
+        sig.variableArity = false;
+        sig.returnType = BaseType::Number;
+        sig.eval_function = fn_FAILING;
+        funcs::registerFunction(sig);
+
+        Workbook book;
+        {
+            auto txn = book.begin();
+            txn.setValue({1, 1}, 1.0);
+            txn.setFormula({1, 2}, "FAILING(A1)");
+            txn.setFormula({1, 3}, "A1*2");
+            txn.setFormula({1, 4}, "C1+1");
+            txn.commit();
+        }
+        auto txn = book.begin();
+        txn.setValue({1, 1}, 13.0);
+        fail_evaluation = true;
+        bool threw = false;
+        try
+        {
+            txn.commit();
+        }
+        catch (const std::runtime_error &)
+        {
+            threw = true;
+        }
+        fail_evaluation = false;
+        check(threw, "the failing evaluation reaches the caller");
+        check(book.commitCount() == 1, "a failed commit gets no number");
+        bool closed = false;
+        try
+        {
+            txn.commit();
+        }
+        catch (const std::runtime_error &)
+        {
+            closed = true;
+        }
+        check(closed, "a failed commit closes its transaction");
+        check(isNumber(book.pin().sheet().get({1, 1}), 1), "a failed commit publishes nothing");
+
+        CommitStats stats{};
+        try
+        {
+            stats = setValue(book, {5, 5}, 1.0);
+        }
+        catch (const std::runtime_error &)
+        {
+            check(false, "the workbook takes a transaction after a failed commit");
+        }
+        check(stats.version == 2, "the next commit goes through");
+        check(stats.dirty == 3 && stats.evaluated == 3, "the next commit evaluates every formula");
+        check(isNumber(book.value({1, 2}), 13) && isNumber(book.value({1, 3}), 26) && isNumber(book.value({1, 4}), 27),
+              "formulas left stale by the failed commit catch up");
+        check(isNumber(book.pin().sheet().get({1, 1}), 13), "the next commit publishes what the failed one applied");
+
+        stats = setValue(book, {6, 6}, 1.0);
+        check(stats.dirty == 0, "only the commit after the failure evaluates everything");
+        stats = setValue(book, {1, 1}, 2.0);
+        check(stats.evaluated == 3 && isNumber(book.value({1, 4}), 5), "commits after that recalc as usual");
+        funcs::unregisterFunction("FAILING");
+    }
+
+    // the change feed lists exactly the cells whose value changed, unchanged formulas cut recalc off
+    {
+        Workbook book;
+        {
+            auto txn = book.begin();
+            txn.setValue({1, 1}, 20.0);
+            txn.setFormula({1, 2}, "MIN(A1,10)");
+            txn.setFormula({1, 3}, "B1*2");
+            txn.setValue({2, 1}, 1.0);
+            txn.commit();
+        }
+        auto txn = book.begin();
+        txn.setValue({1, 1}, 30.0);
+        txn.setValue({2, 1}, 1.0);
+        CommitStats stats = txn.commit();
+        check(stats.dirty == 2 && stats.evaluated == 1 && stats.pruned == 1, "a formula whose inputs didn't change is pruned");
+        check(stats.changed == 1 && book.changes().size() == 1, "rewriting a value with itself is not a change");
+        const CellChange &change = book.changes()[0];
+        check(change.cell == RC{1, 1} && change.sheet == 0 && isNumber(change.old_value, 20) && isNumber(change.new_value, 30),
+              "the feed has the old and new value of the edited cell");
+
+        stats = setValue(book, {1, 1}, 5.0);
+        check(stats.evaluated == 2 && stats.pruned == 0 && stats.changed == 3, "a changed formula dirties its dependents");
+        check(book.changes()[1].cell == RC{1, 2} && isNumber(book.changes()[1].new_value, 5) &&
+                  book.changes()[2].cell == RC{1, 3} && isNumber(book.changes()[2].old_value, 20) && isNumber(book.changes()[2].new_value, 10),
+              "formula results are in the feed in the order they were written");
+
+        stats = setValue(book, {1, 1}, 5.0);
+        check(stats.dirty == 0 && stats.changed == 0 && book.changes().empty(), "a commit changing nothing has an empty feed");
+    }
+
+    // formulas on or behind a cycle become #CYCLE!, and recover once it is broken
+    {
+        Workbook book;
+        {
+            auto txn = book.begin();
+            txn.setFormula({1, 1}, "B1+1");
+            txn.setFormula({1, 2}, "A1+1");
+            txn.setFormula({1, 3}, "A1*2");
+            txn.setFormula({1, 4}, "5");
+            CommitStats stats = txn.commit();
+            check(stats.cycles == 3, "the cycle and the formula behind it are counted");
+        }
+        auto isCycle = [&](RC cell)
+        {
+            Value v = book.value(cell);
+            return std::holds_alternative<Error>(v) && std::get<Error>(v).code == ErrorCode::Cycle;
+        };
+        check(isCycle({1, 1}) && isCycle({1, 2}) && isCycle({1, 3}), "cells on and behind a cycle hold #CYCLE!");
+        check(isNumber(book.value({1, 4}), 5), "a formula off the cycle evaluates");
+
+        auto txn = book.begin();
+        txn.setValue({1, 2}, 1.0);
+        CommitStats stats = txn.commit();
+        check(stats.cycles == 0 && isNumber(book.value({1, 1}), 2) && isNumber(book.value({1, 3}), 4), "breaking the cycle recalculates");
+    }
+
+    // a volatile tick evaluates the volatile roots and only the dependents whose inputs changed
+    {
+        Workbook book;
+        {
+            auto txn = book.begin();
+            txn.setFormula({1, 1}, "RAND()");
+            txn.setFormula({1, 2}, "A1*0+1");
+            txn.setFormula({1, 3}, "A1*2");
+            txn.setFormula({1, 4}, "B1+1");
+            txn.setValue({2, 1}, 3.0);
+            txn.setFormula({2, 2}, "A2+1");
+            txn.commit();
+        }
+        check(book.volatileCount() == 1, "one volatile formula");
+        Value before = book.value({1, 1});
+        CommitStats stats = book.recalc();
+        check(stats.edits == 0 && stats.dirty == 4, "the tick dirties the volatile formula and its dependents only");
+        check(stats.evaluated == 3 && stats.pruned == 1, "a dependent whose input kept its value is pruned");
+        check(stats.changed == 2 && book.changes()[0].cell == RC{1, 1} && book.changes()[1].cell == RC{1, 3},
+              "the feed has the new draw and what changed with it");
+        check(!sameValue(before, book.value({1, 1})), "the tick draws again");
+
+        auto txn = book.begin();
+        txn.setValue({1, 1}, 0.5);
+        txn.commit();
+        check(book.volatileCount() == 0, "overwriting the volatile formula untracks it");
+        stats = book.recalc();
+        check(stats.dirty == 0 && stats.changed == 0, "a tick without volatile formulas does nothing");
+    }
+
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}
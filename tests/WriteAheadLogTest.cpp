@@ -0,0 +1,228 @@
+#include "WriteAheadLog.h"
+#include "Workbook.h"
+#include "StringPool.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    if (!ok)
+    {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+static const std::string dir = TEST_OUTPUT_DIR;
+static const std::string log_path = dir + "/wal_test.log";
+static const std::string snapshot_path = dir + "/wal_test.snap";
+static const std::string damaged_path = dir + "/wal_test_damaged.log";
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+static void writeFile(const std::string &path, const std::string &bytes)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+static std::string show(const Value &v)
+{
+    if (const auto *number = std::get_if<Number>(&v))
+        return std::to_string(*number);
+    if (isText(v))
+        return "'" + std::string(textView(v));
+    if (const auto *error = std::get_if<Error>(&v))
+        return "#" + std::to_string(static_cast<int>(error->code));
+    return std::holds_alternative<Blank>(v) ? "_" : "?";
+}
+
+// the cells the edits below touch and the commit number
+static std::string digest(const Workbook &book)
+{
+    std::string out = std::to_string(book.commitCount()) + ":";
+    for (int sheet = 0; sheet < book.sheetCount(); sheet++)
+        for (int r = 1; r <= 12; r++)
+            for (int c = 1; c <= 4; c++)
+                out += show(book.value(sheet, {r, c})) + ",";
+    return out;
+}
+
+// commit c writes A(c), a formula in B(c), text in D1, and commit 4 is three edits of one transaction
+static void edit(Workbook &book, int c)
+{
+    auto txn = book.begin();
+    txn.setValue({c, 1}, double(c * 10));
+    txn.setFormula({c, 2}, "A" + std::to_string(c) + "*2+SUM(A1:A10)");
+    txn.setValue({1, 4}, Text("commit " + std::to_string(c)));
+    txn.commit();
+}
+
+struct Recovered
+{
+    RecoveryStats stats;
+    std::string digest;
+};
+
+static Recovered recover(const std::string &path)
+{
+    Workbook book;
+    Recovered out;
+    out.stats = WriteAheadLog::recover(book, snapshot_path, path);
+    out.digest = digest(book);
+    check(out.stats.commit == book.commitCount(), "recovery reports the commit the workbook is at");
+    return out;
+}
+
+// recovering bytes has to end at commit expected with the state it had
+static void checkRecovers(const std::string &bytes, uint64_t expected, const std::vector<std::string> &states, const std::string &what)
+{
+    writeFile(damaged_path, bytes);
+    try
+    {
+        Recovered recovered = recover(damaged_path);
+        check(recovered.stats.commit == expected, what + ": last commit " + std::to_string(recovered.stats.commit) + ", expected " + std::to_string(expected));
+        check(recovered.digest == states[expected], what + ": recovered cells");
+    }
+    catch (const std::exception &e)
+    {
+        check(false, what + ": threw " + e.what());
+    }
+}
+
+int main()
+{
+    ::unlink(log_path.c_str());
+    ::unlink(snapshot_path.c_str());
+
+    // ends[c] is the size of the log once commit c is on disk
+    const int commits = 8;
+    std::vector<std::string> states;
+    std::vector<size_t> ends;
+    Workbook book;
+    {
+        WriteAheadLog log(book, log_path);
+        log.sync();
+        states.push_back(digest(book));
+        ends.push_back(readFile(log_path).size());
+        for (int c = 1; c <= commits; c++)
+        {
+            if (c == 5)
+                book.insertRows(1, 1); // commit 5 is a structural edit
+            else if (c == 6)
+                book.recalc(); // commit 6 is an empty tick
+            else
+                edit(book, c);
+            log.sync();
+            states.push_back(digest(book));
+            ends.push_back(readFile(log_path).size());
+        }
+        LogStats stats = log.stats();
+        check(stats.commits == commits && stats.durable == commits, "log stats count every commit");
+        check(stats.syncs <= stats.commits, "at most one sync per commit");
+    }
+    const std::string full = readFile(log_path);
+    check(full.size() == ends[commits], "log ends at the last commit");
+
+    checkRecovers(full, commits, states, "whole log");
+    // cut inside the last record, or short of its checksum
+    checkRecovers(full.substr(0, full.size() - 1), commits - 1, states, "last record torn");
+    checkRecovers(full.substr(0, full.size() - 20), commits - 1, states, "last record header torn");
+    // cut in the middle of a record of commit 4
+    checkRecovers(full.substr(0, ends[3] + 7), 3, states, "cut mid record");
+    // commit 4 has three records, a cut after the first leaves a transaction without its commit
+    // record (a SetValue record of a number is a 16 byte header and 21 bytes of payload)
+    checkRecovers(full.substr(0, ends[3] + 16 + 21), 3, states, "cut inside a transaction");
+    checkRecovers(full.substr(0, ends[3]), 3, states, "cut at a commit boundary");
+    checkRecovers(full.substr(0, 10), 0, states, "cut inside the file header");
+    checkRecovers(full + std::string(40, '\x5a'), commits, states, "garbage after the last commit");
+    {
+        // the checksum of the last commit record, the last 8 bytes of the file are its payload
+        std::string damaged = full;
+        damaged[damaged.size() - 8 - 8] ^= 0x40;
+        checkRecovers(damaged, commits - 1, states, "bad checksum of the last record");
+        damaged = full;
+        damaged[ends[2] + 20] ^= 0x01;
+        checkRecovers(damaged, 2, states, "bad payload of commit 3");
+    }
+    {
+        Recovered recovered = recover(log_path);
+        check(recovered.stats.transactions == commits && recovered.stats.dropped_bytes == 0, "whole log replays every commit");
+    }
+    {
+        // a transaction missing from the middle breaks the sequence of commit numbers
+        writeFile(damaged_path, full.substr(0, ends[2]) + full.substr(ends[3]));
+        Workbook other;
+        try
+        {
+            WriteAheadLog::recover(other, snapshot_path, damaged_path);
+            check(false, "missing transaction is rejected");
+        }
+        catch (const std::runtime_error &e)
+        {
+            check(std::string(e.what()) == "CORRUPT LOG", "missing transaction is rejected as corrupt");
+        }
+    }
+
+    // reattaching to a torn log cuts the tail off, the commits after it follow the last whole one
+    {
+        writeFile(damaged_path, full.substr(0, ends[7] + 11));
+        Workbook reopened;
+        RecoveryStats stats = WriteAheadLog::recover(reopened, snapshot_path, damaged_path);
+        check(stats.commit == 7 && stats.dropped_bytes == 11, "torn tail dropped on recovery");
+        {
+            WriteAheadLog log(reopened, damaged_path);
+            check(readFile(damaged_path).size() == ends[7], "attaching truncates the torn tail");
+            edit(reopened, 9);
+        }
+        std::string after = digest(reopened);
+        Recovered recovered = recover(damaged_path);
+        check(recovered.stats.commit == 8 && recovered.digest == after, "commits after a truncated tail replay");
+    }
+
+    // a log with commits the workbook doesn't have can't be attached
+    {
+        Workbook other;
+        try
+        {
+            WriteAheadLog log(other, log_path);
+            check(false, "log ahead of the workbook is rejected");
+        }
+        catch (const std::runtime_error &e)
+        {
+            check(std::string(e.what()) == "LOG IS AHEAD OF THE WORKBOOK", "log ahead of the workbook is rejected");
+        }
+    }
+
+    // a checkpoint starts the log over, recovery loads the snapshot and replays what follows
+    {
+        WriteAheadLog log(book, log_path);
+        log.checkpoint(snapshot_path);
+        check(readFile(log_path).size() == ends[0], "checkpoint empties the log");
+        edit(book, 10);
+        edit(book, 11);
+        log.sync();
+        std::string expected = digest(book);
+        Recovered recovered = recover(log_path);
+        check(recovered.stats.snapshot && recovered.stats.snapshot_commit == commits, "checkpoint snapshot loaded");
+        check(recovered.stats.transactions == 2 && recovered.digest == expected, "commits after the checkpoint replay");
+    }
+
+    ::unlink(log_path.c_str());
+    ::unlink(snapshot_path.c_str());
+    ::unlink(damaged_path.c_str());
+    if (failures)
+        std::printf("%d failed\n", failures);
+    return failures ? 1 : 0;
+}